@@ -2358,6 +2358,10 @@ void CL_CheckForResend( void ) {
 			Info_SetValueForKey(info, "protocol", va("%i", com_protocol->integer));
 		Info_SetValueForKey( info, "qport", va("%i", port ) );
 		Info_SetValueForKey( info, "challenge", va("%i", clc.challenge ) );
+		// snapshots can be sent in the field order of the map
+		Info_SetValueForKey( info, "fieldOrder", "1" );
+		// and messages range coded
+		Info_SetValueForKey( info, "rangeCoding", "1" );
 		
 		strcpy(data, "connect ");
     // TTimo adding " " around the userinfo string to avoid truncated userinfo on the server
@@ -2707,6 +2711,14 @@ void CL_ConnectionlessPacket( netadr_t from, msg_t *msg ) {
 			      clc.challenge, qfalse);
 #endif
 
+		// servers that don't know about range coding don't say so
+		clc.rangeCoding = !Q_stricmp( Cmd_Argv( 2 ), "rangeCoding" );
+#ifdef LEGACY_PROTOCOL
+		if ( clc.compat ) {
+			clc.rangeCoding = qfalse;
+		}
+#endif
+
 		clc.state = CA_CONNECTED;
 		clc.lastPacketSentTime = -9999;		// send first packet immediately
 		return;
@@ -2777,6 +2789,8 @@ A packet has arrived from the main event loop
 */
 void CL_PacketEvent( netadr_t from, msg_t *msg ) {
 	int		headerBytes;
+	msg_t	demoMsg;
+	byte	demoData[MAX_MSGLEN];
 
 	clc.lastPacketTime = cls.realtime;
 
@@ -2816,16 +2830,32 @@ void CL_PacketEvent( netadr_t from, msg_t *msg ) {
 	// gamestate
 	clc.serverMessageSequence = LittleLong( *(int *)msg->data );
 
+	// demos get range coded messages huffman coded, as they are read
+	if ( msg->coder && clc.demorecording ) {
+		MSG_Init( &demoMsg, demoData, sizeof( demoData ) );
+		msg->readCopy = &demoMsg;
+	}
+
 	clc.lastPacketTime = cls.realtime;
 	CL_ParseServerMessage( msg );
+	CL_Netchan_FinishRangeDecoding( msg );
 
 	//
 	// we don't know if it is ok to save a demo message until
 	// after we have parsed the frame
 	//
 	if ( clc.demorecording && !clc.demowaiting ) {
-		CL_WriteDemoMessage( msg, headerBytes );
+		if ( msg->readCopy && msg->readCopy->overflowed ) {
+			// huffman coded, a large range coded message may not fit in a demo message
+			Com_Printf( S_COLOR_YELLOW "WARNING: server message too large for the demo, recording stopped\n" );
+			CL_StopRecord_f();
+		} else if ( msg->readCopy ) {
+			CL_WriteDemoMessage( msg->readCopy, 0 );
+		} else {
+			CL_WriteDemoMessage( msg, headerBytes );
+		}
 	}
+	msg->readCopy = NULL;
 }
 
 /*
@@ -128,6 +128,56 @@ static void CL_Netchan_Decode( msg_t *msg ) {
 }
 #endif
 
+/*
+=================
+CL_Netchan_StartRangeDecoding
+
+The header byte has the checkpoint the message makes and the one it
+starts from, see sv_rangecoding.c
+=================
+*/
+static void CL_Netchan_StartRangeDecoding( msg_t *msg ) {
+	int		header, base;
+
+	if ( msg->readcount >= msg->cursize ) {
+		Com_Error( ERR_DROP, "CL_Netchan_StartRangeDecoding: no header" );
+	}
+	header = msg->data[msg->readcount];
+	msg->readcount++;
+
+	base = header & ( RANGE_CHECKPOINTS - 1 );
+	if ( !base ) {
+		Range_InitModel( &clc.rangeCoder.model );
+	} else if ( clc.hasRangeCheckpoint[base] ) {
+		clc.rangeCoder.model = clc.rangeCheckpoints[base];
+	} else {
+		Com_Error( ERR_DROP, "CL_Netchan_StartRangeDecoding: checkpoint %i missing", base );
+	}
+	clc.rangeCheckpoint = header >> 4;
+
+	MSG_StartRangeDecoding( msg, &clc.rangeCoder );
+}
+
+/*
+=================
+CL_Netchan_FinishRangeDecoding
+
+Called after the message has been read up to its svc_EOF, which
+is where the server takes its checkpoint too
+=================
+*/
+void CL_Netchan_FinishRangeDecoding( msg_t *msg ) {
+	if ( !msg->coder ) {
+		return;
+	}
+
+	if ( clc.rangeCheckpoint ) {
+		clc.rangeCheckpoints[clc.rangeCheckpoint] = clc.rangeCoder.model;
+		clc.hasRangeCheckpoint[clc.rangeCheckpoint] = qtrue;
+	}
+	msg->coder = NULL;
+}
+
 /*
 =================
 CL_Netchan_TransmitNextFragment
@@ -183,5 +233,9 @@ qboolean CL_Netchan_Process( netchan_t *chan, msg_t *msg ) {
 		CL_Netchan_Decode(msg);
 #endif
 
+	if ( clc.rangeCoding ) {
+		CL_Netchan_StartRangeDecoding( msg );
+	}
+
 	return qtrue;
 }
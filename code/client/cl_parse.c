@@ -280,7 +280,14 @@ void CL_ParseSnapshot( msg_t *msg ) {
 
 	// read packet entities
 	SHOWNET( msg, "packet entities" );
+	if ( newSnap.snapFlags & SNAPFLAG_FIELD_ORDER ) {
+		if ( !cl.hasEntityFieldOrder ) {
+			Com_Error( ERR_DROP, "CL_ParseSnapshot: snapshot in a field order the server didn't send" );
+		}
+		msg->entityFieldOrder = cl.entityFieldOrder;
+	}
 	CL_ParsePacketEntities( msg, old, &newSnap );
+	msg->entityFieldOrder = NULL;
 
 	// if not valid, dump the entire thing now that it has
 	// been properly read
@@ -364,6 +371,10 @@ void CL_SystemInfoChanged( void ) {
 	}
 #endif
 
+	// the entity field order of the map, which demos need as well
+	cl.hasEntityFieldOrder = MSG_ParseEntityFieldOrder( Info_ValueForKey( systemInfo, "sv_entityFieldOrder" ),
+		cl.entityFieldOrder );
+
 	// don't set any vars when playing a demo
 	if ( clc.demoplaying ) {
 		return;
@@ -136,6 +136,10 @@ typedef struct {
 
 	int			serverId;			// included in each client message so the server
 												// can tell if it is for a prior map_restart
+
+	qboolean	hasEntityFieldOrder;	// from the systeminfo, for SNAPFLAG_FIELD_ORDER snapshots
+	byte		entityFieldOrder[MAX_ENTITY_FIELDS];
+
 	// big stuff at end of structure so most offsets are 15 bits or less
 	clSnapshot_t	snapshots[PACKET_BACKUP];
 
@@ -269,6 +273,13 @@ typedef struct {
 	qboolean compat;
 #endif
 
+	// range coded server messages, see sv_rangecoding.c
+	qboolean		rangeCoding;
+	int				rangeCheckpoint;		// made by the message being read, 0 for none
+	qboolean		hasRangeCheckpoint[RANGE_CHECKPOINTS];
+	rangeModel_t	rangeCheckpoints[RANGE_CHECKPOINTS];
+	rangeCoder_t	rangeCoder;
+
 	// big stuff at end of structure so most offsets are 15 bits or less
 	netchan_t	netchan;
 } clientConnection_t;
@@ -625,6 +636,7 @@ void LAN_SaveServersToCache( void );
 //
 void CL_Netchan_Transmit( netchan_t *chan, msg_t* msg);	//int length, const byte *data );
 qboolean CL_Netchan_Process( netchan_t *chan, msg_t *msg );
+void CL_Netchan_FinishRangeDecoding( msg_t *msg );
 
 //
 // cl_avi.c
@@ -2820,6 +2820,40 @@ qboolean InFieldOfVision(vec3_t viewangles, float fov, vec3_t angles)
 	return qtrue;
 }
 
+/*
+==================
+BotVisibilityTraceSetup
+
+sets up the trace between the eye and a point on the entity,
+returns the contents mask to trace with
+==================
+*/
+static int BotVisibilityTraceSetup(int viewer, vec3_t eye, int inwater, int ent, vec3_t middle,
+										vec3_t start, vec3_t end, int *passent, int *hitent) {
+	int contents_mask;
+
+	contents_mask = CONTENTS_SOLID|CONTENTS_PLAYERCLIP;
+	*passent = viewer;
+	*hitent = ent;
+	VectorCopy(eye, start);
+	VectorCopy(middle, end);
+	//if the entity is in water, lava or slime
+	if (trap_AAS_PointContents(middle) & (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER)) {
+		contents_mask |= (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER);
+	}
+	//if eye is in water, lava or slime
+	if (inwater) {
+		if (!(contents_mask & (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER))) {
+			*passent = ent;
+			*hitent = viewer;
+			VectorCopy(middle, start);
+			VectorCopy(eye, end);
+		}
+		contents_mask ^= (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER);
+	}
+	return contents_mask;
+}
+
 /*
 ==================
 BotEntityVisible
@@ -2828,11 +2862,13 @@ returns visibility in the range [0, 1] taking fog and water surfaces into accoun
 ==================
 */
 float BotEntityVisible(int viewer, vec3_t eye, vec3_t viewangles, float fov, int ent) {
-	int i, contents_mask, passent, hitent, infog, inwater, otherinfog, pc;
+	int i, contents_mask, passent, hitent, infog, inwater, otherinfog, pc, batched;
+	int masks[3], passents[3], hitents[3];
 	float squaredfogdist, waterfactor, vis, bestvis;
-	bsp_trace_t trace;
+	bsp_trace_t trace, traces[3];
 	aas_entityinfo_t entinfo;
 	vec3_t dir, entangles, start, end, middle;
+	vec3_t middles[3], starts[3], ends[3];
 
 	//calculate middle of bounding box
 	BotEntityInfo(ent, &entinfo);
@@ -2848,32 +2884,45 @@ float BotEntityVisible(int viewer, vec3_t eye, vec3_t viewangles, float fov, int
 	infog = (pc & CONTENTS_FOG);
 	inwater = (pc & (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER));
 	//
+	//check the middle, bottom and top of the bounding box
+	VectorCopy(middle, middles[0]);
+	VectorCopy(middle, middles[1]);
+	middles[1][2] += entinfo.mins[2];
+	VectorCopy(middle, middles[2]);
+	middles[2][2] += entinfo.maxs[2];
+	//
 	bestvis = 0;
+	batched = qfalse;
 	for (i = 0; i < 3; i++) {
 		//if the point is not in potential visible sight
 		//if (!AAS_inPVS(eye, middle)) continue;
 		//
-		contents_mask = CONTENTS_SOLID|CONTENTS_PLAYERCLIP;
-		passent = viewer;
-		hitent = ent;
-		VectorCopy(eye, start);
-		VectorCopy(middle, end);
-		//if the entity is in water, lava or slime
-		if (trap_AAS_PointContents(middle) & (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER)) {
-			contents_mask |= (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER);
-		}
-		//if eye is in water, lava or slime
-		if (inwater) {
-			if (!(contents_mask & (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER))) {
-				passent = ent;
-				hitent = viewer;
-				VectorCopy(middle, start);
-				VectorCopy(eye, end);
+		if (i == 0) {
+			masks[0] = BotVisibilityTraceSetup(viewer, eye, inwater, ent, middles[0],
+										starts[0], ends[0], &passents[0], &hitents[0]);
+		}
+		else if (i == 1) {
+			//the middle isn't clearly visible, trace the bottom and
+			//top together when they don't need different traces
+			masks[1] = BotVisibilityTraceSetup(viewer, eye, inwater, ent, middles[1],
+										starts[1], ends[1], &passents[1], &hitents[1]);
+			masks[2] = BotVisibilityTraceSetup(viewer, eye, inwater, ent, middles[2],
+										starts[2], ends[2], &passents[2], &hitents[2]);
+			if (masks[1] == masks[2] && passents[1] == passents[2]) {
+				BotAI_TraceBatch(&traces[1], 2, &starts[1], NULL, NULL, &ends[1], passents[1], masks[1]);
+				batched = qtrue;
 			}
-			contents_mask ^= (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER);
 		}
 		//trace from start to end
-		BotAI_Trace(&trace, start, NULL, NULL, end, passent, contents_mask);
+		if (!batched) {
+			BotAI_Trace(&traces[i], starts[i], NULL, NULL, ends[i], passents[i], masks[i]);
+		}
+		trace = traces[i];
+		contents_mask = masks[i];
+		passent = passents[i];
+		hitent = hitents[i];
+		VectorCopy(ends[i], end);
+		VectorCopy(middles[i], middle);
 		//if water was hit
 		waterfactor = 1.0;
 		if (trace.contents & (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER)) {
@@ -2919,9 +2968,6 @@ float BotEntityVisible(int viewer, vec3_t eye, vec3_t viewangles, float fov, int
 			//if pretty much no fog
 			if (bestvis >= 0.95) return bestvis;
 		}
-		//check bottom and top of bounding box as well
-		if (i == 0) middle[2] += entinfo.mins[2];
-		else if (i == 1) middle[2] += entinfo.maxs[2] - entinfo.mins[2];
 	}
 	return bestvis;
 }
@@ -131,6 +131,27 @@ void QDECL BotAI_Print(int type, char *fmt, ...) {
 }
 
 
+/*
+==================
+BotAI_CopyTrace
+==================
+*/
+static void BotAI_CopyTrace(bsp_trace_t *bsptrace, trace_t *trace) {
+	bsptrace->allsolid = trace->allsolid;
+	bsptrace->startsolid = trace->startsolid;
+	bsptrace->fraction = trace->fraction;
+	VectorCopy(trace->endpos, bsptrace->endpos);
+	bsptrace->plane.dist = trace->plane.dist;
+	VectorCopy(trace->plane.normal, bsptrace->plane.normal);
+	bsptrace->plane.signbits = trace->plane.signbits;
+	bsptrace->plane.type = trace->plane.type;
+	bsptrace->surface.value = trace->surfaceFlags;
+	bsptrace->ent = trace->entityNum;
+	bsptrace->exp_dist = 0;
+	bsptrace->sidenum = 0;
+	bsptrace->contents = 0;
+}
+
 /*
 ==================
 BotAI_Trace
@@ -141,19 +162,29 @@ void BotAI_Trace(bsp_trace_t *bsptrace, vec3_t start, vec3_t mins, vec3_t maxs,
 
 	trap_Trace(&trace, start, mins, maxs, end, passent, contentmask);
 	//copy the trace information
-	bsptrace->allsolid = trace.allsolid;
-	bsptrace->startsolid = trace.startsolid;
-	bsptrace->fraction = trace.fraction;
-	VectorCopy(trace.endpos, bsptrace->endpos);
-	bsptrace->plane.dist = trace.plane.dist;
-	VectorCopy(trace.plane.normal, bsptrace->plane.normal);
-	bsptrace->plane.signbits = trace.plane.signbits;
-	bsptrace->plane.type = trace.plane.type;
-	bsptrace->surface.value = trace.surfaceFlags;
-	bsptrace->ent = trace.entityNum;
-	bsptrace->exp_dist = 0;
-	bsptrace->sidenum = 0;
-	bsptrace->contents = 0;
+	BotAI_CopyTrace(bsptrace, &trace);
+}
+
+/*
+==================
+BotAI_TraceBatch
+
+traces several boxes of the same size at once, see trap_TraceBatch
+==================
+*/
+#define BOT_TRACE_BATCH		8
+void BotAI_TraceBatch(bsp_trace_t *bsptraces, int numtraces, vec3_t *starts, vec3_t mins, vec3_t maxs, vec3_t *ends, int passent, int contentmask) {
+	trace_t traces[BOT_TRACE_BATCH];
+	int i, count;
+
+	for ( ; numtraces > 0; numtraces -= count, bsptraces += count, starts += count, ends += count) {
+		count = numtraces > BOT_TRACE_BATCH ? BOT_TRACE_BATCH : numtraces;
+		trap_TraceBatch(traces, count, (const vec3_t *)starts, mins, maxs, (const vec3_t *)ends, passent, contentmask);
+		//copy the trace information
+		for (i = 0; i < count; i++) {
+			BotAI_CopyTrace(&bsptraces[i], &traces[i]);
+		}
+	}
 }
 
 /*
@@ -25,6 +25,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #define	GAME_API_VERSION	8
 
+#define	MAX_GAME_TRACE_BATCH	256		// the most traces a G_TRACEBATCH call can take
+
 // entity->svFlags
 // the server does not know how to interpret most of the values
 // in entityStates (level eType), so the game must explicitly flag
@@ -230,6 +232,10 @@ typedef enum {
 	// 1.32
 	G_FS_SEEK,
 
+	G_TRACEBATCH,	// ( trace_t *results, int numTraces, const vec3_t *starts, const vec3_t mins, const vec3_t maxs, const vec3_t *ends, int passEntityNum, int contentmask );
+	// same as numTraces G_TRACE calls sharing mins / maxs / passEntityNum / contentmask,
+	// 1 to MAX_GAME_TRACE_BATCH of them
+
 	BOTLIB_SETUP = 200,				// ( void );
 	BOTLIB_SHUTDOWN,				// ( void );
 	BOTLIB_LIBVAR_SET,
@@ -157,6 +157,10 @@ void trap_TraceCapsule( trace_t *results, const vec3_t start, const vec3_t mins,
 	syscall( G_TRACECAPSULE, results, start, mins, maxs, end, passEntityNum, contentmask );
 }
 
+void trap_TraceBatch( trace_t *results, int numTraces, const vec3_t *starts, const vec3_t mins, const vec3_t maxs, const vec3_t *ends, int passEntityNum, int contentmask ) {
+	syscall( G_TRACEBATCH, results, numTraces, starts, mins, maxs, ends, passEntityNum, contentmask );
+}
+
 int trap_PointContents( const vec3_t point, int passEntityNum ) {
 	return syscall( G_POINT_CONTENTS, point, passEntityNum );
 }
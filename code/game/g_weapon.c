@@ -267,7 +267,7 @@ SHOTGUN
 // client predicts same spreads
 #define	DEFAULT_SHOTGUN_DAMAGE	10
 
-qboolean ShotgunPellet( vec3_t start, vec3_t end, gentity_t *ent ) {
+qboolean ShotgunPellet( vec3_t start, vec3_t end, gentity_t *ent, const trace_t *first ) {
 	trace_t		tr;
 	int			damage, i, passent;
 	gentity_t	*traceEnt;
@@ -280,7 +280,12 @@ qboolean ShotgunPellet( vec3_t start, vec3_t end, gentity_t *ent ) {
 	VectorCopy( start, tr_start );
 	VectorCopy( end, tr_end );
 	for (i = 0; i < 10; i++) {
-		trap_Trace (&tr, tr_start, NULL, NULL, tr_end, passent, MASK_SHOT);
+		// the first trace may already have been done for the whole pattern
+		if ( i == 0 && first ) {
+			tr = *first;
+		} else {
+			trap_Trace (&tr, tr_start, NULL, NULL, tr_end, passent, MASK_SHOT);
+		}
 		traceEnt = &g_entities[ tr.entityNum ];
 
 		// send bullet impact
@@ -327,9 +332,14 @@ qboolean ShotgunPellet( vec3_t start, vec3_t end, gentity_t *ent ) {
 void ShotgunPattern( vec3_t origin, vec3_t origin2, int seed, gentity_t *ent ) {
 	int			i;
 	float		r, u;
-	vec3_t		end;
+	vec3_t		starts[DEFAULT_SHOTGUN_COUNT], ends[DEFAULT_SHOTGUN_COUNT];
+	trace_t		tr[DEFAULT_SHOTGUN_COUNT];
 	vec3_t		forward, right, up;
 	qboolean	hitClient = qfalse;
+	qboolean	batched = qtrue;
+	gentity_t	*traceEnt;
+	int			linkcount, contents;
+	qboolean	takedamage;
 
 	// derive the right and up vectors from the forward vector, because
 	// the client won't have any other information
@@ -341,13 +351,38 @@ void ShotgunPattern( vec3_t origin, vec3_t origin2, int seed, gentity_t *ent ) {
 	for ( i = 0 ; i < DEFAULT_SHOTGUN_COUNT ; i++ ) {
 		r = Q_crandom( &seed ) * DEFAULT_SHOTGUN_SPREAD * 16;
 		u = Q_crandom( &seed ) * DEFAULT_SHOTGUN_SPREAD * 16;
-		VectorMA( origin, 8192 * 16, forward, end);
-		VectorMA (end, r, right, end);
-		VectorMA (end, u, up, end);
-		if( ShotgunPellet( origin, end, ent ) && !hitClient ) {
+		VectorCopy( origin, starts[i] );
+		VectorMA( origin, 8192 * 16, forward, ends[i]);
+		VectorMA (ends[i], r, right, ends[i]);
+		VectorMA (ends[i], u, up, ends[i]);
+	}
+
+	// trace all pellets in one go, they are only valid until a pellet
+	// relinks, unlinks or changes what it hit (killed a player, or gibbed
+	// a corpse, which leaves it linked but no longer solid), after that
+	// every pellet traces on its own again
+	trap_TraceBatch( tr, DEFAULT_SHOTGUN_COUNT, (const vec3_t *)starts, NULL, NULL, (const vec3_t *)ends, ent->s.number, MASK_SHOT );
+
+	for ( i = 0 ; i < DEFAULT_SHOTGUN_COUNT ; i++ ) {
+		traceEnt = &g_entities[ tr[i].entityNum ];
+		linkcount = traceEnt->r.linkcount;
+		contents = traceEnt->r.contents;
+		takedamage = traceEnt->takedamage;
+		if( ShotgunPellet( origin, ends[i], ent, batched ? &tr[i] : NULL ) && !hitClient ) {
 			hitClient = qtrue;
 			ent->client->accuracy_hits++;
 		}
+		if ( tr[i].entityNum < ENTITYNUM_MAX_NORMAL &&
+			( traceEnt->r.linkcount != linkcount || !traceEnt->r.linked ||
+			traceEnt->r.contents != contents || traceEnt->takedamage != takedamage ) ) {
+			batched = qfalse;
+		}
+#ifdef MISSIONPACK
+		// a pellet bounced off an invulnerable player can have hit anything
+		if ( traceEnt->client && traceEnt->client->invulnerabilityTime > level.time ) {
+			batched = qfalse;
+		}
+#endif
 	}
 }
 
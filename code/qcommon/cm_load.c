@@ -22,6 +22,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 // cmodel.c -- model loading
 
 #include "cm_local.h"
+#include "cm_patch.h"
 
 #ifdef BSPC
 
@@ -43,10 +44,7 @@ void SetPlaneSignbits (cplane_t *out) {
 
 // to allow boxes to be treated as brush models, we allocate
 // some extra indexes along with those needed by the map
-#define	BOX_BRUSHES		1
-#define	BOX_SIDES		6
 #define	BOX_LEAFS		2
-#define	BOX_PLANES		12
 
 #define	LL(x) x=LittleLong(x)
 
@@ -62,16 +60,15 @@ byte		*cmod_base;
 cvar_t		*cm_noAreas;
 cvar_t		*cm_noCurves;
 cvar_t		*cm_playerCurveClip;
+cvar_t		*cm_patchCache;
 #endif
 
-cmodel_t	box_model;
-cplane_t	*box_planes;
-cbrush_t	*box_brush;
+cmContext_t	cm_mainContext;
 
 
 
-void	CM_InitBoxHull (void);
 void	CM_FloodAreaConnections (void);
+unsigned CM_Checksum(dheader_t *header);
 
 
 /*
@@ -196,7 +193,7 @@ void CMod_LoadNodes( lump_t *l ) {
 
 	for (i=0 ; i<count ; i++, out++, in++)
 	{
-		out->plane = cm.planes + LittleLong( in->planeNum );
+		out->plane = cm.planes[ LittleLong( in->planeNum ) ];
 		for (j=0 ; j<2 ; j++)
 		{
 			child = LittleLong (in->children[j]);
@@ -224,6 +221,37 @@ void CM_BoundBrush( cbrush_t *b ) {
 }
 
 
+/*
+=================
+CM_SetBrushSidePlanes
+
+Copies the side planes into the structure of arrays layout
+used by the brush side tests
+=================
+*/
+void CM_SetBrushSidePlanes( cbrush_t *b ) {
+	int			i, stride;
+	cplane_t	*plane;
+
+	stride = BRUSH_SIDE_STRIDE( b->numsides );
+
+	for ( i = 0 ; i < stride ; i++ ) {
+		if ( i < b->numsides ) {
+			plane = b->sides[i].plane;
+			b->sidePlanes[i] = plane->normal[0];
+			b->sidePlanes[i + stride] = plane->normal[1];
+			b->sidePlanes[i + stride*2] = plane->normal[2];
+			b->sidePlanes[i + stride*3] = plane->dist;
+		} else {
+			// a zero plane never separates anything
+			b->sidePlanes[i] = 0;
+			b->sidePlanes[i + stride] = 0;
+			b->sidePlanes[i + stride*2] = 0;
+			b->sidePlanes[i + stride*3] = 0;
+		}
+	}
+}
+
 /*
 =================
 CMod_LoadBrushes
@@ -234,6 +262,8 @@ void CMod_LoadBrushes( lump_t *l ) {
 	dbrush_t	*in;
 	cbrush_t	*out;
 	int			i, count;
+	int			numSideFloats;
+	float		*sidePlanes;
 
 	in = (void *)(cmod_base + l->fileofs);
 	if (l->filelen % sizeof(*in)) {
@@ -241,7 +271,7 @@ void CMod_LoadBrushes( lump_t *l ) {
 	}
 	count = l->filelen / sizeof(*in);
 
-	cm.brushes = Hunk_Alloc( ( BOX_BRUSHES + count ) * sizeof( *cm.brushes ), h_high );
+	cm.brushes = Hunk_Alloc( count * sizeof( *cm.brushes ), h_high );
 	cm.numBrushes = count;
 
 	out = cm.brushes;
@@ -259,6 +289,19 @@ void CMod_LoadBrushes( lump_t *l ) {
 		CM_BoundBrush( out );
 	}
 
+	// all side planes in one block, every brush starts 16 byte aligned
+	numSideFloats = 0;
+	for ( i=0 ; i<count ; i++ ) {
+		numSideFloats += BRUSH_SIDE_STRIDE( cm.brushes[i].numsides ) * 4;
+	}
+	sidePlanes = Hunk_Alloc( numSideFloats * sizeof( *sidePlanes ), h_high );
+
+	for ( i=0 ; i<count ; i++ ) {
+		out = &cm.brushes[i];
+		out->sidePlanes = sidePlanes;
+		sidePlanes += BRUSH_SIDE_STRIDE( out->numsides ) * 4;
+		CM_SetBrushSidePlanes( out );
+	}
 }
 
 /*
@@ -324,7 +367,7 @@ void CMod_LoadPlanes (lump_t *l)
 
 	if (count < 1)
 		Com_Error (ERR_DROP, "Map with no planes");
-	cm.planes = Hunk_Alloc( ( BOX_PLANES + count ) * sizeof( *cm.planes ), h_high );
+	cm.planes = Hunk_Alloc( count * sizeof( *cm.planes ), h_high );
 	cm.numPlanes = count;
 
 	out = cm.planes;	
@@ -362,7 +405,7 @@ void CMod_LoadLeafBrushes (lump_t *l)
 		Com_Error (ERR_DROP, "MOD_LoadBmodel: funny lump size");
 	count = l->filelen / sizeof(*in);
 
-	cm.leafbrushes = Hunk_Alloc( (count + BOX_BRUSHES) * sizeof( *cm.leafbrushes ), h_high );
+	cm.leafbrushes = Hunk_Alloc( count * sizeof( *cm.leafbrushes ), h_high );
 	cm.numLeafBrushes = count;
 
 	out = cm.leafbrushes;
@@ -418,7 +461,7 @@ void CMod_LoadBrushSides (lump_t *l)
 	}
 	count = l->filelen / sizeof(*in);
 
-	cm.brushsides = Hunk_Alloc( ( BOX_SIDES + count ) * sizeof( *cm.brushsides ), h_high );
+	cm.brushsides = Hunk_Alloc( count * sizeof( *cm.brushsides ), h_high );
 	cm.numBrushSides = count;
 
 	out = cm.brushsides;	
@@ -475,13 +518,242 @@ void CMod_LoadVisibility( lump_t *l ) {
 //==================================================================
 
 
+/*
+===============================================================================
+
+PATCH COLLIDE CACHE
+
+Generating the patch collision facets is the slowest part of loading a curve
+heavy map, so the results are saved below the home path, keyed by the map
+checksum, and read back on the next load of the same map.
+
+===============================================================================
+*/
+
+#ifndef BSPC
+
+#define	PATCHCACHE_IDENT	(('C'<<24)+('C'<<16)+('P'<<8)+'M')
+#define	PATCHCACHE_VERSION	1
+
+typedef struct {
+	int			ident;
+	int			version;
+	int			checksum;
+	int			numPatches;
+	int			planeSize;			// sizeof( patchPlane_t ), catches other builds
+	int			facetSize;			// sizeof( facet_t )
+} patchCacheHeader_t;
+
+typedef struct {
+	vec3_t		bounds[2];
+	int			numPlanes;
+	int			numFacets;
+	// followed by the planes and the facets
+} patchCacheEntry_t;
+
+/*
+=================
+CM_PatchCacheName
+=================
+*/
+static const char *CM_PatchCacheName( unsigned checksum ) {
+	return va( "patchcache/%08x.pcc", checksum );
+}
+
+/*
+=================
+CM_PatchCacheFacetValid
+
+The trace code indexes the planes with these without any checks
+=================
+*/
+static qboolean CM_PatchCacheFacetValid( const facet_t *facet, int numPlanes ) {
+	int		i;
+
+	if ( facet->surfacePlane < 0 || facet->surfacePlane >= numPlanes ) {
+		return qfalse;
+	}
+	if ( facet->numBorders < 0 || facet->numBorders > ARRAY_LEN( facet->borderPlanes ) ) {
+		return qfalse;
+	}
+	for ( i = 0 ; i < facet->numBorders ; i++ ) {
+		if ( facet->borderPlanes[i] < 0 || facet->borderPlanes[i] >= numPlanes ) {
+			return qfalse;
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+=================
+CM_ReadPatchCache
+
+Fills in the collision data of all the patches from the cache file,
+returns qfalse if there is no usable cache for this map
+=================
+*/
+static qboolean CM_ReadPatchCache( unsigned checksum, int numPatches ) {
+	fileHandle_t		f;
+	int					i, j, len, pos;
+	byte				*buf;
+	patchCacheHeader_t	*header;
+	patchCacheEntry_t	*entry;
+	const facet_t		*facets;
+	patchCollide_t		*pc;
+
+	if ( !cm_patchCache->integer ) {
+		return qfalse;
+	}
+
+	len = FS_SV_FOpenFileRead( CM_PatchCacheName( checksum ), &f );
+	if ( !f ) {
+		return qfalse;
+	}
+	if ( len < sizeof( *header ) ) {
+		FS_FCloseFile( f );
+		return qfalse;
+	}
+
+	buf = Hunk_AllocateTempMemory( len );
+	if ( FS_Read( buf, len, f ) != len ) {
+		FS_FCloseFile( f );
+		Hunk_FreeTempMemory( buf );
+		return qfalse;
+	}
+	FS_FCloseFile( f );
+
+	header = (patchCacheHeader_t *)buf;
+	if ( header->ident != PATCHCACHE_IDENT || header->version != PATCHCACHE_VERSION
+		|| header->checksum != checksum || header->numPatches != numPatches
+		|| header->planeSize != sizeof( patchPlane_t ) || header->facetSize != sizeof( facet_t ) ) {
+		Com_DPrintf( "CM_ReadPatchCache: %s is out of date\n", CM_PatchCacheName( checksum ) );
+		Hunk_FreeTempMemory( buf );
+		return qfalse;
+	}
+
+	// make sure the whole file is sane before anything is allocated
+	pos = sizeof( *header );
+	for ( i = 0 ; i < numPatches ; i++ ) {
+		if ( len - pos < sizeof( *entry ) ) {
+			break;
+		}
+		entry = (patchCacheEntry_t *)( buf + pos );
+		pos += sizeof( *entry );
+		if ( entry->numPlanes < 0 || entry->numPlanes > MAX_PATCH_PLANES
+			|| entry->numFacets < 0 || entry->numFacets > MAX_FACETS ) {
+			break;
+		}
+		if ( len - pos < entry->numPlanes * sizeof( patchPlane_t ) + entry->numFacets * sizeof( facet_t ) ) {
+			break;
+		}
+		pos += entry->numPlanes * sizeof( patchPlane_t );
+
+		facets = (const facet_t *)( buf + pos );
+		for ( j = 0 ; j < entry->numFacets ; j++ ) {
+			if ( !CM_PatchCacheFacetValid( &facets[j], entry->numPlanes ) ) {
+				break;
+			}
+		}
+		if ( j != entry->numFacets ) {
+			break;
+		}
+		pos += entry->numFacets * sizeof( facet_t );
+	}
+	if ( i != numPatches || pos != len ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: %s is corrupt\n", CM_PatchCacheName( checksum ) );
+		Hunk_FreeTempMemory( buf );
+		return qfalse;
+	}
+
+	pos = sizeof( *header );
+	for ( i = 0 ; i < cm.numSurfaces ; i++ ) {
+		if ( !cm.surfaces[i] ) {
+			continue;
+		}
+
+		entry = (patchCacheEntry_t *)( buf + pos );
+		pos += sizeof( *entry );
+
+		pc = Hunk_Alloc( sizeof( *pc ), h_high );
+		VectorCopy( entry->bounds[0], pc->bounds[0] );
+		VectorCopy( entry->bounds[1], pc->bounds[1] );
+		pc->numPlanes = entry->numPlanes;
+		pc->numFacets = entry->numFacets;
+
+		pc->facets = Hunk_Alloc( pc->numFacets * sizeof( *pc->facets ), h_high );
+		pc->planes = Hunk_Alloc( pc->numPlanes * sizeof( *pc->planes ), h_high );
+		Com_Memcpy( pc->planes, buf + pos, pc->numPlanes * sizeof( *pc->planes ) );
+		pos += pc->numPlanes * sizeof( *pc->planes );
+		Com_Memcpy( pc->facets, buf + pos, pc->numFacets * sizeof( *pc->facets ) );
+		pos += pc->numFacets * sizeof( *pc->facets );
+
+		cm.surfaces[i]->pc = pc;
+	}
+
+	Hunk_FreeTempMemory( buf );
+
+	return qtrue;
+}
+
+/*
+=================
+CM_WritePatchCache
+=================
+*/
+static void CM_WritePatchCache( unsigned checksum, int numPatches ) {
+	fileHandle_t		f;
+	int					i;
+	patchCacheHeader_t	header;
+	patchCacheEntry_t	entry;
+	patchCollide_t		*pc;
+
+	if ( !cm_patchCache->integer || !numPatches ) {
+		return;
+	}
+
+	f = FS_SV_FOpenFileWrite( CM_PatchCacheName( checksum ) );
+	if ( !f ) {
+		Com_DPrintf( "CM_WritePatchCache: couldn't write %s\n", CM_PatchCacheName( checksum ) );
+		return;
+	}
+
+	header.ident = PATCHCACHE_IDENT;
+	header.version = PATCHCACHE_VERSION;
+	header.checksum = checksum;
+	header.numPatches = numPatches;
+	header.planeSize = sizeof( patchPlane_t );
+	header.facetSize = sizeof( facet_t );
+	FS_Write( &header, sizeof( header ), f );
+
+	for ( i = 0 ; i < cm.numSurfaces ; i++ ) {
+		if ( !cm.surfaces[i] ) {
+			continue;
+		}
+		pc = cm.surfaces[i]->pc;
+
+		Com_Memset( &entry, 0, sizeof( entry ) );
+		VectorCopy( pc->bounds[0], entry.bounds[0] );
+		VectorCopy( pc->bounds[1], entry.bounds[1] );
+		entry.numPlanes = pc->numPlanes;
+		entry.numFacets = pc->numFacets;
+		FS_Write( &entry, sizeof( entry ), f );
+		FS_Write( pc->planes, pc->numPlanes * sizeof( *pc->planes ), f );
+		FS_Write( pc->facets, pc->numFacets * sizeof( *pc->facets ), f );
+	}
+
+	FS_FCloseFile( f );
+}
+
+#endif
+
 /*
 =================
 CMod_LoadPatches
 =================
 */
 #define	MAX_PATCH_VERTS		1024
-void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
+void CMod_LoadPatches( lump_t *surfs, lump_t *verts, unsigned checksum ) {
 	drawVert_t	*dv, *dv_p;
 	dsurface_t	*in;
 	int			count;
@@ -491,6 +763,7 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 	vec3_t		points[MAX_PATCH_VERTS];
 	int			width, height;
 	int			shaderNum;
+	int			numPatches;
 
 	in = (void *)(cmod_base + surfs->fileofs);
 	if (surfs->filelen % sizeof(*in))
@@ -504,6 +777,7 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 
 	// scan through all the surfaces, but only load patches,
 	// not planar faces
+	numPatches = 0;
 	for ( i = 0 ; i < count ; i++, in++ ) {
 		if ( LittleLong( in->surfaceType ) != MST_PATCH ) {
 			continue;		// ignore other surfaces
@@ -511,6 +785,25 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 		// FIXME: check for non-colliding patches
 
 		cm.surfaces[ i ] = patch = Hunk_Alloc( sizeof( *patch ), h_high );
+		numPatches++;
+
+		shaderNum = LittleLong( in->shaderNum );
+		patch->contents = cm.shaders[shaderNum].contentFlags;
+		patch->surfaceFlags = cm.shaders[shaderNum].surfaceFlags;
+	}
+
+#ifndef BSPC
+	if ( CM_ReadPatchCache( checksum, numPatches ) ) {
+		return;
+	}
+#endif
+
+	in = (void *)(cmod_base + surfs->fileofs);
+	for ( i = 0 ; i < count ; i++, in++ ) {
+		patch = cm.surfaces[ i ];
+		if ( !patch ) {
+			continue;
+		}
 
 		// load the full drawverts onto the stack
 		width = LittleLong( in->patchWidth );
@@ -527,13 +820,13 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 			points[j][2] = LittleFloat( dv_p->xyz[2] );
 		}
 
-		shaderNum = LittleLong( in->shaderNum );
-		patch->contents = cm.shaders[shaderNum].contentFlags;
-		patch->surfaceFlags = cm.shaders[shaderNum].surfaceFlags;
-
 		// create the internal facet structure
 		patch->pc = CM_GeneratePatchCollide( width, height, points );
 	}
+
+#ifndef BSPC
+	CM_WritePatchCache( checksum, numPatches );
+#endif
 }
 
 //==================================================================
@@ -584,6 +877,7 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	cm_noAreas = Cvar_Get ("cm_noAreas", "0", CVAR_CHEAT);
 	cm_noCurves = Cvar_Get ("cm_noCurves", "0", CVAR_CHEAT);
 	cm_playerCurveClip = Cvar_Get ("cm_playerCurveClip", "1", CVAR_ARCHIVE|CVAR_CHEAT );
+	cm_patchCache = Cvar_Get ("cm_patchCache", "1", CVAR_ARCHIVE );
 #endif
 	Com_DPrintf( "CM_LoadMap( %s, %i )\n", name, clientload );
 
@@ -593,6 +887,9 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	}
 
 	// free old stuff
+#ifndef BSPC
+	CM_EndTraceRecord();
+#endif
 	Com_Memset( &cm, 0, sizeof( cm ) );
 	CM_ClearLevelPatches();
 
@@ -601,6 +898,7 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 		cm.numClusters = 1;
 		cm.numAreas = 1;
 		cm.cmodels = Hunk_Alloc( sizeof( *cm.cmodels ), h_high );
+		CM_InitContext( &cm_mainContext, NULL );
 		*checksum = 0;
 		return;
 	}
@@ -620,6 +918,7 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 
 	last_checksum = LittleLong (Com_BlockChecksum (buf.i, length));
 	*checksum = last_checksum;
+	cm.checksum = last_checksum;
 
 	header = *(dheader_t *)buf.i;
 	for (i=0 ; i<sizeof(dheader_t)/4 ; i++) {
@@ -645,15 +944,19 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	CMod_LoadNodes (&header.lumps[LUMP_NODES]);
 	CMod_LoadEntityString (&header.lumps[LUMP_ENTITIES]);
 	CMod_LoadVisibility( &header.lumps[LUMP_VISIBILITY] );
-	CMod_LoadPatches( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS] );
+	CMod_LoadPatches( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS], CM_Checksum( &header ) );
 
 	// we are NOT freeing the file, because it is cached for the ref
 	FS_FreeFile (buf.v);
 
-	CM_InitBoxHull ();
+	// the checks of the main context live with the rest of the map
+	CM_InitContext( &cm_mainContext,
+		Hunk_Alloc( ( cm.numBrushes + cm.numSurfaces ) * sizeof( cmCheck_t ), h_high ) );
 
 	CM_FloodAreaConnections ();
 
+	CM_InitBrushSideTests ();
+
 	// allow this to be cached if it is loaded by the server
 	if ( !clientload ) {
 		Q_strncpyz( cm.name, name, sizeof( cm.name ) );
@@ -666,8 +969,12 @@ CM_ClearMap
 ==================
 */
 void CM_ClearMap( void ) {
+#ifndef BSPC
+	CM_EndTraceRecord();
+#endif
 	Com_Memset( &cm, 0, sizeof( cm ) );
 	CM_ClearLevelPatches();
+	CM_InitContext( &cm_mainContext, NULL );
 }
 
 /*
@@ -676,6 +983,15 @@ CM_ClipHandleToModel
 ==================
 */
 cmodel_t	*CM_ClipHandleToModel( clipHandle_t handle ) {
+	return CM_ContextClipHandleToModel( &cm_mainContext, handle );
+}
+
+/*
+==================
+CM_ContextClipHandleToModel
+==================
+*/
+cmodel_t	*CM_ContextClipHandleToModel( cmContext_t *ctx, clipHandle_t handle ) {
 	if ( handle < 0 ) {
 		Com_Error( ERR_DROP, "CM_ClipHandleToModel: bad handle %i", handle );
 	}
@@ -683,7 +999,7 @@ cmodel_t	*CM_ClipHandleToModel( clipHandle_t handle ) {
 		return &cm.cmodels[handle];
 	}
 	if ( handle == BOX_MODEL_HANDLE ) {
-		return &box_model;
+		return &ctx->boxModel;
 	}
 	if ( handle < MAX_SUBMODELS ) {
 		Com_Error( ERR_DROP, "CM_ClipHandleToModel: bad handle %i < %i < %i", 
@@ -740,46 +1056,43 @@ int		CM_LeafArea( int leafnum ) {
 ===================
 CM_InitBoxHull
 
-Set up the planes and nodes so that the six floats of a bounding box
+Set up the planes and sides so that the six floats of a bounding box
 can just be stored out and get a proper clipping hull structure.
 ===================
 */
-void CM_InitBoxHull (void)
+static void CM_InitBoxHull( cmContext_t *ctx )
 {
 	int			i;
 	int			side;
 	cplane_t	*p;
 	cbrushside_t	*s;
+	cbrush_t	*box_brush;
 
-	box_planes = &cm.planes[cm.numPlanes];
+	Com_Memset( &ctx->boxModel, 0, sizeof( ctx->boxModel ) );
 
-	box_brush = &cm.brushes[cm.numBrushes];
-	box_brush->numsides = 6;
-	box_brush->sides = cm.brushsides + cm.numBrushSides;
+	box_brush = &ctx->boxBrush;
+	box_brush->numsides = BOX_SIDES;
+	box_brush->sides = ctx->boxSides;
+	box_brush->sidePlanes = ctx->boxSidePlanes;
 	box_brush->contents = CONTENTS_BODY;
 
-	box_model.leaf.numLeafBrushes = 1;
-//	box_model.leaf.firstLeafBrush = cm.numBrushes;
-	box_model.leaf.firstLeafBrush = cm.numLeafBrushes;
-	cm.leafbrushes[cm.numLeafBrushes] = cm.numBrushes;
-
 	for (i=0 ; i<6 ; i++)
 	{
 		side = i&1;
 
 		// brush sides
-		s = &cm.brushsides[cm.numBrushSides+i];
-		s->plane = 	cm.planes + (cm.numPlanes+i*2+side);
+		s = &ctx->boxSides[i];
+		s->plane = &ctx->boxPlanes[i*2+side];
 		s->surfaceFlags = 0;
 
 		// planes
-		p = &box_planes[i*2];
+		p = &ctx->boxPlanes[i*2];
 		p->type = i>>1;
 		p->signbits = 0;
 		VectorClear (p->normal);
 		p->normal[i>>1] = 1;
 
-		p = &box_planes[i*2+1];
+		p = &ctx->boxPlanes[i*2+1];
 		p->type = 3 + (i>>1);
 		p->signbits = 0;
 		VectorClear (p->normal);
@@ -787,26 +1100,70 @@ void CM_InitBoxHull (void)
 
 		SetPlaneSignbits( p );
 	}	
+
+	CM_SetBrushSidePlanes( box_brush );
 }
 
 /*
 ===================
-CM_TempBoxModel
+CM_InitContext
+
+Resets a context for the loaded map, checks holds one
+cmCheck_t for every brush followed by one for every surface
+===================
+*/
+void CM_InitContext( cmContext_t *ctx, cmCheck_t *checks ) {
+	ctx->checkcount = 0;
+	ctx->brushChecks = checks;
+	ctx->patchChecks = checks ? checks + cm.numBrushes : NULL;
+
+	CM_InitBoxHull( ctx );
+}
+
+/*
+===================
+CM_AllocContext
+===================
+*/
+cmContext_t *CM_AllocContext( void ) {
+	cmContext_t	*ctx;
+
+	ctx = Z_Malloc( sizeof( *ctx ) + ( cm.numBrushes + cm.numSurfaces ) * sizeof( cmCheck_t ) );
+	CM_InitContext( ctx, (cmCheck_t *)( ctx + 1 ) );
+
+	return ctx;
+}
+
+/*
+===================
+CM_FreeContext
+===================
+*/
+void CM_FreeContext( cmContext_t *ctx ) {
+	Z_Free( ctx );
+}
+
+/*
+===================
+CM_ContextTempBoxModel
 
 To keep everything totally uniform, bounding boxes are turned into small
-BSP trees instead of being compared directly.
+brush models instead of being compared directly.
 Capsules are handled differently though.
 ===================
 */
-clipHandle_t CM_TempBoxModel( const vec3_t mins, const vec3_t maxs, int capsule ) {
+clipHandle_t CM_ContextTempBoxModel( cmContext_t *ctx, const vec3_t mins, const vec3_t maxs, int capsule ) {
+	cplane_t	*box_planes;
+	cbrush_t	*box_brush;
 
-	VectorCopy( mins, box_model.mins );
-	VectorCopy( maxs, box_model.maxs );
+	VectorCopy( mins, ctx->boxModel.mins );
+	VectorCopy( maxs, ctx->boxModel.maxs );
 
 	if ( capsule ) {
 		return CAPSULE_MODEL_HANDLE;
 	}
 
+	box_planes = ctx->boxPlanes;
 	box_planes[0].dist = maxs[0];
 	box_planes[1].dist = -maxs[0];
 	box_planes[2].dist = mins[0];
@@ -820,21 +1177,42 @@ clipHandle_t CM_TempBoxModel( const vec3_t mins, const vec3_t maxs, int capsule
 	box_planes[10].dist = mins[2];
 	box_planes[11].dist = -mins[2];
 
+	box_brush = &ctx->boxBrush;
 	VectorCopy( mins, box_brush->bounds[0] );
 	VectorCopy( maxs, box_brush->bounds[1] );
 
+	CM_SetBrushSidePlanes( box_brush );
+
 	return BOX_MODEL_HANDLE;
 }
 
+/*
+===================
+CM_TempBoxModel
+===================
+*/
+clipHandle_t CM_TempBoxModel( const vec3_t mins, const vec3_t maxs, int capsule ) {
+	return CM_ContextTempBoxModel( &cm_mainContext, mins, maxs, capsule );
+}
+
 /*
 ===================
 CM_ModelBounds
 ===================
 */
 void CM_ModelBounds( clipHandle_t model, vec3_t mins, vec3_t maxs ) {
+	CM_ContextModelBounds( &cm_mainContext, model, mins, maxs );
+}
+
+/*
+===================
+CM_ContextModelBounds
+===================
+*/
+void CM_ContextModelBounds( cmContext_t *ctx, clipHandle_t model, vec3_t mins, vec3_t maxs ) {
 	cmodel_t	*cmod;
 
-	cmod = CM_ClipHandleToModel( model );
+	cmod = CM_ContextClipHandleToModel( ctx, model );
 	VectorCopy( cmod->mins, mins );
 	VectorCopy( cmod->maxs, maxs );
 }
@@ -28,10 +28,23 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define	BOX_MODEL_HANDLE		255
 #define CAPSULE_MODEL_HANDLE	254
 
+#define	MAX_TRACE_BATCH			32		// one bit per trace in cmCheck_t batchbits
 
+// the temp box model of each cmContext_t
+#define	BOX_SIDES		6
+#define	BOX_PLANES		12
+
+// brush side planes are tested four at a time
+#define	BRUSH_SIDE_STRIDE(numsides)	( ( (numsides) + 3 ) & ~3 )
+#define	MAX_SIMD_BRUSH_SIDES	128		// larger brushes use the plane pointers
+
+
+// the plane is kept inline so a tree walk touches a single
+// 32 byte line per node instead of chasing a plane pointer
 typedef struct {
-	cplane_t	*plane;
+	cplane_t	plane;
 	int			children[2];		// negative numbers are leafs
+	int			pad;				// keep the node 32 bytes
 } cNode_t;
 
 typedef struct {
@@ -62,12 +75,11 @@ typedef struct {
 	vec3_t		bounds[2];
 	int			numsides;
 	cbrushside_t	*sides;
-	int			checkcount;		// to avoid repeated testings
+	float		*sidePlanes;	// normal x, y, z and dist of the sides, BRUSH_SIDE_STRIDE floats apart
 } cbrush_t;
 
 
 typedef struct {
-	int			checkcount;				// to avoid repeated testings
 	int			surfaceFlags;
 	int			contents;
 	struct patchCollide_s	*pc;
@@ -125,15 +137,39 @@ typedef struct {
 	cPatch_t	**surfaces;			// non-patches will be NULL
 
 	int			floodvalid;
-	int			checkcount;					// incremented on each trace
+	int			checksum;					// of the bsp file
 } clipMap_t;
 
 
+// per brush / patch marks of one collision context
+typedef struct {
+	int			checkcount;		// to avoid repeated testings
+	int			batchcount;		// checkcount of the last trace batch that touched it
+	unsigned int	batchbits;	// traces of that batch that already tested it
+} cmCheck_t;
+
+// everything a collision query writes to, so queries
+// with different contexts can run at the same time
+struct cmContext_s {
+	int			checkcount;					// incremented on each trace
+	cmCheck_t	*brushChecks;				// [cm.numBrushes]
+	cmCheck_t	*patchChecks;				// [cm.numSurfaces]
+
+	// the model returned by CM_TempBoxModel
+	cmodel_t	boxModel;
+	cbrush_t	boxBrush;
+	cbrushside_t	boxSides[BOX_SIDES];
+	cplane_t	boxPlanes[BOX_PLANES];
+	float		boxSidePlanes[BRUSH_SIDE_STRIDE( BOX_SIDES ) * 4];
+};
+
+
 // keep 1/8 unit away to keep the position valid before network snapping
 // and to avoid various numeric issues
 #define	SURFACE_CLIP_EPSILON	(0.125)
 
 extern	clipMap_t	cm;
+extern	cmContext_t	cm_mainContext;		// used by all the calls without a context
 extern	int			c_pointcontents;
 extern	int			c_traces, c_brush_traces, c_patch_traces;
 extern	cvar_t		*cm_noAreas;
@@ -164,15 +200,65 @@ typedef struct {
 	qboolean	isPoint;	// optimized case
 	trace_t		trace;		// returned from trace call
 	sphere_t	sphere;		// sphere for oriendted capsule collision
+	cmContext_t	*ctx;		// context of the query
 } traceWork_t;
 
+// trace logs written by CM_BeginTraceRecord and replayed by cmreplay,
+// a traceLogHeader_t followed by traceRecord_t until the end of the file,
+// every field is a little endian 32 bit word
+#define	TRACE_LOG_IDENT		(('R'<<24)+('T'<<16)+('M'<<8)+'C')
+#define	TRACE_LOG_VERSION	1
+
+typedef struct {
+	int			ident;
+	int			version;
+	int			checksum;		// of the bsp the traces were made on
+	char		mapname[MAX_QPATH];
+} traceLogHeader_t;
+
+// traces are logged at the call they came in through, so the
+// replay runs exactly the same code for them
+typedef enum {
+	TR_BOXTRACE,			// CM_BoxTrace
+	TR_TRANSFORMED,			// CM_TransformedBoxTrace
+	TR_BATCH				// CM_BoxTraceBatch
+} traceRecordType_t;
+
+typedef struct {
+	int			type;			// traceRecordType_t
+	int			batchSize;		// traces of the batch, set on its first record
+
+	// parameters
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	int			model;
+	int			brushmask;
+	int			capsule;
+	vec3_t		origin, angles;	// of transformed traces
+	vec3_t		boxMins, boxMaxs;	// temp box model bounds at the time of the trace
+
+	// results
+	qboolean	allsolid;
+	qboolean	startsolid;
+	float		fraction;
+	vec3_t		endpos;
+	vec3_t		normal;
+	float		dist;
+	int			surfaceFlags;
+	int			contents;
+} traceRecord_t;
+
+extern	fileHandle_t	cm_traceLog;
+
 typedef struct leafList_s {
+	cmContext_t	*ctx;
 	int		count;
 	int		maxcount;
 	qboolean	overflowed;
 	int		*list;
 	vec3_t	bounds[2];
 	int		lastLeaf;		// for overflows where each leaf can't be stored individually
+	float	margin;			// CM_BoxLeafnumsMargin: how far the bounds can move without touching other leafs
 	void	(*storeLeafs)( struct leafList_s *ll, int nodenum );
 } leafList_t;
 
@@ -185,9 +271,21 @@ void CM_StoreBrushes( leafList_t *ll, int nodenum );
 void CM_BoxLeafnums_r( leafList_t *ll, int nodenum );
 
 cmodel_t	*CM_ClipHandleToModel( clipHandle_t handle );
+cmodel_t	*CM_ContextClipHandleToModel( cmContext_t *ctx, clipHandle_t handle );
+void CM_ContextModelBounds( cmContext_t *ctx, clipHandle_t model, vec3_t mins, vec3_t maxs );
+void CM_InitContext( cmContext_t *ctx, cmCheck_t *checks );
+void CM_SetBrushSidePlanes( cbrush_t *b );
 qboolean CM_BoundsIntersect( const vec3_t mins, const vec3_t maxs, const vec3_t mins2, const vec3_t maxs2 );
 qboolean CM_BoundsIntersectPoint( const vec3_t mins, const vec3_t maxs, const vec3_t point );
 
+// cm_trace.c
+
+void CM_InitBrushSideTests( void );
+void CM_RecordTrace( traceRecordType_t type, int batchSize, const trace_t *results, const vec3_t start, const vec3_t end,
+						  const vec3_t mins, const vec3_t maxs, clipHandle_t model, int brushmask,
+						  const vec3_t origin, const vec3_t angles, int capsule );
+void CM_SwapTraceRecord( traceRecord_t *rec );
+
 // cm_patch.c
 
 struct patchCollide_s	*CM_GeneratePatchCollide( int width, int height, vec3_t *points );
@@ -1298,10 +1298,11 @@ void CM_TracePointThroughPatchCollide( traceWork_t *tw, const struct patchCollid
 		if ( j == facet->numBorders ) {
 			// we hit this facet
 #ifndef BSPC
-			if (!cv) {
+			// the debug surface is only tracked for the main thread
+			if (!cv && tw->ctx == &cm_mainContext) {
 				cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
 			}
-			if (cv->integer) {
+			if (cv && cv->integer && tw->ctx == &cm_mainContext) {
 				debugPatchCollide = pc;
 				debugFacet = facet;
 			}
@@ -1485,10 +1486,11 @@ void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *
 					enterFrac = 0;
 				}
 #ifndef BSPC
-				if (!cv) {
+				// the debug surface is only tracked for the main thread
+				if (!cv && tw->ctx == &cm_mainContext) {
 					cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
 				}
-				if (cv && cv->integer) {
+				if (cv && cv->integer && tw->ctx == &cm_mainContext) {
 					debugPatchCollide = pc;
 					debugFacet = facet;
 				}
@@ -22,6 +22,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "qfiles.h"
 
+typedef struct cmContext_s cmContext_t;
 
 void		CM_LoadMap( const char *name, qboolean clientload, int *checksum);
 void		CM_ClearMap( void );
@@ -41,6 +42,11 @@ int			CM_TransformedPointContents( const vec3_t p, clipHandle_t model, const vec
 void		CM_BoxTrace ( trace_t *results, const vec3_t start, const vec3_t end,
 						  vec3_t mins, vec3_t maxs,
 						  clipHandle_t model, int brushmask, int capsule );
+// traces several boxes of the same size through the model in one pass,
+// results[i] is identical to a CM_BoxTrace from starts[i] to ends[i]
+void		CM_BoxTraceBatch( trace_t *results, int numTraces, const vec3_t *starts, const vec3_t *ends,
+						  vec3_t mins, vec3_t maxs,
+						  clipHandle_t model, int brushmask, int capsule );
 void		CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t end,
 						  vec3_t mins, vec3_t maxs,
 						  clipHandle_t model, int brushmask,
@@ -54,6 +60,10 @@ int			CM_PointLeafnum( const vec3_t p );
 // overflow if return listsize and if *lastLeaf != list[listsize-1]
 int			CM_BoxLeafnums( const vec3_t mins, const vec3_t maxs, int *list,
 		 					int listsize, int *lastLeaf );
+// also returns how far every side of the box can move
+// and still touch exactly the same leafs
+int			CM_BoxLeafnumsMargin( const vec3_t mins, const vec3_t maxs, int *list,
+							int listsize, int *lastLeaf, float *margin );
 
 int			CM_LeafCluster (int leafnum);
 int			CM_LeafArea (int leafnum);
@@ -63,5 +73,32 @@ qboolean	CM_AreasConnected( int area1, int area2 );
 
 int			CM_WriteAreaBits( byte *buffer, int area );
 
+// collision contexts
+// The calls above all share one context and must only be made from the main
+// thread.  Another thread can make the same queries at the same time through
+// a context of its own.  Contexts belong to the loaded map: allocate them
+// after CM_LoadMap and free them before the next map is loaded.
+cmContext_t	*CM_AllocContext( void );
+void		CM_FreeContext( cmContext_t *ctx );
+
+clipHandle_t CM_ContextTempBoxModel( cmContext_t *ctx, const vec3_t mins, const vec3_t maxs, int capsule );
+int			CM_ContextPointContents( cmContext_t *ctx, const vec3_t p, clipHandle_t model );
+int			CM_ContextTransformedPointContents( cmContext_t *ctx, const vec3_t p, clipHandle_t model, const vec3_t origin, const vec3_t angles );
+void		CM_ContextBoxTrace( cmContext_t *ctx, trace_t *results, const vec3_t start, const vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  clipHandle_t model, int brushmask, int capsule );
+void		CM_ContextTransformedBoxTrace( cmContext_t *ctx, trace_t *results, const vec3_t start, const vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  clipHandle_t model, int brushmask,
+						  const vec3_t origin, const vec3_t angles, int capsule );
+int			CM_ContextBoxLeafnums( cmContext_t *ctx, const vec3_t mins, const vec3_t maxs, int *list,
+		 					int listsize, int *lastLeaf );
+
+// cm_trace.c
+// logs every trace of the main context for replaying with cmreplay
+qboolean	CM_BeginTraceRecord( const char *filename );
+void		CM_EndTraceRecord( void );
+qboolean	CM_TraceRecording( void );
+
 // cm_patch.c
 void CM_DrawDebugSurface( void (*drawPoly)(int color, int numPoints, float *points) );
@@ -36,7 +36,7 @@ int CM_PointLeafnum_r( const vec3_t p, int num ) {
 	while (num >= 0)
 	{
 		node = cm.nodes + num;
-		plane = node->plane;
+		plane = &node->plane;
 		
 		if (plane->type < 3)
 			d = p[plane->type] - plane->dist;
@@ -101,10 +101,10 @@ void CM_StoreBrushes( leafList_t *ll, int nodenum ) {
 	for ( k = 0 ; k < leaf->numLeafBrushes ; k++ ) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
 		b = &cm.brushes[brushnum];
-		if ( b->checkcount == cm.checkcount ) {
+		if ( ll->ctx->brushChecks[brushnum].checkcount == ll->ctx->checkcount ) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		ll->ctx->brushChecks[brushnum].checkcount = ll->ctx->checkcount;
 		for ( i = 0 ; i < 3 ; i++ ) {
 			if ( b->bounds[0][i] >= ll->bounds[1][i] || b->bounds[1][i] <= ll->bounds[0][i] ) {
 				break;
@@ -149,7 +149,7 @@ void CM_BoxLeafnums_r( leafList_t *ll, int nodenum ) {
 		}
 	
 		node = &cm.nodes[nodenum];
-		plane = node->plane;
+		plane = &node->plane;
 		s = BoxOnPlaneSide( ll->bounds[0], ll->bounds[1], plane );
 		if (s == 1) {
 			nodenum = node->children[0];
@@ -170,10 +170,20 @@ CM_BoxLeafnums
 ==================
 */
 int	CM_BoxLeafnums( const vec3_t mins, const vec3_t maxs, int *list, int listsize, int *lastLeaf) {
+	return CM_ContextBoxLeafnums( &cm_mainContext, mins, maxs, list, listsize, lastLeaf );
+}
+
+/*
+==================
+CM_ContextBoxLeafnums
+==================
+*/
+int	CM_ContextBoxLeafnums( cmContext_t *ctx, const vec3_t mins, const vec3_t maxs, int *list, int listsize, int *lastLeaf) {
 	leafList_t	ll;
 
-	cm.checkcount++;
+	ctx->checkcount++;
 
+	ll.ctx = ctx;
 	VectorCopy( mins, ll.bounds[0] );
 	VectorCopy( maxs, ll.bounds[1] );
 	ll.count = 0;
@@ -189,6 +199,108 @@ int	CM_BoxLeafnums( const vec3_t mins, const vec3_t maxs, int *list, int listsiz
 	return ll.count;
 }
 
+/*
+=============
+CM_BoxLeafnumsMargin_r
+
+Same walk as CM_BoxLeafnums_r, also lowering ll->margin to how far
+the box sides can move before a node would classify the box differently
+=============
+*/
+static void CM_BoxLeafnumsMargin_r( leafList_t *ll, int nodenum ) {
+	cplane_t	*plane;
+	cNode_t		*node;
+	int			s, i;
+	float		d[2], slack;
+
+	while (1) {
+		if (nodenum < 0) {
+			ll->storeLeafs( ll, nodenum );
+			return;
+		}
+
+		node = &cm.nodes[nodenum];
+		plane = &node->plane;
+		s = BoxOnPlaneSide( ll->bounds[0], ll->bounds[1], plane );
+
+		// both comparisons BoxOnPlaneSide makes keep their outcome until a
+		// box side moves by its distance to the plane over the normal's L1 length
+		if ( plane->type < 3 ) {
+			d[0] = fabs( ll->bounds[0][plane->type] - plane->dist );
+			d[1] = fabs( ll->bounds[1][plane->type] - plane->dist );
+			slack = d[0] < d[1] ? d[0] : d[1];
+		} else if ( plane->signbits < 8 ) {
+			d[0] = d[1] = -plane->dist;
+			for ( i = 0 ; i < 3 ; i++ ) {
+				if ( plane->normal[i] < 0 ) {
+					d[0] += plane->normal[i] * ll->bounds[0][i];
+					d[1] += plane->normal[i] * ll->bounds[1][i];
+				} else {
+					d[0] += plane->normal[i] * ll->bounds[1][i];
+					d[1] += plane->normal[i] * ll->bounds[0][i];
+				}
+			}
+			d[0] = fabs( d[0] );
+			d[1] = fabs( d[1] );
+			slack = ( d[0] < d[1] ? d[0] : d[1] ) /
+				( fabs( plane->normal[0] ) + fabs( plane->normal[1] ) + fabs( plane->normal[2] ) );
+		} else {
+			slack = ll->margin;		// doesn't depend on the box
+		}
+		if ( slack < ll->margin ) {
+			ll->margin = slack;
+		}
+
+		if (s == 1) {
+			nodenum = node->children[0];
+		} else if (s == 2) {
+			nodenum = node->children[1];
+		} else {
+			// go down both
+			CM_BoxLeafnumsMargin_r( ll, node->children[0] );
+			nodenum = node->children[1];
+		}
+	}
+}
+
+/*
+==================
+CM_BoxLeafnumsMargin
+
+CM_BoxLeafnums that also returns a margin: a box whose sides
+are all less than margin away from mins and maxs touches
+exactly the same leafs
+==================
+*/
+int CM_BoxLeafnumsMargin( const vec3_t mins, const vec3_t maxs, int *list, int listsize, int *lastLeaf, float *margin ) {
+	leafList_t	ll;
+
+	cm_mainContext.checkcount++;
+
+	ll.ctx = &cm_mainContext;
+	VectorCopy( mins, ll.bounds[0] );
+	VectorCopy( maxs, ll.bounds[1] );
+	ll.count = 0;
+	ll.maxcount = listsize;
+	ll.list = list;
+	ll.storeLeafs = CM_StoreLeafs;
+	ll.lastLeaf = 0;
+	ll.overflowed = qfalse;
+	ll.margin = WORLD_SIZE;
+
+	if ( !cm.numNodes ) {	// map not loaded
+		*lastLeaf = 0;
+		*margin = 0;
+		return 0;
+	}
+
+	CM_BoxLeafnumsMargin_r( &ll, 0 );
+
+	*lastLeaf = ll.lastLeaf;
+	*margin = ll.margin;
+	return ll.count;
+}
+
 /*
 ==================
 CM_BoxBrushes
@@ -197,8 +309,9 @@ CM_BoxBrushes
 int CM_BoxBrushes( const vec3_t mins, const vec3_t maxs, cbrush_t **list, int listsize ) {
 	leafList_t	ll;
 
-	cm.checkcount++;
+	cm_mainContext.checkcount++;
 
+	ll.ctx = &cm_mainContext;
 	VectorCopy( mins, ll.bounds[0] );
 	VectorCopy( maxs, ll.bounds[1] );
 	ll.count = 0;
@@ -217,6 +330,32 @@ int CM_BoxBrushes( const vec3_t mins, const vec3_t maxs, cbrush_t **list, int li
 //====================================================================
 
 
+/*
+==================
+CM_PointInBrush
+==================
+*/
+static qboolean CM_PointInBrush( const vec3_t p, const cbrush_t *b ) {
+	int			i;
+	float		d;
+
+	if ( !CM_BoundsIntersectPoint( b->bounds[0], b->bounds[1], p ) ) {
+		return qfalse;
+	}
+
+	// see if the point is in the brush
+	for ( i = 0 ; i < b->numsides ; i++ ) {
+		d = DotProduct( p, b->sides[i].plane->normal );
+// FIXME test for Cash
+//		if ( d >= b->sides[i].plane->dist ) {
+		if ( d > b->sides[i].plane->dist ) {
+			return qfalse;
+		}
+	}
+
+	return qtrue;
+}
+
 /*
 ==================
 CM_PointContents
@@ -224,21 +363,36 @@ CM_PointContents
 ==================
 */
 int CM_PointContents( const vec3_t p, clipHandle_t model ) {
+	return CM_ContextPointContents( &cm_mainContext, p, model );
+}
+
+/*
+==================
+CM_ContextPointContents
+
+==================
+*/
+int CM_ContextPointContents( cmContext_t *ctx, const vec3_t p, clipHandle_t model ) {
 	int			leafnum;
-	int			i, k;
+	int			k;
 	int			brushnum;
 	cLeaf_t		*leaf;
 	cbrush_t	*b;
 	int			contents;
-	float		d;
 	cmodel_t	*clipm;
 
 	if (!cm.numNodes) {	// map not loaded
 		return 0;
 	}
 
+	if ( model == BOX_MODEL_HANDLE ) {
+		// the temp box is the only brush of its model
+		b = &ctx->boxBrush;
+		return CM_PointInBrush( p, b ) ? b->contents : 0;
+	}
+
 	if ( model ) {
-		clipm = CM_ClipHandleToModel( model );
+		clipm = CM_ContextClipHandleToModel( ctx, model );
 		leaf = &clipm->leaf;
 	} else {
 		leafnum = CM_PointLeafnum_r (p, 0);
@@ -250,21 +404,7 @@ int CM_PointContents( const vec3_t p, clipHandle_t model ) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
 		b = &cm.brushes[brushnum];
 
-		if ( !CM_BoundsIntersectPoint( b->bounds[0], b->bounds[1], p ) ) {
-			continue;
-		}
-
-		// see if the point is in the brush
-		for ( i = 0 ; i < b->numsides ; i++ ) {
-			d = DotProduct( p, b->sides[i].plane->normal );
-// FIXME test for Cash
-//			if ( d >= b->sides[i].plane->dist ) {
-			if ( d > b->sides[i].plane->dist ) {
-				break;
-			}
-		}
-
-		if ( i == b->numsides ) {
+		if ( CM_PointInBrush( p, b ) ) {
 			contents |= b->contents;
 		}
 	}
@@ -281,6 +421,15 @@ rotating entities
 ==================
 */
 int	CM_TransformedPointContents( const vec3_t p, clipHandle_t model, const vec3_t origin, const vec3_t angles) {
+	return CM_ContextTransformedPointContents( &cm_mainContext, p, model, origin, angles );
+}
+
+/*
+==================
+CM_ContextTransformedPointContents
+==================
+*/
+int	CM_ContextTransformedPointContents( cmContext_t *ctx, const vec3_t p, clipHandle_t model, const vec3_t origin, const vec3_t angles) {
 	vec3_t		p_l;
 	vec3_t		temp;
 	vec3_t		forward, right, up;
@@ -300,7 +449,7 @@ int	CM_TransformedPointContents( const vec3_t p, clipHandle_t model, const vec3_
 		p_l[2] = DotProduct (temp, up);
 	}
 
-	return CM_PointContents( p_l, model );
+	return CM_ContextPointContents( ctx, p_l, model );
 }
 
 
@@ -21,6 +21,21 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 #include "cm_local.h"
 
+#if idx64 || id386
+#include <emmintrin.h>
+#define CM_SSE2 1
+#if id386 && defined(__GNUC__)
+#define CM_SSE2_FUNC __attribute__ ((target ("sse2")))
+#else
+#define CM_SSE2_FUNC
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CM_NEON 1
+#endif
+
 // always use bbox vs. bbox collision and never capsule vs. bbox or vice versa
 //#define ALWAYS_BBOX_VS_BBOX
 // always use capsule vs. capsule collision and never capsule vs. bbox or vice versa
@@ -145,6 +160,330 @@ float SquareRootFloat(float number) {
 }
 
 
+/*
+===============================================================================
+
+BRUSH SIDE TESTS
+
+The box versions of the brush tests only need the distance of the start and
+end points to every side plane, pushed out by the box corner that is nearest
+to the plane.  These are computed from the cbrush_t sidePlanes arrays, four
+planes at a time where the cpu can, with exactly the same float operations as
+the per plane code, so every path gives the same results.
+
+===============================================================================
+*/
+
+/*
+================
+CM_BrushSideDists_Scalar
+================
+*/
+static qboolean CM_BrushSideDists_Scalar( const traceWork_t *tw, const cbrush_t *brush, float *d1s, float *d2s ) {
+	int			i, stride;
+	const float	*nx, *ny, *nz, *pd;
+	vec3_t		normal, offset;
+	float		dist, d1, d2;
+
+	stride = BRUSH_SIDE_STRIDE( brush->numsides );
+	nx = brush->sidePlanes;
+	ny = nx + stride;
+	nz = ny + stride;
+	pd = nz + stride;
+
+	for ( i = 0 ; i < brush->numsides ; i++ ) {
+		VectorSet( normal, nx[i], ny[i], nz[i] );
+
+		// the corner of the box nearest to the plane, same as tw->offsets[ plane->signbits ]
+		offset[0] = tw->size[ normal[0] < 0 ][0];
+		offset[1] = tw->size[ normal[1] < 0 ][1];
+		offset[2] = tw->size[ normal[2] < 0 ][2];
+
+		// adjust the plane distance apropriately for mins/maxs
+		dist = pd[i] - DotProduct( offset, normal );
+
+		d1 = DotProduct( tw->start, normal ) - dist;
+		d2 = DotProduct( tw->end, normal ) - dist;
+
+		// if completely in front of face, no intersection with the entire brush
+		if (d1 > 0 && ( d2 >= SURFACE_CLIP_EPSILON || d2 >= d1 )  ) {
+			return qtrue;
+		}
+
+		d1s[i] = d1;
+		d2s[i] = d2;
+	}
+
+	return qfalse;
+}
+
+/*
+================
+CM_StartOutsideBrush_Scalar
+================
+*/
+static qboolean CM_StartOutsideBrush_Scalar( const traceWork_t *tw, const cbrush_t *brush ) {
+	int			i, stride;
+	const float	*nx, *ny, *nz, *pd;
+	vec3_t		normal, offset;
+	float		dist, d1;
+
+	stride = BRUSH_SIDE_STRIDE( brush->numsides );
+	nx = brush->sidePlanes;
+	ny = nx + stride;
+	nz = ny + stride;
+	pd = nz + stride;
+
+	// the first six planes are the axial planes, so we only
+	// need to test the remainder
+	for ( i = 6 ; i < brush->numsides ; i++ ) {
+		VectorSet( normal, nx[i], ny[i], nz[i] );
+
+		offset[0] = tw->size[ normal[0] < 0 ][0];
+		offset[1] = tw->size[ normal[1] < 0 ][1];
+		offset[2] = tw->size[ normal[2] < 0 ][2];
+
+		dist = pd[i] - DotProduct( offset, normal );
+
+		d1 = DotProduct( tw->start, normal ) - dist;
+
+		// if completely in front of face, no intersection
+		if ( d1 > 0 ) {
+			return qtrue;
+		}
+	}
+
+	return qfalse;
+}
+
+// fills in the start / end distances of all sides, returns qtrue
+// as soon as one side has the whole move in front of it
+static qboolean	(*CM_BrushSideDists)( const traceWork_t *tw, const cbrush_t *brush, float *d1s, float *d2s ) = CM_BrushSideDists_Scalar;
+// returns qtrue if the start point is in front of any of the non axial sides
+static qboolean	(*CM_StartOutsideBrush)( const traceWork_t *tw, const cbrush_t *brush ) = CM_StartOutsideBrush_Scalar;
+
+#ifdef CM_SSE2
+/*
+================
+CM_BrushSideDists_SSE2
+================
+*/
+static CM_SSE2_FUNC qboolean CM_BrushSideDists_SSE2( const traceWork_t *tw, const cbrush_t *brush, float *d1s, float *d2s ) {
+	int			i, stride;
+	const float	*planes;
+	__m128		zero, eps;
+	__m128		size0x, size0y, size0z, size1x, size1y, size1z;
+	__m128		startx, starty, startz, endx, endy, endz;
+	__m128		nx, ny, nz, ox, oy, oz, mask, dist, d1, d2, out;
+
+	stride = BRUSH_SIDE_STRIDE( brush->numsides );
+	planes = brush->sidePlanes;
+
+	zero = _mm_setzero_ps();
+	eps = _mm_set1_ps( SURFACE_CLIP_EPSILON );
+	size0x = _mm_set1_ps( tw->size[0][0] );
+	size0y = _mm_set1_ps( tw->size[0][1] );
+	size0z = _mm_set1_ps( tw->size[0][2] );
+	size1x = _mm_set1_ps( tw->size[1][0] );
+	size1y = _mm_set1_ps( tw->size[1][1] );
+	size1z = _mm_set1_ps( tw->size[1][2] );
+	startx = _mm_set1_ps( tw->start[0] );
+	starty = _mm_set1_ps( tw->start[1] );
+	startz = _mm_set1_ps( tw->start[2] );
+	endx = _mm_set1_ps( tw->end[0] );
+	endy = _mm_set1_ps( tw->end[1] );
+	endz = _mm_set1_ps( tw->end[2] );
+
+	for ( i = 0 ; i < stride ; i += 4 ) {
+		nx = _mm_loadu_ps( planes + i );
+		ny = _mm_loadu_ps( planes + stride + i );
+		nz = _mm_loadu_ps( planes + stride*2 + i );
+
+		// pick the box corner nearest to each plane
+		mask = _mm_cmplt_ps( nx, zero );
+		ox = _mm_or_ps( _mm_and_ps( mask, size1x ), _mm_andnot_ps( mask, size0x ) );
+		mask = _mm_cmplt_ps( ny, zero );
+		oy = _mm_or_ps( _mm_and_ps( mask, size1y ), _mm_andnot_ps( mask, size0y ) );
+		mask = _mm_cmplt_ps( nz, zero );
+		oz = _mm_or_ps( _mm_and_ps( mask, size1z ), _mm_andnot_ps( mask, size0z ) );
+
+		dist = _mm_add_ps( _mm_add_ps( _mm_mul_ps( ox, nx ), _mm_mul_ps( oy, ny ) ), _mm_mul_ps( oz, nz ) );
+		dist = _mm_sub_ps( _mm_loadu_ps( planes + stride*3 + i ), dist );
+
+		d1 = _mm_add_ps( _mm_add_ps( _mm_mul_ps( startx, nx ), _mm_mul_ps( starty, ny ) ), _mm_mul_ps( startz, nz ) );
+		d1 = _mm_sub_ps( d1, dist );
+		d2 = _mm_add_ps( _mm_add_ps( _mm_mul_ps( endx, nx ), _mm_mul_ps( endy, ny ) ), _mm_mul_ps( endz, nz ) );
+		d2 = _mm_sub_ps( d2, dist );
+
+		// padding planes are all zero and never get out
+		out = _mm_and_ps( _mm_cmpgt_ps( d1, zero ), _mm_or_ps( _mm_cmpge_ps( d2, eps ), _mm_cmpge_ps( d2, d1 ) ) );
+		if ( _mm_movemask_ps( out ) ) {
+			return qtrue;
+		}
+
+		_mm_storeu_ps( d1s + i, d1 );
+		_mm_storeu_ps( d2s + i, d2 );
+	}
+
+	return qfalse;
+}
+
+/*
+================
+CM_StartOutsideBrush_SSE2
+================
+*/
+static CM_SSE2_FUNC qboolean CM_StartOutsideBrush_SSE2( const traceWork_t *tw, const cbrush_t *brush ) {
+	int			i, stride, lanes;
+	const float	*planes;
+	__m128		zero;
+	__m128		size0x, size0y, size0z, size1x, size1y, size1z;
+	__m128		startx, starty, startz;
+	__m128		nx, ny, nz, ox, oy, oz, mask, dist, d1;
+
+	if ( brush->numsides <= 6 ) {
+		return qfalse;
+	}
+
+	stride = BRUSH_SIDE_STRIDE( brush->numsides );
+	planes = brush->sidePlanes;
+
+	zero = _mm_setzero_ps();
+	size0x = _mm_set1_ps( tw->size[0][0] );
+	size0y = _mm_set1_ps( tw->size[0][1] );
+	size0z = _mm_set1_ps( tw->size[0][2] );
+	size1x = _mm_set1_ps( tw->size[1][0] );
+	size1y = _mm_set1_ps( tw->size[1][1] );
+	size1z = _mm_set1_ps( tw->size[1][2] );
+	startx = _mm_set1_ps( tw->start[0] );
+	starty = _mm_set1_ps( tw->start[1] );
+	startz = _mm_set1_ps( tw->start[2] );
+
+	// the first six planes are the axial planes, so we only
+	// need to test the remainder, starting with lanes 2 and 3
+	// of the second group
+	lanes = 0xc;
+	for ( i = 4 ; i < stride ; i += 4, lanes = 0xf ) {
+		nx = _mm_loadu_ps( planes + i );
+		ny = _mm_loadu_ps( planes + stride + i );
+		nz = _mm_loadu_ps( planes + stride*2 + i );
+
+		mask = _mm_cmplt_ps( nx, zero );
+		ox = _mm_or_ps( _mm_and_ps( mask, size1x ), _mm_andnot_ps( mask, size0x ) );
+		mask = _mm_cmplt_ps( ny, zero );
+		oy = _mm_or_ps( _mm_and_ps( mask, size1y ), _mm_andnot_ps( mask, size0y ) );
+		mask = _mm_cmplt_ps( nz, zero );
+		oz = _mm_or_ps( _mm_and_ps( mask, size1z ), _mm_andnot_ps( mask, size0z ) );
+
+		dist = _mm_add_ps( _mm_add_ps( _mm_mul_ps( ox, nx ), _mm_mul_ps( oy, ny ) ), _mm_mul_ps( oz, nz ) );
+		dist = _mm_sub_ps( _mm_loadu_ps( planes + stride*3 + i ), dist );
+
+		d1 = _mm_add_ps( _mm_add_ps( _mm_mul_ps( startx, nx ), _mm_mul_ps( starty, ny ) ), _mm_mul_ps( startz, nz ) );
+		d1 = _mm_sub_ps( d1, dist );
+
+		if ( _mm_movemask_ps( _mm_cmpgt_ps( d1, zero ) ) & lanes ) {
+			return qtrue;
+		}
+	}
+
+	return qfalse;
+}
+#endif
+
+#ifdef CM_NEON
+/*
+================
+CM_BrushSideDists_NEON
+================
+*/
+static qboolean CM_BrushSideDists_NEON( const traceWork_t *tw, const cbrush_t *brush, float *d1s, float *d2s ) {
+	int			i, stride;
+	const float	*planes;
+	float32x4_t	zero, eps;
+	float32x4_t	size0x, size0y, size0z, size1x, size1y, size1z;
+	float32x4_t	startx, starty, startz, endx, endy, endz;
+	float32x4_t	nx, ny, nz, ox, oy, oz, dist, d1, d2;
+	uint32x4_t	out;
+	uint32x2_t	any;
+
+	stride = BRUSH_SIDE_STRIDE( brush->numsides );
+	planes = brush->sidePlanes;
+
+	zero = vdupq_n_f32( 0 );
+	eps = vdupq_n_f32( SURFACE_CLIP_EPSILON );
+	size0x = vdupq_n_f32( tw->size[0][0] );
+	size0y = vdupq_n_f32( tw->size[0][1] );
+	size0z = vdupq_n_f32( tw->size[0][2] );
+	size1x = vdupq_n_f32( tw->size[1][0] );
+	size1y = vdupq_n_f32( tw->size[1][1] );
+	size1z = vdupq_n_f32( tw->size[1][2] );
+	startx = vdupq_n_f32( tw->start[0] );
+	starty = vdupq_n_f32( tw->start[1] );
+	startz = vdupq_n_f32( tw->start[2] );
+	endx = vdupq_n_f32( tw->end[0] );
+	endy = vdupq_n_f32( tw->end[1] );
+	endz = vdupq_n_f32( tw->end[2] );
+
+	for ( i = 0 ; i < stride ; i += 4 ) {
+		nx = vld1q_f32( planes + i );
+		ny = vld1q_f32( planes + stride + i );
+		nz = vld1q_f32( planes + stride*2 + i );
+
+		// pick the box corner nearest to each plane
+		ox = vbslq_f32( vcltq_f32( nx, zero ), size1x, size0x );
+		oy = vbslq_f32( vcltq_f32( ny, zero ), size1y, size0y );
+		oz = vbslq_f32( vcltq_f32( nz, zero ), size1z, size0z );
+
+		// separate multiplies and adds, a fused vmla would round differently
+		dist = vaddq_f32( vaddq_f32( vmulq_f32( ox, nx ), vmulq_f32( oy, ny ) ), vmulq_f32( oz, nz ) );
+		dist = vsubq_f32( vld1q_f32( planes + stride*3 + i ), dist );
+
+		d1 = vaddq_f32( vaddq_f32( vmulq_f32( startx, nx ), vmulq_f32( starty, ny ) ), vmulq_f32( startz, nz ) );
+		d1 = vsubq_f32( d1, dist );
+		d2 = vaddq_f32( vaddq_f32( vmulq_f32( endx, nx ), vmulq_f32( endy, ny ) ), vmulq_f32( endz, nz ) );
+		d2 = vsubq_f32( d2, dist );
+
+		// padding planes are all zero and never get out
+		out = vandq_u32( vcgtq_f32( d1, zero ), vorrq_u32( vcgeq_f32( d2, eps ), vcgeq_f32( d2, d1 ) ) );
+		any = vorr_u32( vget_low_u32( out ), vget_high_u32( out ) );
+		if ( vget_lane_u32( vpmax_u32( any, any ), 0 ) ) {
+			return qtrue;
+		}
+
+		vst1q_f32( d1s + i, d1 );
+		vst1q_f32( d2s + i, d2 );
+	}
+
+	return qfalse;
+}
+#endif
+
+/*
+================
+CM_InitBrushSideTests
+
+Picks the brush side test implementation for this cpu
+================
+*/
+void CM_InitBrushSideTests( void ) {
+	CM_BrushSideDists = CM_BrushSideDists_Scalar;
+	CM_StartOutsideBrush = CM_StartOutsideBrush_Scalar;
+
+#ifdef CM_SSE2
+#if id386 && !defined(BSPC)
+	if ( !( Sys_GetProcessorFeatures() & CF_SSE2 ) ) {
+		return;
+	}
+#endif
+	CM_BrushSideDists = CM_BrushSideDists_SSE2;
+	CM_StartOutsideBrush = CM_StartOutsideBrush_SSE2;
+#endif
+
+#ifdef CM_NEON
+	CM_BrushSideDists = CM_BrushSideDists_NEON;
+#endif
+}
+
 /*
 ===============================================================================
 
@@ -207,23 +546,8 @@ void CM_TestBoxInBrush( traceWork_t *tw, cbrush_t *brush ) {
 				return;
 			}
 		}
-	} else {
-		// the first six planes are the axial planes, so we only
-		// need to test the remainder
-		for ( i = 6 ; i < brush->numsides ; i++ ) {
-			side = brush->sides + i;
-			plane = side->plane;
-
-			// adjust the plane distance apropriately for mins/maxs
-			dist = plane->dist - DotProduct( tw->offsets[ plane->signbits ], plane->normal );
-
-			d1 = DotProduct( tw->start, plane->normal ) - dist;
-
-			// if completely in front of face, no intersection
-			if ( d1 > 0 ) {
-				return;
-			}
-		}
+	} else if ( CM_StartOutsideBrush( tw, brush ) ) {
+		return;
 	}
 
 	// inside this brush
@@ -241,7 +565,7 @@ CM_TestInLeaf
 */
 void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	int			k;
-	int			brushnum;
+	int			brushnum, surfnum;
 	cbrush_t	*b;
 	cPatch_t	*patch;
 
@@ -249,10 +573,10 @@ void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	for (k=0 ; k<leaf->numLeafBrushes ; k++) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
 		b = &cm.brushes[brushnum];
-		if (b->checkcount == cm.checkcount) {
+		if (tw->ctx->brushChecks[brushnum].checkcount == tw->ctx->checkcount) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		tw->ctx->brushChecks[brushnum].checkcount = tw->ctx->checkcount;
 
 		if ( !(b->contents & tw->contents)) {
 			continue;
@@ -271,14 +595,15 @@ void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	if ( !cm_noCurves->integer ) {
 #endif //BSPC
 		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
-			patch = cm.surfaces[ cm.leafsurfaces[ leaf->firstLeafSurface + k ] ];
+			surfnum = cm.leafsurfaces[ leaf->firstLeafSurface + k ];
+			patch = cm.surfaces[ surfnum ];
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
+			if ( tw->ctx->patchChecks[surfnum].checkcount == tw->ctx->checkcount ) {
 				continue;	// already checked this brush in another leaf
 			}
-			patch->checkcount = cm.checkcount;
+			tw->ctx->patchChecks[surfnum].checkcount = tw->ctx->checkcount;
 
 			if ( !(patch->contents & tw->contents)) {
 				continue;
@@ -294,6 +619,22 @@ void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	}
 }
 
+/*
+================
+CM_TestInBoxModel
+
+The temp box model of a context has a single brush
+================
+*/
+static void CM_TestInBoxModel( traceWork_t *tw ) {
+	cbrush_t	*b;
+
+	b = &tw->ctx->boxBrush;
+	if ( b->contents & tw->contents ) {
+		CM_TestBoxInBrush( tw, b );
+	}
+}
+
 /*
 ==================
 CM_TestCapsuleInCapsule
@@ -309,7 +650,7 @@ void CM_TestCapsuleInCapsule( traceWork_t *tw, clipHandle_t model ) {
 	vec3_t offset, symetricSize[2];
 	float radius, halfwidth, halfheight, offs, r;
 
-	CM_ModelBounds(model, mins, maxs);
+	CM_ContextModelBounds(tw->ctx, model, mins, maxs);
 
 	VectorAdd(tw->start, tw->sphere.offset, top);
 	VectorSubtract(tw->start, tw->sphere.offset, bottom);
@@ -372,12 +713,10 @@ bounding box inside capsule check
 */
 void CM_TestBoundingBoxInCapsule( traceWork_t *tw, clipHandle_t model ) {
 	vec3_t mins, maxs, offset, size[2];
-	clipHandle_t h;
-	cmodel_t *cmod;
 	int i;
 
 	// mins maxs of the capsule
-	CM_ModelBounds(model, mins, maxs);
+	CM_ContextModelBounds(tw->ctx, model, mins, maxs);
 
 	// offset for capsule center
 	for ( i = 0 ; i < 3 ; i++ ) {
@@ -395,10 +734,9 @@ void CM_TestBoundingBoxInCapsule( traceWork_t *tw, clipHandle_t model ) {
 	VectorSet( tw->sphere.offset, 0, 0, size[1][2] - tw->sphere.radius );
 
 	// replace the capsule with the bounding box
-	h = CM_TempBoxModel(tw->size[0], tw->size[1], qfalse);
+	CM_ContextTempBoxModel(tw->ctx, tw->size[0], tw->size[1], qfalse);
 	// calculate collision
-	cmod = CM_ClipHandleToModel( h );
-	CM_TestInLeaf( tw, &cmod->leaf );
+	CM_TestInBoxModel( tw );
 }
 
 /*
@@ -421,6 +759,7 @@ void CM_PositionTest( traceWork_t *tw ) {
 		ll.bounds[1][i] += 1;
 	}
 
+	ll.ctx = tw->ctx;
 	ll.count = 0;
 	ll.maxcount = MAX_POSITION_LEAFS;
 	ll.list = leafs;
@@ -428,12 +767,12 @@ void CM_PositionTest( traceWork_t *tw ) {
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
 
-	cm.checkcount++;
+	tw->ctx->checkcount++;
 
 	CM_BoxLeafnums_r( &ll, 0 );
 
 
-	cm.checkcount++;
+	tw->ctx->checkcount++;
 
 	// test the contents of the leafs
 	for (i=0 ; i < ll.count ; i++) {
@@ -491,6 +830,7 @@ void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
 	float		t;
 	vec3_t		startp;
 	vec3_t		endp;
+	float		d1s[MAX_SIMD_BRUSH_SIDES], d2s[MAX_SIMD_BRUSH_SIDES];
 
 	enterFrac = -1.0;
 	leaveFrac = 1.0;
@@ -574,6 +914,50 @@ void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
 				}
 			}
 		}
+	} else if ( brush->numsides <= MAX_SIMD_BRUSH_SIDES ) {
+		// get the distances to all planes at once, this also
+		// catches the trace being completely in front of a face
+		if ( CM_BrushSideDists( tw, brush, d1s, d2s ) ) {
+			return;
+		}
+
+		for (i = 0; i < brush->numsides; i++) {
+			d1 = d1s[i];
+			d2 = d2s[i];
+
+			if (d2 > 0) {
+				getout = qtrue;	// endpoint is not in solid
+			}
+			if (d1 > 0) {
+				startout = qtrue;
+			}
+
+			// if it doesn't cross the plane, the plane isn't relevent
+			if (d1 <= 0 && d2 <= 0 ) {
+				continue;
+			}
+
+			// crosses face
+			if (d1 > d2) {	// enter
+				f = (d1-SURFACE_CLIP_EPSILON) / (d1-d2);
+				if ( f < 0 ) {
+					f = 0;
+				}
+				if (f > enterFrac) {
+					enterFrac = f;
+					leadside = brush->sides + i;
+					clipplane = leadside->plane;
+				}
+			} else {	// leave
+				f = (d1+SURFACE_CLIP_EPSILON) / (d1-d2);
+				if ( f > 1 ) {
+					f = 1;
+				}
+				if (f < leaveFrac) {
+					leaveFrac = f;
+				}
+			}
+		}
 	} else {
 		//
 		// compare the trace against all planes of the brush
@@ -668,7 +1052,7 @@ CM_TraceThroughLeaf
 */
 void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	int			k;
-	int			brushnum;
+	int			brushnum, surfnum;
 	cbrush_t	*b;
 	cPatch_t	*patch;
 
@@ -677,10 +1061,10 @@ void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
 
 		b = &cm.brushes[brushnum];
-		if ( b->checkcount == cm.checkcount ) {
+		if ( tw->ctx->brushChecks[brushnum].checkcount == tw->ctx->checkcount ) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		tw->ctx->brushChecks[brushnum].checkcount = tw->ctx->checkcount;
 
 		if ( !(b->contents & tw->contents) ) {
 			continue;
@@ -704,14 +1088,15 @@ void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	if ( !cm_noCurves->integer ) {
 #endif
 		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
-			patch = cm.surfaces[ cm.leafsurfaces[ leaf->firstLeafSurface + k ] ];
+			surfnum = cm.leafsurfaces[ leaf->firstLeafSurface + k ];
+			patch = cm.surfaces[ surfnum ];
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
+			if ( tw->ctx->patchChecks[surfnum].checkcount == tw->ctx->checkcount ) {
 				continue;	// already checked this patch in another leaf
 			}
-			patch->checkcount = cm.checkcount;
+			tw->ctx->patchChecks[surfnum].checkcount = tw->ctx->checkcount;
 
 			if ( !(patch->contents & tw->contents) ) {
 				continue;
@@ -725,6 +1110,27 @@ void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	}
 }
 
+/*
+================
+CM_TraceThroughBoxModel
+
+The temp box model of a context has a single brush
+================
+*/
+static void CM_TraceThroughBoxModel( traceWork_t *tw ) {
+	cbrush_t	*b;
+
+	b = &tw->ctx->boxBrush;
+	if ( !(b->contents & tw->contents) ) {
+		return;
+	}
+	if ( !CM_BoundsIntersect( tw->bounds[0], tw->bounds[1], b->bounds[0], b->bounds[1] ) ) {
+		return;
+	}
+
+	CM_TraceThroughBrush( tw, b );
+}
+
 #define RADIUS_EPSILON		1.0f
 
 /*
@@ -934,7 +1340,7 @@ void CM_TraceCapsuleThroughCapsule( traceWork_t *tw, clipHandle_t model ) {
 	vec3_t offset, symetricSize[2];
 	float radius, halfwidth, halfheight, offs, h;
 
-	CM_ModelBounds(model, mins, maxs);
+	CM_ContextModelBounds(tw->ctx, model, mins, maxs);
 	// test trace bounds vs. capsule bounds
 	if ( tw->bounds[0][0] > maxs[0] + RADIUS_EPSILON
 		|| tw->bounds[0][1] > maxs[1] + RADIUS_EPSILON
@@ -991,12 +1397,10 @@ bounding box vs. capsule collision
 */
 void CM_TraceBoundingBoxThroughCapsule( traceWork_t *tw, clipHandle_t model ) {
 	vec3_t mins, maxs, offset, size[2];
-	clipHandle_t h;
-	cmodel_t *cmod;
 	int i;
 
 	// mins maxs of the capsule
-	CM_ModelBounds(model, mins, maxs);
+	CM_ContextModelBounds(tw->ctx, model, mins, maxs);
 
 	// offset for capsule center
 	for ( i = 0 ; i < 3 ; i++ ) {
@@ -1014,10 +1418,9 @@ void CM_TraceBoundingBoxThroughCapsule( traceWork_t *tw, clipHandle_t model ) {
 	VectorSet( tw->sphere.offset, 0, 0, size[1][2] - tw->sphere.radius );
 
 	// replace the capsule with the bounding box
-	h = CM_TempBoxModel(tw->size[0], tw->size[1], qfalse);
+	CM_ContextTempBoxModel(tw->ctx, tw->size[0], tw->size[1], qfalse);
 	// calculate collision
-	cmod = CM_ClipHandleToModel( h );
-	CM_TraceThroughLeaf( tw, &cmod->leaf );
+	CM_TraceThroughBoxModel( tw );
 }
 
 //=========================================================================================
@@ -1057,7 +1460,7 @@ void CM_TraceThroughTree( traceWork_t *tw, int num, float p1f, float p2f, vec3_t
 	// and the offset for the size of the box
 	//
 	node = cm.nodes + num;
-	plane = node->plane;
+	plane = &node->plane;
 
 	// adjust the plane distance apropriately for mins/maxs
 	if ( plane->type < 3 ) {
@@ -1137,37 +1540,327 @@ void CM_TraceThroughTree( traceWork_t *tw, int num, float p1f, float p2f, vec3_t
 }
 
 
-//======================================================================
+/*
+===============================================================================
+
+BATCHED TRACING
+
+Traces that share size and contents can walk the tree together.  Every trace
+keeps its own traceWork_t and visits exactly the leafs, in exactly the order,
+that CM_TraceThroughTree would have, so the results are identical; only the
+node plane tests and the brush / patch list walks are shared.
+
+===============================================================================
+*/
+
+typedef struct {
+	int			trace;			// index into traceBatch_t.tw
+	float		p1f, p2f;
+	vec3_t		p1, p2;
+} traceSegment_t;
+
+typedef struct {
+	traceWork_t	*tw;
+	cmContext_t	*ctx;
+	int			contents;
+	qboolean	isPoint;		// size and contents are shared by the whole batch
+	vec3_t		extents;
+	int			checkcount;		// stored in batchcount of every brush / patch tested
+} traceBatch_t;
+
+/*
+================
+CM_TraceThroughLeafBatch
+================
+*/
+static void CM_TraceThroughLeafBatch( traceBatch_t *tb, cLeaf_t *leaf, traceSegment_t **segs, int numSegs ) {
+	int			i, k;
+	int			brushnum, surfnum;
+	unsigned int	bit;
+	cbrush_t	*b;
+	cPatch_t	*patch;
+	cmCheck_t	*check;
+	traceWork_t	*tw;
+	vec3_t		bounds[2];
+
+	// enclosing box of all the traces entering this leaf
+	tw = &tb->tw[segs[0]->trace];
+	VectorCopy( tw->bounds[0], bounds[0] );
+	VectorCopy( tw->bounds[1], bounds[1] );
+	for ( i = 1 ; i < numSegs ; i++ ) {
+		tw = &tb->tw[segs[i]->trace];
+		AddPointToBounds( tw->bounds[0], bounds[0], bounds[1] );
+		AddPointToBounds( tw->bounds[1], bounds[0], bounds[1] );
+	}
+
+	// trace lines against all brushes in the leaf
+	for ( k = 0 ; k < leaf->numLeafBrushes ; k++ ) {
+		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
+
+		b = &cm.brushes[brushnum];
+		if ( !(b->contents & tb->contents) ) {
+			continue;
+		}
+
+		if ( !CM_BoundsIntersect( bounds[0], bounds[1],
+					b->bounds[0], b->bounds[1] ) ) {
+			continue;
+		}
+
+		check = &tb->ctx->brushChecks[brushnum];
+		if ( check->batchcount != tb->checkcount ) {
+			check->batchcount = tb->checkcount;
+			check->batchbits = 0;
+		}
+
+		for ( i = 0 ; i < numSegs ; i++ ) {
+			tw = &tb->tw[segs[i]->trace];
+			if ( !tw->trace.fraction ) {
+				continue;	// this trace is done with the leaf
+			}
+			bit = 1u << segs[i]->trace;
+			if ( check->batchbits & bit ) {
+				continue;	// already checked this brush in another leaf
+			}
+			check->batchbits |= bit;
+
+			if ( !CM_BoundsIntersect( tw->bounds[0], tw->bounds[1],
+						b->bounds[0], b->bounds[1] ) ) {
+				continue;
+			}
+
+			CM_TraceThroughBrush( tw, b );
+		}
+	}
+
+	// trace lines against all patches in the leaf
+#ifdef BSPC
+	if (1) {
+#else
+	if ( !cm_noCurves->integer ) {
+#endif
+		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
+			surfnum = cm.leafsurfaces[ leaf->firstLeafSurface + k ];
+			patch = cm.surfaces[ surfnum ];
+			if ( !patch ) {
+				continue;
+			}
+			if ( !(patch->contents & tb->contents) ) {
+				continue;
+			}
+
+			check = &tb->ctx->patchChecks[surfnum];
+			if ( check->batchcount != tb->checkcount ) {
+				check->batchcount = tb->checkcount;
+				check->batchbits = 0;
+			}
+
+			for ( i = 0 ; i < numSegs ; i++ ) {
+				tw = &tb->tw[segs[i]->trace];
+				if ( !tw->trace.fraction ) {
+					continue;
+				}
+				bit = 1u << segs[i]->trace;
+				if ( check->batchbits & bit ) {
+					continue;	// already checked this patch in another leaf
+				}
+				check->batchbits |= bit;
 
+				CM_TraceThroughPatch( tw, patch );
+			}
+		}
+	}
+}
 
 /*
 ==================
-CM_Trace
+CM_SplitSegment
+
+Fills in the part of a segment before (near) or after (far) the given
+fraction, using the same math as CM_TraceThroughTree
 ==================
 */
-void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mins, vec3_t maxs,
-						  clipHandle_t model, const vec3_t origin, int brushmask, int capsule, sphere_t *sphere ) {
-	int			i;
-	traceWork_t	tw;
-	vec3_t		offset;
-	cmodel_t	*cmod;
+static void CM_SplitSegment( traceSegment_t *out, const traceSegment_t *in, float frac, qboolean farSide ) {
+	float		midf;
+	vec3_t		mid;
 
-	cmod = CM_ClipHandleToModel( model );
+	midf = in->p1f + (in->p2f - in->p1f)*frac;
 
-	cm.checkcount++;		// for multi-check avoidance
+	mid[0] = in->p1[0] + frac*(in->p2[0] - in->p1[0]);
+	mid[1] = in->p1[1] + frac*(in->p2[1] - in->p1[1]);
+	mid[2] = in->p1[2] + frac*(in->p2[2] - in->p1[2]);
 
-	c_traces++;				// for statistics, may be zeroed
+	*out = *in;
+	if ( farSide ) {
+		out->p1f = midf;
+		VectorCopy( mid, out->p1 );
+	} else {
+		out->p2f = midf;
+		VectorCopy( mid, out->p2 );
+	}
+}
 
-	// fill in a default trace
-	Com_Memset( &tw, 0, sizeof(tw) );
-	tw.trace.fraction = 1;	// assume it goes the entire distance until shown otherwise
-	VectorCopy(origin, tw.modelOrigin);
+/*
+==================
+CM_TraceThroughTreeBatch
+
+Every segment that straddles a node is split in a near and a far part.
+The children are visited as
+  child 0: segments in front, and near parts of straddlers going front first
+  child 1: segments behind, and near parts of straddlers going back first
+  child 1: far parts of straddlers that went front first
+  child 0: far parts of straddlers that went back first
+which keeps the per trace leaf order of CM_TraceThroughTree.
+==================
+*/
+#define	SEG_FRONT		0
+#define	SEG_BACK		1
+#define	SEG_CROSS		2		// | side
 
-	if (!cm.numNodes) {
-		*results = tw.trace;
+static void CM_TraceThroughTreeBatch( traceBatch_t *tb, int num, traceSegment_t **segs, int numSegs ) {
+	cNode_t		*node;
+	cplane_t	*plane;
+	traceSegment_t	*child[MAX_TRACE_BATCH];
+	traceSegment_t	split[MAX_TRACE_BATCH];
+	traceSegment_t	*seg;
+	traceWork_t	*tw;
+	byte		type[MAX_TRACE_BATCH];
+	float		fracs[MAX_TRACE_BATCH], fracs2[MAX_TRACE_BATCH];
+	float		t1, t2, offset;
+	float		frac, frac2;
+	float		idist;
+	int			i, pass, numChild, numSplit;
 
-		return;	// map not loaded, shouldn't happen
+	// if < 0, we are in a leaf node
+	if ( num < 0 ) {
+		CM_TraceThroughLeafBatch( tb, &cm.leafs[-1-num], segs, numSegs );
+		return;
+	}
+
+	node = cm.nodes + num;
+	plane = &node->plane;
+
+	// adjust the plane distance apropriately for mins/maxs
+	if ( plane->type < 3 ) {
+		offset = tb->extents[plane->type];
+	} else if ( tb->isPoint ) {
+		offset = 0;
+	} else {
+		// this is silly
+		offset = 2048;
+	}
+
+	numSplit = 0;
+	for ( i = 0 ; i < numSegs ; i++ ) {
+		seg = segs[i];
+
+		if ( plane->type < 3 ) {
+			t1 = seg->p1[plane->type] - plane->dist;
+			t2 = seg->p2[plane->type] - plane->dist;
+		} else {
+			t1 = DotProduct (plane->normal, seg->p1) - plane->dist;
+			t2 = DotProduct (plane->normal, seg->p2) - plane->dist;
+		}
+
+		// see which sides we need to consider
+		if ( t1 >= offset + 1 && t2 >= offset + 1 ) {
+			type[i] = SEG_FRONT;
+			continue;
+		}
+		if ( t1 < -offset - 1 && t2 < -offset - 1 ) {
+			type[i] = SEG_BACK;
+			continue;
+		}
+
+		// put the crosspoint SURFACE_CLIP_EPSILON pixels on the near side
+		if ( t1 < t2 ) {
+			idist = 1.0/(t1-t2);
+			type[i] = SEG_CROSS | 1;
+			frac2 = (t1 + offset + SURFACE_CLIP_EPSILON)*idist;
+			frac = (t1 - offset + SURFACE_CLIP_EPSILON)*idist;
+		} else if (t1 > t2) {
+			idist = 1.0/(t1-t2);
+			type[i] = SEG_CROSS | 0;
+			frac2 = (t1 - offset - SURFACE_CLIP_EPSILON)*idist;
+			frac = (t1 + offset + SURFACE_CLIP_EPSILON)*idist;
+		} else {
+			type[i] = SEG_CROSS | 0;
+			frac = 1;
+			frac2 = 0;
+		}
+
+		// move up to the node
+		if ( frac < 0 ) {
+			frac = 0;
+		}
+		if ( frac > 1 ) {
+			frac = 1;
+		}
+
+		// go past the node
+		if ( frac2 < 0 ) {
+			frac2 = 0;
+		}
+		if ( frac2 > 1 ) {
+			frac2 = 1;
+		}
+
+		fracs[i] = frac;
+		fracs2[i] = frac2;
+		numSplit++;
+	}
+
+	// segments are dropped right before entering a child once their
+	// trace already hit something nearer, as CM_TraceThroughTree does
+	for ( pass = 0 ; pass < ( numSplit ? 4 : 2 ) ; pass++ ) {
+		numChild = 0;
+		for ( i = 0 ; i < numSegs ; i++ ) {
+			seg = segs[i];
+			tw = &tb->tw[seg->trace];
+			if ( pass < 2 ) {
+				if ( type[i] == pass ) {
+					if ( tw->trace.fraction > seg->p1f ) {
+						child[numChild++] = seg;
+					}
+				} else if ( type[i] == ( SEG_CROSS | pass ) ) {
+					if ( tw->trace.fraction > seg->p1f ) {
+						CM_SplitSegment( &split[i], seg, fracs[i], qfalse );
+						child[numChild++] = &split[i];
+					}
+				}
+			} else if ( type[i] == ( SEG_CROSS | ( pass - 2 ) ) ) {
+				CM_SplitSegment( &split[i], seg, fracs2[i], qtrue );
+				if ( tw->trace.fraction > split[i].p1f ) {
+					child[numChild++] = &split[i];
+				}
+			}
+		}
+		if ( numChild ) {
+			CM_TraceThroughTreeBatch( tb, node->children[ ( pass == 0 || pass == 3 ) ? 0 : 1 ], child, numChild );
+		}
 	}
+}
+
+//======================================================================
+
+
+/*
+==================
+CM_InitTraceWork
+
+Fills in the trace parms shared by single and batched traces
+==================
+*/
+static void CM_InitTraceWork( traceWork_t *tw, cmContext_t *ctx, const vec3_t start, const vec3_t end, vec3_t mins, vec3_t maxs,
+						  const vec3_t origin, int brushmask, int capsule, sphere_t *sphere ) {
+	int			i;
+	vec3_t		offset;
+
+	// fill in a default trace
+	Com_Memset( tw, 0, sizeof(*tw) );
+	tw->ctx = ctx;
+	tw->trace.fraction = 1;	// assume it goes the entire distance until shown otherwise
+	VectorCopy(origin, tw->modelOrigin);
 
 	// allow NULL to be passed in for 0,0,0
 	if ( !mins ) {
@@ -1178,90 +1871,163 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mi
 	}
 
 	// set basic parms
-	tw.contents = brushmask;
+	tw->contents = brushmask;
 
 	// adjust so that mins and maxs are always symetric, which
 	// avoids some complications with plane expanding of rotated
 	// bmodels
 	for ( i = 0 ; i < 3 ; i++ ) {
 		offset[i] = ( mins[i] + maxs[i] ) * 0.5;
-		tw.size[0][i] = mins[i] - offset[i];
-		tw.size[1][i] = maxs[i] - offset[i];
-		tw.start[i] = start[i] + offset[i];
-		tw.end[i] = end[i] + offset[i];
+		tw->size[0][i] = mins[i] - offset[i];
+		tw->size[1][i] = maxs[i] - offset[i];
+		tw->start[i] = start[i] + offset[i];
+		tw->end[i] = end[i] + offset[i];
 	}
 
 	// if a sphere is already specified
 	if ( sphere ) {
-		tw.sphere = *sphere;
+		tw->sphere = *sphere;
 	}
 	else {
-		tw.sphere.use = capsule;
-		tw.sphere.radius = ( tw.size[1][0] > tw.size[1][2] ) ? tw.size[1][2]: tw.size[1][0];
-		tw.sphere.halfheight = tw.size[1][2];
-		VectorSet( tw.sphere.offset, 0, 0, tw.size[1][2] - tw.sphere.radius );
+		tw->sphere.use = capsule;
+		tw->sphere.radius = ( tw->size[1][0] > tw->size[1][2] ) ? tw->size[1][2]: tw->size[1][0];
+		tw->sphere.halfheight = tw->size[1][2];
+		VectorSet( tw->sphere.offset, 0, 0, tw->size[1][2] - tw->sphere.radius );
 	}
 
-	tw.maxOffset = tw.size[1][0] + tw.size[1][1] + tw.size[1][2];
+	tw->maxOffset = tw->size[1][0] + tw->size[1][1] + tw->size[1][2];
 
-	// tw.offsets[signbits] = vector to apropriate corner from origin
-	tw.offsets[0][0] = tw.size[0][0];
-	tw.offsets[0][1] = tw.size[0][1];
-	tw.offsets[0][2] = tw.size[0][2];
+	// tw->offsets[signbits] = vector to apropriate corner from origin
+	tw->offsets[0][0] = tw->size[0][0];
+	tw->offsets[0][1] = tw->size[0][1];
+	tw->offsets[0][2] = tw->size[0][2];
 
-	tw.offsets[1][0] = tw.size[1][0];
-	tw.offsets[1][1] = tw.size[0][1];
-	tw.offsets[1][2] = tw.size[0][2];
+	tw->offsets[1][0] = tw->size[1][0];
+	tw->offsets[1][1] = tw->size[0][1];
+	tw->offsets[1][2] = tw->size[0][2];
 
-	tw.offsets[2][0] = tw.size[0][0];
-	tw.offsets[2][1] = tw.size[1][1];
-	tw.offsets[2][2] = tw.size[0][2];
+	tw->offsets[2][0] = tw->size[0][0];
+	tw->offsets[2][1] = tw->size[1][1];
+	tw->offsets[2][2] = tw->size[0][2];
 
-	tw.offsets[3][0] = tw.size[1][0];
-	tw.offsets[3][1] = tw.size[1][1];
-	tw.offsets[3][2] = tw.size[0][2];
+	tw->offsets[3][0] = tw->size[1][0];
+	tw->offsets[3][1] = tw->size[1][1];
+	tw->offsets[3][2] = tw->size[0][2];
 
-	tw.offsets[4][0] = tw.size[0][0];
-	tw.offsets[4][1] = tw.size[0][1];
-	tw.offsets[4][2] = tw.size[1][2];
+	tw->offsets[4][0] = tw->size[0][0];
+	tw->offsets[4][1] = tw->size[0][1];
+	tw->offsets[4][2] = tw->size[1][2];
 
-	tw.offsets[5][0] = tw.size[1][0];
-	tw.offsets[5][1] = tw.size[0][1];
-	tw.offsets[5][2] = tw.size[1][2];
+	tw->offsets[5][0] = tw->size[1][0];
+	tw->offsets[5][1] = tw->size[0][1];
+	tw->offsets[5][2] = tw->size[1][2];
 
-	tw.offsets[6][0] = tw.size[0][0];
-	tw.offsets[6][1] = tw.size[1][1];
-	tw.offsets[6][2] = tw.size[1][2];
+	tw->offsets[6][0] = tw->size[0][0];
+	tw->offsets[6][1] = tw->size[1][1];
+	tw->offsets[6][2] = tw->size[1][2];
 
-	tw.offsets[7][0] = tw.size[1][0];
-	tw.offsets[7][1] = tw.size[1][1];
-	tw.offsets[7][2] = tw.size[1][2];
+	tw->offsets[7][0] = tw->size[1][0];
+	tw->offsets[7][1] = tw->size[1][1];
+	tw->offsets[7][2] = tw->size[1][2];
 
 	//
 	// calculate bounds
 	//
-	if ( tw.sphere.use ) {
+	if ( tw->sphere.use ) {
 		for ( i = 0 ; i < 3 ; i++ ) {
-			if ( tw.start[i] < tw.end[i] ) {
-				tw.bounds[0][i] = tw.start[i] - fabs(tw.sphere.offset[i]) - tw.sphere.radius;
-				tw.bounds[1][i] = tw.end[i] + fabs(tw.sphere.offset[i]) + tw.sphere.radius;
+			if ( tw->start[i] < tw->end[i] ) {
+				tw->bounds[0][i] = tw->start[i] - fabs(tw->sphere.offset[i]) - tw->sphere.radius;
+				tw->bounds[1][i] = tw->end[i] + fabs(tw->sphere.offset[i]) + tw->sphere.radius;
 			} else {
-				tw.bounds[0][i] = tw.end[i] - fabs(tw.sphere.offset[i]) - tw.sphere.radius;
-				tw.bounds[1][i] = tw.start[i] + fabs(tw.sphere.offset[i]) + tw.sphere.radius;
+				tw->bounds[0][i] = tw->end[i] - fabs(tw->sphere.offset[i]) - tw->sphere.radius;
+				tw->bounds[1][i] = tw->start[i] + fabs(tw->sphere.offset[i]) + tw->sphere.radius;
 			}
 		}
 	}
 	else {
 		for ( i = 0 ; i < 3 ; i++ ) {
-			if ( tw.start[i] < tw.end[i] ) {
-				tw.bounds[0][i] = tw.start[i] + tw.size[0][i];
-				tw.bounds[1][i] = tw.end[i] + tw.size[1][i];
+			if ( tw->start[i] < tw->end[i] ) {
+				tw->bounds[0][i] = tw->start[i] + tw->size[0][i];
+				tw->bounds[1][i] = tw->end[i] + tw->size[1][i];
 			} else {
-				tw.bounds[0][i] = tw.end[i] + tw.size[0][i];
-				tw.bounds[1][i] = tw.start[i] + tw.size[1][i];
+				tw->bounds[0][i] = tw->end[i] + tw->size[0][i];
+				tw->bounds[1][i] = tw->start[i] + tw->size[1][i];
 			}
 		}
 	}
+}
+
+/*
+==================
+CM_InitSweep
+
+Sets up the point special case for a trace that actually moves
+==================
+*/
+static void CM_InitSweep( traceWork_t *tw ) {
+	if ( tw->size[0][0] == 0 && tw->size[0][1] == 0 && tw->size[0][2] == 0 ) {
+		tw->isPoint = qtrue;
+		VectorClear( tw->extents );
+	} else {
+		tw->isPoint = qfalse;
+		tw->extents[0] = tw->size[1][0];
+		tw->extents[1] = tw->size[1][1];
+		tw->extents[2] = tw->size[1][2];
+	}
+}
+
+/*
+==================
+CM_FinishTrace
+==================
+*/
+static void CM_FinishTrace( trace_t *results, traceWork_t *tw, const vec3_t start, const vec3_t end ) {
+	int			i;
+
+	// generate endpos from the original, unmodified start/end
+	if ( tw->trace.fraction == 1 ) {
+		VectorCopy (end, tw->trace.endpos);
+	} else {
+		for ( i=0 ; i<3 ; i++ ) {
+			tw->trace.endpos[i] = start[i] + tw->trace.fraction * (end[i] - start[i]);
+		}
+	}
+
+        // If allsolid is set (was entirely inside something solid), the plane is not valid.
+        // If fraction == 1.0, we never hit anything, and thus the plane is not valid.
+        // Otherwise, the normal on the plane should have unit length
+        assert(tw->trace.allsolid ||
+               tw->trace.fraction == 1.0 ||
+               VectorLengthSquared(tw->trace.plane.normal) > 0.9999);
+	*results = tw->trace;
+}
+
+/*
+==================
+CM_Trace
+==================
+*/
+void CM_Trace( cmContext_t *ctx, trace_t *results, const vec3_t start, const vec3_t end, vec3_t mins, vec3_t maxs,
+						  clipHandle_t model, const vec3_t origin, int brushmask, int capsule, sphere_t *sphere ) {
+	traceWork_t	tw;
+	cmodel_t	*cmod;
+
+	cmod = CM_ContextClipHandleToModel( ctx, model );
+
+	ctx->checkcount++;		// for multi-check avoidance
+
+	c_traces++;				// for statistics, may be zeroed
+
+	if (!cm.numNodes) {
+		// fill in a default trace
+		Com_Memset( &tw, 0, sizeof(tw) );
+		tw.trace.fraction = 1;
+		*results = tw.trace;
+
+		return;	// map not loaded, shouldn't happen
+	}
+
+	CM_InitTraceWork( &tw, ctx, start, end, mins, maxs, origin, brushmask, capsule, sphere );
 
 	//
 	// check for position test special case
@@ -1271,7 +2037,7 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mi
 #ifdef ALWAYS_BBOX_VS_BBOX // FIXME - compile time flag?
 			if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
 				tw.sphere.use = qfalse;
-				CM_TestInLeaf( &tw, &cmod->leaf );
+				CM_TestInBoxModel( &tw );
 			}
 			else
 #elif defined(ALWAYS_CAPSULE_VS_CAPSULE)
@@ -1288,6 +2054,9 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mi
 					CM_TestBoundingBoxInCapsule( &tw, model );
 				}
 			}
+			else if ( model == BOX_MODEL_HANDLE ) {
+				CM_TestInBoxModel( &tw );
+			}
 			else {
 				CM_TestInLeaf( &tw, &cmod->leaf );
 			}
@@ -1298,15 +2067,7 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mi
 		//
 		// check for point special case
 		//
-		if ( tw.size[0][0] == 0 && tw.size[0][1] == 0 && tw.size[0][2] == 0 ) {
-			tw.isPoint = qtrue;
-			VectorClear( tw.extents );
-		} else {
-			tw.isPoint = qfalse;
-			tw.extents[0] = tw.size[1][0];
-			tw.extents[1] = tw.size[1][1];
-			tw.extents[2] = tw.size[1][2];
-		}
+		CM_InitSweep( &tw );
 
 		//
 		// general sweeping through world
@@ -1315,7 +2076,7 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mi
 #ifdef ALWAYS_BBOX_VS_BBOX
 			if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
 				tw.sphere.use = qfalse;
-				CM_TraceThroughLeaf( &tw, &cmod->leaf );
+				CM_TraceThroughBoxModel( &tw );
 			}
 			else
 #elif defined(ALWAYS_CAPSULE_VS_CAPSULE)
@@ -1332,6 +2093,9 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mi
 					CM_TraceBoundingBoxThroughCapsule( &tw, model );
 				}
 			}
+			else if ( model == BOX_MODEL_HANDLE ) {
+				CM_TraceThroughBoxModel( &tw );
+			}
 			else {
 				CM_TraceThroughLeaf( &tw, &cmod->leaf );
 			}
@@ -1340,22 +2104,7 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mi
 		}
 	}
 
-	// generate endpos from the original, unmodified start/end
-	if ( tw.trace.fraction == 1 ) {
-		VectorCopy (end, tw.trace.endpos);
-	} else {
-		for ( i=0 ; i<3 ; i++ ) {
-			tw.trace.endpos[i] = start[i] + tw.trace.fraction * (end[i] - start[i]);
-		}
-	}
-
-        // If allsolid is set (was entirely inside something solid), the plane is not valid.
-        // If fraction == 1.0, we never hit anything, and thus the plane is not valid.
-        // Otherwise, the normal on the plane should have unit length
-        assert(tw.trace.allsolid ||
-               tw.trace.fraction == 1.0 ||
-               VectorLengthSquared(tw.trace.plane.normal) > 0.9999);
-	*results = tw.trace;
+	CM_FinishTrace( results, &tw, start, end );
 }
 
 /*
@@ -1366,7 +2115,108 @@ CM_BoxTrace
 void CM_BoxTrace( trace_t *results, const vec3_t start, const vec3_t end,
 						  vec3_t mins, vec3_t maxs,
 						  clipHandle_t model, int brushmask, int capsule ) {
-	CM_Trace( results, start, end, mins, maxs, model, vec3_origin, brushmask, capsule, NULL );
+	CM_Trace( &cm_mainContext, results, start, end, mins, maxs, model, vec3_origin, brushmask, capsule, NULL );
+
+#ifndef BSPC
+	if ( cm_traceLog ) {
+		CM_RecordTrace( TR_BOXTRACE, 0, results, start, end, mins, maxs, model, brushmask, NULL, NULL, capsule );
+	}
+#endif
+}
+
+/*
+==================
+CM_ContextBoxTrace
+==================
+*/
+void CM_ContextBoxTrace( cmContext_t *ctx, trace_t *results, const vec3_t start, const vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  clipHandle_t model, int brushmask, int capsule ) {
+	CM_Trace( ctx, results, start, end, mins, maxs, model, vec3_origin, brushmask, capsule, NULL );
+}
+
+/*
+==================
+CM_BoxTraceBatch
+
+Traces through the world tree are walked together, anything
+else falls back to a trace per start/end pair.  This pays off for
+bundles of traces that cover the same part of the tree, like shotgun
+pellets or visibility samples, not for unrelated traces.
+==================
+*/
+void CM_BoxTraceBatch( trace_t *results, int numTraces, const vec3_t *starts, const vec3_t *ends,
+						  vec3_t mins, vec3_t maxs,
+						  clipHandle_t model, int brushmask, int capsule ) {
+	traceWork_t		tw[MAX_TRACE_BATCH];
+	traceSegment_t	segs[MAX_TRACE_BATCH];
+	traceSegment_t	*segList[MAX_TRACE_BATCH];
+	traceBatch_t	tb;
+	int				i, count, numSegs;
+
+	if ( model || !cm.numNodes || numTraces == 1 ) {
+		for ( i = 0 ; i < numTraces ; i++ ) {
+			CM_Trace( &cm_mainContext, &results[i], starts[i], ends[i], mins, maxs, model, vec3_origin, brushmask, capsule, NULL );
+#ifndef BSPC
+			// logged as batches of one, which take this path as well
+			if ( cm_traceLog ) {
+				CM_RecordTrace( TR_BATCH, 1, &results[i], starts[i], ends[i], mins, maxs, model, brushmask, NULL, NULL, capsule );
+			}
+#endif
+		}
+		return;
+	}
+
+	for ( ; numTraces > 0 ; numTraces -= count, results += count, starts += count, ends += count ) {
+		count = numTraces > MAX_TRACE_BATCH ? MAX_TRACE_BATCH : numTraces;
+
+		cm_mainContext.checkcount++;
+		tb.tw = tw;
+		tb.ctx = &cm_mainContext;
+		tb.contents = brushmask;
+		tb.checkcount = cm_mainContext.checkcount;
+
+		numSegs = 0;
+		for ( i = 0 ; i < count ; i++ ) {
+			c_traces++;				// for statistics, may be zeroed
+
+			CM_InitTraceWork( &tw[i], &cm_mainContext, starts[i], ends[i], mins, maxs, vec3_origin, brushmask, capsule, NULL );
+
+			// position tests don't walk the tree
+			if ( starts[i][0] == ends[i][0] && starts[i][1] == ends[i][1] && starts[i][2] == ends[i][2] ) {
+				CM_PositionTest( &tw[i] );
+				continue;
+			}
+
+			CM_InitSweep( &tw[i] );
+			tb.isPoint = tw[i].isPoint;
+			VectorCopy( tw[i].extents, tb.extents );
+
+			segList[numSegs] = &segs[numSegs];
+			segs[numSegs].trace = i;
+			segs[numSegs].p1f = 0;
+			segs[numSegs].p2f = 1;
+			VectorCopy( tw[i].start, segs[numSegs].p1 );
+			VectorCopy( tw[i].end, segs[numSegs].p2 );
+			numSegs++;
+		}
+
+		if ( numSegs ) {
+			CM_TraceThroughTreeBatch( &tb, 0, segList, numSegs );
+		}
+
+		for ( i = 0 ; i < count ; i++ ) {
+			CM_FinishTrace( &results[i], &tw[i], starts[i], ends[i] );
+		}
+
+#ifndef BSPC
+		if ( cm_traceLog ) {
+			for ( i = 0 ; i < count ; i++ ) {
+				CM_RecordTrace( TR_BATCH, i ? 0 : count, &results[i], starts[i], ends[i], mins, maxs, model, brushmask, NULL, NULL, capsule );
+			}
+		}
+#endif
+	}
 }
 
 /*
@@ -1381,6 +2231,18 @@ void CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t
 						  vec3_t mins, vec3_t maxs,
 						  clipHandle_t model, int brushmask,
 						  const vec3_t origin, const vec3_t angles, int capsule ) {
+	CM_ContextTransformedBoxTrace( &cm_mainContext, results, start, end, mins, maxs, model, brushmask, origin, angles, capsule );
+}
+
+/*
+==================
+CM_ContextTransformedBoxTrace
+==================
+*/
+void CM_ContextTransformedBoxTrace( cmContext_t *ctx, trace_t *results, const vec3_t start, const vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  clipHandle_t model, int brushmask,
+						  const vec3_t origin, const vec3_t angles, int capsule ) {
 	trace_t		trace;
 	vec3_t		start_l, end_l;
 	qboolean	rotated;
@@ -1451,7 +2313,7 @@ void CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t
 	}
 
 	// sweep the box through the model
-	CM_Trace( &trace, start_l, end_l, symetricSize[0], symetricSize[1], model, origin, brushmask, capsule, &sphere );
+	CM_Trace( ctx, &trace, start_l, end_l, symetricSize[0], symetricSize[1], model, origin, brushmask, capsule, &sphere );
 
 	// if the bmodel was rotated and there was a collision
 	if ( rotated && trace.fraction != 1.0 ) {
@@ -1467,4 +2329,176 @@ void CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t
 	trace.endpos[2] = start[2] + trace.fraction * (end[2] - start[2]);
 
 	*results = trace;
+
+#ifndef BSPC
+	// the file system can't be used from other threads
+	if ( cm_traceLog && ctx == &cm_mainContext ) {
+		CM_RecordTrace( TR_TRANSFORMED, 0, results, start, end, mins, maxs, model, brushmask, origin, angles, capsule );
+	}
+#endif
+}
+
+
+/*
+===============================================================================
+
+TRACE RECORDING
+
+===============================================================================
+*/
+
+#define	TRACE_LOG_BUFFER	256
+
+fileHandle_t			cm_traceLog;
+static int				cm_numBufferedTraces;
+static int				cm_numRecordedTraces;
+static traceRecord_t	cm_traceLogBuffer[TRACE_LOG_BUFFER];
+
+/*
+================
+CM_SwapTraceRecord
+
+Converts between host and log byte order, works both ways
+================
+*/
+void CM_SwapTraceRecord( traceRecord_t *rec ) {
+	int		i;
+
+	for ( i = 0 ; i < sizeof( *rec ) / 4 ; i++ ) {
+		((int *)rec)[i] = LittleLong( ((int *)rec)[i] );
+	}
+}
+
+#ifndef BSPC
+/*
+================
+CM_FlushTraceLog
+================
+*/
+static void CM_FlushTraceLog( void ) {
+	int		i;
+
+	for ( i = 0 ; i < cm_numBufferedTraces ; i++ ) {
+		CM_SwapTraceRecord( &cm_traceLogBuffer[i] );
+	}
+	FS_Write( cm_traceLogBuffer, cm_numBufferedTraces * sizeof( traceRecord_t ), cm_traceLog );
+	cm_numBufferedTraces = 0;
+}
+
+/*
+================
+CM_RecordTrace
+
+Only traces of the main context are recorded
+================
+*/
+void CM_RecordTrace( traceRecordType_t type, int batchSize, const trace_t *results, const vec3_t start, const vec3_t end,
+						  const vec3_t mins, const vec3_t maxs, clipHandle_t model, int brushmask,
+						  const vec3_t origin, const vec3_t angles, int capsule ) {
+	traceRecord_t	*rec;
+
+	rec = &cm_traceLogBuffer[cm_numBufferedTraces];
+	Com_Memset( rec, 0, sizeof( *rec ) );
+
+	rec->type = type;
+	rec->batchSize = batchSize;
+	VectorCopy( start, rec->start );
+	VectorCopy( end, rec->end );
+	if ( mins ) {
+		VectorCopy( mins, rec->mins );
+	}
+	if ( maxs ) {
+		VectorCopy( maxs, rec->maxs );
+	}
+	rec->model = model;
+	rec->brushmask = brushmask;
+	rec->capsule = capsule;
+	if ( origin ) {
+		VectorCopy( origin, rec->origin );
+	}
+	if ( angles ) {
+		VectorCopy( angles, rec->angles );
+	}
+	if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE ) {
+		VectorCopy( cm_mainContext.boxModel.mins, rec->boxMins );
+		VectorCopy( cm_mainContext.boxModel.maxs, rec->boxMaxs );
+	}
+
+	rec->allsolid = results->allsolid;
+	rec->startsolid = results->startsolid;
+	rec->fraction = results->fraction;
+	VectorCopy( results->endpos, rec->endpos );
+	VectorCopy( results->plane.normal, rec->normal );
+	rec->dist = results->plane.dist;
+	rec->surfaceFlags = results->surfaceFlags;
+	rec->contents = results->contents;
+
+	cm_numRecordedTraces++;
+	if ( ++cm_numBufferedTraces == TRACE_LOG_BUFFER ) {
+		CM_FlushTraceLog();
+	}
+}
+
+/*
+================
+CM_BeginTraceRecord
+
+Starts logging the traces made on the loaded map to filename
+================
+*/
+qboolean CM_BeginTraceRecord( const char *filename ) {
+	traceLogHeader_t	header;
+
+	if ( !cm.name[0] ) {
+		Com_Printf( "CM_BeginTraceRecord: no map loaded\n" );
+		return qfalse;
+	}
+
+	CM_EndTraceRecord();
+
+	cm_traceLog = FS_FOpenFileWrite( filename );
+	if ( !cm_traceLog ) {
+		Com_Printf( "CM_BeginTraceRecord: couldn't open %s\n", filename );
+		return qfalse;
+	}
+
+	Com_Memset( &header, 0, sizeof( header ) );
+	header.ident = LittleLong( TRACE_LOG_IDENT );
+	header.version = LittleLong( TRACE_LOG_VERSION );
+	header.checksum = LittleLong( cm.checksum );
+	Q_strncpyz( header.mapname, cm.name, sizeof( header.mapname ) );
+	FS_Write( &header, sizeof( header ), cm_traceLog );
+
+	cm_numBufferedTraces = 0;
+	cm_numRecordedTraces = 0;
+
+	Com_Printf( "recording traces on %s to %s\n", cm.name, filename );
+	return qtrue;
 }
+
+/*
+================
+CM_EndTraceRecord
+================
+*/
+void CM_EndTraceRecord( void ) {
+	if ( !cm_traceLog ) {
+		return;
+	}
+
+	CM_FlushTraceLog();
+	FS_FCloseFile( cm_traceLog );
+	cm_traceLog = 0;
+
+	Com_Printf( "stopped trace recording, %i traces\n", cm_numRecordedTraces );
+}
+
+/*
+================
+CM_TraceRecording
+================
+*/
+qboolean CM_TraceRecording( void ) {
+	return cm_traceLog != 0;
+}
+#endif
@@ -486,40 +486,31 @@ void Cmd_Args_Sanitize(void)
 
 /*
 ============
-Cmd_TokenizeString
+Cmd_TokenizeStringTo
 
 Parses the given string into command line tokens.
-The text is copied to a seperate buffer and 0 characters
+The text is copied to textOut and 0 characters
 are inserted in the apropriate place, The argv array
-will point into this temporary buffer.
+will point into it.  textOut needs room for the text
+and a terminator per token.  Touches no global state,
+so other threads can use it.
 ============
 */
-// NOTE TTimo define that to track tokenization issues
-//#define TKN_DBG
-static void Cmd_TokenizeString2( const char *text_in, qboolean ignoreQuotes ) {
+int Cmd_TokenizeStringTo( const char *text_in, qboolean ignoreQuotes, char **argv, int maxArgs, char *textOut ) {
 	const char	*text;
-	char	*textOut;
+	int		argc;
 
-#ifdef TKN_DBG
-  // FIXME TTimo blunt hook to try to find the tokenization of userinfo
-  Com_DPrintf("Cmd_TokenizeString: %s\n", text_in);
-#endif
-
-	// clear previous args
-	cmd_argc = 0;
+	argc = 0;
 
 	if ( !text_in ) {
-		return;
+		return argc;
 	}
-	
-	Q_strncpyz( cmd_cmd, text_in, sizeof(cmd_cmd) );
 
 	text = text_in;
-	textOut = cmd_tokenized;
 
 	while ( 1 ) {
-		if ( cmd_argc == MAX_STRING_TOKENS ) {
-			return;			// this is usually something malicious
+		if ( argc == maxArgs ) {
+			return argc;			// this is usually something malicious
 		}
 
 		while ( 1 ) {
@@ -528,12 +519,12 @@ static void Cmd_TokenizeString2( const char *text_in, qboolean ignoreQuotes ) {
 				text++;
 			}
 			if ( !*text ) {
-				return;			// all tokens parsed
+				return argc;			// all tokens parsed
 			}
 
 			// skip // comments
 			if ( text[0] == '/' && text[1] == '/' ) {
-				return;			// all tokens parsed
+				return argc;			// all tokens parsed
 			}
 
 			// skip /* */ comments
@@ -542,7 +533,7 @@ static void Cmd_TokenizeString2( const char *text_in, qboolean ignoreQuotes ) {
 					text++;
 				}
 				if ( !*text ) {
-					return;		// all tokens parsed
+					return argc;		// all tokens parsed
 				}
 				text += 2;
 			} else {
@@ -553,23 +544,23 @@ static void Cmd_TokenizeString2( const char *text_in, qboolean ignoreQuotes ) {
 		// handle quoted strings
     // NOTE TTimo this doesn't handle \" escaping
 		if ( !ignoreQuotes && *text == '"' ) {
-			cmd_argv[cmd_argc] = textOut;
-			cmd_argc++;
+			argv[argc] = textOut;
+			argc++;
 			text++;
 			while ( *text && *text != '"' ) {
 				*textOut++ = *text++;
 			}
 			*textOut++ = 0;
 			if ( !*text ) {
-				return;		// all tokens parsed
+				return argc;		// all tokens parsed
 			}
 			text++;
 			continue;
 		}
 
 		// regular token
-		cmd_argv[cmd_argc] = textOut;
-		cmd_argc++;
+		argv[argc] = textOut;
+		argc++;
 
 		// skip until whitespace, quote, or command
 		while ( *text > ' ' ) {
@@ -592,10 +583,36 @@ static void Cmd_TokenizeString2( const char *text_in, qboolean ignoreQuotes ) {
 		*textOut++ = 0;
 
 		if ( !*text ) {
-			return;		// all tokens parsed
+			return argc;		// all tokens parsed
 		}
 	}
+}
+
+/*
+============
+Cmd_TokenizeString2
+
+Tokenizes into cmd_argv, for Cmd_Argc and Cmd_Argv
+============
+*/
+// NOTE TTimo define that to track tokenization issues
+//#define TKN_DBG
+static void Cmd_TokenizeString2( const char *text_in, qboolean ignoreQuotes ) {
+#ifdef TKN_DBG
+  // FIXME TTimo blunt hook to try to find the tokenization of userinfo
+  Com_DPrintf("Cmd_TokenizeString: %s\n", text_in);
+#endif
+
+	// clear previous args
+	cmd_argc = 0;
+
+	if ( !text_in ) {
+		return;
+	}
 	
+	Q_strncpyz( cmd_cmd, text_in, sizeof(cmd_cmd) );
+
+	cmd_argc = Cmd_TokenizeStringTo( text_in, ignoreQuotes, cmd_argv, MAX_STRING_TOKENS, cmd_tokenized );
 }
 
 /*
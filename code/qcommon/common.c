@@ -2994,8 +2994,8 @@ int Com_ModifyMsec( int msec ) {
 	if ( com_dedicated->integer ) {
 		// dedicated servers don't want to clamp for a much longer
 		// period, because it would mess up all the client's views
-		// of time.
-		if (com_sv_running->integer && msec > 500)
+		// of time.  A hibernating one sleeps for longer on purpose.
+		if (com_sv_running->integer && msec > 500 && !SV_Hibernating())
 			Com_Printf( "Hitch warning: %i msec frame time\n", msec );
 
 		clampTime = 5000;
@@ -3045,8 +3045,8 @@ Com_Frame
 */
 void Com_Frame( void ) {
 
-	int		msec, minMsec;
-	int		timeVal, timeValSV;
+	int		msec, minMsec, benchMsec;
+	int		timeVal, timeValSV, wakeTime;
 	static int	lastTime = 0, bias = 0;
  
 	int		timeBeforeFirstEvents;
@@ -3106,25 +3106,44 @@ void Com_Frame( void ) {
 	else
 		minMsec = 1;
 
-	do
+	// a server benchmark runs the frames back to back
+	benchMsec = SV_BenchmarkMsec();
+
+	while(!benchMsec)
 	{
+		// a hibernating server wakes up early when a client connects
+		if(com_dedicated->integer && !com_timedemo->integer)
+			minMsec = SV_FrameMsec();
+
 		if(com_sv_running->integer)
 		{
 			timeValSV = SV_SendQueuedPackets();
 			
 			timeVal = Com_TimeVal(minMsec);
+			wakeTime = com_frameTime + minMsec;
 
 			if(timeValSV < timeVal)
+			{
 				timeVal = timeValSV;
+				wakeTime = Sys_Milliseconds() + timeValSV;
+			}
 		}
 		else
+		{
 			timeVal = Com_TimeVal(minMsec);
+			wakeTime = com_frameTime + minMsec;
+		}
 		
+		// the dedicated server wakes up right at the frame instead
+		// of a millisecond early to make up for NET_Sleep rounding
 		if(com_busyWait->integer || timeVal < 1)
 			NET_Sleep(0);
-		else
+		else if(!com_dedicated->integer || !NET_SleepUntil(wakeTime))
 			NET_Sleep(timeVal - 1);
-	} while(Com_TimeVal(minMsec));
+
+		if(!Com_TimeVal(minMsec))
+			break;
+	}
 	
 	lastTime = com_frameTime;
 	com_frameTime = Com_EventLoop();
@@ -3140,7 +3159,10 @@ void Com_Frame( void ) {
 	}
 
 	// mess with msec if needed
-	msec = Com_ModifyMsec(msec);
+	if(benchMsec)
+		msec = benchMsec;
+	else
+		msec = Com_ModifyMsec(msec);
 
 	//
 	// server side
@@ -760,6 +760,64 @@ long FS_SV_FOpenFileRead(const char *filename, fileHandle_t *fp)
 	return -1;
 }
 
+/*
+===========
+FS_SV_MapFile
+
+Maps the file FS_SV_FOpenFileRead would read into memory, read only.
+Returns the length, or -1 if it wasn't found or couldn't be mapped
+===========
+*/
+long FS_SV_MapFile( const char *filename, const byte **data ) {
+	fileHandle_t	f;
+	long			len;
+
+	*data = NULL;
+
+	len = FS_SV_FOpenFileRead( filename, &f );
+	if ( !f ) {
+		return -1;
+	}
+
+	*data = Sys_MapFile( fsh[f].handleFiles.file.o, len );
+	FS_FCloseFile( f );
+
+	if ( !*data ) {
+		return -1;
+	}
+	return len;
+}
+
+/*
+===========
+FS_SV_FileTime
+
+Returns the modification time of the file FS_SV_FOpenFileRead would open
+and its length in *length, or -1 if there's none
+===========
+*/
+int FS_SV_FileTime( const char *filename, long *length ) {
+	char	*ospath;
+	int		mtime;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	ospath = FS_BuildOSPath( fs_homepath->string, filename, "" );
+	ospath[strlen(ospath)-1] = '\0';
+
+	mtime = Sys_FileTime( ospath, length );
+	if ( mtime == -1 && Q_stricmp( fs_homepath->string, fs_basepath->string ) ) {
+		ospath = FS_BuildOSPath( fs_basepath->string, filename, "" );
+		ospath[strlen(ospath)-1] = '\0';
+
+		mtime = Sys_FileTime( ospath, length );
+	}
+
+	return mtime;
+}
+
 
 /*
 ===========
@@ -27,16 +27,30 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "q_shared.h"
 #include "qcommon.h"
 
+// bit position of Huff_Compress and Huff_Decompress, the offset functions
+// only use the offset they are given so messages can be written and read
+// from several threads at once
 static int			bloc = 0;
 
-void	Huff_putBit( int bit, byte *fout, int *offset) {
-	bloc = *offset;
-	if ((bloc&7) == 0) {
-		fout[(bloc>>3)] = 0;
+/* Add a bit to the output file (buffered) */
+static void add_bit (char bit, byte *fout, int *offset) {
+	if ((*offset&7) == 0) {
+		fout[(*offset>>3)] = 0;
 	}
-	fout[(bloc>>3)] |= bit << (bloc&7);
-	bloc++;
-	*offset = bloc;
+	fout[(*offset>>3)] |= bit << (*offset&7);
+	(*offset)++;
+}
+
+/* Receive one bit from the input file (buffered) */
+static int get_bit (byte *fin, int *offset) {
+	int t;
+	t = (fin[(*offset>>3)] >> (*offset&7)) & 0x1;
+	(*offset)++;
+	return t;
+}
+
+void	Huff_putBit( int bit, byte *fout, int *offset) {
+	add_bit( (char)bit, fout, offset );
 }
 
 int		Huff_getBloc(void)
@@ -50,29 +64,47 @@ void	Huff_setBloc(int _bloc)
 }
 
 int		Huff_getBit( byte *fin, int *offset) {
-	int t;
-	bloc = *offset;
-	t = (fin[(bloc>>3)] >> (bloc&7)) & 0x1;
-	bloc++;
-	*offset = bloc;
-	return t;
+	return get_bit( fin, offset );
 }
 
-/* Add a bit to the output file (buffered) */
-static void add_bit (char bit, byte *fout) {
-	if ((bloc&7) == 0) {
-		fout[(bloc>>3)] = 0;
+/* Add count bits at once, the first one lowest */
+static void put_bits (unsigned int bits, int count, byte *fout, int *offset) {
+	byte		*out;
+	int			shift, bytes, i;
+	uint64_t	v;
+
+	out = fout + (*offset>>3);
+	shift = *offset&7;
+	bytes = (shift + count + 7) >> 3;
+	v = (uint64_t)bits << shift;
+
+	// a byte is cleared when its first bit is written, like add_bit does
+	out[0] = (out[0] & ((1<<shift) - 1)) | (byte)v;
+	for (i = 1; i < bytes; i++) {
+		out[i] = (byte)(v >> (i*8));
 	}
-	fout[(bloc>>3)] |= bit << (bloc&7);
-	bloc++;
+	(*offset) += count;
 }
 
-/* Receive one bit from the input file (buffered) */
-static int get_bit (byte *fin) {
-	int t;
-	t = (fin[(bloc>>3)] >> (bloc&7)) & 0x1;
-	bloc++;
-	return t;
+void	Huff_putBits( int bits, int count, byte *fout, int *offset ) {
+	put_bits( bits & ((1<<count) - 1), count, fout, offset );
+}
+
+int		Huff_getBits( byte *fin, int count, int *offset ) {
+	byte		*in;
+	int			shift, bytes, i;
+	unsigned int	v;
+
+	in = fin + (*offset>>3);
+	shift = *offset&7;
+	bytes = (shift + count + 7) >> 3;
+
+	v = 0;
+	for (i = 0; i < bytes; i++) {
+		v |= in[i] << (i*8);
+	}
+	(*offset) += count;
+	return (v >> shift) & ((1<<count) - 1);
 }
 
 static node_t **get_ppnode(huff_t* huff) {
@@ -265,7 +297,7 @@ void Huff_addRef(huff_t* huff, byte ch) {
 /* Get a symbol */
 int Huff_Receive (node_t *node, int *ch, byte *fin) {
 	while (node && node->symbol == INTERNAL_NODE) {
-		if (get_bit(fin)) {
+		if (get_bit(fin, &bloc)) {
 			node = node->right;
 		} else {
 			node = node->left;
@@ -280,9 +312,11 @@ int Huff_Receive (node_t *node, int *ch, byte *fin) {
 
 /* Get a symbol */
 void Huff_offsetReceive (node_t *node, int *ch, byte *fin, int *offset) {
-	bloc = *offset;
+	int		bit;
+
+	bit = *offset;
 	while (node && node->symbol == INTERNAL_NODE) {
-		if (get_bit(fin)) {
+		if (get_bit(fin, &bit)) {
 			node = node->right;
 		} else {
 			node = node->left;
@@ -294,19 +328,19 @@ void Huff_offsetReceive (node_t *node, int *ch, byte *fin, int *offset) {
 //		Com_Error(ERR_DROP, "Illegal tree!");
 	}
 	*ch = node->symbol;
-	*offset = bloc;
+	*offset = bit;
 }
 
 /* Send the prefix code for this node */
-static void send(node_t *node, node_t *child, byte *fout) {
+static void send(node_t *node, node_t *child, byte *fout, int *offset) {
 	if (node->parent) {
-		send(node->parent, node, fout);
+		send(node->parent, node, fout, offset);
 	}
 	if (child) {
 		if (node->right == child) {
-			add_bit(1, fout);
+			add_bit(1, fout, offset);
 		} else {
-			add_bit(0, fout);
+			add_bit(0, fout, offset);
 		}
 	}
 }
@@ -318,17 +352,118 @@ void Huff_transmit (huff_t *huff, int ch, byte *fout) {
 		/* node_t hasn't been transmitted, send a NYT, then the symbol */
 		Huff_transmit(huff, NYT, fout);
 		for (i = 7; i >= 0; i--) {
-			add_bit((char)((ch >> i) & 0x1), fout);
+			add_bit((char)((ch >> i) & 0x1), fout, &bloc);
 		}
 	} else {
-		send(huff->loc[ch], NULL, fout);
+		send(huff->loc[ch], NULL, fout, &bloc);
 	}
 }
 
 void Huff_offsetTransmit (huff_t *huff, int ch, byte *fout, int *offset) {
-	bloc = *offset;
-	send(huff->loc[ch], NULL, fout);
-	*offset = bloc;
+	send(huff->loc[ch], NULL, fout, offset);
+}
+
+/* Make the tables for a tree that isn't updated anymore */
+void Huff_BuildTables( huff_t *huff, huffTables_t *tables ) {
+	huffCode_t		*code;
+	huffLookup_t	*entry;
+	node_t			*node;
+	int				i, length;
+
+	// the code of every symbol, collected from the leaf up
+	for (i = 0; i < HMAX+1; i++) {
+		code = &tables->codes[i];
+		code->node = huff->loc[i];
+		code->code = 0;
+		code->length = 0;
+
+		for (node = code->node; node && node->parent; node = node->parent) {
+			if (code->length == 32) {
+				code->length = 0;		// send from the node instead
+				break;
+			}
+			code->code = (code->code << 1) | (node->parent->right == node);
+			code->length++;
+		}
+	}
+
+	// what every combination of the next HUFF_LOOKUP_BITS bits starts with
+	for (i = 0; i < (1<<HUFF_LOOKUP_BITS); i++) {
+		entry = &tables->lookup[i];
+
+		node = huff->tree;
+		for (length = 0; length < HUFF_LOOKUP_BITS && node && node->symbol == INTERNAL_NODE; length++) {
+			node = ((i >> length) & 1) ? node->right : node->left;
+		}
+
+		entry->node = node;
+		if (!node) {
+			// Huff_offsetReceive gives 0 and doesn't move on
+			entry->symbol = 0;
+			entry->length = 0;
+		} else {
+			entry->symbol = node->symbol;
+			entry->length = length;
+		}
+	}
+}
+
+/* Send a symbol with the tables */
+void Huff_tableTransmit( const huffTables_t *tables, int ch, byte *fout, int *offset ) {
+	const huffCode_t	*code = &tables->codes[ch];
+
+	if (code->length) {
+		put_bits(code->code, code->length, fout, offset);
+	} else {
+		send(code->node, NULL, fout, offset);
+	}
+}
+
+/* Get a symbol with the tables, size is how many bytes fin has */
+void Huff_tableReceive( const huffTables_t *tables, int *ch, byte *fin, int *offset, int size ) {
+	const huffLookup_t	*entry;
+	node_t		*node;
+	unsigned int	peek;
+	int			i, bit;
+
+	i = *offset>>3;
+	if (i + 2 < size) {
+		peek = fin[i] | (fin[i+1] << 8) | (fin[i+2] << 16);
+	} else {
+		// bits past the end read as zero
+		peek = 0;
+		if (i < size) {
+			peek |= fin[i];
+		}
+		if (i + 1 < size) {
+			peek |= fin[i+1] << 8;
+		}
+	}
+	peek >>= *offset&7;
+
+	entry = &tables->lookup[peek & ((1<<HUFF_LOOKUP_BITS) - 1)];
+	if (entry->symbol != INTERNAL_NODE) {
+		*ch = entry->symbol;
+		*offset += entry->length;
+		return;
+	}
+
+	// a longer code, go on from where the lookup ends
+	bit = *offset + HUFF_LOOKUP_BITS;
+	node = entry->node;
+	while (node && node->symbol == INTERNAL_NODE) {
+		if (get_bit(fin, &bit)) {
+			node = node->right;
+		} else {
+			node = node->left;
+		}
+	}
+	if (!node) {
+		*ch = 0;
+		return;
+	}
+	*ch = node->symbol;
+	*offset = bit;
 }
 
 void Huff_Decompress(msg_t *mbuf, int offset) {
@@ -371,7 +506,7 @@ void Huff_Decompress(msg_t *mbuf, int offset) {
 		if ( ch == NYT ) {								/* We got a NYT, get the symbol associated with it */
 			ch = 0;
 			for ( i = 0; i < 8; i++ ) {
-				ch = (ch<<1) + get_bit(buffer);
+				ch = (ch<<1) + get_bit(buffer, &bloc);
 			}
 		}
     
@@ -23,6 +23,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "qcommon.h"
 
 static huffman_t		msgHuff;
+static huffTables_t		msgHuffTables;		// for msgHuff, which stays the same
+static int				msgHuffMaxLength;	// bits of its longest code
 
 static qboolean			msgInit = qfalse;
 
@@ -139,6 +141,16 @@ void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 	if ( bits < 0 ) {
 		bits = -bits;
 	}
+	if ( msg->coder ) {
+		if ( msg->maxsize - msg->cursize < RANGE_MAX_SYMBOL_BYTES ) {
+			msg->overflowed = qtrue;
+			return;
+		}
+		Range_EncodeBits( msg->coder, value, bits );
+		msg->cursize = Range_EncodedSize( msg->coder );
+		msg->bit = msg->cursize << 3;
+		return;
+	}
 	if (msg->oob) {
 		if(bits==8)
 		{
@@ -168,16 +180,14 @@ void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 		if (bits&7) {
 			int nbits;
 			nbits = bits&7;
-			for(i=0;i<nbits;i++) {
-				Huff_putBit((value&1), msg->data, &msg->bit);
-				value = (value>>1);
-			}
+			Huff_putBits(value, nbits, msg->data, &msg->bit);
+			value = (value>>nbits);
 			bits = bits - nbits;
 		}
 		if (bits) {
 			for(i=0;i<bits;i+=8) {
 //				fwrite(bp, 1, 1, fp);
-				Huff_offsetTransmit (&msgHuff.compressor, (value&0xff), msg->data, &msg->bit);
+				Huff_tableTransmit (&msgHuffTables, (value&0xff), msg->data, &msg->bit);
 				value = (value>>8);
 			}
 		}
@@ -186,11 +196,46 @@ void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 	}
 }
 
+/*
+============
+MSG_WriteBitString
+
+Appends bits that were already written to another huffman message,
+starting from its first bit.  The result is the same as repeating the
+writes that produced them, as long as the caller made sure the message
+has room for them, which isn't checked here.  Range coded bits depend
+on everything coded before them, so they can't be copied like this.
+============
+*/
+void MSG_WriteBitString( msg_t *msg, const byte *data, int bits ) {
+	byte	*out;
+	int		shift;
+	int		i, bytes;
+
+	out = msg->data + ( msg->bit >> 3 );
+	shift = msg->bit & 7;
+	bytes = ( bits + 7 ) >> 3;
+
+	if ( !shift ) {
+		Com_Memcpy( out, data, bytes );
+	} else {
+		// bits past the end of data are zero, like the ones huffman leaves
+		for ( i = 0 ; i < bytes ; i++ ) {
+			out[i] |= data[i] << shift;
+			out[i+1] = data[i] >> ( 8 - shift );
+		}
+	}
+
+	msg->bit += bits;
+	msg->cursize = ( msg->bit >> 3 ) + 1;
+}
+
 int MSG_ReadBits( msg_t *msg, int bits ) {
 	int			value;
 	int			get;
 	qboolean	sgn;
 	int			i, nbits;
+	int			width;
 //	FILE*	fp;
 
 	value = 0;
@@ -202,7 +247,21 @@ int MSG_ReadBits( msg_t *msg, int bits ) {
 		sgn = qfalse;
 	}
 
-	if (msg->oob) {
+	width = bits;
+
+	if ( msg->coder ) {
+		value = Range_DecodeBits( msg->coder, bits );
+		msg->readcount = msg->coder->pos;
+		if ( msg->readcount > msg->cursize ) {
+			// the coding may leave off up to four zero bytes
+			if ( msg->readcount - msg->cursize <= 4 ) {
+				msg->readcount = msg->cursize;
+			} else {
+				msg->readcount = msg->cursize + 1;
+			}
+		}
+		msg->bit = msg->readcount << 3;
+	} else if (msg->oob) {
 		if(bits==8)
 		{
 			value = msg->data[msg->readcount];
@@ -230,15 +289,13 @@ int MSG_ReadBits( msg_t *msg, int bits ) {
 		nbits = 0;
 		if (bits&7) {
 			nbits = bits&7;
-			for(i=0;i<nbits;i++) {
-				value |= (Huff_getBit(msg->data, &msg->bit)<<i);
-			}
+			value = Huff_getBits(msg->data, nbits, &msg->bit);
 			bits = bits - nbits;
 		}
 		if (bits) {
 //			fp = fopen("c:\\netchan.bin", "a");
 			for(i=0;i<bits;i+=8) {
-				Huff_offsetReceive (msgHuff.decompressor.tree, &get, msg->data, &msg->bit);
+				Huff_tableReceive (&msgHuffTables, &get, msg->data, &msg->bit, msg->maxsize);
 //				fwrite(&get, 1, 1, fp);
 				value |= (get<<(i+nbits));
 			}
@@ -246,6 +303,9 @@ int MSG_ReadBits( msg_t *msg, int bits ) {
 		}
 		msg->readcount = (msg->bit>>3)+1;
 	}
+	if ( msg->readCopy ) {
+		MSG_WriteBits( msg->readCopy, value, width );
+	}
 	if ( sgn ) {
 		if ( value & ( 1 << ( bits - 1 ) ) ) {
 			value |= -1 ^ ( ( 1 << bits ) - 1 );
@@ -255,7 +315,425 @@ int MSG_ReadBits( msg_t *msg, int bits ) {
 	return value;
 }
 
+/*
+============
+MSG_StartRangeCoding
+
+The model of the coder is what the reading side starts from too
+============
+*/
+void MSG_StartRangeCoding( msg_t *msg, rangeCoder_t *coder ) {
+	Range_StartEncoding( coder, msg->data, msg->maxsize, msg->cursize );
+	msg->coder = coder;
+	msg->cursize = Range_EncodedSize( coder );
+	msg->bit = msg->cursize << 3;
+}
+
+/*
+============
+MSG_FinishRangeCoding
 
+Nothing more can be written after it
+============
+*/
+void MSG_FinishRangeCoding( msg_t *msg ) {
+	if ( !msg->coder ) {
+		return;
+	}
+
+	msg->cursize = Range_FinishEncoding( msg->coder );
+	msg->bit = msg->cursize << 3;
+	msg->coder = NULL;
+}
+
+/*
+============
+MSG_StartRangeDecoding
+============
+*/
+void MSG_StartRangeDecoding( msg_t *msg, rangeCoder_t *coder ) {
+	Range_StartDecoding( coder, msg->data, msg->cursize, msg->readcount );
+	msg->coder = coder;
+	msg->bit = msg->readcount << 3;
+}
+
+/*
+=============================================================================
+
+bit accumulators
+
+The delta functions write and read many small fields in a row.  Instead
+of going through the msg_t for every one like MSG_WriteBits and
+MSG_ReadBits, they keep the bits in a 64 bit accumulator and only store
+or load them a word at a time.  The bits and their huffman coding are
+the same, so are the bytes of the message.
+
+=============================================================================
+*/
+
+typedef struct {
+	msg_t		*msg;
+	qboolean	direct;		// use MSG_WriteBits, for near the end of the message
+	byte		*out;		// where the next word goes
+	uint64_t	bits;		// not stored yet, the first one lowest
+	int			count;
+} msgWriter_t;
+
+typedef struct {
+	msg_t		*msg;
+	qboolean	direct;		// use MSG_ReadBits, for cl_shownet
+	const byte	*in;		// the next byte to load
+	const byte	*end;
+	uint64_t	bits;		// loaded and not read yet, the first one lowest
+	int			count;
+	int			bit;		// in the message of the first one of bits
+} msgReader_t;
+
+/*
+============
+MSG_StartWriting
+
+maxBits is the most bits before huffman coding that will be written.
+Writes that might run into the end of the message go through
+MSG_WriteBits, so it can mark the message overflowed as always.
+============
+*/
+static void MSG_StartWriting( msgWriter_t *w, msg_t *msg, int maxBits ) {
+	int		shift;
+
+	w->msg = msg;
+	w->direct = msg->oob || msg->coder || msg->maxsize - msg->cursize < 4 + ( maxBits * msgHuffMaxLength + 7 ) / 8;
+	if ( w->direct ) {
+		return;
+	}
+
+	// a byte is cleared when its first bit is written, like Huff_putBit does
+	shift = msg->bit & 7;
+	w->out = msg->data + ( msg->bit >> 3 );
+	w->bits = w->out[0] & ( ( 1 << shift ) - 1 );
+	w->count = shift;
+}
+
+/*
+============
+MSG_FinishWriting
+============
+*/
+static void MSG_FinishWriting( msgWriter_t *w ) {
+	int		i;
+
+	if ( w->direct ) {
+		return;
+	}
+
+	for ( i = 0 ; i < w->count ; i += 8 ) {
+		w->out[i >> 3] = (byte)( w->bits >> i );
+	}
+
+	w->msg->bit = ( w->out - w->msg->data ) * 8 + w->count;
+	w->msg->cursize = ( w->msg->bit >> 3 ) + 1;
+}
+
+/*
+============
+MSG_PutBits
+
+Up to 32 bits
+============
+*/
+static ID_INLINE void MSG_PutBits( msgWriter_t *w, unsigned int value, int count ) {
+	w->bits |= (uint64_t)value << w->count;
+	w->count += count;
+
+	if ( w->count >= 32 ) {
+		w->out[0] = (byte)w->bits;
+		w->out[1] = (byte)( w->bits >> 8 );
+		w->out[2] = (byte)( w->bits >> 16 );
+		w->out[3] = (byte)( w->bits >> 24 );
+		w->out += 4;
+		w->bits >>= 32;
+		w->count -= 32;
+	}
+}
+
+/*
+============
+MSG_WriterBits
+
+MSG_WriteBits through the accumulator
+============
+*/
+static void MSG_WriterBits( msgWriter_t *w, int value, int bits ) {
+	const huffCode_t	*code;
+	unsigned int		v;
+	int					nbits;
+
+	if ( w->direct ) {
+		MSG_WriteBits( w->msg, value, bits );
+		return;
+	}
+
+	if ( bits < 0 ) {
+		bits = -bits;
+	}
+	v = value & ( 0xffffffff >> ( 32 - bits ) );
+
+	nbits = bits & 7;
+	if ( nbits ) {
+		MSG_PutBits( w, v & ( ( 1 << nbits ) - 1 ), nbits );
+		v >>= nbits;
+		bits -= nbits;
+	}
+
+	for ( ; bits > 0 ; bits -= 8, v >>= 8 ) {
+		code = &msgHuffTables.codes[v & 0xff];
+		if ( code->length ) {
+			MSG_PutBits( w, code->code, code->length );
+		} else {
+			// too long for the accumulator, send it from the tree
+			MSG_FinishWriting( w );
+			Huff_tableTransmit( &msgHuffTables, v & 0xff, w->msg->data, &w->msg->bit );
+			w->msg->cursize = ( w->msg->bit >> 3 ) + 1;
+			MSG_StartWriting( w, w->msg, 0 );
+		}
+	}
+}
+
+/*
+============
+MSG_WriterFlags
+
+A few single bits, the first lowest, written together
+============
+*/
+static ID_INLINE void MSG_WriterFlags( msgWriter_t *w, int flags, int count ) {
+	int		i;
+
+	if ( w->direct ) {
+		// one at a time, so an overflow is noticed where it always was
+		for ( i = 0 ; i < count ; i++ ) {
+			MSG_WriteBits( w->msg, ( flags >> i ) & 1, 1 );
+		}
+		return;
+	}
+
+	MSG_PutBits( w, flags, count );
+}
+
+/*
+============
+MSG_StartReading
+============
+*/
+static void MSG_StartReading( msgReader_t *r, msg_t *msg, qboolean direct ) {
+	r->msg = msg;
+	r->direct = direct || msg->oob || msg->coder || msg->readCopy;
+	if ( r->direct ) {
+		return;
+	}
+
+	r->in = msg->data + ( msg->bit >> 3 );
+	r->end = msg->data + msg->maxsize;
+	r->bits = 0;
+	r->count = 0;
+	r->bit = msg->bit;
+
+	// without the bits of the first byte that were read already
+	if ( r->in < r->end ) {
+		r->bits = *r->in >> ( msg->bit & 7 );
+	}
+	r->in++;
+	r->count = 8 - ( msg->bit & 7 );
+}
+
+/*
+============
+MSG_FinishReading
+============
+*/
+static void MSG_FinishReading( msgReader_t *r ) {
+	if ( r->direct ) {
+		return;
+	}
+
+	r->msg->bit = r->bit;
+	r->msg->readcount = ( r->bit >> 3 ) + 1;
+}
+
+/*
+============
+MSG_FillBits
+
+Makes sure at least 32 bits are loaded, bits past the end of the buffer
+read as zero
+============
+*/
+static ID_INLINE void MSG_FillBits( msgReader_t *r ) {
+	if ( r->count >= 32 ) {
+		return;
+	}
+
+	if ( r->end - r->in >= 4 ) {
+		r->bits |= (uint64_t)( r->in[0] | ( r->in[1] << 8 ) | ( r->in[2] << 16 ) |
+			( (unsigned int)r->in[3] << 24 ) ) << r->count;
+		r->in += 4;
+		r->count += 32;
+		return;
+	}
+
+	while ( r->count < 32 ) {
+		if ( r->in < r->end ) {
+			r->bits |= (uint64_t)*r->in << r->count;
+		}
+		r->in++;
+		r->count += 8;
+	}
+}
+
+/*
+============
+MSG_TakeBits
+
+Up to 32 bits
+============
+*/
+static ID_INLINE unsigned int MSG_TakeBits( msgReader_t *r, int count ) {
+	unsigned int	value;
+
+	MSG_FillBits( r );
+	value = (unsigned int)r->bits & ( 0xffffffff >> ( 32 - count ) );
+	r->bits >>= count;
+	r->count -= count;
+	r->bit += count;
+
+	return value;
+}
+
+/*
+============
+MSG_ReaderSymbol
+============
+*/
+static int MSG_ReaderSymbol( msgReader_t *r ) {
+	const huffLookup_t	*entry;
+	int					ch;
+
+	MSG_FillBits( r );
+	entry = &msgHuffTables.lookup[r->bits & ( ( 1 << HUFF_LOOKUP_BITS ) - 1 )];
+	if ( entry->symbol != INTERNAL_NODE ) {
+		r->bits >>= entry->length;
+		r->count -= entry->length;
+		r->bit += entry->length;
+		return entry->symbol;
+	}
+
+	// longer than the lookup, go on in the tree
+	MSG_FinishReading( r );
+	Huff_tableReceive( &msgHuffTables, &ch, r->msg->data, &r->msg->bit, r->msg->maxsize );
+	MSG_StartReading( r, r->msg, qfalse );
+
+	return ch;
+}
+
+/*
+============
+MSG_ReaderBits
+
+MSG_ReadBits through the accumulator
+============
+*/
+static int MSG_ReaderBits( msgReader_t *r, int bits ) {
+	int			value;
+	qboolean	sgn;
+	int			i, nbits;
+
+	if ( r->direct ) {
+		return MSG_ReadBits( r->msg, bits );
+	}
+
+	if ( bits < 0 ) {
+		bits = -bits;
+		sgn = qtrue;
+	} else {
+		sgn = qfalse;
+	}
+
+	value = 0;
+	nbits = bits & 7;
+	if ( nbits ) {
+		value = MSG_TakeBits( r, nbits );
+		bits -= nbits;
+	}
+	for ( i = 0 ; i < bits ; i += 8 ) {
+		value |= MSG_ReaderSymbol( r ) << ( i + nbits );
+	}
+
+	if ( sgn ) {
+		if ( value & ( 1 << ( bits - 1 ) ) ) {
+			value |= -1 ^ ( ( 1 << bits ) - 1 );
+		}
+	}
+
+	return value;
+}
+
+/*
+============
+MSG_ReaderFlag
+
+A single bit, which is always sent raw
+============
+*/
+static ID_INLINE int MSG_ReaderFlag( msgReader_t *r ) {
+	if ( r->direct ) {
+		return MSG_ReadBits( r->msg, 1 );
+	}
+	return MSG_TakeBits( r, 1 );
+}
+
+/*
+============
+MSG_ReaderPastEnd
+
+Whether the reads went past cursize, for the -1 of MSG_ReadByte and friends
+============
+*/
+static qboolean MSG_ReaderPastEnd( msgReader_t *r ) {
+	if ( r->direct ) {
+		return r->msg->readcount > r->msg->cursize;
+	}
+	return ( r->bit >> 3 ) + 1 > r->msg->cursize;
+}
+
+static int MSG_ReaderByte( msgReader_t *r ) {
+	int	c;
+
+	c = (unsigned char)MSG_ReaderBits( r, 8 );
+	if ( MSG_ReaderPastEnd( r ) ) {
+		c = -1;
+	}
+	return c;
+}
+
+static int MSG_ReaderShort( msgReader_t *r ) {
+	int	c;
+
+	c = (short)MSG_ReaderBits( r, 16 );
+	if ( MSG_ReaderPastEnd( r ) ) {
+		c = -1;
+	}
+	return c;
+}
+
+static int MSG_ReaderLong( msgReader_t *r ) {
+	int	c;
+
+	c = MSG_ReaderBits( r, 32 );
+	if ( MSG_ReaderPastEnd( r ) ) {
+		c = -1;
+	}
+	return c;
+}
 
 //================================================================================
 
@@ -776,59 +1254,67 @@ typedef struct {
 // using the stringizing operator to save typing...
 #define	NETF(x) #x,(size_t)&((entityState_t*)0)->x
 
+// the fields in the order they are sent and their bits, 0 for a float.
+// Both the table and the unrolled delta functions below are expanded
+// from this, so they can't disagree.
+#define	ENTITY_STATE_FIELDS \
+	FIELD( pos.trTime, 32 ) \
+	FIELD( pos.trBase[0], 0 ) \
+	FIELD( pos.trBase[1], 0 ) \
+	FIELD( pos.trDelta[0], 0 ) \
+	FIELD( pos.trDelta[1], 0 ) \
+	FIELD( pos.trBase[2], 0 ) \
+	FIELD( apos.trBase[1], 0 ) \
+	FIELD( pos.trDelta[2], 0 ) \
+	FIELD( apos.trBase[0], 0 ) \
+	FIELD( event, 10 ) \
+	FIELD( angles2[1], 0 ) \
+	FIELD( eType, 8 ) \
+	FIELD( torsoAnim, 8 ) \
+	FIELD( eventParm, 8 ) \
+	FIELD( legsAnim, 8 ) \
+	FIELD( groundEntityNum, GENTITYNUM_BITS ) \
+	FIELD( pos.trType, 8 ) \
+	FIELD( eFlags, 19 ) \
+	FIELD( otherEntityNum, GENTITYNUM_BITS ) \
+	FIELD( weapon, 8 ) \
+	FIELD( clientNum, 8 ) \
+	FIELD( angles[1], 0 ) \
+	FIELD( pos.trDuration, 32 ) \
+	FIELD( apos.trType, 8 ) \
+	FIELD( origin[0], 0 ) \
+	FIELD( origin[1], 0 ) \
+	FIELD( origin[2], 0 ) \
+	FIELD( solid, 24 ) \
+	FIELD( powerups, MAX_POWERUPS ) \
+	FIELD( modelindex, 8 ) \
+	FIELD( otherEntityNum2, GENTITYNUM_BITS ) \
+	FIELD( loopSound, 8 ) \
+	FIELD( generic1, 8 ) \
+	FIELD( origin2[2], 0 ) \
+	FIELD( origin2[0], 0 ) \
+	FIELD( origin2[1], 0 ) \
+	FIELD( modelindex2, 8 ) \
+	FIELD( angles[0], 0 ) \
+	FIELD( time, 32 ) \
+	FIELD( apos.trTime, 32 ) \
+	FIELD( apos.trDuration, 32 ) \
+	FIELD( apos.trBase[2], 0 ) \
+	FIELD( apos.trDelta[0], 0 ) \
+	FIELD( apos.trDelta[1], 0 ) \
+	FIELD( apos.trDelta[2], 0 ) \
+	FIELD( time2, 32 ) \
+	FIELD( angles[2], 0 ) \
+	FIELD( angles2[0], 0 ) \
+	FIELD( angles2[2], 0 ) \
+	FIELD( constantLight, 32 ) \
+	FIELD( frame, 16 )
+
 netField_t	entityStateFields[] = 
 {
-{ NETF(pos.trTime), 32 },
-{ NETF(pos.trBase[0]), 0 },
-{ NETF(pos.trBase[1]), 0 },
-{ NETF(pos.trDelta[0]), 0 },
-{ NETF(pos.trDelta[1]), 0 },
-{ NETF(pos.trBase[2]), 0 },
-{ NETF(apos.trBase[1]), 0 },
-{ NETF(pos.trDelta[2]), 0 },
-{ NETF(apos.trBase[0]), 0 },
-{ NETF(event), 10 },
-{ NETF(angles2[1]), 0 },
-{ NETF(eType), 8 },
-{ NETF(torsoAnim), 8 },
-{ NETF(eventParm), 8 },
-{ NETF(legsAnim), 8 },
-{ NETF(groundEntityNum), GENTITYNUM_BITS },
-{ NETF(pos.trType), 8 },
-{ NETF(eFlags), 19 },
-{ NETF(otherEntityNum), GENTITYNUM_BITS },
-{ NETF(weapon), 8 },
-{ NETF(clientNum), 8 },
-{ NETF(angles[1]), 0 },
-{ NETF(pos.trDuration), 32 },
-{ NETF(apos.trType), 8 },
-{ NETF(origin[0]), 0 },
-{ NETF(origin[1]), 0 },
-{ NETF(origin[2]), 0 },
-{ NETF(solid), 24 },
-{ NETF(powerups), MAX_POWERUPS },
-{ NETF(modelindex), 8 },
-{ NETF(otherEntityNum2), GENTITYNUM_BITS },
-{ NETF(loopSound), 8 },
-{ NETF(generic1), 8 },
-{ NETF(origin2[2]), 0 },
-{ NETF(origin2[0]), 0 },
-{ NETF(origin2[1]), 0 },
-{ NETF(modelindex2), 8 },
-{ NETF(angles[0]), 0 },
-{ NETF(time), 32 },
-{ NETF(apos.trTime), 32 },
-{ NETF(apos.trDuration), 32 },
-{ NETF(apos.trBase[2]), 0 },
-{ NETF(apos.trDelta[0]), 0 },
-{ NETF(apos.trDelta[1]), 0 },
-{ NETF(apos.trDelta[2]), 0 },
-{ NETF(time2), 32 },
-{ NETF(angles[2]), 0 },
-{ NETF(angles2[0]), 0 },
-{ NETF(angles2[2]), 0 },
-{ NETF(constantLight), 32 },
-{ NETF(frame), 16 }
+#define	FIELD( x, bits )	{ NETF( x ), bits },
+	ENTITY_STATE_FIELDS
+#undef FIELD
 };
 
 
@@ -837,6 +1323,313 @@ netField_t	entityStateFields[] =
 #define	FLOAT_INT_BITS	13
 #define	FLOAT_INT_BIAS	(1<<(FLOAT_INT_BITS-1))
 
+// a field as an int, floats are compared and sent bit for bit
+#define	FIELD_INT( s, x )	( *(int *)&(s)->x )
+
+/*
+==================
+MSG_WriteEntityField
+
+bits is a constant at every use, so only its half of this is kept
+==================
+*/
+static ID_INLINE void MSG_WriteEntityField( msgWriter_t *w, int fromF, int toF, int bits ) {
+	float	fullFloat;
+	int		trunc;
+
+	if ( fromF == toF ) {
+		MSG_WriterFlags( w, 0, 1 );	// no change
+		return;
+	}
+
+	// the changed bit goes with the ones after it
+	if ( bits == 0 ) {
+		// float
+		fullFloat = *(float *)&toF;
+		trunc = (int)fullFloat;
+
+		if ( fullFloat == 0.0f ) {
+			MSG_WriterFlags( w, 1, 2 );	// changed, zero
+			oldsize += FLOAT_INT_BITS;
+		} else if ( trunc == fullFloat && trunc + FLOAT_INT_BIAS >= 0 && 
+			trunc + FLOAT_INT_BIAS < ( 1 << FLOAT_INT_BITS ) ) {
+			// send as small integer
+			MSG_WriterFlags( w, 3, 3 );	// changed, not zero, integral
+			MSG_WriterBits( w, trunc + FLOAT_INT_BIAS, FLOAT_INT_BITS );
+		} else {
+			// send as full floating point value
+			MSG_WriterFlags( w, 7, 3 );	// changed, not zero, full
+			MSG_WriterBits( w, toF, 32 );
+		}
+	} else {
+		if ( toF == 0 ) {
+			MSG_WriterFlags( w, 1, 2 );	// changed, zero
+		} else {
+			MSG_WriterFlags( w, 3, 2 );	// changed, not zero
+			// integer
+			MSG_WriterBits( w, toF, bits );
+		}
+	}
+}
+
+/*
+==================
+MSG_WriteEntityFields
+
+The first lc fields, unrolled from ENTITY_STATE_FIELDS
+==================
+*/
+static void MSG_WriteEntityFields( msgWriter_t *w, const entityState_t *from, const entityState_t *to, int lc ) {
+	int		i;
+
+	i = 0;
+#define	FIELD( x, bits ) \
+	if ( i++ == lc ) { \
+		return; \
+	} \
+	MSG_WriteEntityField( w, FIELD_INT( from, x ), FIELD_INT( to, x ), bits );
+	ENTITY_STATE_FIELDS
+#undef FIELD
+}
+
+/*
+==================
+MSG_EntityLastChanged
+
+How many fields up to the last one that changed
+==================
+*/
+static int MSG_EntityLastChanged( const entityState_t *from, const entityState_t *to ) {
+	int		i, lc;
+
+	i = 0;
+	lc = 0;
+#define	FIELD( x, bits ) \
+	i++; \
+	if ( FIELD_INT( from, x ) != FIELD_INT( to, x ) ) { \
+		lc = i; \
+	}
+	ENTITY_STATE_FIELDS
+#undef FIELD
+
+	return lc;
+}
+
+/*
+==================
+MSG_ReadEntityField
+
+Leaves toF alone if the field didn't change
+==================
+*/
+static ID_INLINE void MSG_ReadEntityField( msgReader_t *r, const char *name, int *toF, int bits, qboolean print ) {
+	int		trunc;
+
+	if ( ! MSG_ReaderFlag( r ) ) {
+		// no change
+		return;
+	}
+
+	if ( bits == 0 ) {
+		// float
+		if ( MSG_ReaderFlag( r ) == 0 ) {
+			*(float *)toF = 0.0f; 
+		} else {
+			if ( MSG_ReaderFlag( r ) == 0 ) {
+				// integral float
+				trunc = MSG_ReaderBits( r, FLOAT_INT_BITS );
+				// bias to allow equal parts positive and negative
+				trunc -= FLOAT_INT_BIAS;
+				*(float *)toF = trunc; 
+				if ( print ) {
+					Com_Printf( "%s:%i ", name, trunc );
+				}
+			} else {
+				// full floating point value
+				*toF = MSG_ReaderBits( r, 32 );
+				if ( print ) {
+					Com_Printf( "%s:%f ", name, *(float *)toF );
+				}
+			}
+		}
+	} else {
+		if ( MSG_ReaderFlag( r ) == 0 ) {
+			*toF = 0;
+		} else {
+			// integer
+			*toF = MSG_ReaderBits( r, bits );
+			if ( print ) {
+				Com_Printf( "%s:%i ", name, *toF );
+			}
+		}
+	}
+}
+
+/*
+==================
+MSG_ReadEntityFields
+
+The first lc fields over the ones already copied from the delta base,
+unrolled from ENTITY_STATE_FIELDS
+==================
+*/
+static void MSG_ReadEntityFields( msgReader_t *r, entityState_t *to, int lc, qboolean print ) {
+	int		i;
+
+	i = 0;
+#define	FIELD( x, bits ) \
+	if ( i++ == lc ) { \
+		return; \
+	} \
+	MSG_ReadEntityField( r, #x, &FIELD_INT( to, x ), bits, print );
+	ENTITY_STATE_FIELDS
+#undef FIELD
+}
+
+/*
+==================
+MSG_OrderedEntityLastChanged
+
+MSG_EntityLastChanged for a field order other than the usual one.
+It and the next two are only used for the snapshots of servers that
+publish an order for the map, see sv_fieldorder.c.
+==================
+*/
+static int MSG_OrderedEntityLastChanged( const byte *order, const entityState_t *from, const entityState_t *to ) {
+	netField_t	*field;
+	int			i;
+
+	for ( i = ARRAY_LEN( entityStateFields ) - 1 ; i >= 0 ; i-- ) {
+		field = &entityStateFields[order[i]];
+		if ( *(int *)( (byte *)from + field->offset ) != *(int *)( (byte *)to + field->offset ) ) {
+			return i + 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+==================
+MSG_WriteOrderedEntityFields
+==================
+*/
+static void MSG_WriteOrderedEntityFields( msgWriter_t *w, const byte *order, const entityState_t *from,
+										  const entityState_t *to, int lc ) {
+	netField_t	*field;
+	int			i;
+
+	for ( i = 0 ; i < lc ; i++ ) {
+		field = &entityStateFields[order[i]];
+		MSG_WriteEntityField( w, *(int *)( (byte *)from + field->offset ),
+			*(int *)( (byte *)to + field->offset ), field->bits );
+	}
+}
+
+/*
+==================
+MSG_ReadOrderedEntityFields
+==================
+*/
+static void MSG_ReadOrderedEntityFields( msgReader_t *r, const byte *order, entityState_t *to, int lc, qboolean print ) {
+	netField_t	*field;
+	int			i;
+
+	for ( i = 0 ; i < lc ; i++ ) {
+		field = &entityStateFields[order[i]];
+		MSG_ReadEntityField( r, field->name, (int *)( (byte *)to + field->offset ), field->bits, print );
+	}
+}
+
+/*
+==================
+MSG_NumEntityFields
+==================
+*/
+int MSG_NumEntityFields( void ) {
+	return ARRAY_LEN( entityStateFields );
+}
+
+/*
+==================
+MSG_EntityFieldName
+==================
+*/
+const char *MSG_EntityFieldName( int field ) {
+	return entityStateFields[field].name;
+}
+
+/*
+==================
+MSG_CountEntityFieldChanges
+
+Adds one to the counts of the fields that are different
+==================
+*/
+void MSG_CountEntityFieldChanges( const entityState_t *from, const entityState_t *to, int *counts ) {
+	int		i;
+
+	i = 0;
+#define	FIELD( x, bits ) \
+	if ( FIELD_INT( from, x ) != FIELD_INT( to, x ) ) { \
+		counts[i]++; \
+	} \
+	i++;
+	ENTITY_STATE_FIELDS
+#undef FIELD
+}
+
+/*
+==================
+MSG_ParseEntityFieldOrder
+
+The field numbers as two hex digits each.  Anything that isn't
+every field once is refused.
+==================
+*/
+qboolean MSG_ParseEntityFieldOrder( const char *s, byte *order ) {
+	static const char	*hex = "0123456789abcdef";
+	const char			*hi, *lo;
+	qboolean			seen[MAX_ENTITY_FIELDS];
+	int					i, field, numFields;
+
+	numFields = ARRAY_LEN( entityStateFields );
+	if ( strlen( s ) != numFields * 2 ) {
+		return qfalse;
+	}
+
+	Com_Memset( seen, 0, sizeof( seen ) );
+	for ( i = 0 ; i < numFields ; i++ ) {
+		hi = strchr( hex, s[i * 2] );
+		lo = strchr( hex, s[i * 2 + 1] );
+		if ( !hi || !lo ) {
+			return qfalse;
+		}
+		field = ( hi - hex ) * 16 + ( lo - hex );
+		if ( field >= numFields || seen[field] ) {
+			return qfalse;
+		}
+		seen[field] = qtrue;
+		order[i] = field;
+	}
+
+	return qtrue;
+}
+
+/*
+==================
+MSG_EntityFieldOrderString
+==================
+*/
+void MSG_EntityFieldOrderString( const byte *order, char *s, int size ) {
+	int		i;
+
+	s[0] = 0;
+	for ( i = 0 ; i < ARRAY_LEN( entityStateFields ) ; i++ ) {
+		Q_strcat( s, size, va( "%02x", order[i] ) );
+	}
+}
+
 /*
 ==================
 MSG_WriteDeltaEntity
@@ -850,12 +1643,9 @@ identical, under the assumption that the in-order delta code will catch it.
 */
 void MSG_WriteDeltaEntity( msg_t *msg, struct entityState_s *from, struct entityState_s *to, 
 						   qboolean force ) {
-	int			i, lc;
+	int			lc;
 	int			numFields;
-	netField_t	*field;
-	int			trunc;
-	float		fullFloat;
-	int			*fromF, *toF;
+	msgWriter_t	w;
 
 	numFields = ARRAY_LEN( entityStateFields );
 
@@ -879,14 +1669,10 @@ void MSG_WriteDeltaEntity( msg_t *msg, struct entityState_s *from, struct entity
 		Com_Error (ERR_FATAL, "MSG_WriteDeltaEntity: Bad entity number: %i", to->number );
 	}
 
-	lc = 0;
-	// build the change vector as bytes so it is endien independent
-	for ( i = 0, field = entityStateFields ; i < numFields ; i++, field++ ) {
-		fromF = (int *)( (byte *)from + field->offset );
-		toF = (int *)( (byte *)to + field->offset );
-		if ( *fromF != *toF ) {
-			lc = i+1;
-		}
+	if ( msg->entityFieldOrder ) {
+		lc = MSG_OrderedEntityLastChanged( msg->entityFieldOrder, from, to );
+	} else {
+		lc = MSG_EntityLastChanged( from, to );
 	}
 
 	if ( lc == 0 ) {
@@ -901,56 +1687,25 @@ void MSG_WriteDeltaEntity( msg_t *msg, struct entityState_s *from, struct entity
 		return;
 	}
 
-	MSG_WriteBits( msg, to->number, GENTITYNUM_BITS );
-	MSG_WriteBits( msg, 0, 1 );			// not removed
-	MSG_WriteBits( msg, 1, 1 );			// we have a delta
+	// the number, removed and delta bits, the count, and for every field
+	// a changed bit and at most three more before the value
+	MSG_StartWriting( &w, msg, GENTITYNUM_BITS + 2 + 8 + lc * ( 4 + 32 ) );
 
-	MSG_WriteByte( msg, lc );	// # of changes
+	MSG_WriterBits( &w, to->number, GENTITYNUM_BITS );
+	MSG_WriterBits( &w, 0, 1 );			// not removed
+	MSG_WriterBits( &w, 1, 1 );			// we have a delta
 
-	oldsize += numFields;
-
-	for ( i = 0, field = entityStateFields ; i < lc ; i++, field++ ) {
-		fromF = (int *)( (byte *)from + field->offset );
-		toF = (int *)( (byte *)to + field->offset );
-
-		if ( *fromF == *toF ) {
-			MSG_WriteBits( msg, 0, 1 );	// no change
-			continue;
-		}
+	MSG_WriterBits( &w, lc, 8 );	// # of changes
 
-		MSG_WriteBits( msg, 1, 1 );	// changed
-
-		if ( field->bits == 0 ) {
-			// float
-			fullFloat = *(float *)toF;
-			trunc = (int)fullFloat;
+	oldsize += numFields;
 
-			if (fullFloat == 0.0f) {
-					MSG_WriteBits( msg, 0, 1 );
-					oldsize += FLOAT_INT_BITS;
-			} else {
-				MSG_WriteBits( msg, 1, 1 );
-				if ( trunc == fullFloat && trunc + FLOAT_INT_BIAS >= 0 && 
-					trunc + FLOAT_INT_BIAS < ( 1 << FLOAT_INT_BITS ) ) {
-					// send as small integer
-					MSG_WriteBits( msg, 0, 1 );
-					MSG_WriteBits( msg, trunc + FLOAT_INT_BIAS, FLOAT_INT_BITS );
-				} else {
-					// send as full floating point value
-					MSG_WriteBits( msg, 1, 1 );
-					MSG_WriteBits( msg, *toF, 32 );
-				}
-			}
-		} else {
-			if (*toF == 0) {
-				MSG_WriteBits( msg, 0, 1 );
-			} else {
-				MSG_WriteBits( msg, 1, 1 );
-				// integer
-				MSG_WriteBits( msg, *toF, field->bits );
-			}
-		}
+	if ( msg->entityFieldOrder ) {
+		MSG_WriteOrderedEntityFields( &w, msg->entityFieldOrder, from, to, lc );
+	} else {
+		MSG_WriteEntityFields( &w, from, to, lc );
 	}
+
+	MSG_FinishWriting( &w );
 }
 
 /*
@@ -967,13 +1722,11 @@ Can go from either a baseline or a previous packet_entity
 */
 void MSG_ReadDeltaEntity( msg_t *msg, entityState_t *from, entityState_t *to, 
 						 int number) {
-	int			i, lc;
+	int			lc;
 	int			numFields;
-	netField_t	*field;
-	int			*fromF, *toF;
 	int			print;
-	int			trunc;
 	int			startBit, endBit;
+	msgReader_t	r;
 
 	if ( number < 0 || number >= MAX_GENTITIES) {
 		Com_Error( ERR_DROP, "Bad delta entity number: %i", number );
@@ -985,8 +1738,12 @@ void MSG_ReadDeltaEntity( msg_t *msg, entityState_t *from, entityState_t *to,
 		startBit = ( msg->readcount - 1 ) * 8 + msg->bit - GENTITYNUM_BITS;
 	}
 
+	// printing uses msg->readcount as it goes
+	MSG_StartReading( &r, msg, cl_shownet && ( cl_shownet->integer >= 2 || cl_shownet->integer == -1 ) );
+
 	// check for a remove
-	if ( MSG_ReadBits( msg, 1 ) == 1 ) {
+	if ( MSG_ReaderBits( &r, 1 ) == 1 ) {
+		MSG_FinishReading( &r );
 		Com_Memset( to, 0, sizeof( *to ) );	
 		to->number = MAX_GENTITIES - 1;
 		if ( cl_shownet && ( cl_shownet->integer >= 2 || cl_shownet->integer == -1 ) ) {
@@ -996,14 +1753,15 @@ void MSG_ReadDeltaEntity( msg_t *msg, entityState_t *from, entityState_t *to,
 	}
 
 	// check for no delta
-	if ( MSG_ReadBits( msg, 1 ) == 0 ) {
+	if ( MSG_ReaderBits( &r, 1 ) == 0 ) {
+		MSG_FinishReading( &r );
 		*to = *from;
 		to->number = number;
 		return;
 	}
 
 	numFields = ARRAY_LEN( entityStateFields );
-	lc = MSG_ReadByte(msg);
+	lc = MSG_ReaderByte( &r );
 
 	if ( lc > numFields || lc < 0 ) {
 		Com_Error( ERR_DROP, "invalid entityState field count" );
@@ -1018,59 +1776,17 @@ void MSG_ReadDeltaEntity( msg_t *msg, entityState_t *from, entityState_t *to,
 		print = 0;
 	}
 
+	*to = *from;
 	to->number = number;
 
-	for ( i = 0, field = entityStateFields ; i < lc ; i++, field++ ) {
-		fromF = (int *)( (byte *)from + field->offset );
-		toF = (int *)( (byte *)to + field->offset );
-
-		if ( ! MSG_ReadBits( msg, 1 ) ) {
-			// no change
-			*toF = *fromF;
-		} else {
-			if ( field->bits == 0 ) {
-				// float
-				if ( MSG_ReadBits( msg, 1 ) == 0 ) {
-						*(float *)toF = 0.0f; 
-				} else {
-					if ( MSG_ReadBits( msg, 1 ) == 0 ) {
-						// integral float
-						trunc = MSG_ReadBits( msg, FLOAT_INT_BITS );
-						// bias to allow equal parts positive and negative
-						trunc -= FLOAT_INT_BIAS;
-						*(float *)toF = trunc; 
-						if ( print ) {
-							Com_Printf( "%s:%i ", field->name, trunc );
-						}
-					} else {
-						// full floating point value
-						*toF = MSG_ReadBits( msg, 32 );
-						if ( print ) {
-							Com_Printf( "%s:%f ", field->name, *(float *)toF );
-						}
-					}
-				}
-			} else {
-				if ( MSG_ReadBits( msg, 1 ) == 0 ) {
-					*toF = 0;
-				} else {
-					// integer
-					*toF = MSG_ReadBits( msg, field->bits );
-					if ( print ) {
-						Com_Printf( "%s:%i ", field->name, *toF );
-					}
-				}
-			}
-//			pcount[i]++;
-		}
-	}
-	for ( i = lc, field = &entityStateFields[lc] ; i < numFields ; i++, field++ ) {
-		fromF = (int *)( (byte *)from + field->offset );
-		toF = (int *)( (byte *)to + field->offset );
-		// no change
-		*toF = *fromF;
+	if ( msg->entityFieldOrder ) {
+		MSG_ReadOrderedEntityFields( &r, msg->entityFieldOrder, to, lc, print );
+	} else {
+		MSG_ReadEntityFields( &r, to, lc, print );
 	}
 
+	MSG_FinishReading( &r );
+
 	if ( print ) {
 		if ( msg->bit == 0 ) {
 			endBit = msg->readcount * 8 - GENTITYNUM_BITS;
@@ -1093,58 +1809,203 @@ plyer_state_t communication
 // using the stringizing operator to save typing...
 #define	PSF(x) #x,(size_t)&((playerState_t*)0)->x
 
+// like ENTITY_STATE_FIELDS
+#define	PLAYER_STATE_FIELDS \
+	FIELD( commandTime, 32 ) \
+	FIELD( origin[0], 0 ) \
+	FIELD( origin[1], 0 ) \
+	FIELD( bobCycle, 8 ) \
+	FIELD( velocity[0], 0 ) \
+	FIELD( velocity[1], 0 ) \
+	FIELD( viewangles[1], 0 ) \
+	FIELD( viewangles[0], 0 ) \
+	FIELD( weaponTime, -16 ) \
+	FIELD( origin[2], 0 ) \
+	FIELD( velocity[2], 0 ) \
+	FIELD( legsTimer, 8 ) \
+	FIELD( pm_time, -16 ) \
+	FIELD( eventSequence, 16 ) \
+	FIELD( torsoAnim, 8 ) \
+	FIELD( movementDir, 4 ) \
+	FIELD( events[0], 8 ) \
+	FIELD( legsAnim, 8 ) \
+	FIELD( events[1], 8 ) \
+	FIELD( pm_flags, 16 ) \
+	FIELD( groundEntityNum, GENTITYNUM_BITS ) \
+	FIELD( weaponstate, 4 ) \
+	FIELD( eFlags, 16 ) \
+	FIELD( externalEvent, 10 ) \
+	FIELD( gravity, 16 ) \
+	FIELD( speed, 16 ) \
+	FIELD( delta_angles[1], 16 ) \
+	FIELD( externalEventParm, 8 ) \
+	FIELD( viewheight, -8 ) \
+	FIELD( damageEvent, 8 ) \
+	FIELD( damageYaw, 8 ) \
+	FIELD( damagePitch, 8 ) \
+	FIELD( damageCount, 8 ) \
+	FIELD( generic1, 8 ) \
+	FIELD( pm_type, 8 ) \
+	FIELD( delta_angles[0], 16 ) \
+	FIELD( delta_angles[2], 16 ) \
+	FIELD( torsoTimer, 12 ) \
+	FIELD( eventParms[0], 8 ) \
+	FIELD( eventParms[1], 8 ) \
+	FIELD( clientNum, 8 ) \
+	FIELD( weapon, 5 ) \
+	FIELD( viewangles[2], 0 ) \
+	FIELD( grapplePoint[0], 0 ) \
+	FIELD( grapplePoint[1], 0 ) \
+	FIELD( grapplePoint[2], 0 ) \
+	FIELD( jumppad_ent, GENTITYNUM_BITS ) \
+	FIELD( loopSound, 16 )
+
 netField_t	playerStateFields[] = 
 {
-{ PSF(commandTime), 32 },				
-{ PSF(origin[0]), 0 },
-{ PSF(origin[1]), 0 },
-{ PSF(bobCycle), 8 },
-{ PSF(velocity[0]), 0 },
-{ PSF(velocity[1]), 0 },
-{ PSF(viewangles[1]), 0 },
-{ PSF(viewangles[0]), 0 },
-{ PSF(weaponTime), -16 },
-{ PSF(origin[2]), 0 },
-{ PSF(velocity[2]), 0 },
-{ PSF(legsTimer), 8 },
-{ PSF(pm_time), -16 },
-{ PSF(eventSequence), 16 },
-{ PSF(torsoAnim), 8 },
-{ PSF(movementDir), 4 },
-{ PSF(events[0]), 8 },
-{ PSF(legsAnim), 8 },
-{ PSF(events[1]), 8 },
-{ PSF(pm_flags), 16 },
-{ PSF(groundEntityNum), GENTITYNUM_BITS },
-{ PSF(weaponstate), 4 },
-{ PSF(eFlags), 16 },
-{ PSF(externalEvent), 10 },
-{ PSF(gravity), 16 },
-{ PSF(speed), 16 },
-{ PSF(delta_angles[1]), 16 },
-{ PSF(externalEventParm), 8 },
-{ PSF(viewheight), -8 },
-{ PSF(damageEvent), 8 },
-{ PSF(damageYaw), 8 },
-{ PSF(damagePitch), 8 },
-{ PSF(damageCount), 8 },
-{ PSF(generic1), 8 },
-{ PSF(pm_type), 8 },					
-{ PSF(delta_angles[0]), 16 },
-{ PSF(delta_angles[2]), 16 },
-{ PSF(torsoTimer), 12 },
-{ PSF(eventParms[0]), 8 },
-{ PSF(eventParms[1]), 8 },
-{ PSF(clientNum), 8 },
-{ PSF(weapon), 5 },
-{ PSF(viewangles[2]), 0 },
-{ PSF(grapplePoint[0]), 0 },
-{ PSF(grapplePoint[1]), 0 },
-{ PSF(grapplePoint[2]), 0 },
-{ PSF(jumppad_ent), GENTITYNUM_BITS },
-{ PSF(loopSound), 16 }
+#define	FIELD( x, bits )	{ PSF( x ), bits },
+	PLAYER_STATE_FIELDS
+#undef FIELD
 };
 
+/*
+=============
+MSG_WritePlayerstateField
+
+Like MSG_WriteEntityField, without the zero bits
+=============
+*/
+static ID_INLINE void MSG_WritePlayerstateField( msgWriter_t *w, int fromF, int toF, int bits ) {
+	float	fullFloat;
+	int		trunc;
+
+	if ( fromF == toF ) {
+		MSG_WriterFlags( w, 0, 1 );	// no change
+		return;
+	}
+
+	if ( bits == 0 ) {
+		// float
+		fullFloat = *(float *)&toF;
+		trunc = (int)fullFloat;
+
+		if ( trunc == fullFloat && trunc + FLOAT_INT_BIAS >= 0 && 
+			trunc + FLOAT_INT_BIAS < ( 1 << FLOAT_INT_BITS ) ) {
+			// send as small integer
+			MSG_WriterFlags( w, 1, 2 );	// changed, integral
+			MSG_WriterBits( w, trunc + FLOAT_INT_BIAS, FLOAT_INT_BITS );
+		} else {
+			// send as full floating point value
+			MSG_WriterFlags( w, 3, 2 );	// changed, full
+			MSG_WriterBits( w, toF, 32 );
+		}
+	} else {
+		MSG_WriterFlags( w, 1, 1 );	// changed
+		// integer
+		MSG_WriterBits( w, toF, bits );
+	}
+}
+
+/*
+=============
+MSG_WritePlayerstateFields
+
+The first lc fields, unrolled from PLAYER_STATE_FIELDS
+=============
+*/
+static void MSG_WritePlayerstateFields( msgWriter_t *w, const playerState_t *from, const playerState_t *to, int lc ) {
+	int		i;
+
+	i = 0;
+#define	FIELD( x, bits ) \
+	if ( i++ == lc ) { \
+		return; \
+	} \
+	MSG_WritePlayerstateField( w, FIELD_INT( from, x ), FIELD_INT( to, x ), bits );
+	PLAYER_STATE_FIELDS
+#undef FIELD
+}
+
+/*
+=============
+MSG_PlayerstateLastChanged
+=============
+*/
+static int MSG_PlayerstateLastChanged( const playerState_t *from, const playerState_t *to ) {
+	int		i, lc;
+
+	i = 0;
+	lc = 0;
+#define	FIELD( x, bits ) \
+	i++; \
+	if ( FIELD_INT( from, x ) != FIELD_INT( to, x ) ) { \
+		lc = i; \
+	}
+	PLAYER_STATE_FIELDS
+#undef FIELD
+
+	return lc;
+}
+
+/*
+=============
+MSG_ReadPlayerstateField
+=============
+*/
+static ID_INLINE void MSG_ReadPlayerstateField( msgReader_t *r, const char *name, int *toF, int bits, qboolean print ) {
+	int		trunc;
+
+	if ( ! MSG_ReaderFlag( r ) ) {
+		// no change
+		return;
+	}
+
+	if ( bits == 0 ) {
+		// float
+		if ( MSG_ReaderFlag( r ) == 0 ) {
+			// integral float
+			trunc = MSG_ReaderBits( r, FLOAT_INT_BITS );
+			// bias to allow equal parts positive and negative
+			trunc -= FLOAT_INT_BIAS;
+			*(float *)toF = trunc; 
+			if ( print ) {
+				Com_Printf( "%s:%i ", name, trunc );
+			}
+		} else {
+			// full floating point value
+			*toF = MSG_ReaderBits( r, 32 );
+			if ( print ) {
+				Com_Printf( "%s:%f ", name, *(float *)toF );
+			}
+		}
+	} else {
+		// integer
+		*toF = MSG_ReaderBits( r, bits );
+		if ( print ) {
+			Com_Printf( "%s:%i ", name, *toF );
+		}
+	}
+}
+
+/*
+=============
+MSG_ReadPlayerstateFields
+
+Unrolled from PLAYER_STATE_FIELDS, like MSG_ReadEntityFields
+=============
+*/
+static void MSG_ReadPlayerstateFields( msgReader_t *r, playerState_t *to, int lc, qboolean print ) {
+	int		i;
+
+	i = 0;
+#define	FIELD( x, bits ) \
+	if ( i++ == lc ) { \
+		return; \
+	} \
+	MSG_ReadPlayerstateField( r, #x, &FIELD_INT( to, x ), bits, print );
+	PLAYER_STATE_FIELDS
+#undef FIELD
+}
+
 /*
 =============
 MSG_WriteDeltaPlayerstate
@@ -1159,10 +2020,8 @@ void MSG_WriteDeltaPlayerstate( msg_t *msg, struct playerState_s *from, struct p
 	int				ammobits;
 	int				powerupbits;
 	int				numFields;
-	netField_t		*field;
-	int				*fromF, *toF;
-	float			fullFloat;
-	int				trunc, lc;
+	int				lc;
+	msgWriter_t		w;
 
 	if (!from) {
 		from = &dummy;
@@ -1171,52 +2030,19 @@ void MSG_WriteDeltaPlayerstate( msg_t *msg, struct playerState_s *from, struct p
 
 	numFields = ARRAY_LEN( playerStateFields );
 
-	lc = 0;
-	for ( i = 0, field = playerStateFields ; i < numFields ; i++, field++ ) {
-		fromF = (int *)( (byte *)from + field->offset );
-		toF = (int *)( (byte *)to + field->offset );
-		if ( *fromF != *toF ) {
-			lc = i+1;
-		}
-	}
-
-	MSG_WriteByte( msg, lc );	// # of changes
-
-	oldsize += numFields - lc;
-
-	for ( i = 0, field = playerStateFields ; i < lc ; i++, field++ ) {
-		fromF = (int *)( (byte *)from + field->offset );
-		toF = (int *)( (byte *)to + field->offset );
+	lc = MSG_PlayerstateLastChanged( from, to );
 
-		if ( *fromF == *toF ) {
-			MSG_WriteBits( msg, 0, 1 );	// no change
-			continue;
-		}
-
-		MSG_WriteBits( msg, 1, 1 );	// changed
-//		pcount[i]++;
+	// the count, a changed bit and at most one more before every value,
+	// and the arrays with all of their values
+	MSG_StartWriting( &w, msg, 8 + lc * ( 2 + 32 ) + 1 +
+		( 1 + MAX_STATS + MAX_STATS * 16 ) + ( 1 + MAX_PERSISTANT + MAX_PERSISTANT * 16 ) +
+		( 1 + MAX_WEAPONS + MAX_WEAPONS * 16 ) + ( 1 + MAX_POWERUPS + MAX_POWERUPS * 32 ) );
 
-		if ( field->bits == 0 ) {
-			// float
-			fullFloat = *(float *)toF;
-			trunc = (int)fullFloat;
+	MSG_WriterBits( &w, lc, 8 );	// # of changes
 
-			if ( trunc == fullFloat && trunc + FLOAT_INT_BIAS >= 0 && 
-				trunc + FLOAT_INT_BIAS < ( 1 << FLOAT_INT_BITS ) ) {
-				// send as small integer
-				MSG_WriteBits( msg, 0, 1 );
-				MSG_WriteBits( msg, trunc + FLOAT_INT_BIAS, FLOAT_INT_BITS );
-			} else {
-				// send as full floating point value
-				MSG_WriteBits( msg, 1, 1 );
-				MSG_WriteBits( msg, *toF, 32 );
-			}
-		} else {
-			// integer
-			MSG_WriteBits( msg, *toF, field->bits );
-		}
-	}
+	oldsize += numFields - lc;
 
+	MSG_WritePlayerstateFields( &w, from, to, lc );
 
 	//
 	// send the arrays
@@ -1247,54 +2073,57 @@ void MSG_WriteDeltaPlayerstate( msg_t *msg, struct playerState_s *from, struct p
 	}
 
 	if (!statsbits && !persistantbits && !ammobits && !powerupbits) {
-		MSG_WriteBits( msg, 0, 1 );	// no change
+		MSG_WriterBits( &w, 0, 1 );	// no change
 		oldsize += 4;
+		MSG_FinishWriting( &w );
 		return;
 	}
-	MSG_WriteBits( msg, 1, 1 );	// changed
+	MSG_WriterBits( &w, 1, 1 );	// changed
 
 	if ( statsbits ) {
-		MSG_WriteBits( msg, 1, 1 );	// changed
-		MSG_WriteBits( msg, statsbits, MAX_STATS );
+		MSG_WriterBits( &w, 1, 1 );	// changed
+		MSG_WriterBits( &w, statsbits, MAX_STATS );
 		for (i=0 ; i<MAX_STATS ; i++)
 			if (statsbits & (1<<i) )
-				MSG_WriteShort (msg, to->stats[i]);
+				MSG_WriterBits( &w, to->stats[i], 16 );
 	} else {
-		MSG_WriteBits( msg, 0, 1 );	// no change
+		MSG_WriterBits( &w, 0, 1 );	// no change
 	}
 
 
 	if ( persistantbits ) {
-		MSG_WriteBits( msg, 1, 1 );	// changed
-		MSG_WriteBits( msg, persistantbits, MAX_PERSISTANT );
+		MSG_WriterBits( &w, 1, 1 );	// changed
+		MSG_WriterBits( &w, persistantbits, MAX_PERSISTANT );
 		for (i=0 ; i<MAX_PERSISTANT ; i++)
 			if (persistantbits & (1<<i) )
-				MSG_WriteShort (msg, to->persistant[i]);
+				MSG_WriterBits( &w, to->persistant[i], 16 );
 	} else {
-		MSG_WriteBits( msg, 0, 1 );	// no change
+		MSG_WriterBits( &w, 0, 1 );	// no change
 	}
 
 
 	if ( ammobits ) {
-		MSG_WriteBits( msg, 1, 1 );	// changed
-		MSG_WriteBits( msg, ammobits, MAX_WEAPONS );
+		MSG_WriterBits( &w, 1, 1 );	// changed
+		MSG_WriterBits( &w, ammobits, MAX_WEAPONS );
 		for (i=0 ; i<MAX_WEAPONS ; i++)
 			if (ammobits & (1<<i) )
-				MSG_WriteShort (msg, to->ammo[i]);
+				MSG_WriterBits( &w, to->ammo[i], 16 );
 	} else {
-		MSG_WriteBits( msg, 0, 1 );	// no change
+		MSG_WriterBits( &w, 0, 1 );	// no change
 	}
 
 
 	if ( powerupbits ) {
-		MSG_WriteBits( msg, 1, 1 );	// changed
-		MSG_WriteBits( msg, powerupbits, MAX_POWERUPS );
+		MSG_WriterBits( &w, 1, 1 );	// changed
+		MSG_WriterBits( &w, powerupbits, MAX_POWERUPS );
 		for (i=0 ; i<MAX_POWERUPS ; i++)
 			if (powerupbits & (1<<i) )
-				MSG_WriteLong( msg, to->powerups[i] );
+				MSG_WriterBits( &w, to->powerups[i], 32 );
 	} else {
-		MSG_WriteBits( msg, 0, 1 );	// no change
+		MSG_WriterBits( &w, 0, 1 );	// no change
 	}
+
+	MSG_FinishWriting( &w );
 }
 
 
@@ -1306,13 +2135,11 @@ MSG_ReadDeltaPlayerstate
 void MSG_ReadDeltaPlayerstate (msg_t *msg, playerState_t *from, playerState_t *to ) {
 	int			i, lc;
 	int			bits;
-	netField_t	*field;
 	int			numFields;
 	int			startBit, endBit;
 	int			print;
-	int			*fromF, *toF;
-	int			trunc;
 	playerState_t	dummy;
+	msgReader_t	r;
 
 	if ( !from ) {
 		from = &dummy;
@@ -1335,103 +2162,66 @@ void MSG_ReadDeltaPlayerstate (msg_t *msg, playerState_t *from, playerState_t *t
 		print = 0;
 	}
 
+	MSG_StartReading( &r, msg, print );
+
 	numFields = ARRAY_LEN( playerStateFields );
-	lc = MSG_ReadByte(msg);
+	lc = MSG_ReaderByte( &r );
 
 	if ( lc > numFields || lc < 0 ) {
 		Com_Error( ERR_DROP, "invalid playerState field count" );
 	}
 
-	for ( i = 0, field = playerStateFields ; i < lc ; i++, field++ ) {
-		fromF = (int *)( (byte *)from + field->offset );
-		toF = (int *)( (byte *)to + field->offset );
-
-		if ( ! MSG_ReadBits( msg, 1 ) ) {
-			// no change
-			*toF = *fromF;
-		} else {
-			if ( field->bits == 0 ) {
-				// float
-				if ( MSG_ReadBits( msg, 1 ) == 0 ) {
-					// integral float
-					trunc = MSG_ReadBits( msg, FLOAT_INT_BITS );
-					// bias to allow equal parts positive and negative
-					trunc -= FLOAT_INT_BIAS;
-					*(float *)toF = trunc; 
-					if ( print ) {
-						Com_Printf( "%s:%i ", field->name, trunc );
-					}
-				} else {
-					// full floating point value
-					*toF = MSG_ReadBits( msg, 32 );
-					if ( print ) {
-						Com_Printf( "%s:%f ", field->name, *(float *)toF );
-					}
-				}
-			} else {
-				// integer
-				*toF = MSG_ReadBits( msg, field->bits );
-				if ( print ) {
-					Com_Printf( "%s:%i ", field->name, *toF );
-				}
-			}
-		}
-	}
-	for ( i=lc,field = &playerStateFields[lc];i<numFields; i++, field++) {
-		fromF = (int *)( (byte *)from + field->offset );
-		toF = (int *)( (byte *)to + field->offset );
-		// no change
-		*toF = *fromF;
-	}
-
+	MSG_ReadPlayerstateFields( &r, to, lc, print );
 
 	// read the arrays
-	if (MSG_ReadBits( msg, 1 ) ) {
+	if (MSG_ReaderBits( &r, 1 ) ) {
 		// parse stats
-		if ( MSG_ReadBits( msg, 1 ) ) {
+		if ( MSG_ReaderBits( &r, 1 ) ) {
 			LOG("PS_STATS");
-			bits = MSG_ReadBits (msg, MAX_STATS);
+			bits = MSG_ReaderBits( &r, MAX_STATS );
 			for (i=0 ; i<MAX_STATS ; i++) {
 				if (bits & (1<<i) ) {
-					to->stats[i] = MSG_ReadShort(msg);
+					to->stats[i] = MSG_ReaderShort( &r );
 				}
 			}
 		}
 
 		// parse persistant stats
-		if ( MSG_ReadBits( msg, 1 ) ) {
+		if ( MSG_ReaderBits( &r, 1 ) ) {
 			LOG("PS_PERSISTANT");
-			bits = MSG_ReadBits (msg, MAX_PERSISTANT);
+			bits = MSG_ReaderBits( &r, MAX_PERSISTANT );
 			for (i=0 ; i<MAX_PERSISTANT ; i++) {
 				if (bits & (1<<i) ) {
-					to->persistant[i] = MSG_ReadShort(msg);
+					to->persistant[i] = MSG_ReaderShort( &r );
 				}
 			}
 		}
 
 		// parse ammo
-		if ( MSG_ReadBits( msg, 1 ) ) {
+		if ( MSG_ReaderBits( &r, 1 ) ) {
 			LOG("PS_AMMO");
-			bits = MSG_ReadBits (msg, MAX_WEAPONS);
+			bits = MSG_ReaderBits( &r, MAX_WEAPONS );
 			for (i=0 ; i<MAX_WEAPONS ; i++) {
 				if (bits & (1<<i) ) {
-					to->ammo[i] = MSG_ReadShort(msg);
+					to->ammo[i] = MSG_ReaderShort( &r );
 				}
 			}
 		}
 
 		// parse powerups
-		if ( MSG_ReadBits( msg, 1 ) ) {
+		if ( MSG_ReaderBits( &r, 1 ) ) {
 			LOG("PS_POWERUPS");
-			bits = MSG_ReadBits (msg, MAX_POWERUPS);
+			bits = MSG_ReaderBits( &r, MAX_POWERUPS );
 			for (i=0 ; i<MAX_POWERUPS ; i++) {
 				if (bits & (1<<i) ) {
-					to->powerups[i] = MSG_ReadLong(msg);
+					to->powerups[i] = MSG_ReaderLong( &r );
 				}
 			}
 		}
 	}
 
+	MSG_FinishReading( &r );
+
 	if ( print ) {
 		if ( msg->bit == 0 ) {
 			endBit = msg->readcount * 8 - GENTITYNUM_BITS;
@@ -1712,6 +2502,18 @@ void MSG_initHuffman( void ) {
 			Huff_addRef(&msgHuff.decompressor,	(byte)i);			// Do update
 		}
 	}
+	Huff_BuildTables(&msgHuff.compressor, &msgHuffTables);
+
+	msgHuffMaxLength = 8;
+	for(i=0;i<256;i++) {
+		if (!msgHuffTables.codes[i].length) {
+			msgHuffMaxLength = 32;		// sent from the tree, could be any length
+			break;
+		}
+		if (msgHuffTables.codes[i].length > msgHuffMaxLength) {
+			msgHuffMaxLength = msgHuffTables.codes[i].length;
+		}
+	}
 }
 
 /*
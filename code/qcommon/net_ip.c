@@ -20,6 +20,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 ===========================================================================
 */
 
+#ifdef __linux__
+#	define _GNU_SOURCE		// recvmmsg, sendmmsg
+#endif
+
 #include "../qcommon/q_shared.h"
 #include "../qcommon/qcommon.h"
 
@@ -89,6 +93,16 @@ typedef int SOCKET;
 typedef int	ioctlarg_t;
 #	define socketError			errno
 
+#	ifdef __linux__
+#		include <sys/epoll.h>
+#		include <sys/timerfd.h>
+
+		// several datagrams per system call
+#		define NET_MMSG
+		// NET_Sleep with epoll, NET_SleepUntil with a timerfd
+#		define NET_EPOLL
+#	endif
+
 #endif
 
 static qboolean usingSocks = qfalse;
@@ -111,6 +125,10 @@ static cvar_t	*net_mcast6iface;
 
 static cvar_t	*net_dropsim;
 
+#ifdef NET_MMSG
+static cvar_t	*net_batch;
+#endif
+
 static struct sockaddr	socksRelayAddr;
 
 static SOCKET	ip_socket = INVALID_SOCKET;
@@ -118,11 +136,23 @@ static SOCKET	ip6_socket = INVALID_SOCKET;
 static SOCKET	socks_socket = INVALID_SOCKET;
 static SOCKET	multicast6_socket = INVALID_SOCKET;
 
+// Sys_SendPacketDirect is called from other threads, NET_Config holds
+// this while it closes and opens the sockets
+static void		*net_socketMutex;
+
+#ifdef NET_EPOLL
+static int		net_epoll = -1;
+static int		net_timer = -1;
+static qboolean	net_epollFailed;
+#endif
+
 // Keep track of currently joined multicast group.
 static struct ipv6_mreq curgroup;
 // And the currently bound address.
 static struct sockaddr_in6 boundto;
 
+static void NET_CloseEpoll( void );
+
 #ifndef IF_NAMESIZE
   #define IF_NAMESIZE 16
 #endif
@@ -513,6 +543,53 @@ qboolean	NET_IsLocalAddress( netadr_t adr ) {
 
 //=============================================================================
 
+/*
+==================
+NET_ReceivedPacket
+
+Fills in net_from and net_message for the ret bytes
+that were received on sock into net_message->data
+==================
+*/
+static qboolean NET_ReceivedPacket( SOCKET sock, struct sockaddr_storage *from, socklen_t fromlen, int ret,
+									netadr_t *net_from, msg_t *net_message )
+{
+	if( sock == ip_socket )
+	{
+		memset( ((struct sockaddr_in *)from)->sin_zero, 0, 8 );
+	
+		if ( usingSocks && memcmp( from, &socksRelayAddr, fromlen ) == 0 ) {
+			if ( ret < 10 || net_message->data[0] != 0 || net_message->data[1] != 0 || net_message->data[2] != 0 || net_message->data[3] != 1 ) {
+				return qfalse;
+			}
+			net_from->type = NA_IP;
+			net_from->ip[0] = net_message->data[4];
+			net_from->ip[1] = net_message->data[5];
+			net_from->ip[2] = net_message->data[6];
+			net_from->ip[3] = net_message->data[7];
+			net_from->port = *(short *)&net_message->data[8];
+			net_message->readcount = 10;
+		}
+		else {
+			SockadrToNetadr( (struct sockaddr *) from, net_from );
+			net_message->readcount = 0;
+		}
+	}
+	else
+	{
+		SockadrToNetadr( (struct sockaddr *) from, net_from );
+		net_message->readcount = 0;
+	}
+
+	if( ret >= net_message->maxsize ) {
+		Com_Printf( "Oversize packet from %s\n", NET_AdrToString (*net_from) );
+		return qfalse;
+	}
+	
+	net_message->cursize = ret;
+	return qtrue;
+}
+
 /*
 ==================
 NET_GetPacket
@@ -540,35 +617,7 @@ qboolean NET_GetPacket(netadr_t *net_from, msg_t *net_message, fd_set *fdr)
 				Com_Printf( "NET_GetPacket: %s\n", NET_ErrorString() );
 		}
 		else
-		{
-
-			memset( ((struct sockaddr_in *)&from)->sin_zero, 0, 8 );
-		
-			if ( usingSocks && memcmp( &from, &socksRelayAddr, fromlen ) == 0 ) {
-				if ( ret < 10 || net_message->data[0] != 0 || net_message->data[1] != 0 || net_message->data[2] != 0 || net_message->data[3] != 1 ) {
-					return qfalse;
-				}
-				net_from->type = NA_IP;
-				net_from->ip[0] = net_message->data[4];
-				net_from->ip[1] = net_message->data[5];
-				net_from->ip[2] = net_message->data[6];
-				net_from->ip[3] = net_message->data[7];
-				net_from->port = *(short *)&net_message->data[8];
-				net_message->readcount = 10;
-			}
-			else {
-				SockadrToNetadr( (struct sockaddr *) &from, net_from );
-				net_message->readcount = 0;
-			}
-		
-			if( ret >= net_message->maxsize ) {
-				Com_Printf( "Oversize packet from %s\n", NET_AdrToString (*net_from) );
-				return qfalse;
-			}
-			
-			net_message->cursize = ret;
-			return qtrue;
-		}
+			return NET_ReceivedPacket( ip_socket, &from, fromlen, ret, net_from, net_message );
 	}
 	
 	if(ip6_socket != INVALID_SOCKET && FD_ISSET(ip6_socket, fdr))
@@ -584,19 +633,7 @@ qboolean NET_GetPacket(netadr_t *net_from, msg_t *net_message, fd_set *fdr)
 				Com_Printf( "NET_GetPacket: %s\n", NET_ErrorString() );
 		}
 		else
-		{
-			SockadrToNetadr((struct sockaddr *) &from, net_from);
-			net_message->readcount = 0;
-		
-			if(ret >= net_message->maxsize)
-			{
-				Com_Printf( "Oversize packet from %s\n", NET_AdrToString (*net_from) );
-				return qfalse;
-			}
-			
-			net_message->cursize = ret;
-			return qtrue;
-		}
+			return NET_ReceivedPacket( ip6_socket, &from, fromlen, ret, net_from, net_message );
 	}
 
 	if(multicast6_socket != INVALID_SOCKET && multicast6_socket != ip6_socket && FD_ISSET(multicast6_socket, fdr))
@@ -612,19 +649,7 @@ qboolean NET_GetPacket(netadr_t *net_from, msg_t *net_message, fd_set *fdr)
 				Com_Printf( "NET_GetPacket: %s\n", NET_ErrorString() );
 		}
 		else
-		{
-			SockadrToNetadr((struct sockaddr *) &from, net_from);
-			net_message->readcount = 0;
-		
-			if(ret >= net_message->maxsize)
-			{
-				Com_Printf( "Oversize packet from %s\n", NET_AdrToString (*net_from) );
-				return qfalse;
-			}
-			
-			net_message->cursize = ret;
-			return qtrue;
-		}
+			return NET_ReceivedPacket( multicast6_socket, &from, fromlen, ret, net_from, net_message );
 	}
 	
 	
@@ -635,6 +660,153 @@ qboolean NET_GetPacket(netadr_t *net_from, msg_t *net_message, fd_set *fdr)
 
 static char socksBuf[4096];
 
+/*
+==================
+NET_SendError
+==================
+*/
+static void NET_SendError( int err, netadrtype_t type ) {
+	// wouldblock is silent
+	if( err == EAGAIN ) {
+		return;
+	}
+
+	// some PPP links do not allow broadcasts and return an error
+	if( ( err == EADDRNOTAVAIL ) && ( ( type == NA_BROADCAST ) ) ) {
+		return;
+	}
+
+	Com_Printf( "Sys_SendPacket: %s\n", NET_ErrorString() );
+}
+
+#ifdef NET_MMSG
+
+/*
+=============================================================================
+
+Send batches
+
+Between NET_BeginSendBatch and NET_FlushSendBatch the packets are only
+copied aside, and then go out with one sendmmsg per socket instead of a
+sendto each.
+
+=============================================================================
+*/
+
+#define	MAX_SEND_BATCH		128
+#define	SEND_BATCH_BYTES	0x40000
+
+typedef struct {
+	SOCKET					sock;
+	struct sockaddr_storage	addr;
+	socklen_t				addrlen;
+	netadrtype_t			type;
+	struct iovec			iov;
+} batchedPacket_t;
+
+static qboolean			sendBatching;
+static batchedPacket_t	batchedPackets[MAX_SEND_BATCH];
+static struct mmsghdr	batchedHeaders[MAX_SEND_BATCH];
+static int				numBatchedPackets;
+static byte				sendBatchData[SEND_BATCH_BYTES];
+static int				sendBatchBytes;
+
+/*
+==================
+NET_SendBatched
+==================
+*/
+static void NET_SendBatched( void ) {
+	batchedPacket_t	*packet;
+	struct msghdr	*hdr;
+	int				i, run, sent;
+
+	for ( i = 0 ; i < numBatchedPackets ; i++ ) {
+		packet = &batchedPackets[i];
+		hdr = &batchedHeaders[i].msg_hdr;
+		memset( hdr, 0, sizeof( *hdr ) );
+		hdr->msg_name = &packet->addr;
+		hdr->msg_namelen = packet->addrlen;
+		hdr->msg_iov = &packet->iov;
+		hdr->msg_iovlen = 1;
+	}
+
+	for ( i = 0 ; i < numBatchedPackets ; ) {
+		for ( run = 1 ; i + run < numBatchedPackets ; run++ ) {
+			if ( batchedPackets[i + run].sock != batchedPackets[i].sock ) {
+				break;
+			}
+		}
+
+		// the first packet it couldn't send failed, skip that one and go on
+		sent = sendmmsg( batchedPackets[i].sock, &batchedHeaders[i], run, 0 );
+		if ( sent <= 0 ) {
+			NET_SendError( socketError, batchedPackets[i].type );
+			sent = 1;
+		}
+		i += sent;
+	}
+
+	numBatchedPackets = 0;
+	sendBatchBytes = 0;
+}
+
+/*
+==================
+NET_BatchPacket
+==================
+*/
+static void NET_BatchPacket( SOCKET sock, struct sockaddr_storage *addr, socklen_t addrlen,
+							 int length, const void *data, netadrtype_t type ) {
+	batchedPacket_t	*packet;
+
+	if ( numBatchedPackets == MAX_SEND_BATCH || sendBatchBytes + length > SEND_BATCH_BYTES ) {
+		NET_SendBatched();
+	}
+
+	packet = &batchedPackets[numBatchedPackets++];
+	packet->sock = sock;
+	packet->addr = *addr;
+	packet->addrlen = addrlen;
+	packet->type = type;
+	packet->iov.iov_base = sendBatchData + sendBatchBytes;
+	packet->iov.iov_len = length;
+
+	Com_Memcpy( sendBatchData + sendBatchBytes, data, length );
+	sendBatchBytes += length;
+}
+
+#endif
+
+/*
+==================
+NET_BeginSendBatch
+
+Holds back the packets sent from now on until NET_FlushSendBatch
+==================
+*/
+void NET_BeginSendBatch( void ) {
+#ifdef NET_MMSG
+	if ( net_batch && net_batch->integer ) {
+		sendBatching = qtrue;
+	}
+#endif
+}
+
+/*
+==================
+NET_FlushSendBatch
+==================
+*/
+void NET_FlushSendBatch( void ) {
+#ifdef NET_MMSG
+	sendBatching = qfalse;
+	if ( numBatchedPackets ) {
+		NET_SendBatched();
+	}
+#endif
+}
+
 /*
 ==================
 Sys_SendPacket
@@ -672,6 +844,15 @@ void Sys_SendPacket( int length, const void *data, netadr_t to ) {
 		memcpy( &socksBuf[10], data, length );
 		ret = sendto( ip_socket, socksBuf, length+10, 0, &socksRelayAddr, sizeof(socksRelayAddr) );
 	}
+#ifdef NET_MMSG
+	else if( sendBatching ) {
+		if(addr.ss_family == AF_INET)
+			NET_BatchPacket( ip_socket, &addr, sizeof(struct sockaddr_in), length, data, to.type );
+		else if(addr.ss_family == AF_INET6)
+			NET_BatchPacket( ip6_socket, &addr, sizeof(struct sockaddr_in6), length, data, to.type );
+		return;
+	}
+#endif
 	else {
 		if(addr.ss_family == AF_INET)
 			ret = sendto( ip_socket, data, length, 0, (struct sockaddr *) &addr, sizeof(struct sockaddr_in) );
@@ -679,20 +860,29 @@ void Sys_SendPacket( int length, const void *data, netadr_t to ) {
 			ret = sendto( ip6_socket, data, length, 0, (struct sockaddr *) &addr, sizeof(struct sockaddr_in6) );
 	}
 	if( ret == SOCKET_ERROR ) {
-		int err = socketError;
+		NET_SendError( socketError, to.type );
+	}
+}
 
-		// wouldblock is silent
-		if( err == EAGAIN ) {
-			return;
-		}
+/*
+==================
+Sys_SendPacketDirect
+==================
+*/
+void Sys_SendPacketDirect( int length, const void *data, netadr_t to ) {
+	struct sockaddr_storage	addr;
 
-		// some PPP links do not allow broadcasts and return an error
-		if( ( err == EADDRNOTAVAIL ) && ( ( to.type == NA_BROADCAST ) ) ) {
-			return;
-		}
+	memset(&addr, 0, sizeof(addr));
+	NetadrToSockadr( &to, (struct sockaddr *) &addr );
 
-		Com_Printf( "Sys_SendPacket: %s\n", NET_ErrorString() );
-	}
+	Sys_LockMutex( net_socketMutex );
+
+	if( to.type == NA_IP && ip_socket != INVALID_SOCKET )
+		sendto( ip_socket, data, length, 0, (struct sockaddr *) &addr, sizeof(struct sockaddr_in) );
+	else if( to.type == NA_IP6 && ip6_socket != INVALID_SOCKET )
+		sendto( ip6_socket, data, length, 0, (struct sockaddr *) &addr, sizeof(struct sockaddr_in6) );
+
+	Sys_UnlockMutex( net_socketMutex );
 }
 
 
@@ -1002,6 +1192,9 @@ void NET_JoinMulticast6(void)
 	
 	if(ip6_socket == INVALID_SOCKET || multicast6_socket != INVALID_SOCKET || (net_enabled->integer & NET_DISABLEMCAST))
 		return;
+
+	// the epoll set is built with the multicast socket in it
+	NET_CloseEpoll();
 	
 	if(IN6_IS_ADDR_MULTICAST(&boundto.sin6_addr) || IN6_IS_ADDR_UNSPECIFIED(&boundto.sin6_addr))
 	{
@@ -1056,6 +1249,7 @@ void NET_LeaveMulticast6()
 			setsockopt(multicast6_socket, IPPROTO_IPV6, IPV6_LEAVE_GROUP, (char *) &curgroup, sizeof(curgroup));
 
 		multicast6_socket = INVALID_SOCKET;
+		NET_CloseEpoll();
 	}
 }
 
@@ -1480,10 +1674,34 @@ static qboolean NET_GetCvars( void ) {
 
 	net_dropsim = Cvar_Get("net_dropsim", "", CVAR_TEMP);
 
+#ifdef NET_MMSG
+	net_batch = Cvar_Get( "net_batch", "1", CVAR_ARCHIVE );
+#endif
+
 	return modified ? qtrue : qfalse;
 }
 
 
+/*
+====================
+NET_CloseEpoll
+
+Called when the sockets change, the next NET_Sleep opens it again
+====================
+*/
+static void NET_CloseEpoll( void ) {
+#ifdef NET_EPOLL
+	if ( net_epoll != -1 ) {
+		close( net_epoll );
+		net_epoll = -1;
+	}
+	if ( net_timer != -1 ) {
+		close( net_timer );
+		net_timer = -1;
+	}
+#endif
+}
+
 /*
 ====================
 NET_Config
@@ -1528,7 +1746,19 @@ void NET_Config( qboolean enableNetworking ) {
 		networkingEnabled = enableNetworking;
 	}
 
+	if( stop || start ) {
+		NET_CloseEpoll();
+#ifdef NET_EPOLL
+		// give epoll another chance with the new sockets
+		net_epollFailed = qfalse;
+#endif
+	}
+
+	Sys_LockMutex( net_socketMutex );
+
 	if( stop ) {
+		NET_FlushSendBatch();
+
 		if ( ip_socket != INVALID_SOCKET ) {
 			closesocket( ip_socket );
 			ip_socket = INVALID_SOCKET;
@@ -1562,6 +1792,8 @@ void NET_Config( qboolean enableNetworking ) {
 			NET_SetMulticast6();
 		}
 	}
+
+	Sys_UnlockMutex( net_socketMutex );
 }
 
 
@@ -1573,7 +1805,16 @@ NET_Init
 void NET_Init( void ) {
 #ifdef _WIN32
 	int		r;
+#endif
+
+	if ( !net_socketMutex ) {
+		net_socketMutex = Sys_CreateMutex();
+		if ( !net_socketMutex ) {
+			Com_Error( ERR_FATAL, "NET_Init: couldn't create mutex" );
+		}
+	}
 
+#ifdef _WIN32
 	r = WSAStartup( MAKEWORD( 1, 1 ), &winsockdata );
 	if( r ) {
 		Com_Printf( "WARNING: Winsock initialization failed, returned %d\n", r );
@@ -1608,6 +1849,87 @@ void NET_Shutdown( void ) {
 #endif
 }
 
+/*
+====================
+NET_PacketEvent
+====================
+*/
+static void NET_PacketEvent( netadr_t *from, msg_t *netmsg )
+{
+	if(net_dropsim->value > 0.0f && net_dropsim->value <= 100.0f)
+	{
+		// com_dropsim->value percent of incoming packets get dropped.
+		if(rand() < (int) (((double) RAND_MAX) / 100.0 * (double) net_dropsim->value))
+			return;          // drop this packet
+	}
+
+	if(com_sv_running->integer)
+		Com_RunAndTimeServerPacket(from, netmsg);
+	else
+		CL_PacketEvent(*from, netmsg);
+}
+
+#ifdef NET_MMSG
+
+#define	MAX_RECV_BATCH	32
+
+static byte						recvBatchData[MAX_RECV_BATCH][MAX_MSGLEN + 1];
+static struct sockaddr_storage	recvBatchFrom[MAX_RECV_BATCH];
+
+/*
+====================
+NET_ReceiveBatches
+
+Drains *sock with recvmmsg, handling up to MAX_RECV_BATCH packets per call.
+The packets can restart the network, so the socket is checked again after
+every batch.
+====================
+*/
+static void NET_ReceiveBatches( SOCKET *sock )
+{
+	struct mmsghdr	hdrs[MAX_RECV_BATCH];
+	struct iovec	iov[MAX_RECV_BATCH];
+	SOCKET			s;
+	netadr_t		from;
+	msg_t			netmsg;
+	int				i, count, err;
+
+	s = *sock;
+	do
+	{
+		for(i = 0; i < MAX_RECV_BATCH; i++)
+		{
+			iov[i].iov_base = recvBatchData[i];
+			iov[i].iov_len = sizeof(recvBatchData[i]);
+			memset(&hdrs[i].msg_hdr, 0, sizeof(hdrs[i].msg_hdr));
+			hdrs[i].msg_hdr.msg_name = &recvBatchFrom[i];
+			hdrs[i].msg_hdr.msg_namelen = sizeof(recvBatchFrom[i]);
+			hdrs[i].msg_hdr.msg_iov = &iov[i];
+			hdrs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		count = recvmmsg(s, hdrs, MAX_RECV_BATCH, MSG_DONTWAIT, NULL);
+		if(count == SOCKET_ERROR)
+		{
+			err = socketError;
+
+			if( err != EAGAIN && err != ECONNRESET )
+				Com_Printf( "NET_GetPacket: %s\n", NET_ErrorString() );
+			return;
+		}
+
+		for(i = 0; i < count && *sock == s; i++)
+		{
+			MSG_Init(&netmsg, recvBatchData[i], sizeof(recvBatchData[i]));
+
+			if(NET_ReceivedPacket(s, &recvBatchFrom[i], hdrs[i].msg_hdr.msg_namelen, hdrs[i].msg_len, &from, &netmsg))
+				NET_PacketEvent(&from, &netmsg);
+		}
+	} while(count == MAX_RECV_BATCH && *sock == s);
+}
+
+#endif
+
 /*
 ====================
 NET_Event
@@ -1621,30 +1943,167 @@ void NET_Event(fd_set *fdr)
 	byte bufData[MAX_MSGLEN + 1];
 	netadr_t from;
 	msg_t netmsg;
+
+#ifdef NET_MMSG
+	if(net_batch->integer)
+	{
+		if(ip_socket != INVALID_SOCKET && FD_ISSET(ip_socket, fdr))
+			NET_ReceiveBatches(&ip_socket);
+		if(ip6_socket != INVALID_SOCKET && FD_ISSET(ip6_socket, fdr))
+			NET_ReceiveBatches(&ip6_socket);
+		if(multicast6_socket != INVALID_SOCKET && multicast6_socket != ip6_socket && FD_ISSET(multicast6_socket, fdr))
+			NET_ReceiveBatches(&multicast6_socket);
+		return;
+	}
+#endif
 	
 	while(1)
 	{
 		MSG_Init(&netmsg, bufData, sizeof(bufData));
 
 		if(NET_GetPacket(&from, &netmsg, fdr))
-		{
-			if(net_dropsim->value > 0.0f && net_dropsim->value <= 100.0f)
-			{
-				// com_dropsim->value percent of incoming packets get dropped.
-				if(rand() < (int) (((double) RAND_MAX) / 100.0 * (double) net_dropsim->value))
-					continue;          // drop this packet
-			}
-
-			if(com_sv_running->integer)
-				Com_RunAndTimeServerPacket(&from, &netmsg);
-			else
-				CL_PacketEvent(from, &netmsg);
-		}
+			NET_PacketEvent(&from, &netmsg);
 		else
 			break;
 	}
 }
 
+#ifdef NET_EPOLL
+
+/*
+====================
+NET_EpollAdd
+====================
+*/
+static qboolean NET_EpollAdd( int fd ) {
+	struct epoll_event	ev;
+
+	if ( fd == INVALID_SOCKET ) {
+		return qtrue;
+	}
+
+	memset( &ev, 0, sizeof( ev ) );
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+
+	return epoll_ctl( net_epoll, EPOLL_CTL_ADD, fd, &ev ) == 0;
+}
+
+/*
+====================
+NET_OpenEpoll
+====================
+*/
+static qboolean NET_OpenEpoll( void ) {
+	if ( net_epoll != -1 ) {
+		return qtrue;
+	}
+	if ( net_epollFailed ) {
+		return qfalse;
+	}
+
+	net_epoll = epoll_create1( EPOLL_CLOEXEC );
+	net_timer = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+
+	if ( net_epoll == -1 || net_timer == -1 || !NET_EpollAdd( net_timer )
+		|| !NET_EpollAdd( ip_socket ) || !NET_EpollAdd( ip6_socket )
+		|| ( multicast6_socket != ip6_socket && !NET_EpollAdd( multicast6_socket ) ) ) {
+		Com_Printf( "WARNING: epoll setup failed, using select(): %s\n", NET_ErrorString() );
+		NET_CloseEpoll();
+		net_epollFailed = qtrue;
+		return qfalse;
+	}
+
+	return qtrue;
+}
+
+/*
+====================
+NET_EpollWait
+
+Waits until the timer runs out if usec is set, msec otherwise,
+or something happens on the network
+====================
+*/
+static qboolean NET_EpollWait( int msec, int usec ) {
+	struct epoll_event	events[4];
+	struct itimerspec	its;
+	fd_set				fdr;
+	qboolean			received;
+	int					i, count;
+
+	if ( !NET_OpenEpoll() ) {
+		return qfalse;
+	}
+
+	memset( &its, 0, sizeof( its ) );
+	if ( usec > 0 ) {
+		its.it_value.tv_sec = usec / 1000000;
+		its.it_value.tv_nsec = ( usec % 1000000 ) * 1000;
+		timerfd_settime( net_timer, 0, &its, NULL );
+		msec = -1;
+	}
+
+	count = epoll_wait( net_epoll, events, ARRAY_LEN( events ), msec );
+
+	if ( usec > 0 ) {
+		// disarming also clears an expiry, so it can't end a later sleep early
+		memset( &its, 0, sizeof( its ) );
+		timerfd_settime( net_timer, 0, &its, NULL );
+	}
+
+	if ( count == SOCKET_ERROR ) {
+		if ( socketError != EINTR ) {
+			Com_Printf( "Warning: epoll_wait() syscall failed: %s\n", NET_ErrorString() );
+		}
+		return qtrue;
+	}
+
+	FD_ZERO( &fdr );
+	received = qfalse;
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( events[i].data.fd != net_timer ) {
+			FD_SET( events[i].data.fd, &fdr );
+			received = qtrue;
+		}
+	}
+
+	if ( received ) {
+		NET_Event( &fdr );
+	}
+
+	return qtrue;
+}
+
+#endif
+
+/*
+====================
+NET_SleepUntil
+
+Sleeps until Sys_Milliseconds reaches time or something happens on the
+network, without rounding the wait to whole milliseconds like NET_Sleep.
+Returns qfalse if that isn't available here and NET_Sleep has to be used
+====================
+*/
+qboolean NET_SleepUntil( int time )
+{
+#ifdef NET_EPOLL
+	int usec;
+
+	// nothing should wait in a send batch while sleeping
+	NET_FlushSendBatch();
+
+	usec = Sys_MicrosecondsUntil( time );
+	if( usec <= 0 )
+		return NET_EpollWait( 0, 0 );
+
+	return NET_EpollWait( 0, usec );
+#else
+	return qfalse;
+#endif
+}
+
 /*
 ====================
 NET_Sleep
@@ -1662,6 +2121,14 @@ void NET_Sleep(int msec)
 	if(msec < 0)
 		msec = 0;
 
+	// nothing should wait in a send batch while sleeping
+	NET_FlushSendBatch();
+
+#ifdef NET_EPOLL
+	if(NET_EpollWait(msec, 0))
+		return;
+#endif
+
 	FD_ZERO(&fdr);
 
 	if(ip_socket != INVALID_SOCKET)
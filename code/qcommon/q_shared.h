@@ -1156,6 +1156,7 @@ typedef enum {
 #define	SNAPFLAG_RATE_DELAYED	1
 #define	SNAPFLAG_NOT_ACTIVE		2	// snapshot used during connection and for zombies
 #define SNAPFLAG_SERVERCOUNT	4	// toggled every map_restart so transitions can be detected
+#define	SNAPFLAG_FIELD_ORDER	8	// entities are sent in the field order of the gamestate systeminfo
 
 //
 // per-level limits
@@ -39,7 +39,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 //
 // msg.c
 //
-typedef struct {
+typedef struct msg_s {
 	qboolean	allowoverflow;	// if false, do a Com_Error
 	qboolean	overflowed;		// set to true if the buffer size failed (with allowoverflow set)
 	qboolean	oob;			// set to true if the buffer size failed (with allowoverflow set)
@@ -48,6 +48,9 @@ typedef struct {
 	int		cursize;
 	int		readcount;
 	int		bit;				// for bitwise reads and writes
+	const byte	*entityFieldOrder;	// sent order of the entityState_t fields, NULL for the usual one
+	struct rangeCoder_s	*coder;	// range coding instead of huffman, see MSG_StartRangeCoding
+	struct msg_s	*readCopy;	// everything read is written to it too
 } msg_t;
 
 void MSG_Init (msg_t *buf, byte *data, int length);
@@ -67,6 +70,13 @@ struct entityState_s;
 struct playerState_s;
 
 void MSG_WriteBits( msg_t *msg, int value, int bits );
+void MSG_WriteBitString( msg_t *msg, const byte *data, int bits );
+
+// the rest of the message is range coded with the model of the coder,
+// from cursize on when writing and from readcount on when reading
+void MSG_StartRangeCoding( msg_t *msg, struct rangeCoder_s *coder );
+void MSG_FinishRangeCoding( msg_t *msg );
+void MSG_StartRangeDecoding( msg_t *msg, struct rangeCoder_s *coder );
 
 void MSG_WriteChar (msg_t *sb, int c);
 void MSG_WriteByte (msg_t *sb, int c);
@@ -106,6 +116,15 @@ void MSG_ReadDeltaEntity( msg_t *msg, entityState_t *from, entityState_t *to,
 void MSG_WriteDeltaPlayerstate( msg_t *msg, struct playerState_s *from, struct playerState_s *to );
 void MSG_ReadDeltaPlayerstate( msg_t *msg, struct playerState_s *from, struct playerState_s *to );
 
+// an entityState_t field order is a list of their numbers, which are
+// their places in the usual order
+#define	MAX_ENTITY_FIELDS	64
+
+int		MSG_NumEntityFields( void );
+const char	*MSG_EntityFieldName( int field );
+void	MSG_CountEntityFieldChanges( const entityState_t *from, const entityState_t *to, int *counts );
+qboolean	MSG_ParseEntityFieldOrder( const char *s, byte *order );
+void	MSG_EntityFieldOrderString( const byte *order, char *s, int size );
 
 void MSG_ReportChangeVectors_f( void );
 
@@ -171,6 +190,8 @@ void		NET_Shutdown( void );
 void		NET_Restart_f( void );
 void		NET_Config( qboolean enableNetworking );
 void		NET_FlushPacketQueue(void);
+void		NET_BeginSendBatch(void);
+void		NET_FlushSendBatch(void);
 void		NET_SendPacket (netsrc_t sock, int length, const void *data, netadr_t to);
 void		QDECL NET_OutOfBandPrint( netsrc_t net_socket, netadr_t adr, const char *format, ...) __attribute__ ((format (printf, 3, 4)));
 void		QDECL NET_OutOfBandData( netsrc_t sock, netadr_t adr, byte *format, int len );
@@ -186,6 +207,7 @@ qboolean	NET_GetLoopPacket (netsrc_t sock, netadr_t *net_from, msg_t *net_messag
 void		NET_JoinMulticast6(void);
 void		NET_LeaveMulticast6(void);
 void		NET_Sleep(int msec);
+qboolean	NET_SleepUntil(int time);
 
 
 #define	MAX_MSGLEN				16384		// max length of a message, which may
@@ -370,6 +392,7 @@ void	VM_Debug( int level );
 
 void	*VM_ArgPtr( intptr_t intValue );
 void	*VM_ExplicitArgPtr( vm_t *vm, intptr_t intValue );
+qboolean	VM_ArgBlockValid( intptr_t intValue, size_t size );
 
 #define	VMA(x) VM_ArgPtr(args[x])
 static ID_INLINE float _vmf(intptr_t x)
@@ -465,6 +488,10 @@ void	Cmd_TokenizeStringIgnoreQuotes( const char *text_in );
 // Takes a null terminated string.  Does not need to be /n terminated.
 // breaks the string up into arg tokens.
 
+int		Cmd_TokenizeStringTo( const char *text_in, qboolean ignoreQuotes, char **argv, int maxArgs, char *textOut );
+// The same into caller supplied storage, returning the argc.  textOut
+// needs strlen( text_in ) + maxArgs bytes.  Safe from other threads.
+
 void	Cmd_ExecuteString( const char *text );
 // Parses a single line of text into arguments and tries to execute it
 // as if it was typed at the console
@@ -641,6 +668,12 @@ fileHandle_t	FS_FCreateOpenPipeFile( const char *filename );
 
 fileHandle_t FS_SV_FOpenFileWrite( const char *filename );
 long		FS_SV_FOpenFileRead( const char *filename, fileHandle_t *fp );
+long		FS_SV_MapFile( const char *filename, const byte **data );
+// maps the file FS_SV_FOpenFileRead would open, returns -1 if it can't,
+// release it with Sys_UnmapFile
+int		FS_SV_FileTime( const char *filename, long *length );
+// the modification time and length of the file FS_SV_FOpenFileRead would
+// open, -1 if there's none
 void	FS_SV_Rename( const char *from, const char *to, qboolean safe );
 long		FS_FOpenFileRead( const char *qpath, fileHandle_t *file, qboolean uniqueFILE );
 // if uniqueFILE is true, then a new FILE will be fopened even if the file
@@ -1037,6 +1070,8 @@ void SV_Shutdown( char *finalmsg );
 void SV_Frame( int msec );
 void SV_PacketEvent( netadr_t from, msg_t *msg );
 int SV_FrameMsec(void);
+int SV_BenchmarkMsec( void );
+qboolean SV_Hibernating( void );
 qboolean SV_GameCommand( void );
 int SV_SendQueuedPackets(void);
 
@@ -1087,6 +1122,8 @@ void	Sys_Print( const char *msg );
 // Sys_Milliseconds should only be used for profiling purposes,
 // any game related timing information should come from event timestamps
 int		Sys_Milliseconds (void);
+int64_t	Sys_Microseconds (void);
+int		Sys_MicrosecondsUntil (int msec);
 
 qboolean Sys_RandomBytes( byte *string, int len );
 
@@ -1095,9 +1132,28 @@ void	Sys_DisplaySystemConsole( qboolean show );
 
 cpuFeatures_t Sys_GetProcessorFeatures( void );
 
+// worker threads must not touch anything but their own data,
+// returns NULL if the thread could not be started
+void	*Sys_CreateThread( void (*function)( void *data ), void *data );
+void	Sys_JoinThread( void *thread );
+
+// for threads that live longer and share some data with the main thread
+void	*Sys_CreateMutex( void );
+void	Sys_LockMutex( void *mutex );
+void	Sys_UnlockMutex( void *mutex );
+void	*Sys_CreateSignal( void );
+void	Sys_DestroySignal( void *signal );
+void	Sys_RaiseSignal( void *signal );
+void	Sys_WaitSignal( void *signal );
+// waits until the signal is raised, then lowers it again
+void	Sys_MemoryBarrier( void );
+
 void	Sys_SetErrorText( const char *text );
 
 void	Sys_SendPacket( int length, const void *data, netadr_t to );
+void	Sys_SendPacketDirect( int length, const void *data, netadr_t to );
+// right away even during a send batch, without printing errors,
+// so other threads can use it
 
 qboolean	Sys_StringToAdr( const char *s, netadr_t *a, netadrtype_t family );
 //Does NOT parse port numbers, only base addresses.
@@ -1106,6 +1162,9 @@ qboolean	Sys_IsLANAddress (netadr_t adr);
 void		Sys_ShowIP(void);
 
 FILE	*Sys_FOpen( const char *ospath, const char *mode );
+int		Sys_FileTime( const char *path, long *length );
+void	*Sys_MapFile( FILE *f, long length );
+void	Sys_UnmapFile( void *data, long length );
 qboolean Sys_Mkdir( const char *path );
 FILE	*Sys_Mkfifo( const char *ospath );
 char	*Sys_Cwd( void );
@@ -1187,6 +1246,28 @@ typedef struct {
 	huff_t		decompressor;
 } huffman_t;
 
+// a tree that doesn't change anymore, like the one of the netchan
+// messages, can be written and read with lookup tables instead of
+// following the tree a bit at a time
+#define	HUFF_LOOKUP_BITS	11
+
+typedef struct {
+	unsigned int	code;		// the bits in the order they are sent, first one lowest
+	int				length;		// 0 if longer than 32 bits, then send from node
+	node_t			*node;
+} huffCode_t;
+
+typedef struct {
+	short			symbol;		// INTERNAL_NODE if the code is longer than the lookup
+	short			length;		// bits used up
+	node_t			*node;		// where to go on from when it is
+} huffLookup_t;
+
+typedef struct {
+	huffCode_t		codes[HMAX+1];
+	huffLookup_t	lookup[1<<HUFF_LOOKUP_BITS];
+} huffTables_t;
+
 void	Huff_Compress(msg_t *buf, int offset);
 void	Huff_Decompress(msg_t *buf, int offset);
 void	Huff_Init(huffman_t *huff);
@@ -1198,6 +1279,15 @@ void	Huff_offsetTransmit (huff_t *huff, int ch, byte *fout, int *offset);
 void	Huff_putBit( int bit, byte *fout, int *offset);
 int		Huff_getBit( byte *fout, int *offset);
 
+void	Huff_BuildTables( huff_t *huff, huffTables_t *tables );
+void	Huff_tableTransmit( const huffTables_t *tables, int ch, byte *fout, int *offset );
+void	Huff_tableReceive( const huffTables_t *tables, int *ch, byte *fin, int *offset, int size );
+// the same as Huff_offsetTransmit and Huff_offsetReceive with the tree the tables
+// were built from, size is the bytes of fin that may be looked at
+void	Huff_putBits( int bits, int count, byte *fout, int *offset );
+int		Huff_getBits( byte *fin, int count, int *offset );
+// count bits at once, as many Huff_putBit or Huff_getBit calls would, up to 24
+
 // don't use if you don't know what you're doing.
 int		Huff_getBloc(void);
 void	Huff_setBloc(int _bloc);
@@ -1205,6 +1295,51 @@ void	Huff_setBloc(int _bloc);
 
 extern huffman_t clientHuffTables;
 
+//
+// rangecoder.c
+//
+
+// an adaptive binary range coder for the symbols of MSG_WriteBits, which
+// server messages can be coded with instead of huffman
+#define	RANGE_MAX_SYMBOL_BYTES	32		// the most a symbol and the end of the coding take
+#define	RANGE_CHECKPOINTS		16		// ids in a nibble of the message header, 0 is the initial model
+
+#define	RANGE_FLAG_CONTEXTS		35
+
+typedef struct {
+	unsigned short	flags[RANGE_FLAG_CONTEXTS];	// single bits, by the symbol before them
+	unsigned short	bits[8][128];		// the bits below the bytes of a symbol, by how many
+	unsigned short	bytes[10][256];		// by the bytes in the symbol and which one it is
+} rangeModel_t;
+
+typedef struct rangeCoder_s {
+	rangeModel_t	model;		// adapts to what is coded with it
+
+	byte			*data;
+	int				start;		// where the coded bytes begin
+	int				size;		// the bytes of data there are
+	int				pos;		// of the next byte written or read
+
+	uint64_t		low;		// encoding
+	unsigned int	range;
+	int				cache;
+	int				cacheSize;
+	unsigned int	code;		// decoding
+
+	int				lastBits;	// of the last symbol, for the flag contexts
+	int				lastFlag;
+} rangeCoder_t;
+
+void	Range_InitModel( rangeModel_t *model );
+void	Range_StartEncoding( rangeCoder_t *rc, byte *data, int size, int start );
+void	Range_EncodeBits( rangeCoder_t *rc, int value, int bits );
+int		Range_EncodedSize( const rangeCoder_t *rc );
+// the most bytes the coding can end up with, all of them once finished
+int		Range_FinishEncoding( rangeCoder_t *rc );
+void	Range_StartDecoding( rangeCoder_t *rc, byte *data, int size, int start );
+int		Range_DecodeBits( rangeCoder_t *rc, int bits );
+// returns the bits without sign extension
+
 #define	SV_ENCODE_START		4
 #define SV_DECODE_START		12
 #define	CL_ENCODE_START		12
@@ -0,0 +1,439 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// rangecoder.c -- adaptive binary range coding of message symbols
+
+/*
+=============================================================================
+
+The huffman coding of the messages uses a single tree for every byte of
+every symbol, and sends the bits below a byte raw.  Here every bit is
+coded with a probability that adapts to what was coded before, with the
+context being where in a symbol of how many bits it is.  The flag bits
+of the delta functions depend on the symbol before them.
+
+The coder is the carryless one of LZMA, with 12 bit probabilities.  The
+first byte it writes is always zero and isn't sent, and neither are the
+zero bytes it ends with, bytes read past the end are zero.
+
+=============================================================================
+*/
+
+#include "q_shared.h"
+#include "qcommon.h"
+
+#define	RANGE_PROB_BITS		12
+#define	RANGE_PROB_ONE		( 1 << RANGE_PROB_BITS )
+#define	RANGE_MOVE_BITS		4			// how fast the probabilities adapt
+#define	RANGE_TOP			( 1 << 24 )
+
+extern int		msg_hData[256];
+
+static rangeModel_t	range_initialModel;
+static qboolean		range_initialized;
+
+/*
+============
+Range_ByteProbabilities
+
+The bytes start out as likely as the huffman tree has them
+============
+*/
+static void Range_ByteProbabilities( unsigned short *probs ) {
+	int		node, depth, first, half;
+	int		i, zeros, total, p;
+
+	for ( node = 1 ; node < 256 ; node++ ) {
+		for ( depth = 0 ; ( 2 << depth ) <= node ; depth++ ) {
+		}
+		first = ( node - ( 1 << depth ) ) << ( 8 - depth );
+		half = 1 << ( 7 - depth );
+
+		zeros = 1;
+		total = 2;
+		for ( i = 0 ; i < half * 2 ; i++ ) {
+			if ( i < half ) {
+				zeros += msg_hData[first + i];
+			}
+			total += msg_hData[first + i];
+		}
+
+		p = (int)( (double)zeros * RANGE_PROB_ONE / total );
+		if ( p < 31 ) {
+			p = 31;
+		} else if ( p > RANGE_PROB_ONE - 31 ) {
+			p = RANGE_PROB_ONE - 31;
+		}
+		probs[node] = p;
+	}
+}
+
+/*
+============
+Range_InitModel
+
+What both sides start from, the first time from the main thread
+============
+*/
+void Range_InitModel( rangeModel_t *model ) {
+	int		i, j;
+
+	if ( !range_initialized ) {
+		for ( i = 0 ; i < RANGE_FLAG_CONTEXTS ; i++ ) {
+			range_initialModel.flags[i] = RANGE_PROB_ONE / 2;
+		}
+		for ( i = 0 ; i < 8 ; i++ ) {
+			for ( j = 0 ; j < 128 ; j++ ) {
+				range_initialModel.bits[i][j] = RANGE_PROB_ONE / 2;
+			}
+		}
+		for ( i = 0 ; i < 10 ; i++ ) {
+			Range_ByteProbabilities( range_initialModel.bytes[i] );
+		}
+		range_initialized = qtrue;
+	}
+
+	*model = range_initialModel;
+}
+
+/*
+=============================================================================
+
+ENCODING
+
+=============================================================================
+*/
+
+/*
+============
+Range_PutByte
+============
+*/
+static ID_INLINE void Range_PutByte( rangeCoder_t *rc, int b ) {
+	// the first byte is always zero
+	if ( rc->pos >= rc->start && rc->pos < rc->size ) {
+		rc->data[rc->pos] = b;
+	}
+	rc->pos++;
+}
+
+/*
+============
+Range_ShiftLow
+
+Sends the top byte of low, unless a carry could still change it
+============
+*/
+static ID_INLINE void Range_ShiftLow( rangeCoder_t *rc ) {
+	int		carry;
+
+	if ( (unsigned int)rc->low < 0xff000000 || ( rc->low >> 32 ) ) {
+		carry = (int)( rc->low >> 32 );
+		Range_PutByte( rc, ( rc->cache + carry ) & 0xff );
+		for ( ; rc->cacheSize > 1 ; rc->cacheSize-- ) {
+			Range_PutByte( rc, ( 0xff + carry ) & 0xff );
+		}
+		rc->cacheSize = 0;
+		rc->cache = (int)( rc->low >> 24 ) & 0xff;
+	}
+	rc->cacheSize++;
+	rc->low = ( rc->low & 0x00ffffff ) << 8;
+}
+
+/*
+============
+Range_EncodeBit
+============
+*/
+static ID_INLINE void Range_EncodeBit( rangeCoder_t *rc, unsigned short *prob, int bit ) {
+	unsigned int	bound;
+
+	bound = ( rc->range >> RANGE_PROB_BITS ) * *prob;
+	if ( !bit ) {
+		rc->range = bound;
+		*prob += ( RANGE_PROB_ONE - *prob ) >> RANGE_MOVE_BITS;
+	} else {
+		rc->low += bound;
+		rc->range -= bound;
+		*prob -= *prob >> RANGE_MOVE_BITS;
+	}
+
+	while ( rc->range < RANGE_TOP ) {
+		rc->range <<= 8;
+		Range_ShiftLow( rc );
+	}
+}
+
+/*
+============
+Range_EncodeTree
+
+count bits of value, the highest first, each in the context of the ones before it
+============
+*/
+static ID_INLINE void Range_EncodeTree( rangeCoder_t *rc, unsigned short *probs, int value, int count ) {
+	int		node, bit;
+
+	node = 1;
+	while ( count-- ) {
+		bit = ( value >> count ) & 1;
+		Range_EncodeBit( rc, &probs[node], bit );
+		node = node * 2 + bit;
+	}
+}
+
+/*
+============
+Range_StartEncoding
+============
+*/
+void Range_StartEncoding( rangeCoder_t *rc, byte *data, int size, int start ) {
+	rc->data = data;
+	rc->start = start;
+	rc->size = size;
+	rc->pos = start - 1;
+	rc->low = 0;
+	rc->range = 0xffffffff;
+	rc->cache = 0;
+	rc->cacheSize = 1;
+	rc->lastBits = 0;
+	rc->lastFlag = 0;
+}
+
+/*
+============
+Range_EncodeBits
+
+Like MSG_WriteBits, bits can be negative
+============
+*/
+void Range_EncodeBits( rangeCoder_t *rc, int value, int bits ) {
+	unsigned int	v;
+	int				nbits, nbytes, context;
+
+	if ( bits < 0 ) {
+		bits = -bits;
+	}
+	v = value & ( 0xffffffff >> ( 32 - bits ) );
+
+	if ( bits == 1 ) {
+		if ( rc->lastBits == 1 ) {
+			context = 33 + rc->lastFlag;
+		} else {
+			context = rc->lastBits;
+		}
+		Range_EncodeBit( rc, &rc->model.flags[context], v );
+		rc->lastBits = 1;
+		rc->lastFlag = v;
+		return;
+	}
+
+	nbits = bits & 7;
+	if ( nbits ) {
+		Range_EncodeTree( rc, rc->model.bits[nbits], v & ( ( 1 << nbits ) - 1 ), nbits );
+		v >>= nbits;
+	}
+
+	nbytes = bits >> 3;
+	context = nbytes * ( nbytes - 1 ) / 2;
+	for ( ; nbytes > 0 ; nbytes--, context++, v >>= 8 ) {
+		Range_EncodeTree( rc, rc->model.bytes[context], v & 0xff, 8 );
+	}
+
+	rc->lastBits = bits;
+}
+
+/*
+============
+Range_EncodedSize
+============
+*/
+int Range_EncodedSize( const rangeCoder_t *rc ) {
+	return rc->pos + rc->cacheSize + 4;
+}
+
+/*
+============
+Range_FinishEncoding
+
+Returns the end of the coded bytes
+============
+*/
+int Range_FinishEncoding( rangeCoder_t *rc ) {
+	uint64_t	mask, value;
+	int			i, end;
+
+	// anything from low to low + range reads the same, the zero
+	// bytes at the end of the one with the most needn't be sent
+	for ( mask = 0xffffffff ; mask ; mask >>= 8 ) {
+		value = ( rc->low + mask ) & ~mask;
+		if ( value < rc->low + rc->range ) {
+			rc->low = value;
+			break;
+		}
+	}
+
+	for ( i = 0 ; i < 5 ; i++ ) {
+		Range_ShiftLow( rc );
+	}
+
+	// the decoder reads at most the four bytes of low past the end
+	end = rc->pos;
+	if ( end > rc->size ) {
+		end = rc->size;
+	}
+	for ( i = 0 ; i < 4 && end > rc->start && !rc->data[end - 1] ; i++ ) {
+		end--;
+	}
+
+	return end;
+}
+
+/*
+=============================================================================
+
+DECODING
+
+=============================================================================
+*/
+
+/*
+============
+Range_GetByte
+============
+*/
+static ID_INLINE int Range_GetByte( rangeCoder_t *rc ) {
+	int		b;
+
+	b = rc->pos < rc->size ? rc->data[rc->pos] : 0;
+	rc->pos++;
+	return b;
+}
+
+/*
+============
+Range_DecodeBit
+============
+*/
+static ID_INLINE int Range_DecodeBit( rangeCoder_t *rc, unsigned short *prob ) {
+	unsigned int	bound;
+	int				bit;
+
+	bound = ( rc->range >> RANGE_PROB_BITS ) * *prob;
+	if ( rc->code < bound ) {
+		rc->range = bound;
+		*prob += ( RANGE_PROB_ONE - *prob ) >> RANGE_MOVE_BITS;
+		bit = 0;
+	} else {
+		rc->code -= bound;
+		rc->range -= bound;
+		*prob -= *prob >> RANGE_MOVE_BITS;
+		bit = 1;
+	}
+
+	while ( rc->range < RANGE_TOP ) {
+		rc->range <<= 8;
+		rc->code = ( rc->code << 8 ) | Range_GetByte( rc );
+	}
+
+	return bit;
+}
+
+/*
+============
+Range_DecodeTree
+============
+*/
+static ID_INLINE int Range_DecodeTree( rangeCoder_t *rc, unsigned short *probs, int count ) {
+	int		node, i;
+
+	node = 1;
+	for ( i = 0 ; i < count ; i++ ) {
+		node = node * 2 + Range_DecodeBit( rc, &probs[node] );
+	}
+
+	return node - ( 1 << count );
+}
+
+/*
+============
+Range_StartDecoding
+
+size is the bytes of data there are, the ones after it read as zero
+============
+*/
+void Range_StartDecoding( rangeCoder_t *rc, byte *data, int size, int start ) {
+	int		i;
+
+	rc->data = data;
+	rc->start = start;
+	rc->size = size;
+	rc->pos = start;
+	rc->range = 0xffffffff;
+	rc->code = 0;
+	rc->lastBits = 0;
+	rc->lastFlag = 0;
+
+	for ( i = 0 ; i < 4 ; i++ ) {
+		rc->code = ( rc->code << 8 ) | Range_GetByte( rc );
+	}
+}
+
+/*
+============
+Range_DecodeBits
+============
+*/
+int Range_DecodeBits( rangeCoder_t *rc, int bits ) {
+	unsigned int	value;
+	int				nbits, nbytes, context, i;
+
+	if ( bits < 0 ) {
+		bits = -bits;
+	}
+
+	if ( bits == 1 ) {
+		if ( rc->lastBits == 1 ) {
+			context = 33 + rc->lastFlag;
+		} else {
+			context = rc->lastBits;
+		}
+		value = Range_DecodeBit( rc, &rc->model.flags[context] );
+		rc->lastBits = 1;
+		rc->lastFlag = value;
+		return value;
+	}
+
+	value = 0;
+	nbits = bits & 7;
+	if ( nbits ) {
+		value = Range_DecodeTree( rc, rc->model.bits[nbits], nbits );
+	}
+
+	nbytes = bits >> 3;
+	context = nbytes * ( nbytes - 1 ) / 2;
+	for ( i = 0 ; i < nbytes ; i++, context++ ) {
+		value |= (unsigned int)Range_DecodeTree( rc, rc->model.bytes[context], 8 ) << ( nbits + i * 8 );
+	}
+
+	rc->lastBits = bits;
+	return (int)value;
+}
@@ -759,6 +759,29 @@ void *VM_ArgPtr( intptr_t intValue ) {
 	}
 }
 
+/*
+============
+VM_ArgBlockValid
+
+qtrue if the size bytes at a pointer argument are all in the data of
+the VM, native code can point anywhere like with VM_ArgPtr
+============
+*/
+qboolean VM_ArgBlockValid( intptr_t intValue, size_t size ) {
+	size_t	dataLength;
+
+	if ( !currentVM || currentVM->entryPoint ) {
+		return qtrue;
+	}
+
+	dataLength = (size_t)currentVM->dataMask + 1;
+	if ( intValue < 0 || (size_t)intValue > dataLength || size > dataLength - (size_t)intValue ) {
+		return qfalse;
+	}
+
+	return qtrue;
+}
+
 void *VM_ExplicitArgPtr( vm_t *vm, intptr_t intValue ) {
 	if ( !intValue ) {
 		return NULL;
@@ -57,7 +57,11 @@ typedef struct svEntity_s {
 	int			clusternums[MAX_ENT_CLUSTERS];
 	int			lastCluster;		// if all the clusters don't fit in clusternums
 	int			areanum, areanum2;
-	int			snapshotCounter;	// used to prevent double adding from portal views
+
+	// the clusters and areas stay valid while every side of the abs box
+	// is less than leafMargin away from where the leafs were last found
+	vec3_t		leafMins, leafMaxs;
+	float		leafMargin;			// 0 if the leafs have to be found again
 } svEntity_t;
 
 typedef enum {
@@ -75,7 +79,6 @@ typedef struct {
 	// https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=475
 	// the serverId associated with the current checksumFeed (always <= serverId)
 	int       checksumFeedServerId;	
-	int				snapshotCounter;	// incremented for each snapshot built
 	int				timeResidual;		// <= 1000 / sv_frame->value
 	int				nextFrameTime;		// when time > nextFrameTime, process world
 	char			*configstrings[MAX_CONFIGSTRINGS];
@@ -93,6 +96,9 @@ typedef struct {
 
 	int				restartTime;
 	int				time;
+
+	qboolean		hasEntityFieldOrder;	// sent to the clients in sv_entityFieldOrder
+	byte			entityFieldOrder[MAX_ENTITY_FIELDS];
 } server_t;
 
 
@@ -130,6 +136,33 @@ typedef struct netchan_buffer_s {
 	struct netchan_buffer_s *next;
 } netchan_buffer_t;
 
+typedef struct {
+	char			name[MAX_QPATH];
+	const byte		*data;				// mapped read only
+	int				size;
+	int				refCount;			// clients downloading it, unmapped at zero
+	int				mtime;				// of the file when it was mapped
+	int				checkTime;			// svs.time the file was last compared
+	qboolean		stale;				// the file changed, new downloads map it again
+	int				validSize;			// what can still be read if the file got cut short
+} downloadMap_t;
+
+#define	MAX_PENDING_CHECKPOINTS	4
+
+typedef struct {
+	rangeModel_t	model;			// after the message that made it
+	int				id;				// 0 for the initial model or when not in use
+	int				sequence;		// of the message that made it, -1 until sent
+} rangeCheckpoint_t;
+
+typedef struct {
+	rangeCoder_t		coder;		// of the message being written
+	rangeCheckpoint_t	base;		// the last checkpoint the client has acknowledged
+	rangeCheckpoint_t	pending[MAX_PENDING_CHECKPOINTS];	// made by messages not acknowledged yet
+	int					making;		// pending checkpoint of the message being written, -1 for none
+	int					lastId;
+} rangeChannel_t;
+
 typedef struct client_s {
 	clientState_t	state;
 	char			userinfo[MAX_INFO_STRING];		// name, etc
@@ -153,6 +186,7 @@ typedef struct client_s {
 	// downloading
 	char			downloadName[MAX_QPATH]; // if not empty string, we are downloading
 	fileHandle_t	download;			// file being downloaded
+	downloadMap_t	*downloadMap;		// or the mapping it is sent from
  	int				downloadSize;		// total bytes (can't use EOF because of paks)
  	int				downloadCount;		// bytes sent
 	int				downloadClientBlock;	// last block we sent to the client, awaiting ack
@@ -199,6 +233,11 @@ typedef struct client_s {
 #ifdef LEGACY_PROTOCOL
 	qboolean		compat;
 #endif
+
+	qboolean		fieldOrder;			// can read SNAPFLAG_FIELD_ORDER snapshots
+
+	qboolean		rangeCoding;		// messages to the client are range coded
+	rangeChannel_t	*range;				// only allocated for those
 } client_t;
 
 //=============================================================================
@@ -243,6 +282,10 @@ typedef struct {
 	netadr_t	redirectAddress;			// for rcon return messages
 
 	netadr_t	authorizeAddress;			// for rcon return messages
+
+	qboolean	hibernating;				// no game frames until someone connects
+	int			hibernateTime;				// svs.time it started
+	int			emptyTime;					// svs.time nobody was connected since
 } serverStatic_t;
 
 #define SERVER_MAXBANS	1024
@@ -293,6 +336,17 @@ extern	cvar_t	*sv_lanForceRate;
 extern	cvar_t	*sv_strictAuth;
 #endif
 extern	cvar_t	*sv_banFile;
+extern	cvar_t	*sv_traceCache;
+extern	cvar_t	*sv_snapshotThreads;
+extern	cvar_t	*sv_profile;
+extern	cvar_t	*sv_benchmark;
+extern	cvar_t	*sv_benchmarkBots;
+extern	cvar_t	*sv_benchmarkSkill;
+extern	cvar_t	*sv_hibernateTime;
+extern	cvar_t	*sv_queryThread;
+extern	cvar_t	*sv_fieldOrder;
+extern	cvar_t	*sv_fieldOrderTime;
+extern	cvar_t	*sv_rangeCoding;
 
 extern	serverBan_t serverBans[SERVER_MAXBANS];
 extern	int serverBansCount;
@@ -329,6 +383,11 @@ extern leakyBucket_t outboundLeakyBucket;
 qboolean SVC_RateLimit( leakyBucket_t *bucket, int burst, int period );
 qboolean SVC_RateLimitAddress( netadr_t from, int burst, int period );
 
+void SV_ClearQueryCache( void );
+// getstatus and getinfo replies are rebuilt on the next query
+int SV_UpdateQueryReplies( void );
+void SV_CopyQueryReplies( char *status, char *players, int playersSize, char *info );
+
 void SV_FinalMessage (char *message);
 void QDECL SV_SendServerCommand( client_t *cl, const char *fmt, ...) __attribute__ ((format (printf, 2, 3)));
 
@@ -360,6 +419,7 @@ void SV_SpawnServer( char *server, qboolean killBots );
 //
 // sv_client.c
 //
+challenge_t *SV_NewChallenge( netadr_t from, int clientChallenge, int *oldestClientTime );
 void SV_GetChallenge(netadr_t from);
 
 void SV_DirectConnect( netadr_t from );
@@ -398,6 +458,70 @@ void SV_SendMessageToClient( msg_t *msg, client_t *client );
 void SV_SendClientMessages( void );
 void SV_SendClientSnapshot( client_t *client );
 
+//
+// sv_profile.c
+//
+typedef enum {
+	PROF_PACKETS,		// SV_PacketEvent since the last frame
+	PROF_PINGS,			// SV_CalcPings
+	PROF_BOTS,			// SV_BotFrame
+	PROF_GAME,			// GAME_RUN_FRAME
+	PROF_TIMEOUTS,		// SV_CheckTimeouts
+	PROF_BUILD,			// gathering and copying snapshot entities
+	PROF_ENCODE,		// writing snapshot messages
+	PROF_SEND,			// transmitting them
+	PROF_MESSAGES,		// all of SV_SendClientMessages
+	PROF_FRAME,			// all of SV_Frame
+
+	NUM_PROFILE_PHASES
+} profilePhase_t;
+
+int64_t	SV_ProfileStart( void );
+void	SV_ProfileEnd( profilePhase_t phase, int64_t start );
+// adds the time since a SV_ProfileStart to the phase, if sv_profile or a log is on
+
+void	SV_ProfileEndFrame( void );
+void	SV_ProfileShutdown( void );
+void	SV_Profile_f( void );
+
+void	SV_BenchmarkStart( void );
+// adds the sv_benchmarkBots when sv_benchmark is set on a dedicated server
+
+//
+// sv_query.c
+//
+void		SV_QueryInit( void );
+void		SV_QueryShutdown( void );
+void		SV_QueryFrame( void );
+qboolean	SV_QueueQuery( netadr_t from, msg_t *msg );
+// qtrue if the packet was handed to the query thread
+
+void		SV_QueryLock( void );
+void		SV_QueryUnlock( void );
+// around the rate limit buckets and svs.challenges, which the query
+// thread uses as well
+
+//
+// sv_fieldorder.c
+//
+void		SV_LoadFieldOrder( void );
+// sets sv.entityFieldOrder and sv_entityFieldOrder for a new map
+
+qboolean	SV_CountingFieldChanges( void );
+void		SV_AddFieldChanges( const int *counts );
+// counts are MSG_CountEntityFieldChanges of the entity deltas of a frame
+
+//
+// sv_rangecoding.c
+//
+void		SV_InitRangeCoding( client_t *client );
+void		SV_FreeRangeCoding( client_t *client );
+void		SV_StartRangeCoding( client_t *client, msg_t *msg, qboolean checkpoint );
+// after MSG_Init, checkpoint is for the messages the client reads all of
+void		SV_FinishRangeCoding( client_t *client, msg_t *msg );
+void		SV_RangeCodingSent( client_t *client, msg_t *msg );
+void		SV_RangeCodingAcknowledged( client_t *client );
+
 //
 // sv_game.c
 //
@@ -453,6 +577,10 @@ clipHandle_t SV_ClipHandleForEntity( const sharedEntity_t *ent );
 
 
 void SV_SectorList_f( void );
+void SV_TraceCache_f( void );
+
+void SV_ClearTraceCache( void );
+// forgets all the traces remembered by sv_traceCache, called every game frame
 
 
 int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount );
@@ -480,6 +608,11 @@ void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
 // passEntityNum is explicitly excluded from clipping checks (normally ENTITYNUM_NONE)
 
 
+void SV_TraceBatch( trace_t *results, int numTraces, const vec3_t *starts, vec3_t mins, vec3_t maxs, const vec3_t *ends, int passEntityNum, int contentmask, int capsule );
+// same as numTraces calls to SV_Trace, but the world tree and the entity
+// sectors are only walked once for the whole set
+
+
 void SV_ClipToEntity( trace_t *trace, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int entityNum, int contentmask, int capsule );
 // clip to a specific entity
 
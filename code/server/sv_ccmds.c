@@ -302,6 +302,7 @@ static void SV_MapRestart_f( void ) {
 	// run a few frames to allow everything to settle
 	for (i = 0; i < 3; i++)
 	{
+		SV_ClearTraceCache();
 		VM_Call (gvm, GAME_RUN_FRAME, sv.time);
 		sv.time += 100;
 		svs.time += 100;
@@ -350,6 +351,7 @@ static void SV_MapRestart_f( void ) {
 	}	
 
 	// run another frame to allow things to look at all the players
+	SV_ClearTraceCache();
 	VM_Call (gvm, GAME_RUN_FRAME, sv.time);
 	sv.time += 100;
 	svs.time += 100;
@@ -1371,6 +1373,283 @@ static void SV_DumpUser_f( void ) {
 }
 
 
+/*
+=================
+SV_TraceRecord_f
+
+Logs every collision trace of the session for replaying with cmreplay
+=================
+*/
+static void SV_TraceRecord_f( void ) {
+	char		filename[MAX_QPATH];
+
+	if ( Cmd_Argc() != 2 ) {
+		Com_Printf( "Usage: tracerecord <name | stop>\n" );
+		return;
+	}
+
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "stop" ) ) {
+		if ( !CM_TraceRecording() ) {
+			Com_Printf( "Not recording traces.\n" );
+			return;
+		}
+		CM_EndTraceRecord();
+		return;
+	}
+
+	if ( !com_sv_running->integer ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	Com_sprintf( filename, sizeof( filename ), "traces/%s.trc", Cmd_Argv( 1 ) );
+	CM_BeginTraceRecord( filename );
+}
+
+/*
+=================
+SV_RandomWorldPoints
+
+The same seed gives the same points for the same map
+=================
+*/
+static vec3_t *SV_RandomWorldPoints( int count ) {
+	int			i, seed;
+	vec3_t		worldMins, worldMaxs;
+	vec3_t		*points;
+
+	CM_ModelBounds( CM_InlineModel( 0 ), worldMins, worldMaxs );
+	points = Z_Malloc( count * sizeof( *points ) );
+	seed = 0x5eed;
+	for ( i = 0 ; i < count ; i++ ) {
+		points[i][0] = worldMins[0] + Q_random( &seed ) * ( worldMaxs[0] - worldMins[0] );
+		points[i][1] = worldMins[1] + Q_random( &seed ) * ( worldMaxs[1] - worldMins[1] );
+		points[i][2] = worldMins[2] + Q_random( &seed ) * ( worldMaxs[2] - worldMins[2] );
+	}
+
+	return points;
+}
+
+/*
+=================
+SV_TraceBench_f
+
+Replays the same set of random collision queries through the loaded map
+and reports how long each kind took, for comparing collision changes
+=================
+*/
+static void SV_TraceBench_f( void ) {
+	int			i, count;
+	int			start, pointTime, boxTime, traceTime;
+	int			leafs[64], lastLeaf;
+	vec3_t		boxMins, boxMaxs;
+	vec3_t		mins = { -15, -15, -24 }, maxs = { 15, 15, 32 };
+	vec3_t		*points;
+	trace_t		trace;
+
+	if ( !com_sv_running->integer ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	count = 100000;
+	if ( Cmd_Argc() > 1 ) {
+		count = atoi( Cmd_Argv( 1 ) );
+	}
+	if ( count < 1 ) {
+		Com_Printf( "Usage: tracebench [count]\n" );
+		return;
+	}
+
+	// pick the queries before timing anything
+	points = SV_RandomWorldPoints( count * 2 );
+
+	start = Sys_Milliseconds();
+	for ( i = 0 ; i < count ; i++ ) {
+		CM_PointLeafnum( points[i] );
+	}
+	pointTime = Sys_Milliseconds() - start;
+
+	start = Sys_Milliseconds();
+	for ( i = 0 ; i < count ; i++ ) {
+		VectorAdd( points[i], mins, boxMins );
+		VectorAdd( points[i], maxs, boxMaxs );
+		CM_BoxLeafnums( boxMins, boxMaxs, leafs, ARRAY_LEN( leafs ), &lastLeaf );
+	}
+	boxTime = Sys_Milliseconds() - start;
+
+	start = Sys_Milliseconds();
+	for ( i = 0 ; i < count ; i++ ) {
+		CM_BoxTrace( &trace, points[i], points[count + i], mins, maxs, 0, MASK_PLAYERSOLID, qfalse );
+	}
+	traceTime = Sys_Milliseconds() - start;
+
+	Z_Free( points );
+
+	Com_Printf( "%i queries: %i msec point leafs, %i msec box leafs, %i msec box traces\n",
+		count, pointTime, boxTime, traceTime );
+}
+
+#define	MAX_STRESS_THREADS	16
+#define	MAX_STRESS_LEAFS	32
+
+typedef struct {
+	trace_t		worldTrace;
+	trace_t		boxTrace;
+	int			contents;
+	int			boxContents;
+	int			numLeafs;
+	int			lastLeaf;
+	int			leafs[MAX_STRESS_LEAFS];
+} stressResult_t;
+
+typedef struct {
+	cmContext_t		*ctx;
+	const vec3_t	*points;
+	int				count;
+	int				first;		// threads start at different queries to collide more
+	stressResult_t	*results;
+	void			*thread;
+} stressWork_t;
+
+/*
+=================
+SV_TraceStressQueries
+
+Runs every query once through the work's collision context
+=================
+*/
+static void SV_TraceStressQueries( void *data ) {
+	stressWork_t	*work = data;
+	stressResult_t	*r;
+	int				i, n;
+	float			size;
+	vec3_t			mins = { -15, -15, -24 }, maxs = { 15, 15, 32 };
+	vec3_t			boxMins, boxMaxs, origin;
+	const float		*start, *end;
+	clipHandle_t	h;
+
+	for ( n = 0 ; n < work->count ; n++ ) {
+		i = ( work->first + n ) % work->count;
+		r = &work->results[i];
+		start = work->points[i];
+		end = work->points[work->count + i];
+
+		CM_ContextBoxTrace( work->ctx, &r->worldTrace, start, end, mins, maxs, 0, MASK_PLAYERSOLID, i & 1 );
+		r->contents = CM_ContextPointContents( work->ctx, start, 0 );
+
+		VectorAdd( start, mins, boxMins );
+		VectorAdd( start, maxs, boxMaxs );
+		r->numLeafs = CM_ContextBoxLeafnums( work->ctx, boxMins, boxMaxs, r->leafs, MAX_STRESS_LEAFS, &r->lastLeaf );
+
+		// an entity sized box halfway along the trace
+		size = 8 + ( i & 63 );
+		VectorSet( boxMins, -size, -size, -size );
+		VectorSet( boxMaxs, size, size, size );
+		VectorAdd( start, end, origin );
+		VectorScale( origin, 0.5f, origin );
+		h = CM_ContextTempBoxModel( work->ctx, boxMins, boxMaxs, qfalse );
+		CM_ContextTransformedBoxTrace( work->ctx, &r->boxTrace, start, end, mins, maxs, h,
+			MASK_PLAYERSOLID, origin, vec3_origin, i & 1 );
+		r->boxContents = CM_ContextTransformedPointContents( work->ctx, end, h, origin, vec3_origin );
+	}
+}
+
+/*
+=================
+SV_TraceStress_f
+
+Runs the same random collision queries from several threads at once,
+each with its own collision context, and checks that every thread gets
+exactly the results of a single threaded run
+=================
+*/
+static void SV_TraceStress_f( void ) {
+	int				i, j, count, numThreads, mismatches;
+	int				start, singleTime, threadTime;
+	size_t			resultSize;
+	vec3_t			*points;
+	stressWork_t	reference;
+	stressWork_t	work[MAX_STRESS_THREADS];
+
+	if ( !com_sv_running->integer ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	numThreads = 4;
+	if ( Cmd_Argc() > 1 ) {
+		numThreads = atoi( Cmd_Argv( 1 ) );
+	}
+	count = 20000;
+	if ( Cmd_Argc() > 2 ) {
+		count = atoi( Cmd_Argv( 2 ) );
+	}
+	if ( numThreads < 1 || numThreads > MAX_STRESS_THREADS || count < 1 ) {
+		Com_Printf( "Usage: tracestress [threads (1-%i)] [count]\n", MAX_STRESS_THREADS );
+		return;
+	}
+
+	points = SV_RandomWorldPoints( count * 2 );
+	resultSize = count * sizeof( stressResult_t );
+
+	// the single threaded run everything is compared against
+	Com_Memset( &reference, 0, sizeof( reference ) );
+	reference.ctx = CM_AllocContext();
+	reference.points = (const vec3_t *)points;
+	reference.count = count;
+	reference.results = Z_Malloc( resultSize );
+
+	start = Sys_Milliseconds();
+	SV_TraceStressQueries( &reference );
+	singleTime = Sys_Milliseconds() - start;
+
+	// contexts and results have to be allocated up front, the
+	// zone allocator can't be used from the worker threads
+	for ( i = 0 ; i < numThreads ; i++ ) {
+		work[i] = reference;
+		work[i].ctx = CM_AllocContext();
+		work[i].first = i * count / numThreads;
+		work[i].results = Z_Malloc( resultSize );
+	}
+
+	start = Sys_Milliseconds();
+	for ( i = 0 ; i < numThreads ; i++ ) {
+		work[i].thread = Sys_CreateThread( SV_TraceStressQueries, &work[i] );
+		if ( !work[i].thread ) {
+			Com_Printf( "tracestress: couldn't start thread %i, running it here\n", i );
+			SV_TraceStressQueries( &work[i] );
+		}
+	}
+	for ( i = 0 ; i < numThreads ; i++ ) {
+		if ( work[i].thread ) {
+			Sys_JoinThread( work[i].thread );
+		}
+	}
+	threadTime = Sys_Milliseconds() - start;
+
+	mismatches = 0;
+	for ( i = 0 ; i < numThreads ; i++ ) {
+		for ( j = 0 ; j < count ; j++ ) {
+			if ( memcmp( &work[i].results[j], &reference.results[j], sizeof( stressResult_t ) ) ) {
+				if ( mismatches < 10 ) {
+					Com_Printf( "thread %i query %i: results differ\n", i, j );
+				}
+				mismatches++;
+			}
+		}
+		Z_Free( work[i].results );
+		CM_FreeContext( work[i].ctx );
+	}
+
+	Z_Free( reference.results );
+	CM_FreeContext( reference.ctx );
+	Z_Free( points );
+
+	Com_Printf( "%i queries: %i msec single threaded, %i msec on %i threads, %i mismatches\n",
+		count, singleTime, threadTime, numThreads, mismatches );
+}
+
 /*
 =================
 SV_KillServer
@@ -1425,6 +1704,11 @@ void SV_AddOperatorCommands( void ) {
 	Cmd_AddCommand ("dumpuser", SV_DumpUser_f);
 	Cmd_AddCommand ("map_restart", SV_MapRestart_f);
 	Cmd_AddCommand ("sectorlist", SV_SectorList_f);
+	Cmd_AddCommand ("tracecache", SV_TraceCache_f);
+	Cmd_AddCommand ("tracebench", SV_TraceBench_f);
+	Cmd_AddCommand ("tracerecord", SV_TraceRecord_f);
+	Cmd_AddCommand ("tracestress", SV_TraceStress_f);
+	Cmd_AddCommand ("svprofile", SV_Profile_f);
 	Cmd_AddCommand ("map", SV_Map_f);
 	Cmd_SetCommandCompletionFunc( "map", SV_CompleteMapName );
 #ifndef PRE_RELEASE_DEMO
@@ -25,6 +25,70 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 static void SV_CloseDownload( client_t *cl );
 
+/*
+=================
+SV_NewChallenge
+
+Finds or allocates the challenge slot for an address and gives it a new
+challenge number.  svs.challenges is shared with the query thread, so the
+caller holds SV_QueryLock.
+=================
+*/
+challenge_t *SV_NewChallenge( netadr_t from, int clientChallenge, int *oldestClientTime )
+{
+	int		i;
+	int		oldest;
+	int		oldestTime;
+	challenge_t	*challenge;
+	qboolean wasfound = qfalse;
+
+	oldest = 0;
+	*oldestClientTime = oldestTime = 0x7fffffff;
+
+	// see if we already have a challenge for this ip
+	challenge = &svs.challenges[0];
+
+	for(i = 0 ; i < MAX_CHALLENGES ; i++, challenge++)
+	{
+		if(!challenge->connected && NET_CompareAdr(from, challenge->adr))
+		{
+			wasfound = qtrue;
+			
+			if(challenge->time < *oldestClientTime)
+				*oldestClientTime = challenge->time;
+		}
+		
+		if(wasfound && i >= MAX_CHALLENGES_MULTI)
+		{
+			i = MAX_CHALLENGES;
+			break;
+		}
+		
+		if(challenge->time < oldestTime)
+		{
+			oldestTime = challenge->time;
+			oldest = i;
+		}
+	}
+
+	if (i == MAX_CHALLENGES)
+	{
+		// this is the first time this client has asked for a challenge
+		challenge = &svs.challenges[oldest];
+		challenge->clientChallenge = clientChallenge;
+		challenge->adr = from;
+		challenge->firstTime = svs.time;
+		challenge->connected = qfalse;
+	}
+
+	// always generate a new challenge number, so the client cannot circumvent sv_maxping
+	challenge->challenge = ( (rand() << 16) ^ rand() ) ^ svs.time;
+	challenge->wasrefused = qfalse;
+	challenge->time = svs.time;
+
+	return challenge;
+}
+
 /*
 =================
 SV_GetChallenge
@@ -52,15 +116,14 @@ v4-only auth server for these new types of connections.
 */
 void SV_GetChallenge(netadr_t from)
 {
-	int		i;
-	int		oldest;
-	int		oldestTime;
 	int		oldestClientTime;
 	int		clientChallenge;
 	challenge_t	*challenge;
-	qboolean wasfound = qfalse;
 	char *gameName;
 	qboolean gameMismatch;
+#ifndef STANDALONE
+	qboolean authorize;
+#endif
 
 	// ignore if we are in single player
 	if ( Cvar_VariableValue( "g_gametype" ) == GT_SINGLE_PLAYER || Cvar_VariableValue("ui_singlePlayerActive")) {
@@ -99,71 +162,36 @@ void SV_GetChallenge(netadr_t from)
 		return;
 	}
 
-	oldest = 0;
-	oldestClientTime = oldestTime = 0x7fffffff;
-
-	// see if we already have a challenge for this ip
-	challenge = &svs.challenges[0];
 	clientChallenge = atoi(Cmd_Argv(1));
 
-	for(i = 0 ; i < MAX_CHALLENGES ; i++, challenge++)
+#ifndef STANDALONE
+	// Drop the authorize stuff if this client is coming in via v6 as the auth server does not support ipv6.
+	// Drop also for addresses coming in on local LAN and for stand-alone games independent from id's assets.
+	authorize = from.type == NA_IP && !com_standalone->integer && !Sys_IsLANAddress(from);
+
+	// look up the authorize server's IP, outside the lock as the
+	// query thread would wait on the lookup
+	if (authorize && svs.authorizeAddress.type == NA_BAD)
 	{
-		if(!challenge->connected && NET_CompareAdr(from, challenge->adr))
-		{
-			wasfound = qtrue;
-			
-			if(challenge->time < oldestClientTime)
-				oldestClientTime = challenge->time;
-		}
-		
-		if(wasfound && i >= MAX_CHALLENGES_MULTI)
-		{
-			i = MAX_CHALLENGES;
-			break;
-		}
+		Com_Printf( "Resolving %s\n", AUTHORIZE_SERVER_NAME );
 		
-		if(challenge->time < oldestTime)
+		if (NET_StringToAdr(AUTHORIZE_SERVER_NAME, &svs.authorizeAddress, NA_IP))
 		{
-			oldestTime = challenge->time;
-			oldest = i;
+			svs.authorizeAddress.port = BigShort( PORT_AUTHORIZE );
+			Com_Printf( "%s resolved to %i.%i.%i.%i:%i\n", AUTHORIZE_SERVER_NAME,
+				svs.authorizeAddress.ip[0], svs.authorizeAddress.ip[1],
+				svs.authorizeAddress.ip[2], svs.authorizeAddress.ip[3],
+				BigShort( svs.authorizeAddress.port ) );
 		}
 	}
+#endif
 
-	if (i == MAX_CHALLENGES)
-	{
-		// this is the first time this client has asked for a challenge
-		challenge = &svs.challenges[oldest];
-		challenge->clientChallenge = clientChallenge;
-		challenge->adr = from;
-		challenge->firstTime = svs.time;
-		challenge->connected = qfalse;
-	}
-
-	// always generate a new challenge number, so the client cannot circumvent sv_maxping
-	challenge->challenge = ( (rand() << 16) ^ rand() ) ^ svs.time;
-	challenge->wasrefused = qfalse;
-	challenge->time = svs.time;
+	SV_QueryLock();
+	challenge = SV_NewChallenge(from, clientChallenge, &oldestClientTime);
 
 #ifndef STANDALONE
-	// Drop the authorize stuff if this client is coming in via v6 as the auth server does not support ipv6.
-	// Drop also for addresses coming in on local LAN and for stand-alone games independent from id's assets.
-	if(challenge->adr.type == NA_IP && !com_standalone->integer && !Sys_IsLANAddress(from))
+	if(authorize)
 	{
-		// look up the authorize server's IP
-		if (svs.authorizeAddress.type == NA_BAD)
-		{
-			Com_Printf( "Resolving %s\n", AUTHORIZE_SERVER_NAME );
-			
-			if (NET_StringToAdr(AUTHORIZE_SERVER_NAME, &svs.authorizeAddress, NA_IP))
-			{
-				svs.authorizeAddress.port = BigShort( PORT_AUTHORIZE );
-				Com_Printf( "%s resolved to %i.%i.%i.%i:%i\n", AUTHORIZE_SERVER_NAME,
-					svs.authorizeAddress.ip[0], svs.authorizeAddress.ip[1],
-					svs.authorizeAddress.ip[2], svs.authorizeAddress.ip[3],
-					BigShort( svs.authorizeAddress.port ) );
-			}
-		}
-
 		// we couldn't contact the auth server, let them in.
 		if(svs.authorizeAddress.type == NA_BAD)
 			Com_Printf("Couldn't resolve auth server address\n");
@@ -193,6 +221,7 @@ void SV_GetChallenge(netadr_t from)
 				"getIpAuthorize %i %i.%i.%i.%i %s 0 %s",  challenge->challenge,
 				from.ip[0], from.ip[1], from.ip[2], from.ip[3], game, sv_strictAuth->string );
 			
+			SV_QueryUnlock();
 			return;
 		}
 	}
@@ -201,32 +230,23 @@ void SV_GetChallenge(netadr_t from)
 	challenge->pingTime = svs.time;
 	NET_OutOfBandPrint(NS_SERVER, challenge->adr, "challengeResponse %d %d %d",
 			   challenge->challenge, clientChallenge, com_protocol->integer);
+	SV_QueryUnlock();
 }
 
 #ifndef STANDALONE
 /*
 ====================
-SV_AuthorizeIpPacket
+SV_AuthorizeChallenge
 
-A packet has been returned from the authorize server.
-If we have a challenge adr for that ip, send the
-challengeResponse to it
+Answers the client the authorize server replied about
 ====================
 */
-void SV_AuthorizeIpPacket( netadr_t from ) {
-	int		challenge;
+static void SV_AuthorizeChallenge( int challenge ) {
 	int		i;
 	char	*s;
 	char	*r;
 	challenge_t *challengeptr;
 
-	if ( !NET_CompareBaseAdr( from, svs.authorizeAddress ) ) {
-		Com_Printf( "SV_AuthorizeIpPacket: not from authorize server\n" );
-		return;
-	}
-
-	challenge = atoi( Cmd_Argv( 1 ) );
-
 	for (i = 0 ; i < MAX_CHALLENGES ; i++) {
 		if ( svs.challenges[i].challenge == challenge ) {
 			break;
@@ -277,6 +297,26 @@ void SV_AuthorizeIpPacket( netadr_t from ) {
 	// clear the challenge record so it won't timeout and let them through
 	Com_Memset( challengeptr, 0, sizeof(*challengeptr) );
 }
+
+/*
+====================
+SV_AuthorizeIpPacket
+
+A packet has been returned from the authorize server.
+If we have a challenge adr for that ip, send the
+challengeResponse to it
+====================
+*/
+void SV_AuthorizeIpPacket( netadr_t from ) {
+	if ( !NET_CompareBaseAdr( from, svs.authorizeAddress ) ) {
+		Com_Printf( "SV_AuthorizeIpPacket: not from authorize server\n" );
+		return;
+	}
+
+	SV_QueryLock();
+	SV_AuthorizeChallenge( atoi( Cmd_Argv( 1 ) ) );
+	SV_QueryUnlock();
+}
 #endif
 
 /*
@@ -313,6 +353,66 @@ static qboolean SV_IsBanned(netadr_t *from, qboolean isexception)
 	return qfalse;
 }
 
+/*
+==================
+SV_CheckChallenge
+
+Whether a connecting client answered the challenge it was given
+and its challenge ping is acceptable.  The caller holds SV_QueryLock.
+==================
+*/
+static qboolean SV_CheckChallenge( netadr_t from, int challenge )
+{
+	int i;
+	int ping;
+	challenge_t *challengeptr;
+
+	for (i=0; i<MAX_CHALLENGES; i++)
+	{
+		if (NET_CompareAdr(from, svs.challenges[i].adr))
+		{
+			if(challenge == svs.challenges[i].challenge)
+				break;
+		}
+	}
+
+	if (i == MAX_CHALLENGES)
+	{
+		NET_OutOfBandPrint( NS_SERVER, from, "print\nNo or bad challenge for your address.\n" );
+		return qfalse;
+	}
+
+	challengeptr = &svs.challenges[i];
+	
+	if(challengeptr->wasrefused)
+	{
+		// Return silently, so that error messages written by the server keep being displayed.
+		return qfalse;
+	}
+
+	ping = svs.time - challengeptr->pingTime;
+
+	// never reject a LAN client based on ping
+	if ( !Sys_IsLANAddress( from ) ) {
+		if ( sv_minPing->value && ping < sv_minPing->value ) {
+			NET_OutOfBandPrint( NS_SERVER, from, "print\nServer is for high pings only\n" );
+			Com_DPrintf ("Client %i rejected on a too low ping\n", i);
+			challengeptr->wasrefused = qtrue;
+			return qfalse;
+		}
+		if ( sv_maxPing->value && ping > sv_maxPing->value ) {
+			NET_OutOfBandPrint( NS_SERVER, from, "print\nServer is for low pings only\n" );
+			Com_DPrintf ("Client %i rejected on a too high ping\n", i);
+			challengeptr->wasrefused = qtrue;
+			return qfalse;
+		}
+	}
+
+	Com_Printf("Client %i connecting with %i challenge ping\n", i, ping);
+	challengeptr->connected = qtrue;
+	return qtrue;
+}
+
 /*
 ==================
 SV_DirectConnect
@@ -404,52 +504,14 @@ void SV_DirectConnect( netadr_t from ) {
 	// see if the challenge is valid (LAN clients don't need to challenge)
 	if (!NET_IsLocalAddress(from))
 	{
-		int ping;
-		challenge_t *challengeptr;
+		qboolean	valid;
 
-		for (i=0; i<MAX_CHALLENGES; i++)
-		{
-			if (NET_CompareAdr(from, svs.challenges[i].adr))
-			{
-				if(challenge == svs.challenges[i].challenge)
-					break;
-			}
-		}
+		SV_QueryLock();
+		valid = SV_CheckChallenge(from, challenge);
+		SV_QueryUnlock();
 
-		if (i == MAX_CHALLENGES)
-		{
-			NET_OutOfBandPrint( NS_SERVER, from, "print\nNo or bad challenge for your address.\n" );
+		if (!valid)
 			return;
-		}
-	
-		challengeptr = &svs.challenges[i];
-		
-		if(challengeptr->wasrefused)
-		{
-			// Return silently, so that error messages written by the server keep being displayed.
-			return;
-		}
-
-		ping = svs.time - challengeptr->pingTime;
-
-		// never reject a LAN client based on ping
-		if ( !Sys_IsLANAddress( from ) ) {
-			if ( sv_minPing->value && ping < sv_minPing->value ) {
-				NET_OutOfBandPrint( NS_SERVER, from, "print\nServer is for high pings only\n" );
-				Com_DPrintf ("Client %i rejected on a too low ping\n", i);
-				challengeptr->wasrefused = qtrue;
-				return;
-			}
-			if ( sv_maxPing->value && ping > sv_maxPing->value ) {
-				NET_OutOfBandPrint( NS_SERVER, from, "print\nServer is for low pings only\n" );
-				Com_DPrintf ("Client %i rejected on a too high ping\n", i);
-				challengeptr->wasrefused = qtrue;
-				return;
-			}
-		}
-
-		Com_Printf("Client %i connecting with %i challenge ping\n", i, ping);
-		challengeptr->connected = qtrue;
 	}
 
 	newcl = &temp;
@@ -538,6 +600,7 @@ gotnewcl:
 	// build a new connection
 	// accept the new client
 	// this is the only place a client_t is ever initialized
+	SV_FreeRangeCoding( newcl );
 	*newcl = temp;
 	clientNum = newcl - svs.clients;
 	ent = SV_GentityNum( clientNum );
@@ -559,6 +622,19 @@ gotnewcl:
 	// save the userinfo
 	Q_strncpyz( newcl->userinfo, userinfo, sizeof(newcl->userinfo) );
 
+	newcl->fieldOrder = atoi( Info_ValueForKey( userinfo, "fieldOrder" ) ) != 0;
+
+	// old clients and the legacy protocol stay with huffman coding
+	newcl->rangeCoding = sv_rangeCoding->integer && atoi( Info_ValueForKey( userinfo, "rangeCoding" ) );
+#ifdef LEGACY_PROTOCOL
+	if ( compat ) {
+		newcl->rangeCoding = qfalse;
+	}
+#endif
+	if ( newcl->rangeCoding ) {
+		SV_InitRangeCoding( newcl );
+	}
+
 	// get the game a chance to reject this connection or modify the userinfo
 	denied = VM_Call( gvm, GAME_CLIENT_CONNECT, clientNum, qtrue, qfalse ); // firstTime = qtrue
 	if ( denied ) {
@@ -573,11 +649,13 @@ gotnewcl:
 	SV_UserinfoChanged( newcl );
 
 	// send the connect packet to the client
-	NET_OutOfBandPrint(NS_SERVER, from, "connectResponse %d", challenge);
+	NET_OutOfBandPrint(NS_SERVER, from, "connectResponse %d%s", challenge,
+		newcl->rangeCoding ? " rangeCoding" : "");
 
 	Com_DPrintf( "Going from CS_FREE to CS_CONNECTED for %s\n", newcl->name );
 
 	newcl->state = CS_CONNECTED;
+	SV_ClearQueryCache();
 	newcl->lastSnapshotTime = 0;
 	newcl->lastPacketTime = svs.time;
 	newcl->lastConnectTime = svs.time;
@@ -648,6 +726,7 @@ void SV_DropClient( client_t *drop, const char *reason ) {
 		// see if we already have a challenge for this ip
 		challenge = &svs.challenges[0];
 
+		SV_QueryLock();
 		for (i = 0 ; i < MAX_CHALLENGES ; i++, challenge++)
 		{
 			if(NET_CompareAdr(drop->netchan.remoteAddress, challenge->adr))
@@ -656,6 +735,7 @@ void SV_DropClient( client_t *drop, const char *reason ) {
 				break;
 			}
 		}
+		SV_QueryUnlock();
 	}
 
 	// Free all allocated data on the client structure
@@ -685,6 +765,7 @@ void SV_DropClient( client_t *drop, const char *reason ) {
 		Com_DPrintf( "Going to CS_ZOMBIE for %s\n", drop->name );
 		drop->state = CS_ZOMBIE;		// become free in a few seconds
 	}
+	SV_ClearQueryCache();
 
 	// if this was the last client on the server, send a heartbeat
 	// to the master so it is known the server is empty
@@ -729,6 +810,7 @@ static void SV_SendClientGameState( client_t *client ) {
 	client->gamestateMessageNum = client->netchan.outgoingSequence;
 
 	MSG_Init( &msg, msgBuffer, sizeof( msgBuffer ) );
+	SV_StartRangeCoding( client, &msg, qfalse );
 
 	// NOTE, MRE: all server->client messages now acknowledge
 	// let the client know which reliable clientCommands we have received
@@ -818,6 +900,150 @@ CLIENT COMMAND EXECUTION
 ============================================================
 */
 
+/*
+=============================================================================
+
+Download maps
+
+When a new map is pushed, every client downloads the same pk3.  Instead of
+a file handle and block buffers of their own, the clients downloading a file
+share a read only mapping of it and their blocks are written from there.
+A file that can't be mapped is read through a file handle as before.
+
+The file is compared with the length and time it was mapped with before a
+mapping is shared or read from.  If it changed, later downloads map it again,
+and if it got shorter the old mapping isn't read past the new end, which
+would fault.  A file replaced by a shorter one can't be told from one cut
+short in place, so it's treated the same.
+
+=============================================================================
+*/
+
+#define	MAX_DOWNLOAD_MAPS	32
+
+static downloadMap_t	sv_downloadMaps[MAX_DOWNLOAD_MAPS];
+
+/*
+==================
+SV_CheckDownloadMap
+
+Compares the file with what was mapped, once a frame
+==================
+*/
+static void SV_CheckDownloadMap( downloadMap_t *map ) {
+	long	length;
+	int		mtime;
+
+	if ( map->checkTime == svs.time ) {
+		return;
+	}
+	map->checkTime = svs.time;
+
+	length = 0;
+	mtime = FS_SV_FileTime( map->name, &length );
+	if ( mtime == map->mtime && length == map->size ) {
+		return;
+	}
+
+	if ( !map->stale ) {
+		Com_DPrintf( "clientDownload: \"%s\" changed since it was mapped\n", map->name );
+		map->stale = qtrue;
+	}
+
+	// a removed file stays readable through the mapping
+	if ( mtime != -1 && length < map->validSize ) {
+		map->validSize = length;
+	}
+}
+
+/*
+==================
+SV_MapDownload
+
+Returns the shared mapping of a file with a reference added, or NULL
+==================
+*/
+static downloadMap_t *SV_MapDownload( const char *name ) {
+	downloadMap_t	*map, *unused;
+	const byte		*data;
+	long			size, length;
+	int				mtime;
+	int				i;
+
+	unused = NULL;
+	for ( i = 0, map = sv_downloadMaps ; i < MAX_DOWNLOAD_MAPS ; i++, map++ ) {
+		if ( !map->refCount ) {
+			if ( !unused ) {
+				unused = map;
+			}
+			continue;
+		}
+		if ( !strcmp( map->name, name ) ) {
+			SV_CheckDownloadMap( map );
+			if ( !map->stale ) {
+				map->refCount++;
+				return map;
+			}
+		}
+	}
+
+	if ( !unused ) {
+		return NULL;
+	}
+
+	// taken first, so a change while mapping shows up as stale
+	length = 0;
+	mtime = FS_SV_FileTime( name, &length );
+
+	size = FS_SV_MapFile( name, &data );
+	if ( size < 0 ) {
+		return NULL;
+	}
+
+	Q_strncpyz( unused->name, name, sizeof( unused->name ) );
+	unused->data = data;
+	unused->size = size;
+	unused->refCount = 1;
+	unused->mtime = mtime;
+	unused->checkTime = svs.time;
+	unused->stale = ( mtime == -1 || length != size );
+	unused->validSize = size;
+
+	Com_DPrintf( "clientDownload: mapped \"%s\", %i bytes\n", name, unused->size );
+	return unused;
+}
+
+/*
+==================
+SV_ReleaseDownloadMap
+==================
+*/
+static void SV_ReleaseDownloadMap( downloadMap_t *map ) {
+	if ( --map->refCount > 0 ) {
+		return;
+	}
+
+	Com_DPrintf( "clientDownload: unmapped \"%s\"\n", map->name );
+	Sys_UnmapFile( (void *)map->data, map->size );
+	Com_Memset( map, 0, sizeof( *map ) );
+}
+
+/*
+==================
+SV_OpenDownload
+
+Returns the size of cl->downloadName, or -1 if it can't be opened
+==================
+*/
+static int SV_OpenDownload( client_t *cl ) {
+	cl->downloadMap = SV_MapDownload( cl->downloadName );
+	if ( cl->downloadMap ) {
+		return cl->downloadMap->size;
+	}
+
+	return FS_SV_FOpenFileRead( cl->downloadName, &cl->download );
+}
+
 /*
 ==================
 SV_CloseDownload
@@ -833,6 +1059,11 @@ static void SV_CloseDownload( client_t *cl ) {
 		FS_FCloseFile( cl->download );
 	}
 	cl->download = 0;
+
+	if (cl->downloadMap) {
+		SV_ReleaseDownloadMap( cl->downloadMap );
+		cl->downloadMap = NULL;
+	}
 	*cl->downloadName = 0;
 
 	// Free the temporary buffer space
@@ -941,7 +1172,7 @@ int SV_WriteDownloadToClient(client_t *cl, msg_t *msg)
 	if (!*cl->downloadName)
 		return 0;	// Nothing being downloaded
 
-	if(!cl->download)
+	if(!cl->download && !cl->downloadMap)
 	{
 		qboolean idPack = qfalse;
 		#ifndef STANDALONE
@@ -992,7 +1223,7 @@ int SV_WriteDownloadToClient(client_t *cl, msg_t *msg)
 		if ( !(sv_allowDownload->integer & DLF_ENABLE) ||
 			(sv_allowDownload->integer & DLF_NO_UDP) ||
 			idPack || unreferenced ||
-			( cl->downloadSize = FS_SV_FOpenFileRead( cl->downloadName, &cl->download ) ) < 0 ) {
+			( cl->downloadSize = SV_OpenDownload( cl ) ) < 0 ) {
 			// cannot auto-download file
 			if(unreferenced)
 			{
@@ -1060,6 +1291,17 @@ int SV_WriteDownloadToClient(client_t *cl, msg_t *msg)
 
 		curindex = (cl->downloadCurrentBlock % MAX_DOWNLOAD_WINDOW);
 
+		if (cl->downloadMap) {
+			// sent straight from the mapping
+			cl->downloadBlockSize[curindex] = cl->downloadSize - cl->downloadCount;
+			if (cl->downloadBlockSize[curindex] > MAX_DOWNLOAD_BLKSIZE)
+				cl->downloadBlockSize[curindex] = MAX_DOWNLOAD_BLKSIZE;
+
+			cl->downloadCount += cl->downloadBlockSize[curindex];
+			cl->downloadCurrentBlock++;
+			continue;
+		}
+
 		if (!cl->downloadBlocks[curindex])
 			cl->downloadBlocks[curindex] = Z_Malloc(MAX_DOWNLOAD_BLKSIZE);
 
@@ -1105,6 +1347,18 @@ int SV_WriteDownloadToClient(client_t *cl, msg_t *msg)
 	// Send current block
 	curindex = (cl->downloadXmitBlock % MAX_DOWNLOAD_WINDOW);
 
+	if (cl->downloadMap && cl->downloadBlockSize[curindex])
+	{
+		SV_CheckDownloadMap(cl->downloadMap);
+
+		if (cl->downloadXmitBlock * MAX_DOWNLOAD_BLKSIZE + cl->downloadBlockSize[curindex] > cl->downloadMap->validSize)
+		{
+			Com_Printf("clientDownload: %d : \"%s\" was cut short on the server\n", (int) (cl - svs.clients), cl->downloadName);
+			SV_DropClient(cl, "download changed on the server");
+			return 0;
+		}
+	}
+
 	MSG_WriteByte( msg, svc_download );
 	MSG_WriteShort( msg, cl->downloadXmitBlock );
 
@@ -1116,7 +1370,13 @@ int SV_WriteDownloadToClient(client_t *cl, msg_t *msg)
 
 	// Write the block
 	if(cl->downloadBlockSize[curindex])
-		MSG_WriteData(msg, cl->downloadBlocks[curindex], cl->downloadBlockSize[curindex]);
+	{
+		if(cl->downloadMap)
+			MSG_WriteData(msg, cl->downloadMap->data + cl->downloadXmitBlock * MAX_DOWNLOAD_BLKSIZE,
+				cl->downloadBlockSize[curindex]);
+		else
+			MSG_WriteData(msg, cl->downloadBlocks[curindex], cl->downloadBlockSize[curindex]);
+	}
 
 	Com_DPrintf( "clientDownload: %d : writing block %d\n", (int) (cl - svs.clients), cl->downloadXmitBlock );
 
@@ -1184,6 +1444,7 @@ int SV_SendDownloadMessages(void)
 		if(cl->state && *cl->downloadName)
 		{
 			MSG_Init(&msg, msgBuffer, sizeof(msgBuffer));
+			SV_StartRangeCoding(cl, &msg, qfalse);
 			MSG_WriteLong(&msg, cl->lastClientCommand);
 			
 			retval = SV_WriteDownloadToClient(cl, &msg);
@@ -1399,6 +1660,7 @@ void SV_UserinfoChanged( client_t *cl ) {
 
 	// name for C code
 	Q_strncpyz( cl->name, Info_ValueForKey (cl->userinfo, "name"), sizeof(cl->name) );
+	SV_ClearQueryCache();
 
 	// rate command
 
@@ -1916,6 +2178,8 @@ void SV_ExecuteClientMessage( client_t *cl, msg_t *msg ) {
 		return;
 	}
 
+	SV_RangeCodingAcknowledged( cl );
+
 	cl->reliableAcknowledge = MSG_ReadLong( msg );
 
 	// NOTE: when the client message is fux0red the acknowledgement numbers
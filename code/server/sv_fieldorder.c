@@ -0,0 +1,220 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// sv_fieldorder.c -- sending entity fields in an order made for the map
+
+#include "server.h"
+
+/*
+=============================================================================
+
+An entity delta has a bit for every field up to the last one that changed,
+so the fields that change most should go first.  The usual order is the
+one of the id maps.
+
+With sv_fieldOrder, the fields that change in the entity deltas of the
+first sv_fieldOrderTime seconds of a map are counted and stored in
+fieldorder/<mapname>.txt.  The next time the map is loaded the fields go
+in the order of those counts, for the clients that said they can read it
+when they connected.
+
+The order is in the sv_entityFieldOrder systeminfo and never changes
+during a map.  Snapshots that use it have SNAPFLAG_FIELD_ORDER, because
+a client still has the gamestate of the last map for a while after a map
+change.  Baselines and the playerstate always use the usual order.
+
+=============================================================================
+*/
+
+#define	MIN_FIELD_CHANGES	1000	// fewer are not worth storing
+
+static int		sv_fieldChanges[MAX_ENTITY_FIELDS];
+static int		sv_fieldChangesTotal;
+static qboolean	sv_fieldCounting;
+
+/*
+=================
+SV_FieldOrderFile
+=================
+*/
+static const char *SV_FieldOrderFile( void ) {
+	return va( "fieldorder/%s.txt", sv_mapname->string );
+}
+
+/*
+=================
+SV_ReadFieldChanges
+
+The counts from the last time the map was played, qfalse if there are none
+=================
+*/
+static qboolean SV_ReadFieldChanges( int *counts ) {
+	union {
+		char	*c;
+		void	*v;
+	} buffer;
+	char		*text, *token;
+	char		name[MAX_TOKEN_CHARS];
+	int			i, numFields;
+	qboolean	found;
+
+	if ( FS_ReadFile( SV_FieldOrderFile(), &buffer.v ) <= 0 ) {
+		return qfalse;
+	}
+
+	numFields = MSG_NumEntityFields();
+	Com_Memset( counts, 0, numFields * sizeof( *counts ) );
+	found = qfalse;
+
+	// field name and count pairs, fields that aren't there any more are skipped
+	text = buffer.c;
+	while ( 1 ) {
+		token = COM_Parse( &text );
+		if ( !token[0] ) {
+			break;
+		}
+		Q_strncpyz( name, token, sizeof( name ) );
+		token = COM_Parse( &text );
+
+		for ( i = 0 ; i < numFields ; i++ ) {
+			if ( !Q_stricmp( name, MSG_EntityFieldName( i ) ) ) {
+				counts[i] = atoi( token );
+				found = qtrue;
+				break;
+			}
+		}
+	}
+
+	FS_FreeFile( buffer.v );
+	return found;
+}
+
+/*
+=================
+SV_WriteFieldChanges
+=================
+*/
+static void SV_WriteFieldChanges( void ) {
+	char	text[MAX_ENTITY_FIELDS * 64];
+	int		i, numFields;
+
+	text[0] = 0;
+	numFields = MSG_NumEntityFields();
+	for ( i = 0 ; i < numFields ; i++ ) {
+		Q_strcat( text, sizeof( text ), va( "%s %i\n", MSG_EntityFieldName( i ), sv_fieldChanges[i] ) );
+	}
+
+	FS_WriteFile( SV_FieldOrderFile(), text, strlen( text ) );
+	Com_DPrintf( "Wrote entity field changes to %s\n", SV_FieldOrderFile() );
+}
+
+/*
+=================
+SV_LoadFieldOrder
+
+Called by SV_SpawnServer before the systeminfo is set
+=================
+*/
+void SV_LoadFieldOrder( void ) {
+	int		counts[MAX_ENTITY_FIELDS];
+	char	orderString[MAX_ENTITY_FIELDS * 2 + 1];
+	int		i, j, field, numFields;
+	qboolean	usual;
+
+	Com_Memset( sv_fieldChanges, 0, sizeof( sv_fieldChanges ) );
+	sv_fieldChangesTotal = 0;
+	sv_fieldCounting = sv_fieldOrder->integer != 0;
+
+	sv.hasEntityFieldOrder = qfalse;
+	Cvar_Set( "sv_entityFieldOrder", "" );
+
+	if ( !sv_fieldOrder->integer || !SV_ReadFieldChanges( counts ) ) {
+		return;
+	}
+
+	// most changes first, fields that change as often stay in the usual order
+	numFields = MSG_NumEntityFields();
+	for ( i = 0 ; i < numFields ; i++ ) {
+		field = i;
+		for ( j = i ; j > 0 && counts[sv.entityFieldOrder[j - 1]] < counts[field] ; j-- ) {
+			sv.entityFieldOrder[j] = sv.entityFieldOrder[j - 1];
+		}
+		sv.entityFieldOrder[j] = field;
+	}
+
+	usual = qtrue;
+	for ( i = 0 ; i < numFields ; i++ ) {
+		if ( sv.entityFieldOrder[i] != i ) {
+			usual = qfalse;
+			break;
+		}
+	}
+	if ( usual ) {
+		return;
+	}
+
+	sv.hasEntityFieldOrder = qtrue;
+	MSG_EntityFieldOrderString( sv.entityFieldOrder, orderString, sizeof( orderString ) );
+	Cvar_Set( "sv_entityFieldOrder", orderString );
+}
+
+/*
+=================
+SV_CountingFieldChanges
+=================
+*/
+qboolean SV_CountingFieldChanges( void ) {
+	return sv_fieldCounting;
+}
+
+/*
+=================
+SV_AddFieldChanges
+
+Called after the snapshots of every frame, stores the counts once
+sv_fieldOrderTime is over
+=================
+*/
+void SV_AddFieldChanges( const int *counts ) {
+	int		i, numFields;
+
+	if ( !sv_fieldCounting ) {
+		return;
+	}
+
+	numFields = MSG_NumEntityFields();
+	for ( i = 0 ; i < numFields ; i++ ) {
+		sv_fieldChanges[i] += counts[i];
+		sv_fieldChangesTotal += counts[i];
+	}
+
+	if ( sv.time < sv_fieldOrderTime->integer * 1000 ) {
+		return;
+	}
+
+	sv_fieldCounting = qfalse;
+	if ( sv_fieldChangesTotal < MIN_FIELD_CHANGES ) {
+		Com_DPrintf( "Only %i entity field changes, not storing them\n", sv_fieldChangesTotal );
+		return;
+	}
+
+	SV_WriteFieldChanges();
+}
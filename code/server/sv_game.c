@@ -365,6 +365,19 @@ intptr_t SV_GameSystemCalls( intptr_t *args ) {
 	case G_TRACECAPSULE:
 		SV_Trace( VMA(1), VMA(2), VMA(3), VMA(4), VMA(5), args[6], args[7], /*int capsule*/ qtrue );
 		return 0;
+	case G_TRACEBATCH:
+		if ( args[2] <= 0 || args[2] > MAX_GAME_TRACE_BATCH ) {
+			Com_Error( ERR_DROP, "G_TRACEBATCH: bad trace count %i", (int)args[2] );
+		}
+		if ( !VM_ArgBlockValid( args[1], args[2] * sizeof( trace_t ) )
+			|| !VM_ArgBlockValid( args[3], args[2] * sizeof( vec3_t ) )
+			|| !VM_ArgBlockValid( args[4], sizeof( vec3_t ) )
+			|| !VM_ArgBlockValid( args[5], sizeof( vec3_t ) )
+			|| !VM_ArgBlockValid( args[6], args[2] * sizeof( vec3_t ) ) ) {
+			Com_Error( ERR_DROP, "G_TRACEBATCH: arrays outside the game data" );
+		}
+		SV_TraceBatch( VMA(1), args[2], VMA(3), VMA(4), VMA(5), VMA(6), args[7], args[8], /*int capsule*/ qfalse );
+		return 0;
 	case G_POINT_CONTENTS:
 		return SV_PointContents( VMA(1), args[2] );
 	case G_SET_BRUSH_MODEL:
@@ -879,6 +892,9 @@ static void SV_InitGameVM( qboolean restart ) {
 	for ( i = 0 ; i < sv_maxclients->integer ; i++ ) {
 		svs.clients[i].gentity = NULL;
 	}
+
+	// the entities are about to be spawned again
+	SV_ClearTraceCache();
 	
 	// use the current msec count for a random seed
 	// init for this gamestate
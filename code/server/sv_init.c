@@ -330,6 +330,13 @@ void SV_ChangeMaxClients( void ) {
 		}
 	}
 
+	// the ones not copied are gone
+	for ( i = 0 ; i < oldMaxClients ; i++ ) {
+		if ( svs.clients[i].state < CS_CONNECTED ) {
+			SV_FreeRangeCoding( &svs.clients[i] );
+		}
+	}
+
 	// free old clients arrays
 	Z_Free( svs.clients );
 
@@ -506,6 +513,7 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 	// run a few frames to allow everything to settle
 	for (i = 0;i < 3; i++)
 	{
+		SV_ClearTraceCache();
 		VM_Call (gvm, GAME_RUN_FRAME, sv.time);
 		SV_BotFrame (sv.time);
 		sv.time += 100;
@@ -563,6 +571,7 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 	}	
 
 	// run another frame to allow things to look at all the players
+	SV_ClearTraceCache();
 	VM_Call (gvm, GAME_RUN_FRAME, sv.time);
 	SV_BotFrame (sv.time);
 	sv.time += 100;
@@ -596,6 +605,8 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 	p = FS_ReferencedPakNames();
 	Cvar_Set( "sv_referencedPakNames", p );
 
+	SV_LoadFieldOrder();
+
 	// save systeminfo and serverinfo strings
 	Q_strncpyz( systemInfo, Cvar_InfoString_Big( CVAR_SYSTEMINFO ), sizeof( systemInfo ) );
 	cvar_modifiedFlags &= ~CVAR_SYSTEMINFO;
@@ -614,6 +625,12 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 
 	Hunk_SetMark();
 
+	// a new map counts as activity
+	svs.hibernating = qfalse;
+	svs.emptyTime = svs.time;
+
+	SV_BenchmarkStart();
+
 	Com_Printf ("-----------------------------------\n");
 }
 
@@ -660,6 +677,7 @@ void SV_Init (void)
 	Cvar_Get ("sv_pakNames", "", CVAR_SYSTEMINFO | CVAR_ROM );
 	Cvar_Get ("sv_referencedPaks", "", CVAR_SYSTEMINFO | CVAR_ROM );
 	Cvar_Get ("sv_referencedPakNames", "", CVAR_SYSTEMINFO | CVAR_ROM );
+	Cvar_Get ("sv_entityFieldOrder", "", CVAR_SYSTEMINFO | CVAR_ROM );
 
 	// server vars
 	sv_rconPassword = Cvar_Get ("rconPassword", "", CVAR_TEMP );
@@ -687,6 +705,19 @@ void SV_Init (void)
 	sv_strictAuth = Cvar_Get ("sv_strictAuth", "1", CVAR_ARCHIVE );
 #endif
 	sv_banFile = Cvar_Get("sv_banFile", "serverbans.dat", CVAR_ARCHIVE);
+	sv_traceCache = Cvar_Get("sv_traceCache", "0", CVAR_ARCHIVE);
+	sv_snapshotThreads = Cvar_Get("sv_snapshotThreads", "0", CVAR_ARCHIVE);
+	sv_profile = Cvar_Get("sv_profile", "0", 0);
+	sv_benchmark = Cvar_Get("sv_benchmark", "0", 0);
+	sv_benchmarkBots = Cvar_Get("sv_benchmarkBots", "0", 0);
+	sv_benchmarkSkill = Cvar_Get("sv_benchmarkSkill", "3", 0);
+	sv_hibernateTime = Cvar_Get("sv_hibernateTime", "0", CVAR_ARCHIVE);
+	sv_queryThread = Cvar_Get("sv_queryThread", "0", CVAR_ARCHIVE);
+	sv_fieldOrder = Cvar_Get("sv_fieldOrder", "1", CVAR_ARCHIVE);
+	sv_fieldOrderTime = Cvar_Get("sv_fieldOrderTime", "300", CVAR_ARCHIVE);
+	sv_rangeCoding = Cvar_Get("sv_rangeCoding", "1", CVAR_ARCHIVE);
+
+	SV_QueryInit();
 
 	// initialize bot cvars so they are listed and can be set before loading the botlib
 	SV_BotInitCvars();
@@ -754,6 +785,8 @@ void SV_Shutdown( char *finalmsg ) {
 
 	SV_RemoveOperatorCommands();
 	SV_MasterShutdown();
+	SV_ProfileShutdown();
+	SV_QueryShutdown();
 	SV_ShutdownGameProgs();
 
 	// free current level
@@ -765,7 +798,10 @@ void SV_Shutdown( char *finalmsg ) {
 		int index;
 		
 		for(index = 0; index < sv_maxclients->integer; index++)
+		{
 			SV_FreeClient(&svs.clients[index]);
+			SV_FreeRangeCoding(&svs.clients[index]);
+		}
 		
 		Z_Free(svs.clients);
 	}
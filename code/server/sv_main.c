@@ -61,6 +61,17 @@ cvar_t	*sv_lanForceRate; // dedicated 1 (LAN) server forces local client rates t
 cvar_t	*sv_strictAuth;
 #endif
 cvar_t	*sv_banFile;
+cvar_t	*sv_traceCache;			// remember identical traces within a game frame
+cvar_t	*sv_snapshotThreads;	// threads building and encoding client snapshots
+cvar_t	*sv_profile;			// time the phases of every server frame
+cvar_t	*sv_benchmark;			// seconds of game time to run the next map as fast as possible
+cvar_t	*sv_benchmarkBots;		// bots added for the benchmark
+cvar_t	*sv_benchmarkSkill;
+cvar_t	*sv_hibernateTime;		// msec a dedicated server without clients runs before hibernating
+cvar_t	*sv_queryThread;		// answer getinfo, getstatus and getchallenge on a thread of their own
+cvar_t	*sv_fieldOrder;			// send entities in an order of their fields made for the map
+cvar_t	*sv_fieldOrderTime;		// seconds at the start of a map its field changes are counted for
+cvar_t	*sv_rangeCoding;		// range code the messages to the clients that can read them
 
 serverBan_t serverBans[SERVER_MAXBANS];
 int serverBansCount = 0;
@@ -477,10 +488,10 @@ static leakyBucket_t *SVC_BucketForAddress( netadr_t address, int burst, int per
 
 /*
 ================
-SVC_RateLimit
+SVC_LeakBucket
 ================
 */
-qboolean SVC_RateLimit( leakyBucket_t *bucket, int burst, int period ) {
+static qboolean SVC_LeakBucket( leakyBucket_t *bucket, int burst, int period ) {
 	if ( bucket != NULL ) {
 		int now = Sys_Milliseconds();
 		int interval = now - bucket->lastTime;
@@ -505,6 +516,21 @@ qboolean SVC_RateLimit( leakyBucket_t *bucket, int burst, int period ) {
 	return qtrue;
 }
 
+/*
+================
+SVC_RateLimit
+================
+*/
+qboolean SVC_RateLimit( leakyBucket_t *bucket, int burst, int period ) {
+	qboolean	limited;
+
+	SV_QueryLock();
+	limited = SVC_LeakBucket( bucket, burst, period );
+	SV_QueryUnlock();
+
+	return limited;
+}
+
 /*
 ================
 SVC_RateLimitAddress
@@ -513,59 +539,84 @@ Rate limit for a particular address
 ================
 */
 qboolean SVC_RateLimitAddress( netadr_t from, int burst, int period ) {
-	leakyBucket_t *bucket = SVC_BucketForAddress( from, burst, period );
+	leakyBucket_t	*bucket;
+	qboolean		limited;
 
-	return SVC_RateLimit( bucket, burst, period );
+	// the query thread checks its packets too
+	SV_QueryLock();
+	bucket = SVC_BucketForAddress( from, burst, period );
+	limited = SVC_LeakBucket( bucket, burst, period );
+	SV_QueryUnlock();
+
+	return limited;
 }
 
+/*
+==============================================================================
+
+Query responses
+
+getstatus and getinfo replies are the same for every query within a frame
+apart from the challenge echoed back, so they are built once and copied
+for the queries after.  They are rebuilt every frame, and sooner when a
+client connects, leaves or changes its userinfo, or a serverinfo cvar
+changes.
+
+==============================================================================
+*/
+
+typedef struct {
+	qboolean	statusValid;
+	int			statusTime;					// svs.time it was built at
+	char		status[MAX_INFO_STRING];	// serverinfo without the challenge
+	char		players[MAX_MSGLEN];
+
+	qboolean	infoValid;
+	int			infoTime;
+	char		info[MAX_INFO_STRING];		// without the challenge
+
+	int			sequence;					// bumped when either is rebuilt
+} queryCache_t;
+
+static queryCache_t	sv_queryCache;
+
 /*
 ================
-SVC_Status
+SV_ClearQueryCache
+================
+*/
+void SV_ClearQueryCache( void ) {
+	sv_queryCache.statusValid = qfalse;
+	sv_queryCache.infoValid = qfalse;
+}
 
-Responds with all the info that qplug or qspy can see about the server
-and all connected players.  Used for getting detailed information after
-the simple info query.
+/*
+================
+SV_QueryCacheValid
 ================
 */
-static void SVC_Status( netadr_t from ) {
+static qboolean SV_QueryCacheValid( qboolean valid, int time ) {
+	return valid && time == svs.time && !( cvar_modifiedFlags & CVAR_SERVERINFO );
+}
+
+/*
+================
+SV_BuildStatus
+================
+*/
+static void SV_BuildStatus( void ) {
 	char	player[1024];
-	char	status[MAX_MSGLEN];
 	int		i;
 	client_t	*cl;
 	playerState_t	*ps;
 	int		statusLength;
 	int		playerLength;
-	char	infostring[MAX_INFO_STRING];
-
-	// ignore if we are in single player
-	if ( Cvar_VariableValue( "g_gametype" ) == GT_SINGLE_PLAYER || Cvar_VariableValue("ui_singlePlayerActive")) {
-		return;
-	}
-
-	// Prevent using getstatus as an amplifier
-	if ( SVC_RateLimitAddress( from, 10, 1000 ) ) {
-		Com_DPrintf( "SVC_Status: rate limit from %s exceeded, dropping request\n",
-			NET_AdrToString( from ) );
-		return;
-	}
-
-	// Allow getstatus to be DoSed relatively easily, but prevent
-	// excess outbound bandwidth usage when being flooded inbound
-	if ( SVC_RateLimit( &outboundLeakyBucket, 10, 100 ) ) {
-		Com_DPrintf( "SVC_Status: rate limit exceeded, dropping request\n" );
-		return;
-	}
+	char	*status;
 
-	// A maximum challenge length of 128 should be more than plenty.
-	if(strlen(Cmd_Argv(1)) > 128)
-		return;
-
-	strcpy( infostring, Cvar_InfoString( CVAR_SERVERINFO ) );
-
-	// echo back the parameter to status. so master servers can use it as a challenge
-	// to prevent timed spoofed reply packets that add ghost servers
-	Info_SetValueForKey( infostring, "challenge", Cmd_Argv(1) );
+	Q_strncpyz( sv_queryCache.status, Cvar_InfoString( CVAR_SERVERINFO ), sizeof( sv_queryCache.status ) );
+	Info_RemoveKey( sv_queryCache.status, "challenge" );
 
+	status = sv_queryCache.players;
 	status[0] = 0;
 	statusLength = 0;
 
@@ -576,7 +627,7 @@ static void SVC_Status( netadr_t from ) {
 			Com_sprintf (player, sizeof(player), "%i %i \"%s\"\n", 
 				ps->persistant[PERS_SCORE], cl->ping, cl->name);
 			playerLength = strlen(player);
-			if (statusLength + playerLength >= sizeof(status) ) {
+			if (statusLength + playerLength >= sizeof(sv_queryCache.players) ) {
 				break;		// can't hold any more
 			}
 			strcpy (status + statusLength, player);
@@ -584,20 +635,21 @@ static void SVC_Status( netadr_t from ) {
 		}
 	}
 
-	NET_OutOfBandPrint( NS_SERVER, from, "statusResponse\n%s\n%s", infostring, status );
+	sv_queryCache.statusValid = qtrue;
+	sv_queryCache.statusTime = svs.time;
+	sv_queryCache.sequence++;
 }
 
 /*
 ================
-SVC_Info
+SVC_Status
 
-Responds with a short info message that should be enough to determine
-if a user is interested in a server to do a full status
+Responds with all the info that qplug or qspy can see about the server
+and all connected players.  Used for getting detailed information after
+the simple info query.
 ================
 */
-void SVC_Info( netadr_t from ) {
-	int		i, count, humans;
-	char	*gamedir;
+static void SVC_Status( netadr_t from ) {
 	char	infostring[MAX_INFO_STRING];
 
 	// ignore if we are in single player
@@ -605,29 +657,47 @@ void SVC_Info( netadr_t from ) {
 		return;
 	}
 
-	// Prevent using getinfo as an amplifier
+	// Prevent using getstatus as an amplifier
 	if ( SVC_RateLimitAddress( from, 10, 1000 ) ) {
-		Com_DPrintf( "SVC_Info: rate limit from %s exceeded, dropping request\n",
+		Com_DPrintf( "SVC_Status: rate limit from %s exceeded, dropping request\n",
 			NET_AdrToString( from ) );
 		return;
 	}
 
-	// Allow getinfo to be DoSed relatively easily, but prevent
+	// Allow getstatus to be DoSed relatively easily, but prevent
 	// excess outbound bandwidth usage when being flooded inbound
 	if ( SVC_RateLimit( &outboundLeakyBucket, 10, 100 ) ) {
-		Com_DPrintf( "SVC_Info: rate limit exceeded, dropping request\n" );
+		Com_DPrintf( "SVC_Status: rate limit exceeded, dropping request\n" );
 		return;
 	}
 
-	/*
-	 * Check whether Cmd_Argv(1) has a sane length. This was not done in the original Quake3 version which led
-	 * to the Infostring bug discovered by Luigi Auriemma. See http://aluigi.altervista.org/ for the advisory.
-	 */
-
 	// A maximum challenge length of 128 should be more than plenty.
 	if(strlen(Cmd_Argv(1)) > 128)
 		return;
 
+	if ( !SV_QueryCacheValid( sv_queryCache.statusValid, sv_queryCache.statusTime ) ) {
+		SV_BuildStatus();
+	}
+
+	Com_Memcpy( infostring, sv_queryCache.status, strlen( sv_queryCache.status ) + 1 );
+
+	// echo back the parameter to status. so master servers can use it as a challenge
+	// to prevent timed spoofed reply packets that add ghost servers
+	Info_SetValueForKey( infostring, "challenge", Cmd_Argv(1) );
+
+	NET_OutOfBandPrint( NS_SERVER, from, "statusResponse\n%s\n%s", infostring, sv_queryCache.players );
+}
+
+/*
+================
+SV_BuildInfo
+================
+*/
+static void SV_BuildInfo( void ) {
+	int		i, count, humans;
+	char	*gamedir;
+	char	*infostring;
+
 	// don't count privateclients
 	count = humans = 0;
 	for ( i = sv_privateClients->integer ; i < sv_maxclients->integer ; i++ ) {
@@ -639,12 +709,9 @@ void SVC_Info( netadr_t from ) {
 		}
 	}
 
+	infostring = sv_queryCache.info;
 	infostring[0] = 0;
 
-	// echo back the parameter to status. so servers can use it as a challenge
-	// to prevent timed spoofed reply packets that add ghost servers
-	Info_SetValueForKey( infostring, "challenge", Cmd_Argv(1) );
-
 	Info_SetValueForKey( infostring, "gamename", com_gamename->string );
 
 #ifdef LEGACY_PROTOCOL
@@ -681,6 +748,93 @@ void SVC_Info( netadr_t from ) {
 		Info_SetValueForKey( infostring, "game", gamedir );
 	}
 
+	sv_queryCache.infoValid = qtrue;
+	sv_queryCache.infoTime = svs.time;
+	sv_queryCache.sequence++;
+}
+
+/*
+================
+SV_UpdateQueryReplies
+
+Rebuilds the getstatus and getinfo replies if they are stale, and returns
+a number that changes whenever they do
+================
+*/
+int SV_UpdateQueryReplies( void ) {
+	if ( !SV_QueryCacheValid( sv_queryCache.statusValid, sv_queryCache.statusTime ) ) {
+		SV_BuildStatus();
+	}
+	if ( !SV_QueryCacheValid( sv_queryCache.infoValid, sv_queryCache.infoTime ) ) {
+		SV_BuildInfo();
+	}
+
+	return sv_queryCache.sequence;
+}
+
+/*
+================
+SV_CopyQueryReplies
+
+The getstatus and getinfo replies without the challenge, for the query
+thread to answer with
+================
+*/
+void SV_CopyQueryReplies( char *status, char *players, int playersSize, char *info ) {
+	Q_strncpyz( status, sv_queryCache.status, MAX_INFO_STRING );
+	Q_strncpyz( players, sv_queryCache.players, playersSize );
+	Q_strncpyz( info, sv_queryCache.info, MAX_INFO_STRING );
+}
+
+/*
+================
+SVC_Info
+
+Responds with a short info message that should be enough to determine
+if a user is interested in a server to do a full status
+================
+*/
+void SVC_Info( netadr_t from ) {
+	char	infostring[MAX_INFO_STRING];
+
+	// ignore if we are in single player
+	if ( Cvar_VariableValue( "g_gametype" ) == GT_SINGLE_PLAYER || Cvar_VariableValue("ui_singlePlayerActive")) {
+		return;
+	}
+
+	// Prevent using getinfo as an amplifier
+	if ( SVC_RateLimitAddress( from, 10, 1000 ) ) {
+		Com_DPrintf( "SVC_Info: rate limit from %s exceeded, dropping request\n",
+			NET_AdrToString( from ) );
+		return;
+	}
+
+	// Allow getinfo to be DoSed relatively easily, but prevent
+	// excess outbound bandwidth usage when being flooded inbound
+	if ( SVC_RateLimit( &outboundLeakyBucket, 10, 100 ) ) {
+		Com_DPrintf( "SVC_Info: rate limit exceeded, dropping request\n" );
+		return;
+	}
+
+	/*
+	 * Check whether Cmd_Argv(1) has a sane length. This was not done in the original Quake3 version which led
+	 * to the Infostring bug discovered by Luigi Auriemma. See http://aluigi.altervista.org/ for the advisory.
+	 */
+
+	// A maximum challenge length of 128 should be more than plenty.
+	if(strlen(Cmd_Argv(1)) > 128)
+		return;
+
+	if ( !SV_QueryCacheValid( sv_queryCache.infoValid, sv_queryCache.infoTime ) ) {
+		SV_BuildInfo();
+	}
+
+	Com_Memcpy( infostring, sv_queryCache.info, strlen( sv_queryCache.info ) + 1 );
+
+	// echo back the parameter to status. so servers can use it as a challenge
+	// to prevent timed spoofed reply packets that add ghost servers
+	Info_SetValueForKey( infostring, "challenge", Cmd_Argv(1) );
+
 	NET_OutOfBandPrint( NS_SERVER, from, "infoResponse\n%s", infostring );
 }
 
@@ -783,6 +937,10 @@ static void SV_ConnectionlessPacket( netadr_t from, msg_t *msg ) {
 	char	*s;
 	char	*c;
 
+	if ( SV_QueueQuery( from, msg ) ) {
+		return;		// the query thread answers it
+	}
+
 	MSG_BeginReadingOOB( msg );
 	MSG_ReadLong( msg );		// skip the -1 marker
 
@@ -824,10 +982,10 @@ static void SV_ConnectionlessPacket( netadr_t from, msg_t *msg ) {
 
 /*
 =================
-SV_PacketEvent
+SV_HandlePacket
 =================
 */
-void SV_PacketEvent( netadr_t from, msg_t *msg ) {
+static void SV_HandlePacket( netadr_t from, msg_t *msg ) {
 	int			i;
 	client_t	*cl;
 	int			qport;
@@ -880,6 +1038,19 @@ void SV_PacketEvent( netadr_t from, msg_t *msg ) {
 	}
 }
 
+/*
+=================
+SV_PacketEvent
+=================
+*/
+void SV_PacketEvent( netadr_t from, msg_t *msg ) {
+	int64_t		start;
+
+	start = SV_ProfileStart();
+	SV_HandlePacket( from, msg );
+	SV_ProfileEnd( PROF_PACKETS, start );
+}
+
 
 /*
 ===================
@@ -1018,6 +1189,105 @@ static qboolean SV_CheckPaused( void ) {
 	return qtrue;
 }
 
+#define	HIBERNATE_MSEC	1000
+
+/*
+==================
+SV_HumanClients
+==================
+*/
+static int SV_HumanClients( void ) {
+	client_t	*cl;
+	int			i, count;
+
+	count = 0;
+	for ( i = 0, cl = svs.clients ; i < sv_maxclients->integer ; i++, cl++ ) {
+		if ( cl->state >= CS_CONNECTED && cl->netchan.remoteAddress.type != NA_BOT ) {
+			count++;
+		}
+	}
+	return count;
+}
+
+/*
+==================
+SV_Hibernate
+
+A dedicated server nobody has been connected to for sv_hibernateTime msec
+stops running the game and sending snapshots.  It only keeps up svs.time,
+timeouts and heartbeats, and Com_Frame sleeps on the sockets in between.
+Connectionless packets are still answered as they arrive, and the game
+resumes where it stopped, at the same sv.time, when a client connects.
+
+Returns qtrue if the frame was spent hibernating
+==================
+*/
+static qboolean SV_Hibernate( int msec ) {
+	client_t	*cl;
+	int			i;
+
+	if ( !com_dedicated->integer || sv_hibernateTime->integer <= 0 || SV_BenchmarkMsec() ||
+		SV_HumanClients() ) {
+		svs.emptyTime = svs.time;
+
+		if ( !svs.hibernating ) {
+			return qfalse;
+		}
+
+		// the time since the last frame was hibernated through, it
+		// doesn't get made up with game frames
+		svs.hibernating = qfalse;
+		svs.time += msec;
+		sv.timeResidual = 0;
+
+		// nobody had a chance to send anything while the game stood
+		// still, don't time them out in the first frame
+		for ( i = 0, cl = svs.clients ; i < sv_maxclients->integer ; i++, cl++ ) {
+			if ( cl->state >= CS_CONNECTED ) {
+				cl->lastPacketTime = svs.time;
+			}
+		}
+
+		Com_Printf( "Server resumes after hibernating for %i seconds.\n",
+			( svs.time - svs.hibernateTime ) / 1000 );
+		return qtrue;
+	}
+
+	if ( !svs.hibernating ) {
+		if ( svs.time - svs.emptyTime < sv_hibernateTime->integer ) {
+			return qfalse;
+		}
+
+		svs.hibernating = qtrue;
+		svs.hibernateTime = svs.time;
+		Com_Printf( "Server hibernates until a client connects.\n" );
+	}
+
+	svs.time += msec;
+	sv.timeResidual = 0;
+
+	// bots only show they're alive in game frames, they stay
+	for ( i = 0, cl = svs.clients ; i < sv_maxclients->integer ; i++, cl++ ) {
+		if ( cl->state >= CS_CONNECTED && cl->netchan.remoteAddress.type == NA_BOT ) {
+			cl->lastPacketTime = svs.time;
+		}
+	}
+
+	SV_CheckTimeouts();
+	SV_MasterHeartbeat( HEARTBEAT_FOR_MASTER );
+
+	return qtrue;
+}
+
+/*
+==================
+SV_Hibernating
+==================
+*/
+qboolean SV_Hibernating( void ) {
+	return com_sv_running->integer && svs.hibernating;
+}
+
 /*
 ==================
 SV_FrameMsec
@@ -1026,6 +1296,11 @@ Return time in millseconds until processing of the next server frame.
 */
 int SV_FrameMsec()
 {
+	// wake up now and then to keep svs.time going, and right away
+	// when a client has connected
+	if(SV_Hibernating() && !SV_HumanClients())
+		return HIBERNATE_MSEC;
+
 	if(sv_fps)
 	{
 		int frameMsec;
@@ -1052,6 +1327,7 @@ happen before SV_Frame is called
 void SV_Frame( int msec ) {
 	int		frameMsec;
 	int		startTime;
+	int64_t	frameStart, start;
 
 	// the menu kills the server with this cvar
 	if ( sv_killserver->integer ) {
@@ -1091,7 +1367,11 @@ void SV_Frame( int msec ) {
 
 	sv.timeResidual += msec;
 
-	if (!com_dedicated->integer) SV_BotFrame (sv.time + sv.timeResidual);
+	if (!com_dedicated->integer) {
+		start = SV_ProfileStart();
+		SV_BotFrame (sv.time + sv.timeResidual);
+		SV_ProfileEnd( PROF_BOTS, start );
+	}
 
 	// if time is about to hit the 32nd bit, kick all clients
 	// and clear sv.time, rather
@@ -1115,6 +1395,14 @@ void SV_Frame( int msec ) {
 		return;
 	}
 
+	SV_QueryFrame();
+
+	if ( SV_Hibernate( msec ) ) {
+		return;
+	}
+
+	frameStart = SV_ProfileStart();
+
 	// update infostrings if anything has been changed
 	if ( cvar_modifiedFlags & CVAR_SERVERINFO ) {
 		SV_SetConfigstring( CS_SERVERINFO, Cvar_InfoString( CVAR_SERVERINFO ) );
@@ -1132,32 +1420,53 @@ void SV_Frame( int msec ) {
 	}
 
 	// update ping based on the all received frames
+	start = SV_ProfileStart();
 	SV_CalcPings();
+	SV_ProfileEnd( PROF_PINGS, start );
 
-	if (com_dedicated->integer) SV_BotFrame (sv.time);
+	if (com_dedicated->integer) {
+		start = SV_ProfileStart();
+		SV_BotFrame (sv.time);
+		SV_ProfileEnd( PROF_BOTS, start );
+	}
 
 	// run the game simulation in chunks
+	start = SV_ProfileStart();
 	while ( sv.timeResidual >= frameMsec ) {
 		sv.timeResidual -= frameMsec;
 		svs.time += frameMsec;
 		sv.time += frameMsec;
 
 		// let everything in the world think and move
+		SV_ClearTraceCache();
 		VM_Call (gvm, GAME_RUN_FRAME, sv.time);
 	}
+	SV_ProfileEnd( PROF_GAME, start );
 
 	if ( com_speeds->integer ) {
 		time_game = Sys_Milliseconds () - startTime;
 	}
 
 	// check timeouts
+	start = SV_ProfileStart();
 	SV_CheckTimeouts();
+	SV_ProfileEnd( PROF_TIMEOUTS, start );
 
-	// send messages back to the clients
+	// send messages back to the clients, all in one go at the end of the frame
+	NET_BeginSendBatch();
+	start = SV_ProfileStart();
 	SV_SendClientMessages();
+	SV_ProfileEnd( PROF_MESSAGES, start );
 
 	// send a heartbeat to the master if needed
 	SV_MasterHeartbeat(HEARTBEAT_FOR_MASTER);
+
+	start = SV_ProfileStart();
+	NET_FlushSendBatch();
+	SV_ProfileEnd( PROF_SEND, start );
+
+	SV_ProfileEnd( PROF_FRAME, frameStart );
+	SV_ProfileEndFrame();
 }
 
 /*
@@ -169,6 +169,7 @@ void SV_Netchan_TransmitNextInQueue(client_t *client)
 		SV_Netchan_Encode(client, &netbuf->msg, netbuf->clientCommandString);
 #endif
 
+	SV_RangeCodingSent(client, &netbuf->msg);
 	Netchan_Transmit(&client->netchan, netbuf->msg.cursize, netbuf->msg.data);
 
 	// pop from queue
@@ -224,6 +225,7 @@ then buffer them and make sure they get sent in correct order
 void SV_Netchan_Transmit( client_t *client, msg_t *msg)
 {
 	MSG_WriteByte( msg, svc_EOF );
+	SV_FinishRangeCoding( client, msg );
 
 	if(client->netchan.unsentFragments || client->netchan_start_queue)
 	{
@@ -250,6 +252,7 @@ void SV_Netchan_Transmit( client_t *client, msg_t *msg)
 		if(client->compat)
 			SV_Netchan_Encode(client, msg, client->lastClientCommandString);
 #endif
+		SV_RangeCodingSent( client, msg );
 		Netchan_Transmit( &client->netchan, msg->cursize, msg->data );
 	}
 }
@@ -0,0 +1,543 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// sv_profile.c -- where the time of the server frames goes
+
+#include "server.h"
+
+/*
+=============================================================================
+
+With sv_profile 1, or while "svprofile log" is writing a log, every phase
+of SV_Frame is timed with Sys_Microseconds.  The phases of the last
+PROFILE_FRAMES frames are kept for "svprofile", and the log gets a line
+for the frames of every second, as JSON or CSV.
+
+Packets arrive between the frames, their time goes to the frame after.
+
+=============================================================================
+*/
+
+#define	PROFILE_FRAMES		1024	// must be a power of two
+#define	PROFILE_BUCKETS		24		// powers of two microseconds
+
+typedef struct {
+	int		count;
+	float	avg;
+	int		p50, p90, p99, max;
+	int		buckets[PROFILE_BUCKETS];	// frames under 2, 4, 8... usec
+} profileStats_t;
+
+static const char *sv_profilePhaseNames[NUM_PROFILE_PHASES] = {
+	"packets",
+	"pings",
+	"bots",
+	"game",
+	"timeouts",
+	"build",
+	"encode",
+	"send",
+	"messages",
+	"frame"
+};
+
+static int			sv_profileCurrent[NUM_PROFILE_PHASES];		// usec of the frame being run
+static int			sv_profileFrames[PROFILE_FRAMES][NUM_PROFILE_PHASES];
+static int			sv_profileNumFrames;						// ever recorded, wraps the ring
+
+static qboolean		sv_benchmarking;
+
+static fileHandle_t	sv_profileLog;
+static qboolean		sv_profileLogCSV;
+static int			sv_profileLogTime;
+static int			sv_profileLogFrames;						// sv_profileNumFrames at the last line
+
+/*
+=================
+SV_Profiling
+=================
+*/
+static qboolean SV_Profiling( void ) {
+	return ( sv_profile && sv_profile->integer ) || sv_profileLog || sv_benchmarking;
+}
+
+/*
+=================
+SV_ProfileStart
+
+Returns 0 when not profiling, which SV_ProfileEnd ignores
+=================
+*/
+int64_t SV_ProfileStart( void ) {
+	if ( !SV_Profiling() ) {
+		return 0;
+	}
+	return Sys_Microseconds();
+}
+
+/*
+=================
+SV_ProfileEnd
+=================
+*/
+void SV_ProfileEnd( profilePhase_t phase, int64_t start ) {
+	if ( !start ) {
+		return;
+	}
+	sv_profileCurrent[phase] += (int)( Sys_Microseconds() - start );
+}
+
+/*
+=================
+SV_QsortInts
+=================
+*/
+static int QDECL SV_QsortInts( const void *a, const void *b ) {
+	return *(const int *)a - *(const int *)b;
+}
+
+/*
+=================
+SV_ProfileStats
+
+Statistics of a phase over the last count recorded frames
+=================
+*/
+static void SV_ProfileStats( profilePhase_t phase, int count, profileStats_t *stats ) {
+	static int	values[PROFILE_FRAMES];
+	int			i, b;
+	double		total;
+
+	Com_Memset( stats, 0, sizeof( *stats ) );
+
+	if ( count > sv_profileNumFrames ) {
+		count = sv_profileNumFrames;
+	}
+	if ( count > PROFILE_FRAMES ) {
+		count = PROFILE_FRAMES;
+	}
+	if ( count < 1 ) {
+		return;
+	}
+
+	total = 0;
+	for ( i = 0 ; i < count ; i++ ) {
+		values[i] = sv_profileFrames[( sv_profileNumFrames - count + i ) & ( PROFILE_FRAMES - 1 )][phase];
+		total += values[i];
+
+		for ( b = 0 ; b < PROFILE_BUCKETS - 1 && values[i] >= ( 2 << b ) ; b++ ) {
+		}
+		stats->buckets[b]++;
+	}
+	qsort( values, count, sizeof( values[0] ), SV_QsortInts );
+
+	stats->count = count;
+	stats->avg = total / count;
+	stats->p50 = values[count * 50 / 100];
+	stats->p90 = values[count * 90 / 100];
+	stats->p99 = values[count * 99 / 100];
+	stats->max = values[count - 1];
+}
+
+/*
+=================
+SV_ProfileWriteLog
+
+A line for the frames since the last one
+=================
+*/
+static void SV_ProfileWriteLog( void ) {
+	profileStats_t	stats;
+	int				i, count;
+
+	count = sv_profileNumFrames - sv_profileLogFrames;
+	sv_profileLogFrames = sv_profileNumFrames;
+
+	if ( sv_profileLogCSV ) {
+		FS_Printf( sv_profileLog, "%i,%i,%i", sv_profileLogTime, sv.time, count );
+		for ( i = 0 ; i < NUM_PROFILE_PHASES ; i++ ) {
+			SV_ProfileStats( i, count, &stats );
+			FS_Printf( sv_profileLog, ",%.1f,%i,%i", stats.avg, stats.p99, stats.max );
+		}
+		FS_Printf( sv_profileLog, "\n" );
+		return;
+	}
+
+	FS_Printf( sv_profileLog, "{\"time\":%i,\"svtime\":%i,\"frames\":%i,\"phases\":{",
+		sv_profileLogTime, sv.time, count );
+	for ( i = 0 ; i < NUM_PROFILE_PHASES ; i++ ) {
+		SV_ProfileStats( i, count, &stats );
+		FS_Printf( sv_profileLog, "%s\"%s\":{\"avg\":%.1f,\"p50\":%i,\"p99\":%i,\"max\":%i}",
+			i ? "," : "", sv_profilePhaseNames[i], stats.avg, stats.p50, stats.p99, stats.max );
+	}
+	FS_Printf( sv_profileLog, "}}\n" );
+}
+
+/*
+=================
+SV_ProfilePrint
+=================
+*/
+static void SV_ProfilePrint( void ) {
+	profileStats_t	stats;
+	int				i;
+
+	Com_Printf( "phase         avg     p50     p90     p99     max  usec\n" );
+	for ( i = 0 ; i < NUM_PROFILE_PHASES ; i++ ) {
+		SV_ProfileStats( i, PROFILE_FRAMES, &stats );
+		Com_Printf( "%-9s %7.1f %7i %7i %7i %7i\n", sv_profilePhaseNames[i],
+			stats.avg, stats.p50, stats.p90, stats.p99, stats.max );
+	}
+	Com_Printf( "over the last %i frames\n", stats.count );
+}
+
+/*
+=================
+SV_ProfileStopLog
+=================
+*/
+static void SV_ProfileStopLog( void ) {
+	if ( !sv_profileLog ) {
+		return;
+	}
+	FS_FCloseFile( sv_profileLog );
+	sv_profileLog = 0;
+	Com_Printf( "Stopped the profile log.\n" );
+}
+
+/*
+=============================================================================
+
+Benchmark
+
+With sv_benchmark set, a dedicated server adds sv_benchmarkBots bots when
+a map is loaded and runs SV_Frame back to back, one server frame of game
+time each, until sv_benchmark seconds of game time have passed.  Then it
+reports how fast that went and quits, so the same map, bots and length
+give comparable numbers from one build to the next.
+
+=============================================================================
+*/
+
+static const char *sv_benchmarkBotNames[] = {
+	"sarge", "grunt", "major", "visor", "doom", "keel", "anarki", "hunter",
+	"ranger", "phobos", "mynx", "orbb", "bitterman", "razor", "xaero", "uriel",
+	"klesk", "lucy", "tankjr", "slash", "daemia", "sorlag", "hossman", "angel",
+	"wrack", "gorre", "cadavre", "stripe", "biker", "bones", "patriot"
+};
+
+static int64_t		sv_benchmarkStart;		// Sys_Microseconds of the first tick
+static int			sv_benchmarkEndTime;	// svs.time
+static int			*sv_benchmarkTicks;		// usec of every SV_Frame
+static int			sv_benchmarkNumTicks, sv_benchmarkMaxTicks;
+static int			sv_benchmarkZoneStart, sv_benchmarkZoneLow;
+static int			sv_benchmarkHunkStart, sv_benchmarkHunkLow;
+
+/*
+=================
+SV_BenchmarkFrameMsec
+=================
+*/
+static int SV_BenchmarkFrameMsec( void ) {
+	int		frameMsec;
+
+	frameMsec = 1000 / ( sv_fps->integer > 0 ? sv_fps->integer : 1 );
+	return frameMsec > 0 ? frameMsec : 1;
+}
+
+/*
+=================
+SV_BenchmarkStart
+
+Called when a map has been loaded
+=================
+*/
+void SV_BenchmarkStart( void ) {
+	int		i, frameMsec;
+
+	if ( sv_benchmarking || sv_benchmark->integer <= 0 || !com_dedicated->integer ) {
+		return;		// a map change during the benchmark just goes on
+	}
+
+	frameMsec = SV_BenchmarkFrameMsec();
+
+	sv_benchmarkEndTime = svs.time + sv_benchmark->integer * 1000;
+	sv_benchmarkMaxTicks = sv_benchmark->integer * 1000 / frameMsec + 1;
+	sv_benchmarkTicks = Z_Malloc( sv_benchmarkMaxTicks * sizeof( *sv_benchmarkTicks ) );
+	sv_benchmarkNumTicks = 0;
+	sv_benchmarkStart = 0;
+	sv_benchmarkZoneStart = sv_benchmarkZoneLow = Z_AvailableMemory();
+	sv_benchmarkHunkStart = sv_benchmarkHunkLow = Hunk_MemoryRemaining();
+
+	// they join before the first tick
+	for ( i = 0 ; i < sv_benchmarkBots->integer ; i++ ) {
+		Cbuf_AddText( va( "addbot %s %i free 0\n",
+			sv_benchmarkBotNames[i % ARRAY_LEN( sv_benchmarkBotNames )], sv_benchmarkSkill->integer ) );
+	}
+
+	sv_profileNumFrames = 0;
+	sv_benchmarking = qtrue;
+
+	Com_Printf( "Benchmarking %i seconds with %i bots.\n", sv_benchmark->integer, sv_benchmarkBots->integer );
+}
+
+/*
+=================
+SV_BenchmarkMsec
+
+The msec Com_Frame runs the server frame with instead of sleeping for it,
+0 when not benchmarking
+=================
+*/
+int SV_BenchmarkMsec( void ) {
+	if ( !sv_benchmarking ) {
+		return 0;
+	}
+	return SV_BenchmarkFrameMsec();
+}
+
+/*
+=================
+SV_BenchmarkFree
+=================
+*/
+static void SV_BenchmarkFree( void ) {
+	if ( sv_benchmarkTicks ) {
+		Z_Free( sv_benchmarkTicks );
+		sv_benchmarkTicks = NULL;
+	}
+	sv_benchmarking = qfalse;
+}
+
+/*
+=================
+SV_BenchmarkReport
+=================
+*/
+static void SV_BenchmarkReport( void ) {
+	int		i, n;
+	double	total, seconds, elapsed;
+
+	n = sv_benchmarkNumTicks;
+	elapsed = ( Sys_Microseconds() - sv_benchmarkStart ) / 1000000.0;
+	if ( n < 1 || elapsed <= 0 ) {
+		return;
+	}
+
+	total = 0;
+	for ( i = 0 ; i < n ; i++ ) {
+		total += sv_benchmarkTicks[i];
+	}
+	qsort( sv_benchmarkTicks, n, sizeof( sv_benchmarkTicks[0] ), SV_QsortInts );
+
+	seconds = n * SV_BenchmarkFrameMsec() / 1000.0;
+	Com_Printf( "----- Benchmark -----\n" );
+	Com_Printf( "%i ticks, %.1f seconds of game time in %.2f seconds: %.1f ticks/sec, %.1fx real time\n",
+		n, seconds, elapsed, n / elapsed, seconds / elapsed );
+	Com_Printf( "tick usec: avg %.1f, p50 %i, p90 %i, p99 %i, p99.9 %i, max %i\n", total / n,
+		sv_benchmarkTicks[n * 50 / 100], sv_benchmarkTicks[n * 90 / 100],
+		sv_benchmarkTicks[n * 99 / 100], sv_benchmarkTicks[n * 999 / 1000], sv_benchmarkTicks[n - 1] );
+	Com_Printf( "zone: %i KB free at the low water mark, %i KB at the start\n",
+		sv_benchmarkZoneLow / 1024, sv_benchmarkZoneStart / 1024 );
+	Com_Printf( "hunk: %i KB free at the low water mark, %i KB at the start\n",
+		sv_benchmarkHunkLow / 1024, sv_benchmarkHunkStart / 1024 );
+	SV_ProfilePrint();
+}
+
+/*
+=================
+SV_BenchmarkTick
+
+Called after every SV_Frame while benchmarking with how long it took
+=================
+*/
+static void SV_BenchmarkTick( int usec ) {
+	int		mem;
+
+	if ( !sv_benchmarkStart ) {
+		// the time of the first tick isn't counted, the bots were only joining
+		sv_benchmarkStart = Sys_Microseconds();
+		return;
+	}
+
+	if ( sv_benchmarkNumTicks < sv_benchmarkMaxTicks ) {
+		sv_benchmarkTicks[sv_benchmarkNumTicks++] = usec;
+	}
+
+	mem = Z_AvailableMemory();
+	if ( mem < sv_benchmarkZoneLow ) {
+		sv_benchmarkZoneLow = mem;
+	}
+	mem = Hunk_MemoryRemaining();
+	if ( mem < sv_benchmarkHunkLow ) {
+		sv_benchmarkHunkLow = mem;
+	}
+
+	if ( svs.time - sv_benchmarkEndTime >= 0 ) {
+		SV_BenchmarkReport();
+		SV_BenchmarkFree();
+		Cbuf_AddText( "quit\n" );
+	}
+}
+
+/*
+=================
+SV_ProfileShutdown
+=================
+*/
+void SV_ProfileShutdown( void ) {
+	SV_ProfileStopLog();
+	SV_BenchmarkFree();
+}
+
+/*
+=================
+SV_ProfileEndFrame
+
+Called at the end of every SV_Frame that ran
+=================
+*/
+void SV_ProfileEndFrame( void ) {
+	int		now;
+
+	if ( !SV_Profiling() ) {
+		Com_Memset( sv_profileCurrent, 0, sizeof( sv_profileCurrent ) );
+		return;
+	}
+
+	Com_Memcpy( sv_profileFrames[sv_profileNumFrames & ( PROFILE_FRAMES - 1 )], sv_profileCurrent,
+		sizeof( sv_profileCurrent ) );
+	sv_profileNumFrames++;
+
+	if ( sv_benchmarking ) {
+		SV_BenchmarkTick( sv_profileCurrent[PROF_FRAME] );
+	}
+
+	Com_Memset( sv_profileCurrent, 0, sizeof( sv_profileCurrent ) );
+
+	if ( !sv_profileLog ) {
+		return;
+	}
+
+	now = Sys_Milliseconds();
+	if ( now - sv_profileLogTime >= 1000 ) {
+		sv_profileLogTime = now;
+		SV_ProfileWriteLog();
+	}
+}
+
+/*
+=================
+SV_ProfileStartLog
+=================
+*/
+static void SV_ProfileStartLog( const char *name ) {
+	char	filename[MAX_QPATH];
+	int		i;
+
+	SV_ProfileStopLog();
+
+	Com_sprintf( filename, sizeof( filename ), "profile/%s", name );
+	COM_DefaultExtension( filename, sizeof( filename ), ".json" );
+
+	sv_profileLog = FS_FOpenFileWrite( filename );
+	if ( !sv_profileLog ) {
+		Com_Printf( "Couldn't open %s.\n", filename );
+		return;
+	}
+	FS_ForceFlush( sv_profileLog );
+
+	sv_profileLogCSV = !Q_stricmp( COM_GetExtension( filename ), "csv" );
+	if ( sv_profileLogCSV ) {
+		FS_Printf( sv_profileLog, "time,svtime,frames" );
+		for ( i = 0 ; i < NUM_PROFILE_PHASES ; i++ ) {
+			FS_Printf( sv_profileLog, ",%s_avg,%s_p99,%s_max", sv_profilePhaseNames[i],
+				sv_profilePhaseNames[i], sv_profilePhaseNames[i] );
+		}
+		FS_Printf( sv_profileLog, "\n" );
+	}
+
+	sv_profileLogTime = Sys_Milliseconds();
+	sv_profileLogFrames = sv_profileNumFrames;
+	Com_Printf( "Logging the frame profile to %s every second.\n", filename );
+}
+
+/*
+=================
+SV_Profile_f
+
+svprofile [hist | reset | log <name[.json | .csv]> | log stop]
+=================
+*/
+void SV_Profile_f( void ) {
+	profileStats_t	stats;
+	int				i, b;
+	const char		*cmd;
+
+	cmd = Cmd_Argv( 1 );
+
+	if ( !Q_stricmp( cmd, "reset" ) ) {
+		sv_profileNumFrames = 0;
+		sv_profileLogFrames = 0;
+		return;
+	}
+
+	if ( !Q_stricmp( cmd, "log" ) ) {
+		if ( Cmd_Argc() != 3 ) {
+			Com_Printf( "Usage: svprofile log <name[.json | .csv] | stop>\n" );
+		} else if ( !Q_stricmp( Cmd_Argv( 2 ), "stop" ) ) {
+			SV_ProfileStopLog();
+		} else {
+			SV_ProfileStartLog( Cmd_Argv( 2 ) );
+		}
+		return;
+	}
+
+	if ( *cmd && Q_stricmp( cmd, "hist" ) ) {
+		Com_Printf( "Usage: svprofile [hist | reset | log <name | stop>]\n" );
+		return;
+	}
+
+	if ( !SV_Profiling() ) {
+		Com_Printf( "Set sv_profile 1 to profile the server frames.\n" );
+	}
+	if ( !sv_profileNumFrames ) {
+		Com_Printf( "No frames profiled.\n" );
+		return;
+	}
+
+	if ( !Q_stricmp( cmd, "hist" ) ) {
+		// frames per power of two microseconds, only the ones that have any
+		for ( i = 0 ; i < NUM_PROFILE_PHASES ; i++ ) {
+			SV_ProfileStats( i, PROFILE_FRAMES, &stats );
+			Com_Printf( "%-9s", sv_profilePhaseNames[i] );
+			for ( b = 0 ; b < PROFILE_BUCKETS ; b++ ) {
+				if ( stats.buckets[b] ) {
+					Com_Printf( " <%i:%i", 2 << b, stats.buckets[b] );
+				}
+			}
+			Com_Printf( "\n" );
+		}
+		return;
+	}
+
+	SV_ProfilePrint();
+}
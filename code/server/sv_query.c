@@ -0,0 +1,510 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// sv_query.c -- answering server queries on a thread of their own
+
+#include "server.h"
+
+/*
+=============================================================================
+
+With sv_queryThread 1, getinfo, getstatus and getchallenge packets are
+handed from SV_ConnectionlessPacket to a query thread through a ring the
+main thread only writes the head of and the query thread only writes the
+tail of, so a flood of them costs the main thread little more than
+receiving them.  Everything else, connect and rcon among it, is still
+handled on the main thread.
+
+The query thread answers with the getinfo and getstatus replies the main
+thread built, which are copied over whenever they change before a query
+is queued.  The rate limit buckets and svs.challenges are shared, both
+threads use them under SV_QueryLock.  The query thread never prints, and
+sends through Sys_SendPacketDirect, which waits while NET_Config reopens
+the sockets.
+
+=============================================================================
+*/
+
+#define	QUERY_QUEUE_SIZE	256		// must be a power of two
+#define	QUERY_PACKET_SIZE	512		// larger ones stay on the main thread
+#define	QUERY_MAX_ARGS		16
+
+typedef struct {
+	netadr_t	from;
+	int			length;
+	byte		data[QUERY_PACKET_SIZE];
+} queryPacket_t;
+
+typedef struct {
+	void			*thread;
+	void			*signal;
+	volatile qboolean	quit;
+
+	queryPacket_t	packets[QUERY_QUEUE_SIZE];
+	volatile int	head;			// written by the main thread only
+	volatile int	tail;			// written by the query thread only
+
+	// main thread only
+	int				sequence;		// of the replies copied below
+	qboolean		singlePlayer;
+	int				gameNameModified;
+
+	// under the lock
+	char			status[MAX_INFO_STRING];
+	char			players[MAX_MSGLEN];
+	char			info[MAX_INFO_STRING];
+	char			gameName[MAX_CVAR_VALUE_STRING];
+} queryThread_t;
+
+static void				*sv_queryMutex;
+static queryThread_t	sv_query;
+
+static void QDECL SV_QuerySend( netadr_t to, const char *fmt, ... ) __attribute__ ((format (printf, 2, 3)));
+
+/*
+================
+SV_QueryLock
+================
+*/
+void SV_QueryLock( void ) {
+	Sys_LockMutex( sv_queryMutex );
+}
+
+/*
+================
+SV_QueryUnlock
+================
+*/
+void SV_QueryUnlock( void ) {
+	Sys_UnlockMutex( sv_queryMutex );
+}
+
+/*
+================
+SV_QuerySend
+================
+*/
+static void QDECL SV_QuerySend( netadr_t to, const char *fmt, ... ) {
+	char	string[MAX_MSGLEN];
+	int		length;
+	va_list	argptr;
+
+	string[0] = string[1] = string[2] = string[3] = -1;
+
+	va_start( argptr, fmt );
+	length = Q_vsnprintf( string + 4, sizeof( string ) - 4, fmt, argptr );
+	va_end( argptr );
+
+	if ( length < 0 || length >= sizeof( string ) - 4 ) {
+		return;
+	}
+
+	Sys_SendPacketDirect( length + 4, string, to );
+}
+
+/*
+================
+SV_QuerySetChallenge
+
+Info_SetValueForKey for the challenge, without its warnings
+================
+*/
+static void SV_QuerySetChallenge( char *infostring, const char *challenge ) {
+	char	pair[MAX_INFO_STRING];
+
+	if ( !*challenge || strchr( challenge, '\\' ) || strchr( challenge, ';' ) ||
+		strchr( challenge, '\"' ) ) {
+		return;
+	}
+
+	Com_sprintf( pair, sizeof( pair ), "\\challenge\\%s", challenge );
+	if ( strlen( pair ) + strlen( infostring ) >= MAX_INFO_STRING ) {
+		return;
+	}
+
+	strcat( pair, infostring );
+	strcpy( infostring, pair );
+}
+
+/*
+================
+SV_QueryRateLimit
+================
+*/
+static qboolean SV_QueryRateLimit( netadr_t from ) {
+	// Prevent using queries as an amplifier
+	if ( SVC_RateLimitAddress( from, 10, 1000 ) ) {
+		return qtrue;
+	}
+
+	// Allow them to be DoSed relatively easily, but prevent
+	// excess outbound bandwidth usage when being flooded inbound
+	return SVC_RateLimit( &outboundLeakyBucket, 10, 100 );
+}
+
+/*
+================
+SV_QueryStatus
+
+SVC_Status on the query thread
+================
+*/
+static void SV_QueryStatus( netadr_t from, int argc, char **argv ) {
+	const char	*challenge = argc > 1 ? argv[1] : "";
+	char		infostring[MAX_INFO_STRING];
+	char		players[MAX_MSGLEN];
+
+	if ( SV_QueryRateLimit( from ) ) {
+		return;
+	}
+
+	// A maximum challenge length of 128 should be more than plenty.
+	if ( strlen( challenge ) > 128 ) {
+		return;
+	}
+
+	SV_QueryLock();
+	Q_strncpyz( infostring, sv_query.status, sizeof( infostring ) );
+	Q_strncpyz( players, sv_query.players, sizeof( players ) );
+	SV_QueryUnlock();
+
+	// echo back the parameter to status. so master servers can use it as a challenge
+	// to prevent timed spoofed reply packets that add ghost servers
+	SV_QuerySetChallenge( infostring, challenge );
+
+	SV_QuerySend( from, "statusResponse\n%s\n%s", infostring, players );
+}
+
+/*
+================
+SV_QueryInfo
+
+SVC_Info on the query thread
+================
+*/
+static void SV_QueryInfo( netadr_t from, int argc, char **argv ) {
+	const char	*challenge = argc > 1 ? argv[1] : "";
+	char		infostring[MAX_INFO_STRING];
+
+	if ( SV_QueryRateLimit( from ) ) {
+		return;
+	}
+
+	if ( strlen( challenge ) > 128 ) {
+		return;
+	}
+
+	SV_QueryLock();
+	Q_strncpyz( infostring, sv_query.info, sizeof( infostring ) );
+	SV_QueryUnlock();
+
+	SV_QuerySetChallenge( infostring, challenge );
+
+	SV_QuerySend( from, "infoResponse\n%s", infostring );
+}
+
+/*
+================
+SV_QueryChallenge
+
+SV_GetChallenge on the query thread, for clients that need
+no authorization
+================
+*/
+static void SV_QueryChallenge( netadr_t from, int argc, char **argv ) {
+	const char	*gameName = argc > 2 ? argv[2] : "";
+	int			clientChallenge = argc > 1 ? atoi( argv[1] ) : 0;
+	int			oldestClientTime;
+	int			challengeNum;
+	char		ourGameName[MAX_CVAR_VALUE_STRING];
+	challenge_t	*challenge;
+
+	if ( SV_QueryRateLimit( from ) ) {
+		return;
+	}
+
+	SV_QueryLock();
+	Q_strncpyz( ourGameName, sv_query.gameName, sizeof( ourGameName ) );
+	SV_QueryUnlock();
+
+	// reject client if the gamename string sent by the client doesn't match ours
+#ifdef LEGACY_PROTOCOL
+	// gamename is optional for legacy protocol
+	if ( !com_legacyprotocol->integer || *gameName )
+#endif
+	{
+		if ( !*gameName || strcmp( gameName, ourGameName ) ) {
+			SV_QuerySend( from, "print\nGame mismatch: This is a %s server\n", ourGameName );
+			return;
+		}
+	}
+
+	SV_QueryLock();
+	challenge = SV_NewChallenge( from, clientChallenge, &oldestClientTime );
+	challenge->pingTime = svs.time;
+	challengeNum = challenge->challenge;
+	SV_QueryUnlock();
+
+	SV_QuerySend( from, "challengeResponse %d %d %d",
+		challengeNum, clientChallenge, com_protocol->integer );
+}
+
+/*
+================
+SV_QueryPacket
+
+Reads the command line like MSG_ReadStringLine and answers it
+================
+*/
+static void SV_QueryPacket( const queryPacket_t *packet ) {
+	char	line[QUERY_PACKET_SIZE];
+	char	tokenized[QUERY_PACKET_SIZE + QUERY_MAX_ARGS];
+	char	*argv[QUERY_MAX_ARGS];
+	int		argc;
+	int		i, l;
+	int		c;
+
+	l = 0;
+	for ( i = 4 ; i < packet->length ; i++ ) {
+		c = packet->data[i];
+		if ( c == 0 || c == '\n' ) {
+			break;
+		}
+		// translate all fmt spec to avoid crash bugs
+		// and don't allow higher ascii values
+		if ( c == '%' || c > 127 ) {
+			c = '.';
+		}
+		line[l++] = c;
+	}
+	line[l] = 0;
+
+	argc = Cmd_TokenizeStringTo( line, qfalse, argv, QUERY_MAX_ARGS, tokenized );
+	if ( !argc ) {
+		return;
+	}
+
+	if ( !Q_stricmp( argv[0], "getstatus" ) ) {
+		SV_QueryStatus( packet->from, argc, argv );
+	} else if ( !Q_stricmp( argv[0], "getinfo" ) ) {
+		SV_QueryInfo( packet->from, argc, argv );
+	} else if ( !Q_stricmp( argv[0], "getchallenge" ) ) {
+		SV_QueryChallenge( packet->from, argc, argv );
+	}
+}
+
+/*
+================
+SV_QueryThread
+================
+*/
+static void SV_QueryThread( void *data ) {
+	int		tail;
+
+	while ( 1 ) {
+		Sys_WaitSignal( sv_query.signal );
+		if ( sv_query.quit ) {
+			return;
+		}
+
+		tail = sv_query.tail;
+		while ( tail != sv_query.head ) {
+			Sys_MemoryBarrier();	// read the packet after the head
+			SV_QueryPacket( &sv_query.packets[tail] );
+
+			tail = ( tail + 1 ) & ( QUERY_QUEUE_SIZE - 1 );
+			Sys_MemoryBarrier();	// done with the packet before the slot is reused
+			sv_query.tail = tail;
+			Sys_MemoryBarrier();	// pairs with the one in SV_QueueQuery
+		}
+	}
+}
+
+/*
+================
+SV_QueryCommand
+
+A quick look at the command of a connectionless packet, whether it
+is one the query thread answers
+================
+*/
+static qboolean SV_QueryCommand( const msg_t *msg, const char *cmd ) {
+	int		length = strlen( cmd );
+
+	if ( msg->cursize < 4 + length ) {
+		return qfalse;
+	}
+	if ( Q_stricmpn( (const char *)msg->data + 4, cmd, length ) ) {
+		return qfalse;
+	}
+	return msg->cursize == 4 + length || msg->data[4 + length] <= ' ';
+}
+
+/*
+================
+SV_QueueQuery
+
+Called by SV_ConnectionlessPacket first
+================
+*/
+qboolean SV_QueueQuery( netadr_t from, msg_t *msg ) {
+	queryPacket_t	*packet;
+	int				sequence;
+	int				head, next;
+
+	if ( !sv_query.thread || sv_query.singlePlayer ) {
+		return qfalse;
+	}
+	if ( ( from.type != NA_IP && from.type != NA_IP6 ) || msg->cursize > QUERY_PACKET_SIZE ) {
+		return qfalse;
+	}
+
+	if ( SV_QueryCommand( msg, "getchallenge" ) ) {
+#ifndef STANDALONE
+		// clients the authorize server has to know about go the long way
+		if ( from.type == NA_IP && !com_standalone->integer && !Sys_IsLANAddress( from ) ) {
+			return qfalse;
+		}
+#endif
+	} else if ( !SV_QueryCommand( msg, "getstatus" ) && !SV_QueryCommand( msg, "getinfo" ) ) {
+		return qfalse;
+	}
+
+	head = sv_query.head;
+	next = ( head + 1 ) & ( QUERY_QUEUE_SIZE - 1 );
+	if ( next == sv_query.tail ) {
+		return qtrue;		// the query thread is behind, drop it
+	}
+
+	// give the query thread current replies to answer with
+	sequence = SV_UpdateQueryReplies();
+	if ( sequence != sv_query.sequence ) {
+		SV_QueryLock();
+		SV_CopyQueryReplies( sv_query.status, sv_query.players, sizeof( sv_query.players ), sv_query.info );
+		SV_QueryUnlock();
+		sv_query.sequence = sequence;
+	}
+
+	packet = &sv_query.packets[head];
+	packet->from = from;
+	packet->length = msg->cursize;
+	Com_Memcpy( packet->data, msg->data, msg->cursize );
+
+	Sys_MemoryBarrier();	// the packet before the head
+	sv_query.head = next;
+	Sys_MemoryBarrier();	// the head before looking at the tail
+
+	// an empty ring means the query thread waits, or is about to
+	if ( sv_query.tail == head ) {
+		Sys_RaiseSignal( sv_query.signal );
+	}
+
+	return qtrue;
+}
+
+/*
+================
+SV_QueryStop
+================
+*/
+static void SV_QueryStop( void ) {
+	if ( !sv_query.thread ) {
+		return;
+	}
+
+	sv_query.quit = qtrue;
+	Sys_RaiseSignal( sv_query.signal );
+	Sys_JoinThread( sv_query.thread );
+	Sys_DestroySignal( sv_query.signal );
+
+	sv_query.thread = NULL;
+	sv_query.signal = NULL;
+	sv_query.quit = qfalse;
+	sv_query.head = sv_query.tail = 0;
+}
+
+/*
+================
+SV_QueryFrame
+
+Starts or stops the query thread as sv_queryThread says, and updates
+what it needs to know from cvars
+================
+*/
+void SV_QueryFrame( void ) {
+	if ( !sv_queryThread->integer ) {
+		SV_QueryStop();
+		return;
+	}
+
+	if ( !sv_query.thread ) {
+		sv_query.sequence = SV_UpdateQueryReplies() - 1;
+		sv_query.gameNameModified = -1;
+
+		sv_query.signal = Sys_CreateSignal();
+		if ( sv_query.signal ) {
+			sv_query.thread = Sys_CreateThread( SV_QueryThread, NULL );
+		}
+		if ( !sv_query.thread ) {
+			Com_Printf( "Couldn't start the query thread\n" );
+			if ( sv_query.signal ) {
+				Sys_DestroySignal( sv_query.signal );
+				sv_query.signal = NULL;
+			}
+			Cvar_Set( "sv_queryThread", "0" );
+			return;
+		}
+	}
+
+	// ignore if we are in single player
+	sv_query.singlePlayer = Cvar_VariableValue( "g_gametype" ) == GT_SINGLE_PLAYER ||
+		Cvar_VariableValue( "ui_singlePlayerActive" );
+
+	if ( sv_query.gameNameModified != com_gamename->modificationCount ) {
+		SV_QueryLock();
+		Q_strncpyz( sv_query.gameName, com_gamename->string, sizeof( sv_query.gameName ) );
+		SV_QueryUnlock();
+		sv_query.gameNameModified = com_gamename->modificationCount;
+	}
+}
+
+/*
+================
+SV_QueryInit
+================
+*/
+void SV_QueryInit( void ) {
+	if ( !sv_queryMutex ) {
+		sv_queryMutex = Sys_CreateMutex();
+		if ( !sv_queryMutex ) {
+			Com_Error( ERR_FATAL, "SV_QueryInit: couldn't create mutex" );
+		}
+	}
+}
+
+/*
+================
+SV_QueryShutdown
+================
+*/
+void SV_QueryShutdown( void ) {
+	SV_QueryStop();
+}
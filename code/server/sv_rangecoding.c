@@ -0,0 +1,280 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// sv_rangecoding.c -- range coded messages to the clients that can read them
+
+#include "server.h"
+
+/*
+=============================================================================
+
+A client that sends rangeCoding in the userinfo of its connect gets
+rangeCoding back in the connectResponse when sv_rangeCoding is set, and
+from then on every message to it is range coded instead of huffman coded.
+
+The probabilities of the coder adapt to what it codes, but a message can
+only be read with the model it was written with, and messages get lost.
+So every message starts from a checkpoint the client is known to have,
+the initial model or the one after a snapshot message that it has
+acknowledged.  Snapshot messages make checkpoints while there's room for
+more pending ones, which become the one to start from once acknowledged.
+
+The first byte of a message has the id of the checkpoint it makes in the
+high nibble, 0 for none, and the one it starts from in the low nibble.
+
+Only a client packet with the very sequence of a message as its
+messageAcknowledge means the client read it, a later one doesn't.
+
+=============================================================================
+*/
+
+/*
+=================
+SV_InitRangeCoding
+
+Called by SV_DirectConnect for the clients that asked for it
+=================
+*/
+void SV_InitRangeCoding( client_t *client ) {
+	rangeChannel_t	*range;
+	int				i;
+
+	if ( !client->range ) {
+		client->range = Z_Malloc( sizeof( *client->range ) );
+	}
+
+	range = client->range;
+	Range_InitModel( &range->base.model );
+	range->base.id = 0;
+	range->base.sequence = 0;
+	for ( i = 0 ; i < MAX_PENDING_CHECKPOINTS ; i++ ) {
+		range->pending[i].id = 0;
+	}
+	range->making = -1;
+	range->lastId = 0;
+}
+
+/*
+=================
+SV_FreeRangeCoding
+
+Called when the client slot is reused or freed.  A dropped client keeps
+it for the messages it still gets as a zombie
+=================
+*/
+void SV_FreeRangeCoding( client_t *client ) {
+	if ( client->range ) {
+		Z_Free( client->range );
+		client->range = NULL;
+	}
+	client->rangeCoding = qfalse;
+}
+
+/*
+=================
+SV_CheckpointInUse
+=================
+*/
+static qboolean SV_CheckpointInUse( rangeChannel_t *range, int id ) {
+	int		i;
+
+	if ( id == range->base.id ) {
+		return qtrue;
+	}
+	for ( i = 0 ; i < MAX_PENDING_CHECKPOINTS ; i++ ) {
+		if ( range->pending[i].id == id ) {
+			return qtrue;
+		}
+	}
+
+	return qfalse;
+}
+
+/*
+=================
+SV_NewCheckpoint
+
+A pending checkpoint for the message being written, -1 if there's no room
+=================
+*/
+static int SV_NewCheckpoint( client_t *client ) {
+	rangeChannel_t		*range;
+	rangeCheckpoint_t	*cp;
+	int					i, slot, id;
+
+	range = client->range;
+
+	// a free one, or one that should have been acknowledged long ago
+	slot = -1;
+	for ( i = 0 ; i < MAX_PENDING_CHECKPOINTS ; i++ ) {
+		cp = &range->pending[i];
+		if ( !cp->id || ( cp->sequence != -1 && client->netchan.outgoingSequence - cp->sequence > PACKET_BACKUP ) ) {
+			slot = i;
+			break;
+		}
+	}
+	if ( slot == -1 ) {
+		return -1;
+	}
+
+	// the client keeps every id, the ones in use here can't be overwritten
+	range->pending[slot].id = 0;
+	id = range->lastId;
+	do {
+		id = id % ( RANGE_CHECKPOINTS - 1 ) + 1;
+	} while ( SV_CheckpointInUse( range, id ) );
+	range->lastId = id;
+
+	range->pending[slot].id = id;
+	range->pending[slot].sequence = -1;
+
+	return slot;
+}
+
+/*
+=================
+SV_StartRangeCoding
+
+Can be called again after MSG_Clear, then the message makes no checkpoint
+=================
+*/
+void SV_StartRangeCoding( client_t *client, msg_t *msg, qboolean checkpoint ) {
+	rangeChannel_t	*range;
+	int				id;
+
+	if ( !client->rangeCoding ) {
+		return;
+	}
+
+	range = client->range;
+	if ( range->making != -1 ) {
+		range->pending[range->making].id = 0;
+		range->making = -1;
+	}
+
+	if ( checkpoint ) {
+		range->making = SV_NewCheckpoint( client );
+	}
+	id = range->making != -1 ? range->pending[range->making].id : 0;
+
+	msg->data[0] = ( id << 4 ) | range->base.id;
+	msg->cursize = 1;
+	msg->bit = 8;
+
+	range->coder.model = range->base.model;
+	MSG_StartRangeCoding( msg, &range->coder );
+}
+
+/*
+=================
+SV_FinishRangeCoding
+
+Called by SV_Netchan_Transmit after the svc_EOF the client reads last
+=================
+*/
+void SV_FinishRangeCoding( client_t *client, msg_t *msg ) {
+	rangeChannel_t	*range;
+
+	if ( !msg->coder ) {
+		return;
+	}
+
+	MSG_FinishRangeCoding( msg );
+
+	range = client->range;
+	if ( range->making != -1 ) {
+		if ( msg->overflowed ) {
+			range->pending[range->making].id = 0;
+		} else {
+			range->pending[range->making].model = range->coder.model;
+		}
+		range->making = -1;
+	}
+}
+
+/*
+=================
+SV_RangeCodingSent
+
+Called with a message just before Netchan_Transmit gives it its sequence
+=================
+*/
+void SV_RangeCodingSent( client_t *client, msg_t *msg ) {
+	rangeCheckpoint_t	*cp;
+	int					i, id;
+
+	if ( !client->rangeCoding ) {
+		return;
+	}
+
+	id = msg->data[0] >> 4;
+	if ( !id ) {
+		return;
+	}
+
+	for ( i = 0 ; i < MAX_PENDING_CHECKPOINTS ; i++ ) {
+		cp = &client->range->pending[i];
+		if ( cp->id == id && cp->sequence == -1 ) {
+			cp->sequence = client->netchan.outgoingSequence;
+			return;
+		}
+	}
+}
+
+/*
+=================
+SV_RangeCodingAcknowledged
+
+Called when a client packet has been read, the next messages start from
+the checkpoint of the one it acknowledged
+=================
+*/
+void SV_RangeCodingAcknowledged( client_t *client ) {
+	rangeChannel_t		*range;
+	rangeCheckpoint_t	*cp;
+	int					i;
+
+	if ( !client->rangeCoding ) {
+		return;
+	}
+
+	range = client->range;
+	for ( i = 0 ; i < MAX_PENDING_CHECKPOINTS ; i++ ) {
+		cp = &range->pending[i];
+		if ( cp->id && cp->sequence != -1 && cp->sequence == client->messageAcknowledge ) {
+			break;
+		}
+	}
+	if ( i == MAX_PENDING_CHECKPOINTS ) {
+		return;
+	}
+
+	range->base = *cp;
+	cp->id = 0;
+
+	// the older ones aren't worth going back to
+	for ( i = 0 ; i < MAX_PENDING_CHECKPOINTS ; i++ ) {
+		cp = &range->pending[i];
+		if ( cp->id && cp->sequence != -1 && cp->sequence < range->base.sequence ) {
+			cp->id = 0;
+		}
+	}
+}
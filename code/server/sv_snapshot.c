@@ -45,14 +45,217 @@ A normal server packet will look like:
 =============================================================================
 */
 
+/*
+=============================================================================
+
+Delta entity cache
+
+Clients that are in sync acknowledge the same frames, so the same entity
+deltas get written into many of their messages.  While SV_SendClientMessages
+runs, the new state of an entity is the same for every client, so the bits
+MSG_WriteDeltaEntity writes only depend on the entity number, the state it
+deltas from and force.  They are kept until the next SV_SendClientMessages
+and copied into the following messages instead of being encoded again.
+
+=============================================================================
+*/
+
+#define	MAX_SNAPSHOT_THREADS	16		// each has its own delta cache
+
+#define	DELTA_CACHE_HASH_SIZE	512
+#define	MAX_DELTA_CACHE_ENTRIES	1024
+#define	DELTA_CACHE_BYTES		0x10000
+#define	MAX_DELTA_ENTITY_BYTES	1024	// far more than a full entityState_t takes
+
+typedef struct deltaCacheEntry_s {
+	int				number;			// of the entity the delta is for
+	qboolean		force;
+	const byte		*fieldOrder;	// msg_t entityFieldOrder it was written with
+	entityState_t	from;
+	int				firstByte;		// in deltaCache_t bytes
+	int				numBits;
+	struct deltaCacheEntry_s	*hashNext;
+} deltaCacheEntry_t;
+
+typedef struct {
+	deltaCacheEntry_t	*hashTable[DELTA_CACHE_HASH_SIZE];
+	deltaCacheEntry_t	entries[MAX_DELTA_CACHE_ENTRIES];
+	int					numEntries;
+	byte				bytes[DELTA_CACHE_BYTES];
+	int					numBytes;
+
+	int					fieldChanges[MAX_ENTITY_FIELDS];	// for SV_AddFieldChanges
+} deltaCache_t;
+
+static deltaCache_t		sv_deltaCaches[MAX_SNAPSHOT_THREADS];
+static qboolean			sv_countFieldChanges;		// SV_CountingFieldChanges for the frame
+
+/*
+=============
+SV_ClearDeltaCaches
+=============
+*/
+static void SV_ClearDeltaCaches( void ) {
+	deltaCache_t	*cache;
+	int				i;
+
+	for ( i = 0 ; i < MAX_SNAPSHOT_THREADS ; i++ ) {
+		cache = &sv_deltaCaches[i];
+		if ( !cache->numEntries ) {
+			continue;
+		}
+		Com_Memset( cache->hashTable, 0, sizeof( cache->hashTable ) );
+		cache->numEntries = 0;
+		cache->numBytes = 0;
+	}
+}
+
+/*
+=============
+SV_GatherFieldChanges
+
+Hands the field changes the caches counted to sv_fieldorder.c
+=============
+*/
+static void SV_GatherFieldChanges( void ) {
+	deltaCache_t	*cache;
+	int				counts[MAX_ENTITY_FIELDS];
+	int				i, j;
+
+	if ( sv_countFieldChanges ) {
+		Com_Memset( counts, 0, sizeof( counts ) );
+		for ( i = 0 ; i < MAX_SNAPSHOT_THREADS ; i++ ) {
+			cache = &sv_deltaCaches[i];
+			for ( j = 0 ; j < MAX_ENTITY_FIELDS ; j++ ) {
+				counts[j] += cache->fieldChanges[j];
+			}
+			Com_Memset( cache->fieldChanges, 0, sizeof( cache->fieldChanges ) );
+		}
+		SV_AddFieldChanges( counts );
+	}
+
+	sv_countFieldChanges = SV_CountingFieldChanges();
+}
+
+/*
+=============
+SV_DeltaCacheHash
+=============
+*/
+static int SV_DeltaCacheHash( const entityState_t *from, int number, qboolean force, const byte *fieldOrder ) {
+	const int	*p;
+	unsigned	hash;
+	int			i;
+
+	hash = number * 4 + force * 2 + ( fieldOrder != NULL );
+	p = (const int *)from;
+	for ( i = 0 ; i < sizeof( *from ) / sizeof( int ) ; i++ ) {
+		hash = ( hash ^ p[i] ) * 16777619;
+	}
+
+	return ( hash ^ ( hash >> 16 ) ) & ( DELTA_CACHE_HASH_SIZE - 1 );
+}
+
+/*
+=============
+SV_DeltaFits
+
+MSG_WriteBits marks the message overflowed when any write starts with less
+than 4 bytes left, so the bits can only be copied if that can't happen
+=============
+*/
+static qboolean SV_DeltaFits( msg_t *msg, int bits ) {
+	return msg->maxsize - ( ( ( msg->bit + bits ) >> 3 ) + 1 ) >= 4;
+}
+
+/*
+=============
+SV_WriteDeltaEntity
+
+MSG_WriteDeltaEntity through the delta cache, which can be NULL
+=============
+*/
+static void SV_WriteDeltaEntity( msg_t *msg, deltaCache_t *cache, entityState_t *from, entityState_t *to, qboolean force ) {
+	deltaCacheEntry_t	*entry;
+	msg_t				scratch;
+	byte				scratchBuf[MAX_DELTA_ENTITY_BYTES];
+	int					hash, bytes;
+
+	if ( !cache || msg->oob || msg->overflowed ) {
+		MSG_WriteDeltaEntity( msg, from, to, force );
+		return;
+	}
+
+	// the common case of an entity that didn't change at all writes nothing
+	if ( !force && !memcmp( from, to, sizeof( *to ) ) ) {
+		return;
+	}
+
+	if ( sv_countFieldChanges ) {
+		MSG_CountEntityFieldChanges( from, to, cache->fieldChanges );
+	}
+
+	// range coded bits depend on everything coded before them
+	if ( msg->coder ) {
+		MSG_WriteDeltaEntity( msg, from, to, force );
+		return;
+	}
+
+	hash = SV_DeltaCacheHash( from, to->number, force, msg->entityFieldOrder );
+	for ( entry = cache->hashTable[hash] ; entry ; entry = entry->hashNext ) {
+		if ( entry->number == to->number && entry->force == force && entry->fieldOrder == msg->entityFieldOrder
+			&& !memcmp( &entry->from, from, sizeof( *from ) ) ) {
+			break;
+		}
+	}
+
+	if ( entry ) {
+		if ( SV_DeltaFits( msg, entry->numBits ) ) {
+			MSG_WriteBitString( msg, cache->bytes + entry->firstByte, entry->numBits );
+		} else {
+			MSG_WriteDeltaEntity( msg, from, to, force );
+		}
+		return;
+	}
+
+	MSG_Init( &scratch, scratchBuf, sizeof( scratchBuf ) );
+	scratch.entityFieldOrder = msg->entityFieldOrder;
+	MSG_WriteDeltaEntity( &scratch, from, to, force );
+	if ( scratch.overflowed || !SV_DeltaFits( msg, scratch.bit ) ) {
+		MSG_WriteDeltaEntity( msg, from, to, force );
+		return;
+	}
+	MSG_WriteBitString( msg, scratchBuf, scratch.bit );
+
+	// remember it for the next clients, if there's still room
+	bytes = ( scratch.bit + 7 ) >> 3;
+	if ( cache->numEntries == MAX_DELTA_CACHE_ENTRIES || cache->numBytes + bytes > DELTA_CACHE_BYTES ) {
+		return;
+	}
+
+	entry = &cache->entries[cache->numEntries++];
+	entry->number = to->number;
+	entry->force = force;
+	entry->fieldOrder = msg->entityFieldOrder;
+	entry->from = *from;
+	entry->firstByte = cache->numBytes;
+	entry->numBits = scratch.bit;
+	Com_Memcpy( cache->bytes + cache->numBytes, scratchBuf, bytes );
+	cache->numBytes += bytes;
+
+	entry->hashNext = cache->hashTable[hash];
+	cache->hashTable[hash] = entry;
+}
+
 /*
 =============
 SV_EmitPacketEntities
 
 Writes a delta update of an entityState_t list to the message.
+deltaCache is only given while the entities can't change
 =============
 */
-static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to, msg_t *msg ) {
+static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to, msg_t *msg, deltaCache_t *deltaCache ) {
 	entityState_t	*oldent, *newent;
 	int		oldindex, newindex;
 	int		oldnum, newnum;
@@ -88,7 +291,7 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 			// delta update from old position
 			// because the force parm is qfalse, this will not result
 			// in any bytes being emited if the entity has not changed at all
-			MSG_WriteDeltaEntity (msg, oldent, newent, qfalse );
+			SV_WriteDeltaEntity( msg, deltaCache, oldent, newent, qfalse );
 			oldindex++;
 			newindex++;
 			continue;
@@ -96,7 +299,7 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 
 		if ( newnum < oldnum ) {
 			// this is a new entity, send it from the baseline
-			MSG_WriteDeltaEntity (msg, &sv.svEntities[newnum].baseline, newent, qtrue );
+			SV_WriteDeltaEntity( msg, deltaCache, &sv.svEntities[newnum].baseline, newent, qtrue );
 			newindex++;
 			continue;
 		}
@@ -116,17 +319,15 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 
 /*
 ==================
-SV_WriteSnapshotToClient
+SV_SnapshotDeltaFrame
+
+Picks the previous frame to delta compress the snapshot from, or NULL,
+nextSnapshotEntities is where the entities of the next snapshot will go
 ==================
 */
-static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
-	clientSnapshot_t	*frame, *oldframe;
+static clientSnapshot_t *SV_SnapshotDeltaFrame( client_t *client, int nextSnapshotEntities, int *lastframeOut ) {
+	clientSnapshot_t	*oldframe;
 	int					lastframe;
-	int					i;
-	int					snapFlags;
-
-	// this is the snapshot we are creating
-	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
 
 	// try to use a previous frame as the source for delta compressing the snapshot
 	if ( client->deltaMessage <= 0 || client->state != CS_ACTIVE ) {
@@ -145,13 +346,31 @@ static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
 		lastframe = client->netchan.outgoingSequence - client->deltaMessage;
 
 		// the snapshot's entities may still have rolled off the buffer, though
-		if ( oldframe->first_entity <= svs.nextSnapshotEntities - svs.numSnapshotEntities ) {
+		if ( oldframe->first_entity <= nextSnapshotEntities - svs.numSnapshotEntities ) {
 			Com_DPrintf ("%s: Delta request from out of date entities.\n", client->name);
 			oldframe = NULL;
 			lastframe = 0;
 		}
 	}
 
+	*lastframeOut = lastframe;
+	return oldframe;
+}
+
+/*
+==================
+SV_WriteSnapshotToClient
+==================
+*/
+static void SV_WriteSnapshotToClient( client_t *client, clientSnapshot_t *oldframe, int lastframe, msg_t *msg,
+									  deltaCache_t *deltaCache ) {
+	clientSnapshot_t	*frame;
+	int					i;
+	int					snapFlags;
+
+	// this is the snapshot we are creating
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+
 	MSG_WriteByte (msg, svc_snapshot);
 
 	// NOTE, MRE: now sent at the start of every message from server to client
@@ -182,6 +401,10 @@ static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
 	if ( client->state != CS_ACTIVE ) {
 		snapFlags |= SNAPFLAG_NOT_ACTIVE;
 	}
+	// an active client has the gamestate with the order of this map
+	if ( client->fieldOrder && sv.hasEntityFieldOrder && client->state == CS_ACTIVE ) {
+		snapFlags |= SNAPFLAG_FIELD_ORDER;
+	}
 
 	MSG_WriteByte (msg, snapFlags);
 
@@ -197,7 +420,11 @@ static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
 	}
 
 	// delta encode the entities
-	SV_EmitPacketEntities (oldframe, frame, msg);
+	if ( snapFlags & SNAPFLAG_FIELD_ORDER ) {
+		msg->entityFieldOrder = sv.entityFieldOrder;
+	}
+	SV_EmitPacketEntities (oldframe, frame, msg, deltaCache);
+	msg->entityFieldOrder = NULL;
 
 	// padding for rate debugging
 	if ( sv_padPackets->integer ) {
@@ -238,6 +465,9 @@ Build a client snapshot structure
 typedef struct {
 	int		numSnapshotEntities;
 	int		snapshotEntities[MAX_SNAPSHOT_ENTITIES];	
+	byte	added[MAX_GENTITIES/8];		// to prevent double adding from portal views
+	const char	*error;					// for Com_Error once the snapshot is built
+	qboolean	visibleSets;			// start from the visible entity sets
 } snapshotEntityNumbers_t;
 
 /*
@@ -268,12 +498,15 @@ static int QDECL SV_QsortEntityNumbers( const void *a, const void *b ) {
 SV_AddEntToSnapshot
 ===============
 */
-static void SV_AddEntToSnapshot( svEntity_t *svEnt, sharedEntity_t *gEnt, snapshotEntityNumbers_t *eNums ) {
+static void SV_AddEntToSnapshot( sharedEntity_t *gEnt, snapshotEntityNumbers_t *eNums ) {
+	int		e;
+
 	// if we have already added this entity to this snapshot, don't add again
-	if ( svEnt->snapshotCounter == sv.snapshotCounter ) {
+	e = gEnt->s.number;
+	if ( eNums->added[e >> 3] & ( 1 << ( e & 7 ) ) ) {
 		return;
 	}
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	eNums->added[e >> 3] |= 1 << ( e & 7 );
 
 	// if we are full, silently discard entities
 	if ( eNums->numSnapshotEntities == MAX_SNAPSHOT_ENTITIES ) {
@@ -284,42 +517,116 @@ static void SV_AddEntToSnapshot( svEntity_t *svEnt, sharedEntity_t *gEnt, snapsh
 	eNums->numSnapshotEntities++;
 }
 
+/*
+=============================================================================
+
+Visible entity sets
+
+Most of what SV_AddEntitiesVisibleFromPoint checks depends only on the
+cluster and area of the viewpoint, so while SV_SendClientMessages runs
+the entities passing those checks are collected once per cluster and
+area, and every client standing there starts from that list.  Entities
+sent depending on the client (SVF_SINGLECLIENT, SVF_NOTSINGLECLIENT and
+SVF_CLIENTMASK) are left out of the sets and still checked per client,
+as are the distance and camera of portals.
+
+=============================================================================
+*/
+
+#define	MAX_VISIBLE_SETS			64
+#define	MAX_VISIBLE_SET_ENTITIES	( MAX_GENTITIES * 16 )
+
+#define	SVF_CLIENT_DEPENDENT	( SVF_SINGLECLIENT | SVF_NOTSINGLECLIENT | SVF_CLIENTMASK )
+
+typedef struct {
+	int		cluster, area;
+	int		firstEntity, numEntities;	// in sv_visibleSetEntities
+} visibleSet_t;
+
+static visibleSet_t	sv_visibleSets[MAX_VISIBLE_SETS];
+static int			sv_numVisibleSets;
+static int			sv_visibleSetEntities[MAX_VISIBLE_SET_ENTITIES];
+static int			sv_numVisibleSetEntities;
+static int			sv_clientDependentEntities[MAX_GENTITIES];	// checked for every client
+static int			sv_numClientDependentEntities;
+static qboolean		sv_visibleSetsLocked;		// only existing sets can be used
+
 /*
 ===============
-SV_AddEntitiesVisibleFromPoint
+SV_EntityVisibleFrom
+
+Area and PVS test of an entity against a viewpoint
 ===============
 */
-static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *frame, 
-									snapshotEntityNumbers_t *eNums, qboolean portal ) {
-	int		e, i;
-	sharedEntity_t *ent;
-	svEntity_t	*svEnt;
-	int		l;
-	int		clientarea, clientcluster;
-	int		leafnum;
-	byte	*clientpvs;
-	byte	*bitvector;
+static qboolean SV_EntityVisibleFrom( svEntity_t *svEnt, int clientarea, byte *clientpvs ) {
+	int		i, l;
+
+	// ignore if not touching a PV leaf
+	// check area
+	if ( !CM_AreasConnected( clientarea, svEnt->areanum ) ) {
+		// doors can legally straddle two areas, so
+		// we may need to check another one
+		if ( !CM_AreasConnected( clientarea, svEnt->areanum2 ) ) {
+			return qfalse;		// blocked by a door
+		}
+	}
 
-	// during an error shutdown message we may need to transmit
-	// the shutdown message after the server has shutdown, so
-	// specfically check for it
-	if ( !sv.state ) {
-		return;
+	// check individual leafs
+	if ( !svEnt->numClusters ) {
+		return qfalse;
+	}
+	l = 0;
+	for ( i=0 ; i < svEnt->numClusters ; i++ ) {
+		l = svEnt->clusternums[i];
+		if ( clientpvs[l >> 3] & (1 << (l&7) ) ) {
+			break;
+		}
 	}
 
-	leafnum = CM_PointLeafnum (origin);
-	clientarea = CM_LeafArea (leafnum);
-	clientcluster = CM_LeafCluster (leafnum);
+	// if we haven't found it to be visible,
+	// check overflow clusters that coudln't be stored
+	if ( i == svEnt->numClusters ) {
+		if ( svEnt->lastCluster ) {
+			for ( ; l <= svEnt->lastCluster ; l++ ) {
+				if ( clientpvs[l >> 3] & (1 << (l&7) ) ) {
+					break;
+				}
+			}
+			if ( l == svEnt->lastCluster ) {
+				return qfalse;	// not visible
+			}
+		} else {
+			return qfalse;
+		}
+	}
 
-	// calculate the visible areas
-	frame->areabytes = CM_WriteAreaBits( frame->areabits, clientarea );
+	return qtrue;
+}
 
-	clientpvs = CM_ClusterPVS (clientcluster);
+/*
+===============
+SV_ClearVisibleSets
+
+Forgets the sets of the last SV_SendClientMessages
+and collects the client dependent entities
+===============
+*/
+static void SV_ClearVisibleSets( void ) {
+	int				e;
+	sharedEntity_t	*ent;
+
+	sv_numVisibleSets = 0;
+	sv_numVisibleSetEntities = 0;
+	sv_numClientDependentEntities = 0;
+	sv_visibleSetsLocked = qfalse;
+
+	if ( !sv.state ) {
+		return;
+	}
 
 	for ( e = 0 ; e < sv.num_entities ; e++ ) {
 		ent = SV_GentityNum(e);
 
-		// never send entities that aren't linked in
 		if ( !ent->r.linked ) {
 			continue;
 		}
@@ -329,136 +636,284 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 			ent->s.number = e;
 		}
 
-		// entities can be flagged to explicitly not be sent to the client
-		if ( ent->r.svFlags & SVF_NOCLIENT ) {
-			continue;
+		if ( ( ent->r.svFlags & SVF_CLIENT_DEPENDENT ) && !( ent->r.svFlags & SVF_NOCLIENT ) ) {
+			sv_clientDependentEntities[sv_numClientDependentEntities++] = e;
 		}
+	}
+}
 
-		// entities can be flagged to be sent to only one client
-		if ( ent->r.svFlags & SVF_SINGLECLIENT ) {
-			if ( ent->r.singleClient != frame->ps.clientNum ) {
-				continue;
-			}
-		}
-		// entities can be flagged to be sent to everyone but one client
-		if ( ent->r.svFlags & SVF_NOTSINGLECLIENT ) {
-			if ( ent->r.singleClient == frame->ps.clientNum ) {
-				continue;
-			}
-		}
-		// entities can be flagged to be sent to a given mask of clients
-		if ( ent->r.svFlags & SVF_CLIENTMASK ) {
-			if (frame->ps.clientNum >= 32)
-				Com_Error( ERR_DROP, "SVF_CLIENTMASK: clientNum >= 32" );
-			if (~ent->r.singleClient & (1 << frame->ps.clientNum))
-				continue;
+/*
+===============
+SV_VisibleSet
+
+Finds or builds the set of a cluster and area, NULL if there is no room
+===============
+*/
+static visibleSet_t *SV_VisibleSet( int cluster, int area, byte *clientpvs ) {
+	visibleSet_t	*set;
+	sharedEntity_t	*ent;
+	int				i, e;
+
+	for ( i = 0, set = sv_visibleSets ; i < sv_numVisibleSets ; i++, set++ ) {
+		if ( set->cluster == cluster && set->area == area ) {
+			return set;
 		}
+	}
+
+	if ( sv_visibleSetsLocked || sv_numVisibleSets == MAX_VISIBLE_SETS
+		|| sv_numVisibleSetEntities + sv.num_entities > MAX_VISIBLE_SET_ENTITIES ) {
+		return NULL;
+	}
 
-		svEnt = SV_SvEntityForGentity( ent );
+	set = &sv_visibleSets[sv_numVisibleSets++];
+	set->cluster = cluster;
+	set->area = area;
+	set->firstEntity = sv_numVisibleSetEntities;
 
-		// don't double add an entity through portals
-		if ( svEnt->snapshotCounter == sv.snapshotCounter ) {
+	for ( e = 0 ; e < sv.num_entities ; e++ ) {
+		ent = SV_GentityNum(e);
+
+		if ( !ent->r.linked || ( ent->r.svFlags & ( SVF_NOCLIENT | SVF_CLIENT_DEPENDENT ) ) ) {
 			continue;
 		}
 
 		// broadcast entities are always sent
-		if ( ent->r.svFlags & SVF_BROADCAST ) {
-			SV_AddEntToSnapshot( svEnt, ent, eNums );
+		if ( !( ent->r.svFlags & SVF_BROADCAST )
+			&& !SV_EntityVisibleFrom( SV_SvEntityForGentity( ent ), area, clientpvs ) ) {
 			continue;
 		}
 
-		// ignore if not touching a PV leaf
-		// check area
-		if ( !CM_AreasConnected( clientarea, svEnt->areanum ) ) {
-			// doors can legally straddle two areas, so
-			// we may need to check another one
-			if ( !CM_AreasConnected( clientarea, svEnt->areanum2 ) ) {
-				continue;		// blocked by a door
+		sv_visibleSetEntities[sv_numVisibleSetEntities++] = e;
+	}
+
+	set->numEntities = sv_numVisibleSetEntities - set->firstEntity;
+	return set;
+}
+
+/*
+===============
+SV_PrepareVisibleSet
+
+Builds the set the client's snapshot will start from
+before the snapshot threads can only look them up
+===============
+*/
+static void SV_PrepareVisibleSet( client_t *client ) {
+	playerState_t	*ps;
+	vec3_t			org;
+	int				leafnum;
+
+	if ( !sv.state || !client->gentity || client->state == CS_ZOMBIE ) {
+		return;
+	}
+
+	ps = SV_GameClientNum( client - svs.clients );
+	VectorCopy( ps->origin, org );
+	org[2] += ps->viewheight;
+
+	leafnum = CM_PointLeafnum( org );
+	SV_VisibleSet( CM_LeafCluster( leafnum ), CM_LeafArea( leafnum ),
+		CM_ClusterPVS( CM_LeafCluster( leafnum ) ) );
+}
+
+
+/*
+===============
+SV_AddVisibleEntity
+
+Adds an entity that passed the visibility checks,
+and what can be seen through it if it is a portal
+===============
+*/
+static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *frame, 
+									snapshotEntityNumbers_t *eNums, qboolean portal );
+
+static void SV_AddVisibleEntity( sharedEntity_t *ent, vec3_t origin, clientSnapshot_t *frame,
+									snapshotEntityNumbers_t *eNums ) {
+	// broadcast entities are always sent
+	if ( ent->r.svFlags & SVF_BROADCAST ) {
+		SV_AddEntToSnapshot( ent, eNums );
+		return;
+	}
+
+	// add it
+	SV_AddEntToSnapshot( ent, eNums );
+
+	// if it's a portal entity, add everything visible from its camera position
+	if ( ent->r.svFlags & SVF_PORTAL ) {
+		if ( ent->s.generic1 ) {
+			vec3_t dir;
+			VectorSubtract(ent->s.origin, origin, dir);
+			if ( VectorLengthSquared(dir) > (float) ent->s.generic1 * ent->s.generic1 ) {
+				return;
 			}
 		}
+		SV_AddEntitiesVisibleFromPoint( ent->s.origin2, frame, eNums, qtrue );
+	}
+}
 
-		bitvector = clientpvs;
+/*
+===============
+SV_AddEntityIfVisible
 
-		// check individual leafs
-		if ( !svEnt->numClusters ) {
-			continue;
+Every check of an entity against a viewpoint
+===============
+*/
+static void SV_AddEntityIfVisible( int e, vec3_t origin, clientSnapshot_t *frame, snapshotEntityNumbers_t *eNums,
+									int clientarea, byte *clientpvs ) {
+	sharedEntity_t *ent;
+
+	ent = SV_GentityNum(e);
+
+	// never send entities that aren't linked in
+	if ( !ent->r.linked ) {
+		return;
+	}
+
+	if (ent->s.number != e) {
+		Com_DPrintf ("FIXING ENT->S.NUMBER!!!\n");
+		ent->s.number = e;
+	}
+
+	// entities can be flagged to explicitly not be sent to the client
+	if ( ent->r.svFlags & SVF_NOCLIENT ) {
+		return;
+	}
+
+	// entities can be flagged to be sent to only one client
+	if ( ent->r.svFlags & SVF_SINGLECLIENT ) {
+		if ( ent->r.singleClient != frame->ps.clientNum ) {
+			return;
 		}
-		l = 0;
-		for ( i=0 ; i < svEnt->numClusters ; i++ ) {
-			l = svEnt->clusternums[i];
-			if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
-				break;
-			}
+	}
+	// entities can be flagged to be sent to everyone but one client
+	if ( ent->r.svFlags & SVF_NOTSINGLECLIENT ) {
+		if ( ent->r.singleClient == frame->ps.clientNum ) {
+			return;
 		}
-
-		// if we haven't found it to be visible,
-		// check overflow clusters that coudln't be stored
-		if ( i == svEnt->numClusters ) {
-			if ( svEnt->lastCluster ) {
-				for ( ; l <= svEnt->lastCluster ; l++ ) {
-					if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
-						break;
-					}
-				}
-				if ( l == svEnt->lastCluster ) {
-					continue;	// not visible
-				}
-			} else {
-				continue;
-			}
+	}
+	// entities can be flagged to be sent to a given mask of clients
+	if ( ent->r.svFlags & SVF_CLIENTMASK ) {
+		if (frame->ps.clientNum >= 32) {
+			eNums->error = "SVF_CLIENTMASK: clientNum >= 32";
+			return;
 		}
+		if (~ent->r.singleClient & (1 << frame->ps.clientNum))
+			return;
+	}
+
+	// don't double add an entity through portals
+	if ( eNums->added[e >> 3] & ( 1 << ( e & 7 ) ) ) {
+		return;
+	}
 
-		// add it
-		SV_AddEntToSnapshot( svEnt, ent, eNums );
+	if ( !( ent->r.svFlags & SVF_BROADCAST )
+		&& !SV_EntityVisibleFrom( SV_SvEntityForGentity( ent ), clientarea, clientpvs ) ) {
+		return;
+	}
 
-		// if it's a portal entity, add everything visible from its camera position
-		if ( ent->r.svFlags & SVF_PORTAL ) {
-			if ( ent->s.generic1 ) {
-				vec3_t dir;
-				VectorSubtract(ent->s.origin, origin, dir);
-				if ( VectorLengthSquared(dir) > (float) ent->s.generic1 * ent->s.generic1 ) {
-					continue;
-				}
+	SV_AddVisibleEntity( ent, origin, frame, eNums );
+}
+
+/*
+===============
+SV_AddEntitiesVisibleFromPoint
+===============
+*/
+static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *frame, 
+									snapshotEntityNumbers_t *eNums, qboolean portal ) {
+	int		e, i, j;
+	int		clientarea, clientcluster;
+	int		leafnum;
+	byte	*clientpvs;
+	visibleSet_t	*set;
+	int		*setEntities;
+
+	// during an error shutdown message we may need to transmit
+	// the shutdown message after the server has shutdown, so
+	// specfically check for it
+	if ( !sv.state ) {
+		return;
+	}
+
+	leafnum = CM_PointLeafnum (origin);
+	clientarea = CM_LeafArea (leafnum);
+	clientcluster = CM_LeafCluster (leafnum);
+
+	// calculate the visible areas
+	frame->areabytes = CM_WriteAreaBits( frame->areabits, clientarea );
+
+	clientpvs = CM_ClusterPVS (clientcluster);
+
+	set = NULL;
+	if ( eNums->visibleSets ) {
+		set = SV_VisibleSet( clientcluster, clientarea, clientpvs );
+	}
+
+	if ( !set ) {
+		for ( e = 0 ; e < sv.num_entities ; e++ ) {
+			SV_AddEntityIfVisible( e, origin, frame, eNums, clientarea, clientpvs );
+			if ( eNums->error ) {
+				return;
 			}
-			SV_AddEntitiesVisibleFromPoint( ent->s.origin2, frame, eNums, qtrue );
 		}
+		return;
+	}
 
+	// go through the set and the client dependent entities in entity order,
+	// so a full snapshot drops the same entities as the loop above
+	setEntities = sv_visibleSetEntities + set->firstEntity;
+	i = j = 0;
+	while ( i < set->numEntities || j < sv_numClientDependentEntities ) {
+		if ( j == sv_numClientDependentEntities
+			|| ( i < set->numEntities && setEntities[i] < sv_clientDependentEntities[j] ) ) {
+			e = setEntities[i++];
+			// don't double add an entity through portals
+			if ( eNums->added[e >> 3] & ( 1 << ( e & 7 ) ) ) {
+				continue;
+			}
+			SV_AddVisibleEntity( SV_GentityNum(e), origin, frame, eNums );
+		} else {
+			SV_AddEntityIfVisible( sv_clientDependentEntities[j++], origin, frame, eNums, clientarea, clientpvs );
+		}
+		if ( eNums->error ) {
+			return;
+		}
 	}
 }
 
 /*
 =============
-SV_BuildClientSnapshot
+SV_GatherSnapshotEntities
 
 Decides which entities are going to be visible to the client, and
-copies off the playerstate and areabits.
+copies off the playerstate and areabits.  Returns qfalse if there is
+no entity to see from, which leaves the snapshot empty.
 
 This properly handles multiple recursive portals, but the render
 currently doesn't.
 
+Only touches the client's own frame and eNums, so it can run for
+several clients at the same time.  Errors are left in eNums->error.
+
 For viewing through other player's eyes, clent can be something other than client->gentity
 =============
 */
-static void SV_BuildClientSnapshot( client_t *client ) {
+static qboolean SV_GatherSnapshotEntities( client_t *client, snapshotEntityNumbers_t *eNums ) {
 	vec3_t						org;
 	clientSnapshot_t			*frame;
-	snapshotEntityNumbers_t		entityNumbers;
 	int							i;
-	sharedEntity_t				*ent;
-	entityState_t				*state;
-	svEntity_t					*svEnt;
 	sharedEntity_t				*clent;
 	int							clientNum;
 	playerState_t				*ps;
 
-	// bump the counter used to prevent double adding
-	sv.snapshotCounter++;
-
 	// this is the frame we are creating
 	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
 
 	// clear everything in this snapshot
-	entityNumbers.numSnapshotEntities = 0;
+	eNums->numSnapshotEntities = 0;
+	eNums->error = NULL;
+	Com_Memset( eNums->added, 0, sizeof( eNums->added ) );
 	Com_Memset( frame->areabits, 0, sizeof( frame->areabits ) );
 
   // https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=62
@@ -466,7 +921,7 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 	
 	clent = client->gentity;
 	if ( !clent || client->state == CS_ZOMBIE ) {
-		return;
+		return qfalse;
 	}
 
 	// grab the current playerState_t
@@ -477,11 +932,10 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 	// be regenerated from the playerstate
 	clientNum = frame->ps.clientNum;
 	if ( clientNum < 0 || clientNum >= MAX_GENTITIES ) {
-		Com_Error( ERR_DROP, "SV_SvEntityForGentity: bad gEnt" );
+		eNums->error = "SV_SvEntityForGentity: bad gEnt";
+		return qfalse;
 	}
-	svEnt = &sv.svEntities[ clientNum ];
-
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	eNums->added[clientNum >> 3] |= 1 << ( clientNum & 7 );
 
 	// find the client's viewpoint
 	VectorCopy( ps->origin, org );
@@ -489,14 +943,17 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 
 	// add all the entities directly visible to the eye, which
 	// may include portal entities that merge other viewpoints
-	SV_AddEntitiesVisibleFromPoint( org, frame, &entityNumbers, qfalse );
+	SV_AddEntitiesVisibleFromPoint( org, frame, eNums, qfalse );
+	if ( eNums->error ) {
+		return qfalse;
+	}
 
 	// if there were portals visible, there may be out of order entities
 	// in the list which will need to be resorted for the delta compression
 	// to work correctly.  This also catches the error condition
 	// of an entity being included twice.
-	qsort( entityNumbers.snapshotEntities, entityNumbers.numSnapshotEntities, 
-		sizeof( entityNumbers.snapshotEntities[0] ), SV_QsortEntityNumbers );
+	qsort( eNums->snapshotEntities, eNums->numSnapshotEntities, 
+		sizeof( eNums->snapshotEntities[0] ), SV_QsortEntityNumbers );
 
 	// now that all viewpoint's areabits have been OR'd together, invert
 	// all of them to make it a mask vector, which is what the renderer wants
@@ -504,22 +961,60 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 		((int *)frame->areabits)[i] = ((int *)frame->areabits)[i] ^ -1;
 	}
 
-	// copy the entity states out
+	return qtrue;
+}
+
+/*
+=============
+SV_CopySnapshotEntities
+
+Copies the entity states of the snapshot out to svs.snapshotEntities,
+starting at frame->first_entity
+=============
+*/
+static void SV_CopySnapshotEntities( clientSnapshot_t *frame, snapshotEntityNumbers_t *eNums ) {
+	int							i;
+	sharedEntity_t				*ent;
+
 	frame->num_entities = 0;
-	frame->first_entity = svs.nextSnapshotEntities;
-	for ( i = 0 ; i < entityNumbers.numSnapshotEntities ; i++ ) {
-		ent = SV_GentityNum(entityNumbers.snapshotEntities[i]);
-		state = &svs.snapshotEntities[svs.nextSnapshotEntities % svs.numSnapshotEntities];
-		*state = ent->s;
-		svs.nextSnapshotEntities++;
-		// this should never hit, map should always be restarted first in SV_Frame
-		if ( svs.nextSnapshotEntities >= 0x7FFFFFFE ) {
-			Com_Error(ERR_FATAL, "svs.nextSnapshotEntities wrapped");
-		}
+	for ( i = 0 ; i < eNums->numSnapshotEntities ; i++ ) {
+		ent = SV_GentityNum(eNums->snapshotEntities[i]);
+		svs.snapshotEntities[(frame->first_entity + i) % svs.numSnapshotEntities] = ent->s;
 		frame->num_entities++;
 	}
 }
 
+/*
+=============
+SV_BuildClientSnapshot
+=============
+*/
+static void SV_BuildClientSnapshot( client_t *client, qboolean visibleSets ) {
+	clientSnapshot_t			*frame;
+	snapshotEntityNumbers_t		entityNumbers;
+
+	// this is the frame we are creating
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+
+	entityNumbers.visibleSets = visibleSets;
+
+	if ( !SV_GatherSnapshotEntities( client, &entityNumbers ) ) {
+		if ( entityNumbers.error ) {
+			Com_Error( ERR_DROP, "%s", entityNumbers.error );
+		}
+		return;
+	}
+
+	frame->first_entity = svs.nextSnapshotEntities;
+	svs.nextSnapshotEntities += entityNumbers.numSnapshotEntities;
+	// this should never hit, map should always be restarted first in SV_Frame
+	if ( svs.nextSnapshotEntities >= 0x7FFFFFFE ) {
+		Com_Error(ERR_FATAL, "svs.nextSnapshotEntities wrapped");
+	}
+
+	SV_CopySnapshotEntities( frame, &entityNumbers );
+}
+
 #ifdef USE_VOIP
 /*
 ==================
@@ -588,18 +1083,68 @@ void SV_SendMessageToClient(msg_t *msg, client_t *client)
 
 /*
 =======================
-SV_SendClientSnapshot
+SV_WriteSnapshotMessage
 
-Also called by SV_FinalMessage
+Everything of a snapshot message that comes from the client and
+the snapshot itself, doesn't print or allocate so it is safe to
+run for several clients at the same time
+=======================
+*/
+static void SV_WriteSnapshotMessage( client_t *client, clientSnapshot_t *oldframe, int lastframe, msg_t *msg,
+									 deltaCache_t *deltaCache ) {
+	// NOTE, MRE: all server->client messages now acknowledge
+	// let the client know which reliable clientCommands we have received
+	MSG_WriteLong( msg, client->lastClientCommand );
+
+	// (re)send any reliable server commands
+	SV_UpdateServerCommandsToClient( client, msg );
+
+	// send over all the relevant entityState_t
+	// and the playerState_t
+	SV_WriteSnapshotToClient( client, oldframe, lastframe, msg, deltaCache );
+}
+
+/*
+=======================
+SV_FinishSnapshotMessage
 
+Adds what can only be written from the main thread and sends the message
 =======================
 */
-void SV_SendClientSnapshot( client_t *client ) {
+static void SV_FinishSnapshotMessage( client_t *client, msg_t *msg ) {
+#ifdef USE_VOIP
+	SV_WriteVoipToClient( client, msg );
+#endif
+
+	// check for overflow
+	if ( msg->overflowed ) {
+		Com_Printf ("WARNING: msg overflowed for %s\n", client->name);
+		MSG_Clear (msg);
+		SV_StartRangeCoding( client, msg, qfalse );
+	}
+
+	SV_SendMessageToClient( msg, client );
+}
+
+/*
+=======================
+SV_SendSnapshot
+
+frameCaches is only set from SV_SendClientMessages, which keeps the
+entities from changing while the visible sets and delta cache are in use
+=======================
+*/
+static void SV_SendSnapshot( client_t *client, qboolean frameCaches ) {
 	byte		msg_buf[MAX_MSGLEN];
 	msg_t		msg;
+	clientSnapshot_t	*oldframe;
+	int			lastframe;
+	int64_t		start;
 
 	// build the snapshot
-	SV_BuildClientSnapshot( client );
+	start = SV_ProfileStart();
+	SV_BuildClientSnapshot( client, frameCaches );
+	SV_ProfileEnd( PROF_BUILD, start );
 
 	// bots need to have their snapshots build, but
 	// the query them directly without needing to be sent
@@ -609,29 +1154,213 @@ void SV_SendClientSnapshot( client_t *client ) {
 
 	MSG_Init (&msg, msg_buf, sizeof(msg_buf));
 	msg.allowoverflow = qtrue;
+	SV_StartRangeCoding( client, &msg, qtrue );
 
-	// NOTE, MRE: all server->client messages now acknowledge
-	// let the client know which reliable clientCommands we have received
-	MSG_WriteLong( &msg, client->lastClientCommand );
+	start = SV_ProfileStart();
+	oldframe = SV_SnapshotDeltaFrame( client, svs.nextSnapshotEntities, &lastframe );
+	SV_WriteSnapshotMessage( client, oldframe, lastframe, &msg, frameCaches ? &sv_deltaCaches[0] : NULL );
+	SV_ProfileEnd( PROF_ENCODE, start );
 
-	// (re)send any reliable server commands
-	SV_UpdateServerCommandsToClient( client, &msg );
+	start = SV_ProfileStart();
+	SV_FinishSnapshotMessage( client, &msg );
+	SV_ProfileEnd( PROF_SEND, start );
+}
 
-	// send over all the relevant entityState_t
-	// and the playerState_t
-	SV_WriteSnapshotToClient( client, &msg );
+/*
+=======================
+SV_SendClientSnapshot
 
-#ifdef USE_VOIP
-	SV_WriteVoipToClient( client, &msg );
-#endif
+Also called by SV_FinalMessage
 
-	// check for overflow
-	if ( msg.overflowed ) {
-		Com_Printf ("WARNING: msg overflowed for %s\n", client->name);
-		MSG_Clear (&msg);
+=======================
+*/
+void SV_SendClientSnapshot( client_t *client ) {
+	SV_SendSnapshot( client, qfalse );
+}
+
+
+/*
+=============================================================================
+
+Threaded snapshots
+
+With sv_snapshotThreads above 1 the snapshots of all the clients due one
+are gathered and encoded on that many threads.  Everything that prints,
+allocates, or decides something for more than one client stays on the
+main thread and runs in client order, so the messages are exactly the
+ones SV_SendClientSnapshot would have sent.
+
+=============================================================================
+*/
+
+typedef struct {
+	client_t				*client;
+	qboolean				bot;			// built but not sent
+	qboolean				hasEntities;	// SV_GatherSnapshotEntities result
+	snapshotEntityNumbers_t	entityNumbers;
+	clientSnapshot_t		*oldframe;		// to delta from
+	int						lastframe;
+	msg_t					msg;
+	byte					msgBuf[MAX_MSGLEN];
+} snapshotJob_t;
+
+typedef struct {
+	int			first, step;	// jobs first, first + step, ...
+	qboolean	encode;			// copy the entities and write the messages instead of gathering
+	void		*thread;
+} snapshotWorker_t;
+
+static snapshotJob_t	sv_snapshotJobs[MAX_CLIENTS];
+static int				sv_numSnapshotJobs;
+
+/*
+=======================
+SV_SnapshotWorker
+=======================
+*/
+static void SV_SnapshotWorker( void *data ) {
+	snapshotWorker_t	*worker;
+	snapshotJob_t		*job;
+	clientSnapshot_t	*frame;
+	int					i;
+
+	worker = (snapshotWorker_t *)data;
+
+	for ( i = worker->first ; i < sv_numSnapshotJobs ; i += worker->step ) {
+		job = &sv_snapshotJobs[i];
+
+		if ( !worker->encode ) {
+			job->hasEntities = SV_GatherSnapshotEntities( job->client, &job->entityNumbers );
+			continue;
+		}
+
+		frame = &job->client->frames[ job->client->netchan.outgoingSequence & PACKET_MASK ];
+		if ( job->hasEntities ) {
+			SV_CopySnapshotEntities( frame, &job->entityNumbers );
+		}
+		if ( !job->bot ) {
+			SV_WriteSnapshotMessage( job->client, job->oldframe, job->lastframe, &job->msg,
+				&sv_deltaCaches[worker->first] );
+		}
+	}
+}
+
+/*
+=======================
+SV_RunSnapshotWorkers
+
+Runs SV_SnapshotWorker on numThreads threads, including this one
+=======================
+*/
+static void SV_RunSnapshotWorkers( int numThreads, qboolean encode ) {
+	snapshotWorker_t	workers[MAX_SNAPSHOT_THREADS];
+	int					i;
+
+	for ( i = 0 ; i < numThreads ; i++ ) {
+		workers[i].first = i;
+		workers[i].step = numThreads;
+		workers[i].encode = encode;
+		workers[i].thread = NULL;
+	}
+
+	for ( i = 1 ; i < numThreads ; i++ ) {
+		workers[i].thread = Sys_CreateThread( SV_SnapshotWorker, &workers[i] );
+	}
+
+	SV_SnapshotWorker( &workers[0] );
+
+	for ( i = 1 ; i < numThreads ; i++ ) {
+		if ( workers[i].thread ) {
+			Sys_JoinThread( workers[i].thread );
+		} else {
+			SV_SnapshotWorker( &workers[i] );	// couldn't start the thread
+		}
+	}
+}
+
+/*
+=======================
+SV_SendThreadedSnapshots
+
+Builds and sends the snapshots of sv_snapshotJobs
+=======================
+*/
+static void SV_SendThreadedSnapshots( int numThreads ) {
+	snapshotJob_t		*job;
+	clientSnapshot_t	*frame;
+	qboolean			inOrder;
+	int					i, next;
+	int64_t				start;
+
+	// entity numbers were fixed up by SV_ClearVisibleSets, and the sets
+	// the clients start from are built here, the workers only read them
+	start = SV_ProfileStart();
+	for ( i = 0 ; i < sv_numSnapshotJobs ; i++ ) {
+		SV_PrepareVisibleSet( sv_snapshotJobs[i].client );
+	}
+
+	sv_visibleSetsLocked = qtrue;
+	SV_RunSnapshotWorkers( numThreads, qfalse );
+	sv_visibleSetsLocked = qfalse;
+	SV_ProfileEnd( PROF_BUILD, start );
+
+	// give out the entity buffer space and pick the delta
+	// frames in client order, like the serial snapshots
+	start = SV_ProfileStart();
+	next = svs.nextSnapshotEntities;
+	for ( i = 0 ; i < sv_numSnapshotJobs ; i++ ) {
+		job = &sv_snapshotJobs[i];
+		if ( job->entityNumbers.error ) {
+			Com_Error( ERR_DROP, "%s", job->entityNumbers.error );
+		}
+
+		if ( job->hasEntities ) {
+			frame = &job->client->frames[ job->client->netchan.outgoingSequence & PACKET_MASK ];
+			frame->first_entity = next;
+			next += job->entityNumbers.numSnapshotEntities;
+			// this should never hit, map should always be restarted first in SV_Frame
+			if ( next >= 0x7FFFFFFE ) {
+				Com_Error(ERR_FATAL, "svs.nextSnapshotEntities wrapped");
+			}
+		}
+
+		if ( !job->bot ) {
+			job->oldframe = SV_SnapshotDeltaFrame( job->client, next, &job->lastframe );
+			MSG_Init( &job->msg, job->msgBuf, sizeof( job->msgBuf ) );
+			job->msg.allowoverflow = qtrue;
+			SV_StartRangeCoding( job->client, &job->msg, qtrue );
+		}
+	}
+	svs.nextSnapshotEntities = next;
+
+	// the entities of all the new snapshots have to be copied before any message is
+	// written, which is only the same as one client after the other as long as none
+	// of them deltas from entities that the later clients overwrite in the ring
+	inOrder = qfalse;
+	for ( i = 0 ; i < sv_numSnapshotJobs ; i++ ) {
+		job = &sv_snapshotJobs[i];
+		if ( job->oldframe && job->oldframe->first_entity <= next - svs.numSnapshotEntities ) {
+			inOrder = qtrue;
+			break;
+		}
+	}
+
+	// the workers copy the entities too, which goes with the encoding here
+	if ( inOrder ) {
+		SV_RunSnapshotWorkers( 1, qtrue );
+	} else {
+		SV_RunSnapshotWorkers( numThreads, qtrue );
 	}
+	SV_ProfileEnd( PROF_ENCODE, start );
 
-	SV_SendMessageToClient( &msg, client );
+	start = SV_ProfileStart();
+	for ( i = 0 ; i < sv_numSnapshotJobs ; i++ ) {
+		job = &sv_snapshotJobs[i];
+		if ( !job->bot ) {
+			SV_FinishSnapshotMessage( job->client, &job->msg );
+		}
+	}
+	SV_ProfileEnd( PROF_SEND, start );
 }
 
 
@@ -644,6 +1373,17 @@ void SV_SendClientMessages(void)
 {
 	int		i;
 	client_t	*c;
+	int		numThreads;
+	snapshotJob_t	*job;
+
+	numThreads = sv_snapshotThreads->integer;
+	if ( numThreads > MAX_SNAPSHOT_THREADS ) {
+		numThreads = MAX_SNAPSHOT_THREADS;
+	}
+	sv_numSnapshotJobs = 0;
+
+	SV_ClearVisibleSets();
+	SV_ClearDeltaCaches();
 
 	// send a message to each connected client
 	for(i=0; i < sv_maxclients->integer; i++)
@@ -678,9 +1418,30 @@ void SV_SendClientMessages(void)
 			}
 		}
 
+		// leave it to the snapshot threads
+		if ( numThreads > 1 ) {
+			job = &sv_snapshotJobs[sv_numSnapshotJobs++];
+			job->client = c;
+			job->bot = ( c->gentity && c->gentity->r.svFlags & SVF_BOT );
+			job->entityNumbers.visibleSets = qtrue;
+			continue;
+		}
+
 		// generate and send a new message
-		SV_SendClientSnapshot(c);
+		SV_SendSnapshot(c, qtrue);
 		c->lastSnapshotTime = svs.time;
 		c->rateDelayed = qfalse;
 	}
+
+	if ( sv_numSnapshotJobs ) {
+		SV_SendThreadedSnapshots( MIN( numThreads, sv_numSnapshotJobs ) );
+
+		for ( i = 0 ; i < sv_numSnapshotJobs ; i++ ) {
+			c = sv_snapshotJobs[i].client;
+			c->lastSnapshotTime = svs.time;
+			c->rateDelayed = qfalse;
+		}
+	}
+
+	SV_GatherFieldChanges();
 }
@@ -54,9 +54,12 @@ clipHandle_t SV_ClipHandleForEntity( const sharedEntity_t *ent ) {
 ENTITY CHECKING
 
 To avoid linearly searching through lists of entities during environment testing,
-the world is carved up with an evenly spaced, axially aligned bsp tree.  Entities
-are kept in chains either at the final leafs, or at the first node that splits
-them, which prevents having to deal with multiple fragments of a single entity.
+the world is carved up with an evenly spaced, axially aligned bsp tree.  Each node
+also has loose bounds, its cell grown by half its size on every side.  Entities
+are kept in chains at the deepest node whose loose bounds hold their whole box,
+following the side their center is on, which prevents having to deal with
+multiple fragments of a single entity without piling up everything that
+crosses a split plane at the top of the tree.
 
 ===============================================================================
 */
@@ -64,16 +67,24 @@ them, which prevents having to deal with multiple fragments of a single entity.
 typedef struct worldSector_s {
 	int		axis;		// -1 = leaf node
 	float	dist;
+	int		depth;
+	vec3_t	bounds[2];	// loose bounds, every entity in the chain is inside
 	struct worldSector_s	*children[2];
 	svEntity_t	*entities;
 } worldSector_t;
 
-#define	AREA_DEPTH	4
-#define	AREA_NODES	64
+#define	AREA_DEPTH	6
+#define	AREA_NODES	128
 
 worldSector_t	sv_worldSectors[AREA_NODES];
 int			sv_numworldSectors;
 
+// SV_LinkEntity reuses the clusters and areas of an entity while its
+// box stays this much closer to the old one than the leaf margin
+#define	LEAF_MARGIN_EPSILON	0.25f
+
+static int		sv_leafCacheHits, sv_leafCacheMisses;
+
 
 /*
 ===============
@@ -82,17 +93,35 @@ SV_SectorList_f
 */
 void SV_SectorList_f( void ) {
 	int				i, c;
+	int				depthCounts[AREA_DEPTH+1];
 	worldSector_t	*sec;
 	svEntity_t		*ent;
 
-	for ( i = 0 ; i < AREA_NODES ; i++ ) {
+	Com_Memset( depthCounts, 0, sizeof( depthCounts ) );
+
+	for ( i = 0 ; i < sv_numworldSectors ; i++ ) {
 		sec = &sv_worldSectors[i];
 
 		c = 0;
 		for ( ent = sec->entities ; ent ; ent = ent->nextEntityInWorldSector ) {
 			c++;
 		}
-		Com_Printf( "sector %i: %i entities\n", i, c );
+		depthCounts[sec->depth] += c;
+		if ( c ) {
+			Com_Printf( "sector %i (depth %i): %i entities\n", i, sec->depth, c );
+		}
+	}
+
+	for ( i = 0 ; i <= AREA_DEPTH ; i++ ) {
+		Com_Printf( "depth %i: %i entities\n", i, depthCounts[i] );
+	}
+
+	c = sv_leafCacheHits + sv_leafCacheMisses;
+	Com_Printf( "leaf links: %i reused, %i walked (%.1f%% reused)\n",
+		sv_leafCacheHits, sv_leafCacheMisses, c ? 100.0f * sv_leafCacheHits / c : 0.0f );
+
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		sv_leafCacheHits = sv_leafCacheMisses = 0;
 	}
 }
 
@@ -107,17 +136,24 @@ static worldSector_t *SV_CreateworldSector( int depth, vec3_t mins, vec3_t maxs
 	worldSector_t	*anode;
 	vec3_t		size;
 	vec3_t		mins1, maxs1, mins2, maxs2;
+	int			i;
 
 	anode = &sv_worldSectors[sv_numworldSectors];
 	sv_numworldSectors++;
 
+	anode->depth = depth;
+	VectorSubtract (maxs, mins, size);
+	for ( i = 0 ; i < 3 ; i++ ) {
+		anode->bounds[0][i] = mins[i] - 0.5f * size[i];
+		anode->bounds[1][i] = maxs[i] + 0.5f * size[i];
+	}
+
 	if (depth == AREA_DEPTH) {
 		anode->axis = -1;
 		anode->children[0] = anode->children[1] = NULL;
 		return anode;
 	}
 	
-	VectorSubtract (maxs, mins, size);
 	if (size[0] > size[1]) {
 		anode->axis = 0;
 	} else {
@@ -155,6 +191,131 @@ void SV_ClearWorld( void ) {
 	h = CM_InlineModel( 0 );
 	CM_ModelBounds( h, mins, maxs );
 	SV_CreateworldSector( 0, mins, maxs );
+
+	sv_leafCacheHits = sv_leafCacheMisses = 0;
+
+	SV_ClearTraceCache();
+}
+
+
+/*
+===============================================================================
+
+TRACE CACHE
+
+The game and the bots often issue the same trace many times in a frame.
+With sv_traceCache enabled the results of SV_Trace are remembered until the
+end of the game frame, or until an entity is linked or unlinked inside the
+bounding box of the move.
+
+===============================================================================
+*/
+
+#define	TRACE_CACHE_SIZE	512		// must be a power of two
+
+typedef struct {
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	int			passEntityNum;
+	int			contentmask;
+	int			capsule;
+} traceKey_t;
+
+typedef struct {
+	traceKey_t	key;
+	vec3_t		boxmins, boxmaxs;	// entities linked in here invalidate the trace
+	trace_t		trace;
+	qboolean	valid;
+} traceCacheEntry_t;
+
+static traceCacheEntry_t	sv_traceCacheEntries[TRACE_CACHE_SIZE];
+static int		sv_traceCacheLive[TRACE_CACHE_SIZE];	// indexes of the valid entries
+static int		sv_numTraceCacheLive;
+static int		sv_traceCacheHits, sv_traceCacheMisses, sv_traceCacheInvalidations;
+
+/*
+===============
+SV_TraceCache_f
+===============
+*/
+void SV_TraceCache_f( void ) {
+	int		total;
+
+	total = sv_traceCacheHits + sv_traceCacheMisses;
+	Com_Printf( "trace cache %s: %i entries\n", sv_traceCache->integer ? "on" : "off", sv_numTraceCacheLive );
+	Com_Printf( "%i hits, %i misses (%.1f%% hit rate), %i invalidated\n",
+		sv_traceCacheHits, sv_traceCacheMisses, total ? 100.0f * sv_traceCacheHits / total : 0.0f,
+		sv_traceCacheInvalidations );
+
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		sv_traceCacheHits = sv_traceCacheMisses = sv_traceCacheInvalidations = 0;
+	}
+}
+
+/*
+===============
+SV_ClearTraceCache
+
+Called at the start of every game frame
+===============
+*/
+void SV_ClearTraceCache( void ) {
+	int		i;
+
+	for ( i = 0 ; i < sv_numTraceCacheLive ; i++ ) {
+		sv_traceCacheEntries[ sv_traceCacheLive[i] ].valid = qfalse;
+	}
+	sv_numTraceCacheLive = 0;
+}
+
+/*
+===============
+SV_InvalidateTraceCache
+
+Drops the cached traces that could have hit an entity with the given bounds
+===============
+*/
+static void SV_InvalidateTraceCache( const vec3_t absmin, const vec3_t absmax ) {
+	int		i;
+	traceCacheEntry_t	*entry;
+
+	for ( i = 0 ; i < sv_numTraceCacheLive ; ) {
+		entry = &sv_traceCacheEntries[ sv_traceCacheLive[i] ];
+
+		if ( absmin[0] > entry->boxmaxs[0]
+			|| absmin[1] > entry->boxmaxs[1]
+			|| absmin[2] > entry->boxmaxs[2]
+			|| absmax[0] < entry->boxmins[0]
+			|| absmax[1] < entry->boxmins[1]
+			|| absmax[2] < entry->boxmins[2] ) {
+			i++;
+			continue;
+		}
+
+		entry->valid = qfalse;
+		sv_traceCacheLive[i] = sv_traceCacheLive[--sv_numTraceCacheLive];
+		sv_traceCacheInvalidations++;
+	}
+}
+
+/*
+===============
+SV_TraceCacheSlot
+===============
+*/
+static traceCacheEntry_t *SV_TraceCacheSlot( const traceKey_t *key ) {
+	const int		*p;
+	unsigned int	hash;
+	int				i;
+
+	hash = 0;
+	p = (const int *)key;
+	for ( i = 0 ; i < sizeof( *key ) / sizeof( int ) ; i++ ) {
+		hash = hash * 31 + p[i];
+	}
+	hash ^= hash >> 16;
+
+	return &sv_traceCacheEntries[ hash & ( TRACE_CACHE_SIZE - 1 ) ];
 }
 
 
@@ -179,6 +340,10 @@ void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
 	}
 	ent->worldSector = NULL;
 
+	if ( sv_numTraceCacheLive ) {
+		SV_InvalidateTraceCache( gEnt->r.absmin, gEnt->r.absmax );
+	}
+
 	if ( ws->entities == ent ) {
 		ws->entities = ent->nextEntityInWorldSector;
 		return;
@@ -195,21 +360,116 @@ void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
 }
 
 
+#define MAX_TOTAL_ENT_LEAFS		128
+
 /*
 ===============
-SV_LinkEntity
+SV_LinkEntityLeafs
 
+Finds the areas and PVS clusters touched by the abs box,
+returns qfalse if the entity is outside the world
 ===============
 */
-#define MAX_TOTAL_ENT_LEAFS		128
-void SV_LinkEntity( sharedEntity_t *gEnt ) {
-	worldSector_t	*node;
+static qboolean SV_LinkEntityLeafs( sharedEntity_t *gEnt, svEntity_t *ent ) {
 	int			leafs[MAX_TOTAL_ENT_LEAFS];
 	int			cluster;
 	int			num_leafs;
-	int			i, j, k;
+	int			i;
 	int			area;
 	int			lastLeaf;
+	float		margin;
+
+	// link to PVS leafs
+	ent->numClusters = 0;
+	ent->lastCluster = 0;
+	ent->areanum = -1;
+	ent->areanum2 = -1;
+
+	//get all leafs, including solids
+	num_leafs = CM_BoxLeafnumsMargin( gEnt->r.absmin, gEnt->r.absmax,
+		leafs, MAX_TOTAL_ENT_LEAFS, &lastLeaf, &margin );
+
+	// if none of the leafs were inside the map, the
+	// entity is outside the world and can be considered unlinked
+	if ( !num_leafs ) {
+		ent->leafMargin = 0;
+		return qfalse;
+	}
+
+	VectorCopy( gEnt->r.absmin, ent->leafMins );
+	VectorCopy( gEnt->r.absmax, ent->leafMaxs );
+	ent->leafMargin = margin - LEAF_MARGIN_EPSILON;	// keep clear of float rounding
+
+	// set areas, even from clusters that don't fit in the entity array
+	for (i=0 ; i<num_leafs ; i++) {
+		area = CM_LeafArea (leafs[i]);
+		if (area != -1) {
+			// doors may legally straggle two areas,
+			// but nothing should evern need more than that
+			if (ent->areanum != -1 && ent->areanum != area) {
+				if (ent->areanum2 != -1 && ent->areanum2 != area && sv.state == SS_LOADING) {
+					Com_DPrintf ("Object %i touching 3 areas at %f %f %f\n",
+					gEnt->s.number,
+					gEnt->r.absmin[0], gEnt->r.absmin[1], gEnt->r.absmin[2]);
+				}
+				ent->areanum2 = area;
+			} else {
+				ent->areanum = area;
+			}
+		}
+	}
+
+	// store as many explicit clusters as we can
+	ent->numClusters = 0;
+	for (i=0 ; i < num_leafs ; i++) {
+		cluster = CM_LeafCluster( leafs[i] );
+		if ( cluster != -1 ) {
+			ent->clusternums[ent->numClusters++] = cluster;
+			if ( ent->numClusters == MAX_ENT_CLUSTERS ) {
+				break;
+			}
+		}
+	}
+
+	// store off a last cluster if we need to
+	if ( i != num_leafs ) {
+		ent->lastCluster = CM_LeafCluster( lastLeaf );
+	}
+
+	return qtrue;
+}
+
+/*
+===============
+SV_LeafsUnchanged
+
+True if the abs box can't touch any leafs
+other than the ones it was last linked to
+===============
+*/
+static qboolean SV_LeafsUnchanged( sharedEntity_t *gEnt, svEntity_t *ent ) {
+	int			i;
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		if ( fabs( gEnt->r.absmin[i] - ent->leafMins[i] ) >= ent->leafMargin ) {
+			return qfalse;
+		}
+		if ( fabs( gEnt->r.absmax[i] - ent->leafMaxs[i] ) >= ent->leafMargin ) {
+			return qfalse;
+		}
+	}
+	return qtrue;
+}
+
+/*
+===============
+SV_LinkEntity
+
+===============
+*/
+void SV_LinkEntity( sharedEntity_t *gEnt ) {
+	worldSector_t	*node, *child;
+	int			i, j, k;
 	float		*origin, *angles;
 	svEntity_t	*ent;
 
@@ -278,72 +538,39 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 	gEnt->r.absmax[1] += 1;
 	gEnt->r.absmax[2] += 1;
 
-	// link to PVS leafs
-	ent->numClusters = 0;
-	ent->lastCluster = 0;
-	ent->areanum = -1;
-	ent->areanum2 = -1;
-
-	//get all leafs, including solids
-	num_leafs = CM_BoxLeafnums( gEnt->r.absmin, gEnt->r.absmax,
-		leafs, MAX_TOTAL_ENT_LEAFS, &lastLeaf );
-
-	// if none of the leafs were inside the map, the
-	// entity is outside the world and can be considered unlinked
-	if ( !num_leafs ) {
-		return;
-	}
-
-	// set areas, even from clusters that don't fit in the entity array
-	for (i=0 ; i<num_leafs ; i++) {
-		area = CM_LeafArea (leafs[i]);
-		if (area != -1) {
-			// doors may legally straggle two areas,
-			// but nothing should evern need more than that
-			if (ent->areanum != -1 && ent->areanum != area) {
-				if (ent->areanum2 != -1 && ent->areanum2 != area && sv.state == SS_LOADING) {
-					Com_DPrintf ("Object %i touching 3 areas at %f %f %f\n",
-					gEnt->s.number,
-					gEnt->r.absmin[0], gEnt->r.absmin[1], gEnt->r.absmin[2]);
-				}
-				ent->areanum2 = area;
-			} else {
-				ent->areanum = area;
-			}
-		}
+	if ( sv_numTraceCacheLive ) {
+		SV_InvalidateTraceCache( gEnt->r.absmin, gEnt->r.absmax );
 	}
 
-	// store as many explicit clusters as we can
-	ent->numClusters = 0;
-	for (i=0 ; i < num_leafs ; i++) {
-		cluster = CM_LeafCluster( leafs[i] );
-		if ( cluster != -1 ) {
-			ent->clusternums[ent->numClusters++] = cluster;
-			if ( ent->numClusters == MAX_ENT_CLUSTERS ) {
-				break;
-			}
+	// only walk the bsp when the box may have moved into other leafs
+	if ( SV_LeafsUnchanged( gEnt, ent ) ) {
+		sv_leafCacheHits++;
+	} else {
+		sv_leafCacheMisses++;
+		if ( !SV_LinkEntityLeafs( gEnt, ent ) ) {
+			return;
 		}
 	}
 
-	// store off a last cluster if we need to
-	if ( i != num_leafs ) {
-		ent->lastCluster = CM_LeafCluster( lastLeaf );
-	}
-
 	gEnt->r.linkcount++;
 
-	// find the first world sector node that the ent's box crosses
+	// go down to the side of the center until the box
+	// doesn't fit in the loose bounds of the child
 	node = sv_worldSectors;
-	while (1)
+	while (node->axis != -1)
 	{
-		if (node->axis == -1)
-			break;
-		if ( gEnt->r.absmin[node->axis] > node->dist)
-			node = node->children[0];
-		else if ( gEnt->r.absmax[node->axis] < node->dist)
-			node = node->children[1];
+		if ( gEnt->r.absmin[node->axis] + gEnt->r.absmax[node->axis] >= 2 * node->dist )
+			child = node->children[0];
 		else
-			break;		// crosses the node
+			child = node->children[1];
+		for ( i = 0 ; i < 3 ; i++ ) {
+			if ( gEnt->r.absmin[i] < child->bounds[0][i] || gEnt->r.absmax[i] > child->bounds[1][i] ) {
+				break;
+			}
+		}
+		if ( i != 3 )
+			break;		// too large for the child
+		node = child;
 	}
 	
 	// link it in
@@ -381,6 +608,8 @@ SV_AreaEntities_r
 static void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
 	svEntity_t	*check, *next;
 	sharedEntity_t *gcheck;
+	worldSector_t	*child;
+	int			i;
 
 	for ( check = node->entities  ; check ; check = next ) {
 		next = check->nextEntityInWorldSector;
@@ -409,12 +638,15 @@ static void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
 		return;		// terminal node
 	}
 
-	// recurse down both sides
-	if ( ap->maxs[node->axis] > node->dist ) {
-		SV_AreaEntities_r ( node->children[0], ap );
-	}
-	if ( ap->mins[node->axis] < node->dist ) {
-		SV_AreaEntities_r ( node->children[1], ap );
+	// recurse down the children whose loose bounds touch the area
+	for ( i = 0 ; i < 2 ; i++ ) {
+		child = node->children[i];
+		if ( ap->maxs[0] < child->bounds[0][0] || ap->mins[0] > child->bounds[1][0]
+		|| ap->maxs[1] < child->bounds[0][1] || ap->mins[1] > child->bounds[1][1]
+		|| ap->maxs[2] < child->bounds[0][2] || ap->mins[2] > child->bounds[1][2] ) {
+			continue;
+		}
+		SV_AreaEntities_r( child, ap );
 	}
 }
 
@@ -499,21 +731,21 @@ void SV_ClipToEntity( trace_t *trace, const vec3_t start, const vec3_t mins, con
 
 /*
 ====================
-SV_ClipMoveToEntities
+SV_ClipMoveToEntityList
 
+Clips against the entities of touchlist that the move box reaches,
+the list may hold more entities than SV_AreaEntities would return
+for clip->boxmins / clip->boxmaxs
 ====================
 */
-static void SV_ClipMoveToEntities( moveclip_t *clip ) {
-	int			i, num;
-	int			touchlist[MAX_GENTITIES];
+static void SV_ClipMoveToEntityList( moveclip_t *clip, const int *touchlist, int num ) {
+	int			i;
 	sharedEntity_t *touch;
 	int			passOwnerNum;
 	trace_t		trace;
 	clipHandle_t	clipHandle;
 	float		*origin, *angles;
 
-	num = SV_AreaEntities( clip->boxmins, clip->boxmaxs, touchlist, MAX_GENTITIES);
-
 	if ( clip->passEntityNum != ENTITYNUM_NONE ) {
 		passOwnerNum = ( SV_GentityNum( clip->passEntityNum ) )->r.ownerNum;
 		if ( passOwnerNum == ENTITYNUM_NONE ) {
@@ -529,6 +761,15 @@ static void SV_ClipMoveToEntities( moveclip_t *clip ) {
 		}
 		touch = SV_GentityNum( touchlist[i] );
 
+		if ( touch->r.absmin[0] > clip->boxmaxs[0]
+		|| touch->r.absmin[1] > clip->boxmaxs[1]
+		|| touch->r.absmin[2] > clip->boxmaxs[2]
+		|| touch->r.absmax[0] < clip->boxmins[0]
+		|| touch->r.absmax[1] < clip->boxmins[1]
+		|| touch->r.absmax[2] < clip->boxmins[2]) {
+			continue;
+		}
+
 		// see if we should ignore this entity
 		if ( clip->passEntityNum != ENTITYNUM_NONE ) {
 			if ( touchlist[i] == clip->passEntityNum ) {
@@ -584,6 +825,55 @@ static void SV_ClipMoveToEntities( moveclip_t *clip ) {
 	}
 }
 
+/*
+====================
+SV_ClipMoveToEntities
+
+====================
+*/
+static void SV_ClipMoveToEntities( moveclip_t *clip ) {
+	int			num;
+	int			touchlist[MAX_GENTITIES];
+
+	num = SV_AreaEntities( clip->boxmins, clip->boxmaxs, touchlist, MAX_GENTITIES);
+
+	SV_ClipMoveToEntityList( clip, touchlist, num );
+}
+
+
+/*
+==================
+SV_InitMoveClip
+
+Fills in the move parms and the bounding box of the entire move
+==================
+*/
+static void SV_InitMoveClip( moveclip_t *clip, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
+	int			i;
+
+	clip->contentmask = contentmask;
+	clip->start = start;
+//	VectorCopy( clip->trace.endpos, clip->end );
+	VectorCopy( end, clip->end );
+	clip->mins = mins;
+	clip->maxs = maxs;
+	clip->passEntityNum = passEntityNum;
+	clip->capsule = capsule;
+
+	// create the bounding box of the entire move
+	// we can limit it to the part of the move not
+	// already clipped off by the world, which can be
+	// a significant savings for line of sight and shot traces
+	for ( i=0 ; i<3 ; i++ ) {
+		if ( end[i] > start[i] ) {
+			clip->boxmins[i] = clip->start[i] + clip->mins[i] - 1;
+			clip->boxmaxs[i] = clip->end[i] + clip->maxs[i] + 1;
+		} else {
+			clip->boxmins[i] = clip->end[i] + clip->mins[i] - 1;
+			clip->boxmaxs[i] = clip->start[i] + clip->maxs[i] + 1;
+		}
+	}
+}
 
 /*
 ==================
@@ -595,7 +885,8 @@ passEntityNum and entities owned by passEntityNum are explicitly not checked.
 */
 void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
 	moveclip_t	clip;
-	int			i;
+	traceKey_t	key;
+	traceCacheEntry_t	*entry;
 
 	if ( !mins ) {
 		mins = vec3_origin;
@@ -604,43 +895,115 @@ void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
 		maxs = vec3_origin;
 	}
 
+	entry = NULL;
+	if ( sv_traceCache->integer ) {
+		Com_Memset( &key, 0, sizeof( key ) );
+		VectorCopy( start, key.start );
+		VectorCopy( end, key.end );
+		VectorCopy( mins, key.mins );
+		VectorCopy( maxs, key.maxs );
+		key.passEntityNum = passEntityNum;
+		key.contentmask = contentmask;
+		key.capsule = capsule;
+
+		entry = SV_TraceCacheSlot( &key );
+		if ( entry->valid && !memcmp( &entry->key, &key, sizeof( key ) ) ) {
+			sv_traceCacheHits++;
+			*results = entry->trace;
+			return;
+		}
+		sv_traceCacheMisses++;
+	}
+
 	Com_Memset ( &clip, 0, sizeof ( moveclip_t ) );
 
 	// clip to world
 	CM_BoxTrace( &clip.trace, start, end, mins, maxs, 0, contentmask, capsule );
 	clip.trace.entityNum = clip.trace.fraction != 1.0 ? ENTITYNUM_WORLD : ENTITYNUM_NONE;
-	if ( clip.trace.fraction == 0 ) {
-		*results = clip.trace;
-		return;		// blocked immediately by the world
+
+	SV_InitMoveClip( &clip, start, mins, maxs, end, passEntityNum, contentmask, capsule );
+
+	// clip to other solid entities, unless blocked immediately by the world
+	if ( clip.trace.fraction != 0 ) {
+		SV_ClipMoveToEntities ( &clip );
 	}
 
-	clip.contentmask = contentmask;
-	clip.start = start;
-//	VectorCopy( clip.trace.endpos, clip.end );
-	VectorCopy( end, clip.end );
-	clip.mins = mins;
-	clip.maxs = maxs;
-	clip.passEntityNum = passEntityNum;
-	clip.capsule = capsule;
+	*results = clip.trace;
 
-	// create the bounding box of the entire move
-	// we can limit it to the part of the move not
-	// already clipped off by the world, which can be
-	// a significant savings for line of sight and shot traces
-	for ( i=0 ; i<3 ; i++ ) {
-		if ( end[i] > start[i] ) {
-			clip.boxmins[i] = clip.start[i] + clip.mins[i] - 1;
-			clip.boxmaxs[i] = clip.end[i] + clip.maxs[i] + 1;
-		} else {
-			clip.boxmins[i] = clip.end[i] + clip.mins[i] - 1;
-			clip.boxmaxs[i] = clip.start[i] + clip.maxs[i] + 1;
+	if ( entry ) {
+		if ( !entry->valid ) {
+			entry->valid = qtrue;
+			sv_traceCacheLive[ sv_numTraceCacheLive++ ] = entry - sv_traceCacheEntries;
 		}
+		entry->key = key;
+		VectorCopy( clip.boxmins, entry->boxmins );
+		VectorCopy( clip.boxmaxs, entry->boxmaxs );
+		entry->trace = clip.trace;
 	}
+}
 
-	// clip to other solid entities
-	SV_ClipMoveToEntities ( &clip );
+/*
+==================
+SV_TraceBatch
 
-	*results = clip.trace;
+The world is traced for all moves in one tree walk, and the entities
+touched by any of the moves are gathered once and shared
+==================
+*/
+void SV_TraceBatch( trace_t *results, int numTraces, const vec3_t *starts, vec3_t mins, vec3_t maxs, const vec3_t *ends, int passEntityNum, int contentmask, int capsule ) {
+	moveclip_t	clip;
+	int			touchlist[MAX_GENTITIES];
+	vec3_t		boxmins, boxmaxs;
+	int			i, num, numMoves;
+
+	if ( numTraces <= 0 ) {
+		return;
+	}
+	if ( !mins ) {
+		mins = vec3_origin;
+	}
+	if ( !maxs ) {
+		maxs = vec3_origin;
+	}
+
+	// clip to world
+	CM_BoxTraceBatch( results, numTraces, starts, ends, mins, maxs, 0, contentmask, capsule );
+
+	ClearBounds( boxmins, boxmaxs );
+	numMoves = 0;
+	for ( i = 0 ; i < numTraces ; i++ ) {
+		results[i].entityNum = results[i].fraction != 1.0 ? ENTITYNUM_WORLD : ENTITYNUM_NONE;
+		if ( results[i].fraction == 0 ) {
+			continue;	// blocked immediately by the world
+		}
+
+		SV_InitMoveClip( &clip, starts[i], mins, maxs, ends[i], passEntityNum, contentmask, capsule );
+		AddPointToBounds( clip.boxmins, boxmins, boxmaxs );
+		AddPointToBounds( clip.boxmaxs, boxmins, boxmaxs );
+		numMoves++;
+	}
+
+	if ( !numMoves ) {
+		return;
+	}
+
+	// one sector walk for every entity any of the moves can reach
+	num = SV_AreaEntities( boxmins, boxmaxs, touchlist, MAX_GENTITIES );
+
+	for ( i = 0 ; i < numTraces ; i++ ) {
+		if ( results[i].fraction == 0 ) {
+			continue;
+		}
+
+		Com_Memset ( &clip, 0, sizeof ( moveclip_t ) );
+		clip.trace = results[i];
+		SV_InitMoveClip( &clip, starts[i], mins, maxs, ends[i], passEntityNum, contentmask, capsule );
+
+		// clip to other solid entities
+		SV_ClipMoveToEntityList( &clip, touchlist, num );
+
+		results[i] = clip.trace;
+	}
 }
 
 
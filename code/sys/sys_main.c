@@ -390,16 +390,19 @@ static __attribute__ ((format (printf, 1, 2))) void Sys_Warn( char *warning, ...
 ============
 Sys_FileTime
 
-returns -1 if not present
+returns -1 if not present, the length goes in *length if it isn't NULL
 ============
 */
-int Sys_FileTime( char *path )
+int Sys_FileTime( const char *path, long *length )
 {
 	struct stat buf;
 
 	if (stat (path,&buf) == -1)
 		return -1;
 
+	if (length)
+		*length = buf.st_size;
+
 	return buf.st_mtime;
 }
 
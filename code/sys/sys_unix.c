@@ -40,6 +40,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include <fenv.h>
 #endif
 #include <sys/wait.h>
+#include <pthread.h>
 
 qboolean stdinIsATTY;
 
@@ -112,6 +113,43 @@ int Sys_Milliseconds (void)
 	return curtime;
 }
 
+/*
+================
+Sys_Microseconds
+
+A monotonic clock for timing things shorter than a millisecond,
+with an arbitrary origin
+================
+*/
+int64_t Sys_Microseconds (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+================
+Sys_MicrosecondsUntil
+
+How long until Sys_Milliseconds returns msec, for waits
+that are more precise than a millisecond
+================
+*/
+int Sys_MicrosecondsUntil (int msec)
+{
+	struct timeval tp;
+
+	gettimeofday(&tp, NULL);
+
+	if (!sys_timeBase)
+		return (msec - Sys_Milliseconds()) * 1000;
+
+	return (msec - (int)(tp.tv_sec - sys_timeBase)*1000) * 1000 - tp.tv_usec;
+}
+
 /*
 ==================
 Sys_RandomBytes
@@ -209,6 +247,37 @@ FILE *Sys_FOpen( const char *ospath, const char *mode ) {
 	return fopen( ospath, mode );
 }
 
+/*
+==============
+Sys_MapFile
+
+Maps the first length bytes of an open file read only, NULL on failure.
+The mapping stays valid after the file is closed
+==============
+*/
+void *Sys_MapFile( FILE *f, long length ) {
+	void	*data;
+
+	if ( length <= 0 ) {
+		return NULL;
+	}
+
+	data = mmap( NULL, length, PROT_READ, MAP_SHARED, fileno( f ), 0 );
+	if ( data == MAP_FAILED ) {
+		return NULL;
+	}
+	return data;
+}
+
+/*
+==============
+Sys_UnmapFile
+==============
+*/
+void Sys_UnmapFile( void *data, long length ) {
+	munmap( data, length );
+}
+
 /*
 ==================
 Sys_Mkdir
@@ -864,6 +933,175 @@ void Sys_SetEnv(const char *name, const char *value)
 		unsetenv(name);
 }
 
+typedef struct {
+	pthread_t	thread;
+	void		(*function)( void *data );
+	void		*data;
+} sysThread_t;
+
+static void *Sys_ThreadMain( void *arg )
+{
+	sysThread_t *t = arg;
+
+	t->function( t->data );
+	return NULL;
+}
+
+/*
+==============
+Sys_CreateThread
+==============
+*/
+void *Sys_CreateThread( void (*function)( void *data ), void *data )
+{
+	sysThread_t *t;
+
+	t = malloc( sizeof( *t ) );
+	if( !t )
+		return NULL;
+
+	t->function = function;
+	t->data = data;
+
+	if( pthread_create( &t->thread, NULL, Sys_ThreadMain, t ) != 0 )
+	{
+		free( t );
+		return NULL;
+	}
+
+	return t;
+}
+
+/*
+==============
+Sys_JoinThread
+==============
+*/
+void Sys_JoinThread( void *thread )
+{
+	sysThread_t *t = thread;
+
+	pthread_join( t->thread, NULL );
+	free( t );
+}
+
+typedef struct {
+	pthread_mutex_t	mutex;
+	pthread_cond_t	cond;
+	qboolean		raised;
+} sysSignal_t;
+
+/*
+==============
+Sys_CreateMutex
+==============
+*/
+void *Sys_CreateMutex( void )
+{
+	pthread_mutex_t *m;
+
+	m = malloc( sizeof( *m ) );
+	if( !m )
+		return NULL;
+
+	pthread_mutex_init( m, NULL );
+	return m;
+}
+
+/*
+==============
+Sys_LockMutex
+==============
+*/
+void Sys_LockMutex( void *mutex )
+{
+	pthread_mutex_lock( mutex );
+}
+
+/*
+==============
+Sys_UnlockMutex
+==============
+*/
+void Sys_UnlockMutex( void *mutex )
+{
+	pthread_mutex_unlock( mutex );
+}
+
+/*
+==============
+Sys_CreateSignal
+==============
+*/
+void *Sys_CreateSignal( void )
+{
+	sysSignal_t *s;
+
+	s = malloc( sizeof( *s ) );
+	if( !s )
+		return NULL;
+
+	pthread_mutex_init( &s->mutex, NULL );
+	pthread_cond_init( &s->cond, NULL );
+	s->raised = qfalse;
+	return s;
+}
+
+/*
+==============
+Sys_DestroySignal
+==============
+*/
+void Sys_DestroySignal( void *signal )
+{
+	sysSignal_t *s = signal;
+
+	pthread_cond_destroy( &s->cond );
+	pthread_mutex_destroy( &s->mutex );
+	free( s );
+}
+
+/*
+==============
+Sys_RaiseSignal
+==============
+*/
+void Sys_RaiseSignal( void *signal )
+{
+	sysSignal_t *s = signal;
+
+	pthread_mutex_lock( &s->mutex );
+	s->raised = qtrue;
+	pthread_cond_signal( &s->cond );
+	pthread_mutex_unlock( &s->mutex );
+}
+
+/*
+==============
+Sys_WaitSignal
+==============
+*/
+void Sys_WaitSignal( void *signal )
+{
+	sysSignal_t *s = signal;
+
+	pthread_mutex_lock( &s->mutex );
+	while( !s->raised )
+		pthread_cond_wait( &s->cond, &s->mutex );
+	s->raised = qfalse;
+	pthread_mutex_unlock( &s->mutex );
+}
+
+/*
+==============
+Sys_MemoryBarrier
+==============
+*/
+void Sys_MemoryBarrier( void )
+{
+	__sync_synchronize( );
+}
+
 /*
 ==============
 Sys_PID
@@ -146,6 +146,35 @@ int Sys_Milliseconds (void)
 	return sys_curtime;
 }
 
+/*
+================
+Sys_Microseconds
+================
+*/
+int64_t Sys_Microseconds (void)
+{
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER count;
+
+	if (!frequency.QuadPart)
+		QueryPerformanceFrequency(&frequency);
+
+	QueryPerformanceCounter(&count);
+
+	return count.QuadPart / frequency.QuadPart * 1000000 +
+		count.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart;
+}
+
+/*
+================
+Sys_MicrosecondsUntil
+================
+*/
+int Sys_MicrosecondsUntil (int msec)
+{
+	return (msec - Sys_Milliseconds()) * 1000;
+}
+
 /*
 ================
 Sys_RandomBytes
@@ -291,6 +320,41 @@ FILE *Sys_FOpen( const char *ospath, const char *mode ) {
 	return fopen( ospath, mode );
 }
 
+/*
+==============
+Sys_MapFile
+
+Maps the first length bytes of an open file read only, NULL on failure.
+The view stays valid after the file is closed
+==============
+*/
+void *Sys_MapFile( FILE *f, long length ) {
+	HANDLE	mapping;
+	void	*data;
+
+	if ( length <= 0 ) {
+		return NULL;
+	}
+
+	mapping = CreateFileMapping( (HANDLE)_get_osfhandle( _fileno( f ) ), NULL, PAGE_READONLY, 0, 0, NULL );
+	if ( !mapping ) {
+		return NULL;
+	}
+
+	data = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, length );
+	CloseHandle( mapping );
+	return data;
+}
+
+/*
+==============
+Sys_UnmapFile
+==============
+*/
+void Sys_UnmapFile( void *data, long length ) {
+	UnmapViewOfFile( data );
+}
+
 /*
 ==============
 Sys_Mkdir
@@ -768,6 +832,148 @@ void Sys_SetEnv(const char *name, const char *value)
 		_putenv(va("%s=", name));
 }
 
+typedef struct {
+	HANDLE	thread;
+	void	(*function)( void *data );
+	void	*data;
+} sysThread_t;
+
+static DWORD WINAPI Sys_ThreadMain( LPVOID arg )
+{
+	sysThread_t *t = arg;
+
+	t->function( t->data );
+	return 0;
+}
+
+/*
+==============
+Sys_CreateThread
+==============
+*/
+void *Sys_CreateThread( void (*function)( void *data ), void *data )
+{
+	sysThread_t *t;
+
+	t = malloc( sizeof( *t ) );
+	if( !t )
+		return NULL;
+
+	t->function = function;
+	t->data = data;
+	t->thread = CreateThread( NULL, 0, Sys_ThreadMain, t, 0, NULL );
+
+	if( !t->thread )
+	{
+		free( t );
+		return NULL;
+	}
+
+	return t;
+}
+
+/*
+==============
+Sys_JoinThread
+==============
+*/
+void Sys_JoinThread( void *thread )
+{
+	sysThread_t *t = thread;
+
+	WaitForSingleObject( t->thread, INFINITE );
+	CloseHandle( t->thread );
+	free( t );
+}
+
+/*
+==============
+Sys_CreateMutex
+==============
+*/
+void *Sys_CreateMutex( void )
+{
+	CRITICAL_SECTION *m;
+
+	m = malloc( sizeof( *m ) );
+	if( !m )
+		return NULL;
+
+	InitializeCriticalSection( m );
+	return m;
+}
+
+/*
+==============
+Sys_LockMutex
+==============
+*/
+void Sys_LockMutex( void *mutex )
+{
+	EnterCriticalSection( mutex );
+}
+
+/*
+==============
+Sys_UnlockMutex
+==============
+*/
+void Sys_UnlockMutex( void *mutex )
+{
+	LeaveCriticalSection( mutex );
+}
+
+/*
+==============
+Sys_CreateSignal
+==============
+*/
+void *Sys_CreateSignal( void )
+{
+	// auto reset, a wait lowers it again
+	return CreateEvent( NULL, FALSE, FALSE, NULL );
+}
+
+/*
+==============
+Sys_DestroySignal
+==============
+*/
+void Sys_DestroySignal( void *signal )
+{
+	CloseHandle( signal );
+}
+
+/*
+==============
+Sys_RaiseSignal
+==============
+*/
+void Sys_RaiseSignal( void *signal )
+{
+	SetEvent( signal );
+}
+
+/*
+==============
+Sys_WaitSignal
+==============
+*/
+void Sys_WaitSignal( void *signal )
+{
+	WaitForSingleObject( signal, INFINITE );
+}
+
+/*
+==============
+Sys_MemoryBarrier
+==============
+*/
+void Sys_MemoryBarrier( void )
+{
+	MemoryBarrier( );
+}
+
 /*
 ==============
 Sys_PID
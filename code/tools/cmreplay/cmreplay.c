@@ -0,0 +1,424 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// cmreplay.c -- replays a trace log written by "tracerecord" against a bsp
+// and reports the trace rate and any results that differ from the log.
+// Only the collision code of the engine is linked in, the rest of the
+// engine interface it uses is stubbed out below.
+
+#include "../../qcommon/cm_local.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+===============================================================================
+
+ENGINE STUBS
+
+===============================================================================
+*/
+
+void QDECL Com_Printf( const char *fmt, ... ) {
+	va_list		argptr;
+
+	va_start( argptr, fmt );
+	vprintf( fmt, argptr );
+	va_end( argptr );
+}
+
+void QDECL Com_DPrintf( const char *fmt, ... ) {
+}
+
+void QDECL Com_Error( int level, const char *fmt, ... ) {
+	va_list		argptr;
+
+	printf( "ERROR: " );
+	va_start( argptr, fmt );
+	vprintf( fmt, argptr );
+	va_end( argptr );
+	printf( "\n" );
+	exit( 1 );
+}
+
+cvar_t *Cvar_Get( const char *var_name, const char *var_value, int flags ) {
+	cvar_t		*var;
+
+	// every call gets its own default valued cvar, nothing changes them
+	var = calloc( 1, sizeof( *var ) );
+	if ( !var ) {
+		Com_Error( ERR_FATAL, "Cvar_Get: out of memory" );
+	}
+	var->value = atof( var_value );
+	var->integer = atoi( var_value );
+
+	return var;
+}
+
+// the collision code stores offsets between hunk allocations,
+// so they have to come from one block like in the engine
+#define	HUNK_SIZE	( 512 << 20 )
+
+static byte		*hunk;
+static int		hunkUsed;
+
+void *Hunk_Alloc( int size, ha_pref preference ) {
+	void		*buf;
+
+	if ( !hunk ) {
+		hunk = calloc( 1, HUNK_SIZE );
+		if ( !hunk ) {
+			Com_Error( ERR_FATAL, "Couldn't allocate the hunk" );
+		}
+	}
+
+	size = ( size + 31 ) & ~31;
+	if ( hunkUsed + size > HUNK_SIZE ) {
+		Com_Error( ERR_FATAL, "Hunk_Alloc failed on %i bytes", size );
+	}
+
+	buf = hunk + hunkUsed;
+	hunkUsed += size;
+
+	return buf;
+}
+
+void *Z_Malloc( int size ) {
+	void		*buf;
+
+	buf = calloc( 1, size );
+	if ( !buf ) {
+		Com_Error( ERR_FATAL, "Z_Malloc failed on %i bytes", size );
+	}
+
+	return buf;
+}
+
+void *Hunk_AllocateTempMemory( int size ) {
+	return Z_Malloc( size );
+}
+
+void Hunk_FreeTempMemory( void *buf ) {
+	free( buf );
+}
+
+void Z_Free( void *ptr ) {
+	free( ptr );
+}
+
+cpuFeatures_t Sys_GetProcessorFeatures( void ) {
+#ifdef __SSE2__
+	return CF_SSE2;
+#else
+	return 0;
+#endif
+}
+
+// the map name given to CM_LoadMap is a path in the os file system
+long FS_ReadFile( const char *qpath, void **buffer ) {
+	FILE		*f;
+	long		len;
+
+	*buffer = NULL;
+
+	f = fopen( qpath, "rb" );
+	if ( !f ) {
+		return -1;
+	}
+
+	fseek( f, 0, SEEK_END );
+	len = ftell( f );
+	fseek( f, 0, SEEK_SET );
+
+	*buffer = Z_Malloc( len + 1 );
+	if ( fread( *buffer, 1, len, f ) != len ) {
+		Com_Error( ERR_FATAL, "Couldn't read %s", qpath );
+	}
+	fclose( f );
+
+	return len;
+}
+
+void FS_FreeFile( void *buffer ) {
+	free( buffer );
+}
+
+// the patch collision cache of the server is read from homePath when given,
+// patches generated by a different build can collide slightly differently.
+// Nothing is ever written.
+static const char	*homePath;
+static FILE			*cacheFile;
+
+long FS_SV_FOpenFileRead( const char *filename, fileHandle_t *fp ) {
+	char		path[MAX_OSPATH];
+	long		len;
+
+	*fp = 0;
+	if ( !homePath ) {
+		return -1;
+	}
+
+	Com_sprintf( path, sizeof( path ), "%s/%s", homePath, filename );
+	cacheFile = fopen( path, "rb" );
+	if ( !cacheFile ) {
+		return -1;
+	}
+
+	fseek( cacheFile, 0, SEEK_END );
+	len = ftell( cacheFile );
+	fseek( cacheFile, 0, SEEK_SET );
+
+	*fp = 1;
+	return len;
+}
+
+fileHandle_t FS_SV_FOpenFileWrite( const char *filename ) {
+	return 0;
+}
+
+fileHandle_t FS_FOpenFileWrite( const char *filename ) {
+	return 0;
+}
+
+int FS_Read( void *buffer, int len, fileHandle_t f ) {
+	return fread( buffer, 1, len, cacheFile );
+}
+
+int FS_Write( const void *buffer, int len, fileHandle_t f ) {
+	return 0;
+}
+
+void FS_FCloseFile( fileHandle_t f ) {
+	fclose( cacheFile );
+	cacheFile = NULL;
+}
+
+void BotDrawDebugPolygons( void (*drawPoly)(int color, int numPoints, float *points), int value ) {
+}
+
+/*
+===============================================================================
+
+REPLAY
+
+===============================================================================
+*/
+
+/*
+================
+CR_Milliseconds
+================
+*/
+static int CR_Milliseconds( void ) {
+	return (int)( (double)clock() * 1000.0 / CLOCKS_PER_SEC );
+}
+
+/*
+================
+CR_LoadLog
+
+Returns the records in host byte order
+================
+*/
+static traceRecord_t *CR_LoadLog( const char *filename, traceLogHeader_t *header, int *numRecords ) {
+	FILE			*f;
+	long			len;
+	traceRecord_t	*records;
+	int				i;
+
+	f = fopen( filename, "rb" );
+	if ( !f ) {
+		Com_Error( ERR_FATAL, "Couldn't open %s", filename );
+	}
+
+	fseek( f, 0, SEEK_END );
+	len = ftell( f ) - sizeof( *header );
+	fseek( f, 0, SEEK_SET );
+
+	if ( len < 0 || fread( header, sizeof( *header ), 1, f ) != 1 ) {
+		Com_Error( ERR_FATAL, "%s is not a trace log", filename );
+	}
+	header->ident = LittleLong( header->ident );
+	header->version = LittleLong( header->version );
+	header->checksum = LittleLong( header->checksum );
+	header->mapname[sizeof( header->mapname ) - 1] = 0;
+
+	if ( header->ident != TRACE_LOG_IDENT ) {
+		Com_Error( ERR_FATAL, "%s is not a trace log", filename );
+	}
+	if ( header->version != TRACE_LOG_VERSION ) {
+		Com_Error( ERR_FATAL, "%s has version %i instead of %i", filename, header->version, TRACE_LOG_VERSION );
+	}
+
+	// a log cut short by a crash still replays up to the last whole record
+	*numRecords = len / sizeof( traceRecord_t );
+	records = Z_Malloc( *numRecords * sizeof( traceRecord_t ) + 1 );
+	if ( fread( records, sizeof( traceRecord_t ), *numRecords, f ) != *numRecords ) {
+		Com_Error( ERR_FATAL, "Couldn't read %s", filename );
+	}
+	fclose( f );
+
+	for ( i = 0 ; i < *numRecords ; i++ ) {
+		CM_SwapTraceRecord( &records[i] );
+	}
+
+	return records;
+}
+
+/*
+================
+CR_SameResult
+================
+*/
+static qboolean CR_SameResult( const traceRecord_t *rec, const trace_t *trace ) {
+	return rec->allsolid == trace->allsolid
+		&& rec->startsolid == trace->startsolid
+		&& rec->fraction == trace->fraction
+		&& VectorCompare( rec->endpos, trace->endpos )
+		&& VectorCompare( rec->normal, trace->plane.normal )
+		&& rec->dist == trace->plane.dist
+		&& rec->surfaceFlags == trace->surfaceFlags
+		&& rec->contents == trace->contents;
+}
+
+/*
+================
+CR_Replay
+
+Runs every record through the call it was made with, returns the number
+of results that differ from the log
+================
+*/
+static int CR_Replay( traceRecord_t *records, int numRecords, qboolean report ) {
+	traceRecord_t	*rec;
+	trace_t			traces[MAX_TRACE_BATCH];
+	vec3_t			starts[MAX_TRACE_BATCH], ends[MAX_TRACE_BATCH];
+	int				i, j, count, mismatches;
+
+	mismatches = 0;
+	for ( i = 0 ; i < numRecords ; i += count ) {
+		rec = &records[i];
+
+		if ( rec->model == BOX_MODEL_HANDLE || rec->model == CAPSULE_MODEL_HANDLE ) {
+			CM_TempBoxModel( rec->boxMins, rec->boxMaxs, rec->model == CAPSULE_MODEL_HANDLE );
+		}
+
+		count = 1;
+		switch ( rec->type ) {
+		case TR_BOXTRACE:
+			CM_BoxTrace( &traces[0], rec->start, rec->end, rec->mins, rec->maxs,
+				rec->model, rec->brushmask, rec->capsule );
+			break;
+		case TR_TRANSFORMED:
+			CM_TransformedBoxTrace( &traces[0], rec->start, rec->end, rec->mins, rec->maxs,
+				rec->model, rec->brushmask, rec->origin, rec->angles, rec->capsule );
+			break;
+		case TR_BATCH:
+			count = rec->batchSize;
+			if ( count < 1 || count > MAX_TRACE_BATCH || i + count > numRecords ) {
+				Com_Error( ERR_FATAL, "bad batch of %i traces at trace %i", count, i );
+			}
+			for ( j = 0 ; j < count ; j++ ) {
+				VectorCopy( rec[j].start, starts[j] );
+				VectorCopy( rec[j].end, ends[j] );
+			}
+			CM_BoxTraceBatch( traces, count, (const vec3_t *)starts, (const vec3_t *)ends,
+				rec->mins, rec->maxs, rec->model, rec->brushmask, rec->capsule );
+			break;
+		default:
+			Com_Error( ERR_FATAL, "bad trace type %i at trace %i", rec->type, i );
+		}
+
+		for ( j = 0 ; j < count ; j++ ) {
+			if ( CR_SameResult( &rec[j], &traces[j] ) ) {
+				continue;
+			}
+			if ( report && mismatches < 10 ) {
+				Com_Printf( "trace %i: fraction %f instead of %f, startsolid %i instead of %i\n",
+					i + j, traces[j].fraction, rec[j].fraction, traces[j].startsolid, rec[j].startsolid );
+			}
+			mismatches++;
+		}
+	}
+
+	return mismatches;
+}
+
+/*
+================
+main
+================
+*/
+int main( int argc, char **argv ) {
+	traceLogHeader_t	header;
+	traceRecord_t		*records;
+	int					numRecords, passes, mismatches;
+	int					i, start, msec, best;
+	int					checksum;
+
+	if ( argc < 3 ) {
+		printf( "usage: %s <map.bsp> <log.trc> [passes] [homepath]\n", argv[0] );
+		printf( "homepath is the server's, for replaying with its patch cache\n" );
+		return 1;
+	}
+
+	passes = 5;
+	if ( argc > 3 ) {
+		passes = atoi( argv[3] );
+		if ( passes < 1 ) {
+			passes = 1;
+		}
+	}
+	if ( argc > 4 ) {
+		homePath = argv[4];
+	}
+
+	records = CR_LoadLog( argv[2], &header, &numRecords );
+
+	CM_LoadMap( argv[1], qfalse, &checksum );
+	if ( checksum != header.checksum ) {
+		Com_Error( ERR_FATAL, "%s was recorded on a different version of %s", argv[2], header.mapname );
+	}
+
+	Com_Printf( "%i traces recorded on %s\n", numRecords, header.mapname );
+
+	// the first pass checks the results, later ones only time
+	mismatches = CR_Replay( records, numRecords, qtrue );
+
+	best = 0;
+	for ( i = 0 ; i < passes ; i++ ) {
+		start = CR_Milliseconds();
+		CR_Replay( records, numRecords, qfalse );
+		msec = CR_Milliseconds() - start;
+		if ( !i || msec < best ) {
+			best = msec;
+		}
+	}
+
+	Com_Printf( "best of %i passes: %i msec, %.0f traces/second\n", passes, best,
+		numRecords * 1000.0 / ( best > 0 ? best : 1 ) );
+	Com_Printf( "%i traces differ from the log\n", mismatches );
+
+	Z_Free( records );
+
+	return mismatches ? 2 : 0;
+}
@@ -0,0 +1,653 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// demobench.c -- compares range coding the server messages of demos with
+// the huffman coding they were recorded in, in bytes and time.  The
+// messages are read like the client reads them, and every symbol read is
+// written again through msg->readCopy.  Range coded messages start from
+// the checkpoint of the snapshot message acknowledged lag messages before,
+// like on a connection that loses nothing.  Only the message code of the
+// engine is linked in, the rest of the engine interface it uses is
+// stubbed out below.
+
+#include "../../qcommon/q_shared.h"
+#include "../../qcommon/qcommon.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+===============================================================================
+
+ENGINE STUBS
+
+===============================================================================
+*/
+
+cvar_t	*cl_shownet;
+
+void QDECL Com_Printf( const char *fmt, ... ) {
+	va_list		argptr;
+
+	va_start( argptr, fmt );
+	vprintf( fmt, argptr );
+	va_end( argptr );
+}
+
+void QDECL Com_DPrintf( const char *fmt, ... ) {
+}
+
+void QDECL Com_Error( int level, const char *fmt, ... ) {
+	va_list		argptr;
+
+	printf( "ERROR: " );
+	va_start( argptr, fmt );
+	vprintf( fmt, argptr );
+	va_end( argptr );
+	printf( "\n" );
+	exit( 1 );
+}
+
+//===============================================================================
+
+#define	MAX_DEMOS		1024
+#define	DEFAULT_LAG		3		// messages before a snapshot message is acknowledged
+
+typedef enum {
+	DB_NONE,
+	DB_HUFFMAN,
+	DB_RANGE
+} dbCoding_t;
+
+typedef struct {
+	int			sequence;
+	int			size;
+	byte		*data;
+	int			codedSize;
+	byte		*coded;
+	qboolean	snapshot;
+} dbMessage_t;
+
+typedef struct {
+	int			firstMessage;
+	int			numMessages;
+} dbDemo_t;
+
+typedef struct {
+	qboolean		valid;
+	int				messageNum;
+	playerState_t	ps;
+	int				numEntities;
+	entityState_t	entities[MAX_SNAPSHOT_ENTITIES];
+} dbSnapshot_t;
+
+typedef struct {
+	rangeModel_t	base;
+	rangeModel_t	checkpoints[PACKET_BACKUP];
+	int				made[PACKET_BACKUP];		// message of each checkpoint, -1 for none
+} dbChannel_t;
+
+static dbMessage_t	*dbMessages;
+static int			dbNumMessages;
+static dbDemo_t		dbDemos[MAX_DEMOS];
+static int			dbNumDemos;
+static int			dbLag = DEFAULT_LAG;
+
+// what the client keeps
+static entityState_t	dbBaselines[MAX_GENTITIES];
+static dbSnapshot_t		dbSnapshots[PACKET_BACKUP];
+static dbSnapshot_t		dbNewSnapshot;
+static byte				dbFieldOrder[MAX_ENTITY_FIELDS];
+static qboolean			dbHasFieldOrder;
+static qboolean			dbSnapshotMessage;
+
+static dbChannel_t		dbReadChannel;
+static dbChannel_t		dbWriteChannel;
+
+/*
+===============================================================================
+
+READING
+
+The same symbols the client reads, in the same order
+
+===============================================================================
+*/
+
+/*
+================
+DB_ParseGamestate
+================
+*/
+static void DB_ParseGamestate( msg_t *msg ) {
+	entityState_t	nullstate;
+	int				cmd, i, newnum;
+	char			*s;
+
+	MSG_ReadLong( msg );		// server command sequence
+
+	Com_Memset( dbSnapshots, 0, sizeof( dbSnapshots ) );
+	dbHasFieldOrder = qfalse;
+
+	while ( 1 ) {
+		cmd = MSG_ReadByte( msg );
+
+		if ( cmd == svc_EOF ) {
+			break;
+		}
+
+		if ( cmd == svc_configstring ) {
+			i = MSG_ReadShort( msg );
+			s = MSG_ReadBigString( msg );
+			if ( i == CS_SYSTEMINFO ) {
+				dbHasFieldOrder = MSG_ParseEntityFieldOrder( Info_ValueForKey( s, "sv_entityFieldOrder" ),
+					dbFieldOrder );
+			}
+		} else if ( cmd == svc_baseline ) {
+			newnum = MSG_ReadBits( msg, GENTITYNUM_BITS );
+			if ( newnum < 0 || newnum >= MAX_GENTITIES ) {
+				Com_Error( ERR_DROP, "Baseline number out of range: %i", newnum );
+			}
+			Com_Memset( &nullstate, 0, sizeof( nullstate ) );
+			MSG_ReadDeltaEntity( msg, &nullstate, &dbBaselines[newnum], newnum );
+		} else {
+			Com_Error( ERR_DROP, "DB_ParseGamestate: bad command byte" );
+		}
+	}
+
+	MSG_ReadLong( msg );		// client number
+	MSG_ReadLong( msg );		// checksum feed
+}
+
+/*
+================
+DB_AddEntity
+================
+*/
+static void DB_AddEntity( dbSnapshot_t *frame, const entityState_t *state ) {
+	if ( frame->numEntities == MAX_SNAPSHOT_ENTITIES ) {
+		Com_Error( ERR_DROP, "DB_AddEntity: more than %i entities", MAX_SNAPSHOT_ENTITIES );
+	}
+	frame->entities[frame->numEntities++] = *state;
+}
+
+/*
+================
+DB_ParsePacketEntities
+
+The states of the frame deltas are from don't change what is read, even
+if the client doesn't have the frame any more
+================
+*/
+static void DB_ParsePacketEntities( msg_t *msg, dbSnapshot_t *oldframe, dbSnapshot_t *newframe ) {
+	entityState_t	state, *from;
+	int				newnum, oldindex, oldcount;
+
+	newframe->numEntities = 0;
+	oldindex = 0;
+	oldcount = oldframe ? oldframe->numEntities : 0;
+
+	while ( 1 ) {
+		newnum = MSG_ReadBits( msg, GENTITYNUM_BITS );
+
+		if ( newnum == MAX_GENTITIES - 1 ) {
+			break;
+		}
+
+		if ( msg->readcount > msg->cursize ) {
+			Com_Error( ERR_DROP, "DB_ParsePacketEntities: end of message" );
+		}
+
+		// the unchanged ones before it
+		while ( oldindex < oldcount && oldframe->entities[oldindex].number < newnum ) {
+			DB_AddEntity( newframe, &oldframe->entities[oldindex++] );
+		}
+
+		if ( oldindex < oldcount && oldframe->entities[oldindex].number == newnum ) {
+			from = &oldframe->entities[oldindex++];
+		} else {
+			from = &dbBaselines[newnum];
+		}
+
+		MSG_ReadDeltaEntity( msg, from, &state, newnum );
+		if ( state.number != MAX_GENTITIES - 1 ) {
+			DB_AddEntity( newframe, &state );
+		}
+	}
+
+	while ( oldindex < oldcount ) {
+		DB_AddEntity( newframe, &oldframe->entities[oldindex++] );
+	}
+}
+
+/*
+================
+DB_ParseSnapshot
+================
+*/
+static void DB_ParseSnapshot( msg_t *msg, int messageNum ) {
+	dbSnapshot_t	*old;
+	byte			areamask[MAX_MAP_AREA_BYTES];
+	int				deltaNum, snapFlags, len;
+
+	MSG_ReadLong( msg );		// server time
+	deltaNum = MSG_ReadByte( msg );
+	snapFlags = MSG_ReadByte( msg );
+
+	old = NULL;
+	if ( deltaNum ) {
+		old = &dbSnapshots[( messageNum - deltaNum ) & PACKET_MASK];
+	}
+
+	len = MSG_ReadByte( msg );
+	if ( len > sizeof( areamask ) ) {
+		Com_Error( ERR_DROP, "DB_ParseSnapshot: Invalid size %d for areamask", len );
+	}
+	MSG_ReadData( msg, areamask, len );
+
+	MSG_ReadDeltaPlayerstate( msg, old ? &old->ps : NULL, &dbNewSnapshot.ps );
+
+	if ( snapFlags & SNAPFLAG_FIELD_ORDER ) {
+		if ( !dbHasFieldOrder ) {
+			Com_Error( ERR_DROP, "DB_ParseSnapshot: snapshot in a field order the server didn't send" );
+		}
+		msg->entityFieldOrder = dbFieldOrder;
+	}
+	DB_ParsePacketEntities( msg, old, &dbNewSnapshot );
+	msg->entityFieldOrder = NULL;
+
+	dbNewSnapshot.valid = qtrue;
+	dbNewSnapshot.messageNum = messageNum;
+	dbSnapshots[messageNum & PACKET_MASK] = dbNewSnapshot;
+}
+
+/*
+================
+DB_ParseVoip
+================
+*/
+static void DB_ParseVoip( msg_t *msg ) {
+	byte	data[1024];
+	int		packetsize;
+
+	MSG_ReadShort( msg );		// sender
+	MSG_ReadByte( msg );		// generation
+	MSG_ReadLong( msg );		// sequence
+	MSG_ReadByte( msg );		// frames
+	packetsize = MSG_ReadShort( msg );
+	MSG_ReadBits( msg, VOIP_FLAGCNT );
+
+	if ( packetsize < 0 || packetsize > sizeof( data ) ) {
+		Com_Error( ERR_DROP, "DB_ParseVoip: bad packet size %i", packetsize );
+	}
+	MSG_ReadData( msg, data, packetsize );
+}
+
+/*
+================
+DB_ParseMessage
+================
+*/
+static void DB_ParseMessage( msg_t *msg, int messageNum ) {
+	int		cmd;
+
+	dbSnapshotMessage = qfalse;
+
+	MSG_ReadLong( msg );		// reliable acknowledge
+
+	while ( 1 ) {
+		if ( msg->readcount > msg->cursize ) {
+			Com_Error( ERR_DROP, "DB_ParseMessage: read past end of server message" );
+		}
+
+		cmd = MSG_ReadByte( msg );
+
+		if ( cmd == svc_EOF ) {
+			break;
+		}
+
+		switch ( cmd ) {
+		default:
+			Com_Error( ERR_DROP, "DB_ParseMessage: can't read command %i", cmd );
+			break;
+		case svc_nop:
+			break;
+		case svc_serverCommand:
+			MSG_ReadLong( msg );
+			MSG_ReadString( msg );
+			break;
+		case svc_gamestate:
+			DB_ParseGamestate( msg );
+			break;
+		case svc_snapshot:
+			DB_ParseSnapshot( msg, messageNum );
+			dbSnapshotMessage = qtrue;
+			break;
+		case svc_voip:
+			DB_ParseVoip( msg );
+			break;
+		}
+	}
+}
+
+/*
+===============================================================================
+
+CHECKPOINTS
+
+===============================================================================
+*/
+
+/*
+================
+DB_ClearChannel
+================
+*/
+static void DB_ClearChannel( dbChannel_t *channel ) {
+	int		i;
+
+	Range_InitModel( &channel->base );
+	for ( i = 0 ; i < PACKET_BACKUP ; i++ ) {
+		channel->made[i] = -1;
+	}
+}
+
+/*
+================
+DB_StartMessage
+
+The model message index starts from
+================
+*/
+static void DB_StartMessage( dbChannel_t *channel, int index, rangeModel_t *model ) {
+	int		acknowledged;
+
+	acknowledged = index - dbLag;
+	if ( acknowledged >= 0 && channel->made[acknowledged & PACKET_MASK] == acknowledged ) {
+		channel->base = channel->checkpoints[acknowledged & PACKET_MASK];
+		channel->made[acknowledged & PACKET_MASK] = -1;
+	}
+
+	*model = channel->base;
+}
+
+/*
+================
+DB_FinishMessage
+================
+*/
+static void DB_FinishMessage( dbChannel_t *channel, int index, const rangeModel_t *model ) {
+	if ( !dbSnapshotMessage ) {
+		return;
+	}
+
+	channel->checkpoints[index & PACKET_MASK] = *model;
+	channel->made[index & PACKET_MASK] = index;
+}
+
+//===============================================================================
+
+/*
+================
+DB_Milliseconds
+================
+*/
+static int DB_Milliseconds( void ) {
+	return (int)( (double)clock() * 1000.0 / CLOCKS_PER_SEC );
+}
+
+/*
+================
+DB_LoadDemo
+
+A demo is the sequence, size and data of every message, up to a size of -1
+================
+*/
+static void DB_LoadDemo( const char *name ) {
+	FILE		*f;
+	dbDemo_t	*demo;
+	dbMessage_t	*m;
+	int			sequence, size;
+
+	if ( dbNumDemos == MAX_DEMOS ) {
+		Com_Error( ERR_FATAL, "More than %i demos", MAX_DEMOS );
+	}
+
+	f = fopen( name, "rb" );
+	if ( !f ) {
+		Com_Error( ERR_FATAL, "Couldn't open %s", name );
+	}
+
+	demo = &dbDemos[dbNumDemos++];
+	demo->firstMessage = dbNumMessages;
+
+	while ( fread( &sequence, 4, 1, f ) == 1 && fread( &size, 4, 1, f ) == 1 ) {
+		sequence = LittleLong( sequence );
+		size = LittleLong( size );
+		if ( size == -1 ) {
+			break;
+		}
+		if ( size < 0 || size > MAX_MSGLEN ) {
+			Com_Error( ERR_FATAL, "%s: bad message size %i", name, size );
+		}
+
+		dbMessages = realloc( dbMessages, ( dbNumMessages + 1 ) * sizeof( *dbMessages ) );
+		m = &dbMessages[dbNumMessages++];
+		m->sequence = sequence;
+		m->size = size;
+		m->data = malloc( size );
+		m->codedSize = 0;
+		m->coded = NULL;
+		m->snapshot = qfalse;
+		if ( fread( m->data, 1, size, f ) != size ) {
+			Com_Printf( "%s: demo file was truncated\n", name );
+			dbNumMessages--;
+			break;
+		}
+	}
+
+	fclose( f );
+	demo->numMessages = dbNumMessages - demo->firstMessage;
+}
+
+/*
+================
+DB_Pass
+
+Reads every message of the demos coded as from is, copying what it reads
+coded as to is.  Returns the number of huffman copies that don't come out
+as the demo has them.
+================
+*/
+static int DB_Pass( dbCoding_t from, dbCoding_t to ) {
+	msg_t			msg, copy;
+	rangeCoder_t	reader, writer;
+	static byte		copyData[MAX_MSGLEN];
+	dbMessage_t		*m;
+	int				i, j, errors;
+
+	errors = 0;
+	for ( i = 0 ; i < dbNumDemos ; i++ ) {
+		Com_Memset( dbSnapshots, 0, sizeof( dbSnapshots ) );
+		dbHasFieldOrder = qfalse;
+		DB_ClearChannel( &dbReadChannel );
+		DB_ClearChannel( &dbWriteChannel );
+
+		for ( j = 0 ; j < dbDemos[i].numMessages ; j++ ) {
+			m = &dbMessages[dbDemos[i].firstMessage + j];
+
+			if ( from == DB_RANGE ) {
+				MSG_Init( &msg, m->coded, m->codedSize );
+				msg.cursize = m->codedSize;
+				MSG_BeginReading( &msg );
+				msg.readcount = 1;		// the checkpoint byte
+				DB_StartMessage( &dbReadChannel, j, &reader.model );
+				MSG_StartRangeDecoding( &msg, &reader );
+			} else {
+				MSG_Init( &msg, m->data, m->size );
+				msg.cursize = m->size;
+				MSG_BeginReading( &msg );
+			}
+
+			if ( to != DB_NONE ) {
+				MSG_Init( &copy, copyData, sizeof( copyData ) );
+				msg.readCopy = &copy;
+			}
+			if ( to == DB_RANGE ) {
+				copyData[0] = 0;
+				copy.cursize = 1;
+				DB_StartMessage( &dbWriteChannel, j, &writer.model );
+				MSG_StartRangeCoding( &copy, &writer );
+			}
+
+			DB_ParseMessage( &msg, m->sequence );
+			m->snapshot = dbSnapshotMessage;
+
+			if ( from == DB_RANGE ) {
+				DB_FinishMessage( &dbReadChannel, j, &reader.model );
+			}
+
+			if ( to == DB_HUFFMAN ) {
+				// the byte after the last bit isn't written
+				if ( copy.cursize != m->size || memcmp( copyData, m->data, ( copy.bit + 7 ) >> 3 ) ) {
+					errors++;
+				}
+			} else if ( to == DB_RANGE ) {
+				MSG_FinishRangeCoding( &copy );
+				if ( copy.overflowed ) {
+					Com_Error( ERR_FATAL, "Range coded message overflowed" );
+				}
+				DB_FinishMessage( &dbWriteChannel, j, &writer.model );
+
+				if ( m->codedSize != copy.cursize ) {
+					m->coded = realloc( m->coded, copy.cursize );
+					m->codedSize = copy.cursize;
+				}
+				Com_Memcpy( m->coded, copyData, copy.cursize );
+			}
+		}
+	}
+
+	return errors;
+}
+
+/*
+================
+DB_Time
+
+Best of passes, in msec
+================
+*/
+static int DB_Time( dbCoding_t from, dbCoding_t to, int passes, int *errors ) {
+	int		i, start, msec, best;
+
+	best = 0;
+	for ( i = 0 ; i < passes ; i++ ) {
+		start = DB_Milliseconds();
+		*errors = DB_Pass( from, to );
+		msec = DB_Milliseconds() - start;
+		if ( !i || msec < best ) {
+			best = msec;
+		}
+	}
+
+	return best > 0 ? best : 1;
+}
+
+/*
+================
+main
+================
+*/
+int main( int argc, char **argv ) {
+	int		passes;
+	int		huffRead, rangeRead, huffCopy, rangeCopy;
+	int		writeErrors, readErrors, errors;
+	int		huffBytes, rangeBytes;
+	int		huffSnapshotBytes, rangeSnapshotBytes;
+	int		i;
+
+	passes = 5;
+	for ( i = 1 ; i < argc && argv[i][0] == '-' ; i += 2 ) {
+		if ( i + 1 == argc ) {
+			break;
+		}
+		if ( !strcmp( argv[i], "-passes" ) ) {
+			passes = atoi( argv[i + 1] );
+			if ( passes < 1 ) {
+				passes = 1;
+			}
+		} else if ( !strcmp( argv[i], "-lag" ) ) {
+			dbLag = atoi( argv[i + 1] );
+			if ( dbLag < 1 ) {
+				dbLag = 1;
+			} else if ( dbLag > PACKET_BACKUP - 1 ) {
+				dbLag = PACKET_BACKUP - 1;
+			}
+		} else {
+			break;
+		}
+	}
+	if ( i >= argc ) {
+		Com_Printf( "usage: demobench [-passes n] [-lag messages] demo...\n" );
+		return 1;
+	}
+
+	for ( ; i < argc ; i++ ) {
+		DB_LoadDemo( argv[i] );
+	}
+
+	huffRead = DB_Time( DB_HUFFMAN, DB_NONE, passes, &errors );
+	huffCopy = DB_Time( DB_HUFFMAN, DB_HUFFMAN, passes, &writeErrors );
+	rangeCopy = DB_Time( DB_HUFFMAN, DB_RANGE, passes, &errors );
+	rangeRead = DB_Time( DB_RANGE, DB_NONE, passes, &errors );
+	readErrors = DB_Pass( DB_RANGE, DB_HUFFMAN );
+
+	huffBytes = 0;
+	rangeBytes = 0;
+	huffSnapshotBytes = 0;
+	rangeSnapshotBytes = 0;
+	for ( i = 0 ; i < dbNumMessages ; i++ ) {
+		huffBytes += dbMessages[i].size;
+		rangeBytes += dbMessages[i].codedSize;
+		if ( dbMessages[i].snapshot ) {
+			huffSnapshotBytes += dbMessages[i].size;
+			rangeSnapshotBytes += dbMessages[i].codedSize;
+		}
+	}
+
+	Com_Printf( "%i demos, %i messages, acknowledged after %i\n", dbNumDemos, dbNumMessages, dbLag );
+	Com_Printf( "                 all messages   snapshot messages\n" );
+	Com_Printf( "  huffman %12i bytes %12i bytes\n", huffBytes, huffSnapshotBytes );
+	Com_Printf( "  range   %12i bytes %12i bytes\n", rangeBytes, rangeSnapshotBytes );
+	Com_Printf( "  range / huffman  %6.1f%%             %6.1f%%\n",
+		huffBytes ? 100.0 * rangeBytes / huffBytes : 0.0,
+		huffSnapshotBytes ? 100.0 * rangeSnapshotBytes / huffSnapshotBytes : 0.0 );
+	Com_Printf( "best of %i passes:\n", passes );
+	Com_Printf( "  huffman read                %5i msec\n", huffRead );
+	Com_Printf( "  range read                  %5i msec\n", rangeRead );
+	Com_Printf( "  huffman read, huffman write %5i msec\n", huffCopy );
+	Com_Printf( "  huffman read, range write   %5i msec\n", rangeCopy );
+	Com_Printf( "%i messages written differently, %i read wrong\n", writeErrors, readErrors );
+
+	return writeErrors || readErrors ? 2 : 0;
+}
@@ -0,0 +1,291 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// huffbench.c -- times the huffman coding of netchan messages, through
+// MSG_WriteBits and MSG_ReadBits, against following the tree a bit at a
+// time like they used to, and checks that both give the same bits.
+// Only the message code of the engine is linked in, the rest of the
+// engine interface it uses is stubbed out below.
+
+#include "../../qcommon/q_shared.h"
+#include "../../qcommon/qcommon.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+===============================================================================
+
+ENGINE STUBS
+
+===============================================================================
+*/
+
+cvar_t	*cl_shownet;
+
+void QDECL Com_Printf( const char *fmt, ... ) {
+	va_list		argptr;
+
+	va_start( argptr, fmt );
+	vprintf( fmt, argptr );
+	va_end( argptr );
+}
+
+void QDECL Com_DPrintf( const char *fmt, ... ) {
+}
+
+void QDECL Com_Error( int level, const char *fmt, ... ) {
+	va_list		argptr;
+
+	printf( "ERROR: " );
+	va_start( argptr, fmt );
+	vprintf( fmt, argptr );
+	va_end( argptr );
+	printf( "\n" );
+	exit( 1 );
+}
+
+//===============================================================================
+
+#define	MESSAGE_SIZE	1400		// about a snapshot
+#define	NUM_MESSAGES	1024
+#define	CODED_SIZE		( MESSAGE_SIZE * 4 )
+
+extern int		msg_hData[256];
+
+static byte		hbSource[NUM_MESSAGES][MESSAGE_SIZE];
+static byte		hbTree[NUM_MESSAGES][CODED_SIZE];
+static byte		hbTable[NUM_MESSAGES][CODED_SIZE];
+static int		hbBits[NUM_MESSAGES];
+static byte		hbDecoded[MESSAGE_SIZE];
+
+static huffman_t	hbHuff;
+
+/*
+================
+HB_Milliseconds
+================
+*/
+static int HB_Milliseconds( void ) {
+	return (int)( (double)clock() * 1000.0 / CLOCKS_PER_SEC );
+}
+
+/*
+================
+HB_MakeMessages
+
+Random bytes as often as they are in the netchan messages msg_hData was
+counted from, so the codes have their usual lengths
+================
+*/
+static void HB_MakeMessages( void ) {
+	int				total[256];
+	unsigned int	seed, r;
+	int				i, j, ch;
+
+	total[0] = msg_hData[0];
+	for ( i = 1 ; i < 256 ; i++ ) {
+		total[i] = total[i-1] + msg_hData[i];
+	}
+
+	seed = 0x1234567;
+	for ( i = 0 ; i < NUM_MESSAGES ; i++ ) {
+		for ( j = 0 ; j < MESSAGE_SIZE ; j++ ) {
+			seed = seed * 1664525 + 1013904223;
+			r = ( seed >> 8 ) % total[255];
+			for ( ch = 0 ; total[ch] <= r ; ch++ ) {
+			}
+			hbSource[i][j] = ch;
+		}
+	}
+}
+
+/*
+================
+HB_TreeWrite
+================
+*/
+static int HB_TreeWrite( void ) {
+	int		i, j, bit;
+
+	for ( i = 0 ; i < NUM_MESSAGES ; i++ ) {
+		bit = 0;
+		for ( j = 0 ; j < MESSAGE_SIZE ; j++ ) {
+			Huff_offsetTransmit( &hbHuff.compressor, hbSource[i][j], hbTree[i], &bit );
+		}
+		hbBits[i] = bit;
+	}
+
+	return 0;
+}
+
+/*
+================
+HB_TreeRead
+================
+*/
+static int HB_TreeRead( void ) {
+	int		i, j, bit, ch;
+	int		errors;
+
+	errors = 0;
+	for ( i = 0 ; i < NUM_MESSAGES ; i++ ) {
+		bit = 0;
+		for ( j = 0 ; j < MESSAGE_SIZE ; j++ ) {
+			Huff_offsetReceive( hbHuff.decompressor.tree, &ch, hbTree[i], &bit );
+			hbDecoded[j] = ch;
+		}
+		if ( memcmp( hbDecoded, hbSource[i], MESSAGE_SIZE ) ) {
+			errors++;
+		}
+	}
+
+	return errors;
+}
+
+/*
+================
+HB_MsgWrite
+================
+*/
+static int HB_MsgWrite( void ) {
+	msg_t	msg;
+	int		i, j;
+	int		errors;
+
+	errors = 0;
+	for ( i = 0 ; i < NUM_MESSAGES ; i++ ) {
+		MSG_Init( &msg, hbTable[i], CODED_SIZE );
+		for ( j = 0 ; j < MESSAGE_SIZE ; j++ ) {
+			MSG_WriteBits( &msg, hbSource[i][j], 8 );
+		}
+		if ( msg.bit != hbBits[i] || memcmp( hbTable[i], hbTree[i], ( msg.bit + 7 ) >> 3 ) ) {
+			errors++;
+		}
+	}
+
+	return errors;
+}
+
+/*
+================
+HB_MsgRead
+================
+*/
+static int HB_MsgRead( void ) {
+	msg_t	msg;
+	int		i, j;
+	int		errors;
+
+	errors = 0;
+	for ( i = 0 ; i < NUM_MESSAGES ; i++ ) {
+		MSG_Init( &msg, hbTable[i], CODED_SIZE );
+		msg.cursize = ( hbBits[i] >> 3 ) + 1;
+		MSG_BeginReading( &msg );
+		for ( j = 0 ; j < MESSAGE_SIZE ; j++ ) {
+			hbDecoded[j] = MSG_ReadBits( &msg, 8 );
+		}
+		if ( memcmp( hbDecoded, hbSource[i], MESSAGE_SIZE ) ) {
+			errors++;
+		}
+	}
+
+	return errors;
+}
+
+/*
+================
+HB_Time
+
+Best of passes, in msec
+================
+*/
+static int HB_Time( int (*function)( void ), int passes, int *errors ) {
+	int		i, start, msec, best;
+
+	best = 0;
+	for ( i = 0 ; i < passes ; i++ ) {
+		start = HB_Milliseconds();
+		*errors = function();
+		msec = HB_Milliseconds() - start;
+		if ( !i || msec < best ) {
+			best = msec;
+		}
+	}
+
+	return best > 0 ? best : 1;
+}
+
+/*
+================
+main
+================
+*/
+int main( int argc, char **argv ) {
+	double	megabytes;
+	int		passes;
+	int		treeWrite, treeRead, msgWrite, msgRead;
+	int		readErrors, writeErrors, errors;
+	int		i, j, bits;
+
+	passes = 5;
+	if ( argc > 1 ) {
+		passes = atoi( argv[1] );
+		if ( passes < 1 ) {
+			passes = 1;
+		}
+	}
+
+	// the same tree MSG_initHuffman makes
+	Huff_Init( &hbHuff );
+	for ( i = 0 ; i < 256 ; i++ ) {
+		for ( j = 0 ; j < msg_hData[i] ; j++ ) {
+			Huff_addRef( &hbHuff.compressor, (byte)i );
+			Huff_addRef( &hbHuff.decompressor, (byte)i );
+		}
+	}
+
+	HB_MakeMessages();
+
+	treeWrite = HB_Time( HB_TreeWrite, passes, &errors );
+	treeRead = HB_Time( HB_TreeRead, passes, &readErrors );
+	msgWrite = HB_Time( HB_MsgWrite, passes, &writeErrors );
+	msgRead = HB_Time( HB_MsgRead, passes, &errors );
+	readErrors += errors;
+
+	bits = 0;
+	for ( i = 0 ; i < NUM_MESSAGES ; i++ ) {
+		bits += hbBits[i];
+	}
+
+	megabytes = (double)NUM_MESSAGES * MESSAGE_SIZE / ( 1 << 20 );
+	Com_Printf( "%i messages of %i bytes, %.2f bits a byte\n", NUM_MESSAGES, MESSAGE_SIZE,
+		(double)bits / ( NUM_MESSAGES * MESSAGE_SIZE ) );
+	Com_Printf( "best of %i passes:\n", passes );
+	Com_Printf( "  tree write  %5i msec, %7.1f MB/s\n", treeWrite, megabytes * 1000.0 / treeWrite );
+	Com_Printf( "  tree read   %5i msec, %7.1f MB/s\n", treeRead, megabytes * 1000.0 / treeRead );
+	Com_Printf( "  MSG_WriteBits %3i msec, %7.1f MB/s\n", msgWrite, megabytes * 1000.0 / msgWrite );
+	Com_Printf( "  MSG_ReadBits  %3i msec, %7.1f MB/s\n", msgRead, megabytes * 1000.0 / msgRead );
+	Com_Printf( "%i messages written differently, %i read wrong\n", writeErrors, readErrors );
+
+	return writeErrors || readErrors ? 2 : 0;
+}